@@ -22,6 +22,12 @@
 
 #include <QLibraryInfo>
 #include <QThread>
+#include <QStringList>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QTime>
 #include <hydrogen/config.h>
 #include <hydrogen/version.h>
 #include <getopt.h>
@@ -39,10 +45,15 @@
 #include <hydrogen/Preferences.h>
 #include <hydrogen/h2_exception.h>
 #include <hydrogen/playlist.h>
+#include <hydrogen/timeline.h>
 #include <hydrogen/helpers/filesystem.h>
+#include <hydrogen/helpers/stress_song.h>
+#include <hydrogen/IO/OfflineRenderer.h>
 #include <hydrogen/LocalFileMng.h>
 
+#include <algorithm>
 #include <iostream>
+#include <vector>
 #include <signal.h>
 
 using namespace std;
@@ -62,12 +73,18 @@ static struct option long_opts[] = {
 	{"bits", required_argument, NULL, 'b'},
 	{"rate", required_argument, NULL, 'r'},
 	{"outfile", required_argument, NULL, 'o'},
+	{"tracks", required_argument, NULL, 't'},
+	{"pairs", required_argument, NULL, 'P'},
+	{"jobs", required_argument, NULL, 'j'},
+	{"batch", required_argument, NULL, 'B'},
+	{"format", required_argument, NULL, 'F'},
 	{"interpolation", required_argument, NULL, 'I'},
 	{"version", 0, NULL, 'v'},
 	{"verbose", optional_argument, NULL, 'V'},
 	{"help", 0, NULL, 'h'},
 	{"install", required_argument, NULL, 'i'},
 	{"drumkit", required_argument, NULL, 'k'},
+	{"stress", required_argument, NULL, 'T'},
 	{0, 0, 0, 0},
 };
 
@@ -101,6 +118,141 @@ void show_playlist (Hydrogen *pHydrogen, uint active )
 	cout << endl;
 }
 
+/* a song of a batch render */
+struct BatchJob
+{
+	QString sSong;
+	QString sOutput;
+	OfflineRenderer* pRenderer;
+	bool bSuccess;
+	int nTracks;
+	OfflineRenderer::Report report;
+};
+
+QString json_string( const QString& s )
+{
+	QString escaped = s;
+	escaped.replace( "\\", "\\\\" ).replace( "\"", "\\\"" ).replace( "\n", "\\n" ).replace( "\t", "\\t" );
+	return "\"" + escaped + "\"";
+}
+
+/* Render songs into a directory, nJobs at once, and write summary.json beside them */
+bool batch_render( const QStringList& songs, const QString& sOutDir, const QString& sFormat,
+				   const OfflineRenderer::Options& options, int nBits, int nJobs )
+{
+	if ( ! QDir().mkpath( sOutDir ) ) {
+		cerr << "Can't create " << sOutDir.toLocal8Bit().constData() << endl;
+		return false;
+	}
+
+	std::vector<BatchJob> jobs( songs.size() );
+	QStringList outputs;
+	for ( int i = 0; i < songs.size(); i++ ) {
+		jobs[i].sSong = songs[i];
+		jobs[i].pRenderer = NULL;
+		jobs[i].bSuccess = false;
+		jobs[i].nTracks = 0;
+		// songs of the same name get a number
+		QString sName = QFileInfo( songs[i] ).completeBaseName();
+		QString sOutput = sOutDir + "/" + sName + "." + sFormat;
+		for ( int n = 2; outputs.contains( sOutput ); n++ ) {
+			sOutput = sOutDir + "/" + sName + "-" + QString::number( n ) + "." + sFormat;
+		}
+		outputs << sOutput;
+		jobs[i].sOutput = sOutput;
+	}
+
+	QTime timer;
+	timer.start();
+	int nNext = 0;
+	int nRunning = 0;
+	while ( nNext < jobs.size() || nRunning > 0 ) {
+		// the songs are loaded here, one at a time: loading sets the timeline the renderer snapshots.
+		// the renderers keep the decoded samples in the SamplePool, so the next songs using the
+		// same drumkit share them instead of decoding them again
+		while ( ! quit && nRunning < nJobs && nNext < jobs.size() ) {
+			BatchJob& job = jobs[ nNext++ ];
+			Song* pSong = Song::load( job.sSong );
+			if ( ! pSong ) {
+				cerr << "Error loading " << job.sSong.toLocal8Bit().constData() << endl;
+				continue;
+			}
+			if ( OfflineRenderer::uses_effects( pSong ) ) {
+				cerr << job.sSong.toLocal8Bit().constData() << " is rendered without its LADSPA effects" << endl;
+			}
+			job.pRenderer = new OfflineRenderer( pSong, options );
+			delete pSong;
+			job.nTracks = job.pRenderer->get_stem_count();
+			job.pRenderer->start( QStringList( job.sOutput ), nBits, false );
+			nRunning++;
+		}
+		if ( quit && nNext < jobs.size() ) {
+			nNext = jobs.size();
+			for ( int i = 0; i < jobs.size(); i++ ) {
+				if ( jobs[i].pRenderer ) jobs[i].pRenderer->cancel();
+			}
+		}
+
+		Sleeper::msleep( 50 );
+		for ( int i = 0; i < jobs.size(); i++ ) {
+			BatchJob& job = jobs[i];
+			if ( ! job.pRenderer || job.pRenderer->is_running() ) continue;
+			job.pRenderer->wait();
+			job.bSuccess = job.pRenderer->succeeded();
+			job.report = job.pRenderer->get_report();
+			delete job.pRenderer;
+			job.pRenderer = NULL;
+			nRunning--;
+			cout << ( job.bSuccess ? "Rendered " : "FAILED " ) << job.sOutput.toLocal8Bit().constData();
+			if ( job.bSuccess ) {
+				cout << ", " << job.report.m_fDuration << " s at " << job.report.m_fSpeed << "x realtime";
+			}
+			cout << endl;
+		}
+	}
+	float fWallTime = timer.elapsed() / 1000.0;
+
+	QString sSummary = sOutDir + "/summary.json";
+	QFile file( sSummary );
+	if ( ! file.open( QIODevice::WriteOnly | QIODevice::Truncate ) ) {
+		cerr << "Can't write " << sSummary.toLocal8Bit().constData() << endl;
+		return false;
+	}
+	bool bSuccess = true;
+	float fDuration = 0;
+	QTextStream out( &file );
+	out << "{\n  \"songs\": [\n";
+	for ( int i = 0; i < jobs.size(); i++ ) {
+		const BatchJob& job = jobs[i];
+		const OfflineRenderer::Report& report = job.report;
+		bSuccess = bSuccess && job.bSuccess;
+		fDuration += report.m_fDuration;
+		out << "    { \"song\": " << json_string( job.sSong )
+			<< ", \"output\": " << json_string( job.sOutput )
+			<< ", \"success\": " << ( job.bSuccess ? "true" : "false" )
+			<< ", \"tracks\": " << job.nTracks
+			<< ", \"frames\": " << ( qulonglong )report.m_nFrames
+			<< ", \"duration\": " << report.m_fDuration
+			<< ", \"render_time\": " << report.m_fRenderTime
+			<< ", \"speed\": " << report.m_fSpeed
+			<< ", \"peak_left\": " << report.m_fPeak_L
+			<< ", \"peak_right\": " << report.m_fPeak_R
+			<< " }" << ( i + 1 < jobs.size() ? "," : "" ) << "\n";
+	}
+	out << "  ],\n";
+	out << "  \"sample_rate\": " << options.m_nSampleRate << ",\n";
+	out << "  \"jobs\": " << nJobs << ",\n";
+	out << "  \"duration\": " << fDuration << ",\n";
+	out << "  \"wall_time\": " << fWallTime << ",\n";
+	out << "  \"speed\": " << fDuration / std::max( fWallTime, 0.001f ) << "\n";
+	out << "}\n";
+	file.close();
+
+	cout << jobs.size() << " songs, " << fDuration << " s of audio in " << fWallTime << " s, summary in "
+		 << sSummary.toLocal8Bit().constData() << endl;
+	return bSuccess;
+}
+
 #define NELEM(a) ( sizeof(a)/sizeof((a)[0]) )
 
 int main(int argc, char *argv[])
@@ -124,16 +276,22 @@ int main(int argc, char *argv[])
 		// Deal with the options
 		QString songFilename;
 		QString playlistFilename;
-		QString outFilename = NULL;
+		QStringList outFilenames;
 		QString sSelectedDriver;
 		bool showVersionOpt = false;
 		const char* logLevelOpt = "Error";
 		bool showHelpOpt = false;
 		QString drumkitName;
 		QString drumkitToLoad;
+		QString stressSpec;
 		short bits = 16;
 		int rate = 44100;
 		short interpolation = 0;
+		OfflineRenderer::StemMode stems = OfflineRenderer::NO_STEMS;
+		int jobs = 0;
+		int pairs = 1;
+		QString batchDir;
+		QString format = "wav";
 #ifdef H2CORE_HAVE_JACKSESSION
 		QString sessionId;
 #endif
@@ -153,7 +311,28 @@ int main(int argc, char *argv[])
 				playlistFilename = QString::fromLocal8Bit(optarg);
 				break;
 			case 'o':
-				outFilename = QString::fromLocal8Bit(optarg);
+				outFilenames << QString::fromLocal8Bit(optarg);
+				break;
+			case 't':
+				if ( QString( optarg ) == "instruments" ) {
+					stems = OfflineRenderer::INSTRUMENT_STEMS;
+				} else if ( QString( optarg ) == "components" ) {
+					stems = OfflineRenderer::COMPONENT_STEMS;
+				} else {
+					showHelpOpt = true;
+				}
+				break;
+			case 'j':
+				jobs = strtol(optarg, NULL, 10);
+				break;
+			case 'P':
+				pairs = strtol(optarg, NULL, 10);
+				break;
+			case 'B':
+				batchDir = QString::fromLocal8Bit(optarg);
+				break;
+			case 'F':
+				format = QString::fromLocal8Bit(optarg);
 				break;
 			case 'i':
 				//install h2drumkit
@@ -163,6 +342,9 @@ int main(int argc, char *argv[])
 				//load Drumkit
 				drumkitToLoad = QString::fromLocal8Bit(optarg);
 				break;
+			case 'T':
+				stressSpec = QString::fromLocal8Bit(optarg);
+				break;
 			case 'r':
 				rate = strtol(optarg, NULL, 10);
 				break;
@@ -278,13 +460,97 @@ int main(int argc, char *argv[])
 //		QString path = pQApp->applicationFilePath();
 //		preferences->setJackSessionApplicationPath ( path );
 #endif
+		QString sOldAudioDriver = preferences->m_sAudioDriver;
+		bool bOldUseTimelineBpm = preferences->getUseTimelineBpm();
+		if ( ! stressSpec.isEmpty() || ! batchDir.isEmpty() ) {
+			/* soak runs drive the engine through the fake driver, batch renders don't need the sound card */
+			preferences->m_sAudioDriver = "Fake";
+		}
+
 		Hydrogen::create_instance();
 		Hydrogen *pHydrogen = Hydrogen::get_instance();
 		Song *pSong = NULL;
 		Playlist *pPlaylist = NULL;
 
+		// Stress mode: generate a song and soak the engine with it
+		if ( ! stressSpec.isEmpty() ) {
+			QStringList fields = stressSpec.split( ":" );
+			float fSeconds = fields.value( 0 ).toFloat();
+			StressSong::Options options;
+			if ( fields.size() > 1 ) options.m_nInstruments = fields[1].toInt();
+			if ( fields.size() > 2 ) options.m_nLayers = fields[2].toInt();
+			if ( fields.size() > 3 ) options.m_nComponents = fields[3].toInt();
+			if ( fields.size() > 4 ) options.m_fNoteDensity = fields[4].toFloat();
+			if ( fields.size() > 5 ) options.m_nTempoChanges = fields[5].toInt();
+			if ( fields.size() > 6 ) {
+				options.m_fHumanizeTime = options.m_fHumanizeVelocity = fields[6].toFloat();
+				options.m_fSwing = options.m_fLeadLag = fields[6].toFloat();
+			}
+
+			pSong = StressSong::generate( options );
+			pHydrogen->setSong( pSong );
+			StressSong::fill_timeline( pHydrogen->getTimeline(), options );
+			preferences->setUseTimelineBpm( options.m_nTempoChanges > 0 );
+
+			StressSong::Report report;
+			if ( StressSong::soak( fSeconds, &report ) ) {
+				cout << "Cycles:              " << report.m_nCycles << endl;
+				cout << "Frames:              " << report.m_nFrames << endl;
+				cout << "Max process time:    " << report.m_fMaxProcessTime << " ms" << endl;
+				cout << "Avg process time:    " << report.m_fAvgProcessTime << " ms" << endl;
+				cout << "Budget per cycle:    " << report.m_fBudget << " ms" << endl;
+				cout << "Overruns:            " << report.m_nOverruns << endl;
+				cout << "Max polyphony:       " << report.m_nMaxPlayingNotes << endl;
+				cout << "Max note queue:      " << report.m_nMaxQueuedNotes << endl;
+				cout << "Memory growth:       " << ( report.m_nMemoryEnd - report.m_nMemoryStart ) / 1024 << " KiB" << endl;
+			} else {
+				cerr << "Soak run failed" << endl;
+			}
+
+			preferences->m_sAudioDriver = sOldAudioDriver;
+			preferences->setUseTimelineBpm( bOldUseTimelineBpm );
+			quit = true;
+		}
+
+		// Batch mode: render the playlist and the songs given as arguments, then quit
+		if ( ! batchDir.isEmpty() ) {
+			QStringList songs;
+			if ( ! playlistFilename.isEmpty() ) {
+				pPlaylist = Playlist::load( playlistFilename );
+				if ( ! pPlaylist ) {
+					___ERRORLOG( "Error loading the playlist" );
+				} else {
+					for ( uint i = 0; i < pHydrogen->m_PlayList.size(); ++i ) {
+						songs << pHydrogen->m_PlayList[i].m_hFile;
+					}
+				}
+			}
+			if ( ! songFilename.isEmpty() ) {
+				songs << songFilename;
+			}
+			for ( int i = optind; i < argc; i++ ) {
+				songs << QString::fromLocal8Bit( argv[i] );
+			}
+
+			OfflineRenderer::Options options;
+			options.m_nSampleRate = rate;
+			options.m_nBufferSize = preferences->m_nBufferSize;
+			options.m_bUseTimelineBpm = preferences->getUseTimelineBpm();
+			options.m_interpolation = ( Sampler::InterpolateMode )interpolation;
+			options.m_stems = stems;
+			batch_render( songs, batchDir, format, options, bits, jobs > 0 ? jobs : QThread::idealThreadCount() );
+
+			// the last song loaded left its tempo markers
+			pHydrogen->getTimeline()->m_timelinevector.clear();
+			pHydrogen->getTimeline()->m_timelinetagvector.clear();
+			pSong = Song::get_empty_song();
+			pHydrogen->setSong( pSong );
+			preferences->m_sAudioDriver = sOldAudioDriver;
+			quit = true;
+		}
+
 		// Load playlist
-		if ( ! playlistFilename.isEmpty() ) {
+		if ( ! playlistFilename.isEmpty() && batchDir.isEmpty() ) {
 			pPlaylist = Playlist::load ( playlistFilename );
 			if ( ! pPlaylist ) {
 				___ERRORLOG( "Error loading the playlist" );
@@ -322,9 +588,35 @@ int main(int argc, char *argv[])
 		}
 
 		if ( ! drumkitToLoad.isEmpty() ){
-			Drumkit* drumkitInfo = Drumkit::load_by_name( drumkitToLoad, true );
+			Drumkit* drumkitInfo = Drumkit::load_by_name( drumkitToLoad, false );
 			if ( drumkitInfo ) {
-				pHydrogen->loadDrumkit( drumkitInfo );
+				if ( pHydrogen->loadDrumkitAsync( drumkitInfo, Hydrogen::SWITCH_NOW ) ) {
+					// consume the loading progress so it is not taken for the export one
+					EventQueue* pLoadQueue = EventQueue::get_instance();
+					std::vector<Event> otherEvents;
+					Event event;
+					bool bLoading = true;
+					while ( bLoading ) {
+						bLoading = pHydrogen->isDrumkitLoading();
+						while ( ( event = pLoadQueue->pop_event() ).type != EVENT_NONE ) {
+							if ( event.type == EVENT_PROGRESS ) {
+								cout << "\rLoading drumkit ... " << event.value << "%";
+							} else if ( event.type == EVENT_DRUMKIT_LOADED ) {
+								pHydrogen->finishDrumkitLoad();
+							} else {
+								otherEvents.push_back( event );
+							}
+						}
+						if ( bLoading ) {
+							Sleeper::msleep( 50 );
+						}
+					}
+					cout << endl;
+					for ( int i = 0; i < otherEvents.size(); i++ ) {
+						pLoadQueue->push_event( otherEvents[i].type, otherEvents[i].value );
+					}
+				}
+				delete drumkitInfo;
 			} else {
 				___ERRORLOG ( "Error loading the drumkit" );
 			}
@@ -355,10 +647,43 @@ int main(int argc, char *argv[])
 		signal(SIGINT, signal_handler);
 
 		bool ExportMode = false;
-		if ( ! outFilename.isEmpty() ) {
-			pHydrogen->startExportSong ( outFilename, rate, bits );
-			cout << "Export Progress ... ";
-			ExportMode = true;
+		OfflineRenderer* pRenderer = NULL;
+		if ( ! outFilenames.isEmpty() && batchDir.isEmpty() ) {
+			// the LADSPA effects and the channel pairs only run within the audio engine, which the disk writer takes over
+			if ( OfflineRenderer::uses_effects( pHydrogen->getSong() ) || pairs > 1 ) {
+				if ( stems != OfflineRenderer::NO_STEMS ) {
+					cerr << "The song uses LADSPA effects or channel pairs, the tracks are not exported" << endl;
+				}
+				pHydrogen->startExportSong ( outFilenames, rate, bits, pairs );
+			} else {
+				OfflineRenderer::Options options;
+				options.m_nSampleRate = rate;
+				options.m_nBufferSize = preferences->m_nBufferSize;
+				options.m_bUseTimelineBpm = preferences->getUseTimelineBpm();
+				options.m_interpolation = sampler->getInterpolateMode();
+				options.m_stems = stems;
+				if ( jobs > 1 && stems == OfflineRenderer::NO_STEMS ) {
+					// the segments report no progress, the export is done right here
+					OfflineRenderer::Report report;
+					cout << "Export Progress ... " << flush;
+					if ( OfflineRenderer::render_parallel_to_files( pHydrogen->getSong(), options, jobs, outFilenames, bits, &report ) ) {
+						cout << "DONE, " << report.m_fSpeed << "x realtime" << endl;
+					} else {
+						cout << "FAILED" << endl;
+					}
+					quit = true;
+				} else {
+					if ( jobs > 1 ) {
+						cerr << "The tracks are rendered in a single job" << endl;
+					}
+					pRenderer = new OfflineRenderer( pHydrogen->getSong(), options );
+					pRenderer->start( outFilenames, bits );
+				}
+			}
+			if ( ! quit ) {
+				cout << "Export Progress ... ";
+				ExportMode = true;
+			}
 		}
 
 		// Interactive mode
@@ -374,6 +699,20 @@ int main(int argc, char *argv[])
 	
 				if ( event.value < 100 ) {
 					cout << "\rExport Progress ... " << event.value << "%";
+				} else if ( pRenderer ) {
+					pRenderer->wait();
+					if ( pRenderer->succeeded() ) {
+						cout << "\rExport Progress ... DONE, " << pRenderer->get_report().m_fSpeed << "x realtime" << endl;
+						for ( int i = 0; i < outFilenames.size(); i++ ) {
+							QStringList tracks = pRenderer->get_stem_filenames( outFilenames[i] );
+							for ( int j = 0; j < tracks.size(); j++ ) {
+								cout << "   " << tracks[j].toLocal8Bit().constData() << endl;
+							}
+						}
+					} else {
+						cout << "\rExport Progress ... FAILED" << endl;
+					}
+					quit = true;
 				} else {
 					cout << "\rExport Progress ... DONE" << endl;
 					quit = true;
@@ -396,6 +735,7 @@ int main(int argc, char *argv[])
 		if ( pHydrogen->getState() == STATE_PLAYING )
 			pHydrogen->sequencer_stop();
 
+		delete pRenderer;	// stops a render interrupted by a signal
 		delete pSong;
 		delete pPlaylist;
 
@@ -450,13 +790,22 @@ void showUsage()
 	cout << "   -d, --driver AUDIODRIVER - Use the selected audio driver (jack, alsa, oss)" << endl;
 	cout << "   -s, --song FILE - Load a song (*.h2song) at startup" << endl;
 	cout << "   -p, --playlist FILE - Load a playlist (*.h2playlist) at startup" << endl;
-	cout << "   -o, --outfile FILE - Output to file (export)" << endl;
+	cout << "   -o, --outfile FILE - Output to file (export), repeat it to encode the same render into several formats" << endl;
+	cout << "   -t, --tracks MODE - Also export a file per track, beside the output file" << endl;
+	cout << "       (instruments: a track per instrument, components: a track per instrument component)" << endl;
+	cout << "   -P, --pairs N - Export N channel pairs, the main mix followed by the pairs routed in the preferences" << endl;
+	cout << "   -j, --jobs N - Export the song in N segments rendered at once, without tracks" << endl;
+	cout << "   -B, --batch DIR - Export the songs of the playlist and the songs given as arguments into DIR," << endl;
+	cout << "       --jobs of them at once (default: one per CPU), and write DIR/summary.json" << endl;
+	cout << "   -F, --format EXT - Format of the batch exports (wav [default], flac, ogg, aiff)" << endl;
 	cout << "   -r, --rate RATE - Set bitrate while exporting file" << endl;
 	cout << "   -b, --bits BITS - Set bits depth while exporting file" << endl;
 	cout << "   -k, --kit drumkit_name - Load a drumkit at startup" << endl;
 	cout << "   -i, --install FILE - install a drumkit (*.h2drumkit)" << endl;
 	cout << "   -I, --interpolate INT - Interpolation" << endl;
 	cout << "       (0:linear [default],1:cosine,2:third,3:cubic,4:hermite)" << endl;
+	cout << "   -T, --stress SEC[:INSTR[:LAYERS[:COMPONENTS[:DENSITY[:TEMPOS[:HUMANIZE]]]]]]" << endl;
+	cout << "       - Generate a synthetic song and soak the engine with it for SEC seconds" << endl;
 
 #ifdef H2CORE_HAVE_JACKSESSION
 	cout << "   -S, --jacksessionid ID - Start a JackSessionHandler session" << endl;
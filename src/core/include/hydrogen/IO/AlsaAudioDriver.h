@@ -28,20 +28,33 @@
 #ifdef H2CORE_HAVE_ALSA
 
 #include <inttypes.h>
+#include <vector>
 #include <alsa/asoundlib.h>
 
+#include <hydrogen/IO/PcmConverter.h>
+
 namespace H2Core
 {
 
 typedef int  ( *audioProcessCallback )( uint32_t, void * );
 
+/**
+ * Plays the main mix and the channel pairs on an ALSA device, a period per cycle.
+ *
+ * The sample format is negotiated, float and 32 or 24 bit integers are preferred to
+ * 16 bit ones. With mmap access the periods are converted straight into the ring of
+ * the device, otherwise they go through a buffer allocated at connect().
+ */
 class AlsaAudioDriver : public AudioOutput
 {
 	H2_OBJECT
 public:
 	snd_pcm_t *m_pPlayback_handle;
 	bool m_bIsRunning;
-	unsigned long m_nBufferSize;
+	unsigned long m_nBufferSize;		///< frames of a period, rendered in one cycle
+	bool m_bMmap;						///< the periods are written into the ring of the device
+	PcmConverter::Format m_format;		///< the sample format of the device
+	std::vector<char> m_buffer;			///< a converted period, without mmap
 	float* m_pOut_L;
 	float* m_pOut_R;
 	int m_nXRuns;
@@ -0,0 +1,124 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef AUDIO_FILE_WRITER_H
+#define AUDIO_FILE_WRITER_H
+
+#include <atomic>
+#include <vector>
+
+#include <pthread.h>
+#include <sndfile.h>
+
+#include <hydrogen/object.h>
+
+namespace H2Core
+{
+
+///
+/// Writes a stereo or multichannel stream to an audio file from its own thread.
+///
+/// write() clamps and interleaves the rendered frames into large chunks, the
+/// full chunks go through a bounded ring to the writer thread which encodes them
+/// with libsndfile. The renderer only waits when the ring is full, so the FLAC and
+/// OGG encoders and the disk latency run beside the rendering. Several writers fed
+/// from the same render encode several formats concurrently.
+///
+class AudioFileWriter : public H2Core::Object
+{
+	H2_OBJECT
+public:
+	/**
+	 * \param sFilename the file to write, its extension selects the format
+	 * \param nSampleRate the sample rate of the stream
+	 * \param nSampleDepth the bits per sample, ignored by lossy formats
+	 * \param nChannels the channels of the stream
+	 */
+	AudioFileWriter( const QString& sFilename, unsigned nSampleRate, int nSampleDepth, int nChannels = 2 );
+	/** close the file if it is still open */
+	~AudioFileWriter();
+
+	/**
+	 * open the file and start the writer thread
+	 * \param nChunkFrames the frames of a chunk
+	 * \param nChunks the chunks of the ring
+	 * \return false if the file can't be opened
+	 */
+	bool open( unsigned nChunkFrames = 16384, int nChunks = 8 );
+	/**
+	 * queue frames, waiting for the writer thread if the ring is full
+	 * \return false if the writer failed
+	 */
+	bool write( const float* pIn_L, const float* pIn_R, unsigned nFrames );
+	/**
+	 * queue frames of every channel, waiting for the writer thread if the ring is full
+	 * \param ppIn a buffer per channel
+	 * \return false if the writer failed
+	 */
+	bool write( const float* const* ppIn, unsigned nFrames );
+	/**
+	 * write the queued frames, stop the writer thread and close the file
+	 * \return false if a write failed
+	 */
+	bool close();
+
+	/** return the file written */
+	const QString& get_filename() const	{ return __filename; }
+	/** return the channels of the stream */
+	int get_channels() const			{ return __channels; }
+
+	/** clamp two channels to [-1,1] and interleave them into pOut */
+	static void interleave( const float* pIn_L, const float* pIn_R, float* pOut, unsigned nFrames );
+
+private:
+	QString __filename;
+	unsigned __sample_rate;
+	int __sample_depth;
+	int __channels;
+	SNDFILE* __file;
+
+	std::vector<float*> __chunks;		///< interleaved frames
+	std::vector<unsigned> __chunk_frames;	///< frames held by each chunk
+	unsigned __chunk_size;				///< frames of a chunk
+	int __head;							///< chunk being filled by write()
+	unsigned __head_frames;				///< frames already in the head chunk
+	int __tail;							///< next chunk for the writer thread
+	int __queued;						///< chunks handed to the writer thread, guarded by __mutex
+	bool __closing;						///< no more chunks will come, guarded by __mutex
+	std::atomic<bool> __failed;
+	pthread_mutex_t __mutex;
+	pthread_cond_t __not_empty;
+	pthread_cond_t __not_full;
+	pthread_t __thread;
+	bool __thread_started;
+
+	/** hand the head chunk to the writer thread */
+	void __push_head();
+	/** the writer thread */
+	static void* writer_thread( void* param );
+};
+
+};
+
+#endif
+
+/* vim: set softtabstop=4 expandtab: */
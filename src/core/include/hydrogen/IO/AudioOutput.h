@@ -23,16 +23,29 @@
 #define H2_AUDIO_OUTPUT_H
 
 
+#include <atomic>
+#include <vector>
+
 #include "hydrogen/config.h"
 #include <hydrogen/object.h>
+#include <hydrogen/Preferences.h>
 #include <hydrogen/IO/TransportInfo.h>
 
 namespace H2Core
 {
 
+class Instrument;
+class InstrumentComponent;
+
 ///
 /// Base abstract class for audio output classes.
 ///
+/// An output has the main mix on its first two channels. The track outputs follow
+/// as channel pairs: JACK gives them ports of their own, the multichannel drivers
+/// (ALSA, PortAudio, the disk writer) open as many pairs as the Preferences ask for
+/// and the routes of the Preferences pick the instruments, drumkit components and
+/// effect returns each pair gets, see init_channel_pairs().
+///
 class AudioOutput : public H2Core::Object
 {
 public:
@@ -40,9 +53,12 @@ public:
 
 	AudioOutput( const char* class_name )
 			: Object( class_name )
-			, __track_out_enabled( false ) { }
+			, __track_out_enabled( false )
+			, __track_buffer_count( 0 )
+			, __track_routing( 0 )
+			, __channel_pairs( 1 ) { }
 
-	virtual ~AudioOutput() { }
+	virtual ~AudioOutput();
 
 	virtual int init( unsigned nBufferSize ) = 0;
 	virtual int connect() = 0;
@@ -62,9 +78,58 @@ public:
 	bool has_track_outs() {
 		return __track_out_enabled;
 	}
+	/**
+	 * return the track the voices of an instrument component are mixed into, -1 if it has none.
+	 * The sampler looks it up once per voice, and again when get_track_routing() changes.
+	 */
+	virtual int getTrackIndex( Instrument* pInstr, InstrumentComponent* pCompo );
+	/** fetch the track buffers of a process cycle and clear them, called before the sampler runs */
+	virtual void prepareTrackOuts( unsigned nFrames );
+	/** return the left buffer of a track for the current process cycle, NULL if it has none */
+	float* getTrackBuffer_L( int nTrack ) const {
+		return ( nTrack >= 0 && nTrack < __track_buffer_count ) ? __track_buffers_L[ nTrack ] : NULL;
+	}
+	/** return the right buffer of a track for the current process cycle, NULL if it has none */
+	float* getTrackBuffer_R( int nTrack ) const {
+		return ( nTrack >= 0 && nTrack < __track_buffer_count ) ? __track_buffers_R[ nTrack ] : NULL;
+	}
+	/** return the track an effect return is mixed into, besides the main mix, -1 if it has none */
+	int getFXTrackIndex( int nFX ) const;
+	/** return the number of output channels, the main mix followed by a pair per track */
+	int getChannels() const {
+		return __channel_pairs * 2;
+	}
+	/** return an output channel for the current process cycle, 0 and 1 being the main mix */
+	float* getOut( int nChannel );
+	/** return a counter bumped every time the tracks given by getTrackIndex() change */
+	int get_track_routing() const {
+		return __track_routing.load( std::memory_order_acquire );
+	}
 
 protected:
 	bool __track_out_enabled;	///< True if is capable of per-track audio output
+	std::vector<float*> __track_buffers_L;	///< track buffers of the current cycle, sized before the audio thread runs
+	std::vector<float*> __track_buffers_R;
+	int __track_buffer_count;	///< tracks of __track_buffers_L and __track_buffers_R in use
+	std::atomic<int> __track_routing;	///< see get_track_routing()
+
+	/**
+	 * allocate the channel pairs following the main mix, as many as the Preferences ask for,
+	 * and take their routes from the Preferences. The pairs are the track outputs of the driver.
+	 * \param nBufferSize the frames of a process cycle
+	 * \param nPairs the channel pairs, the main mix included, -1 for the Preferences
+	 */
+	void init_channel_pairs( unsigned nBufferSize, int nPairs = -1 );
+	/** free the channel pairs, the output goes back to the main mix alone */
+	void free_channel_pairs();
+
+private:
+	int __channel_pairs;				///< stereo pairs of the output, the main mix included
+	std::vector<float*> __channel_buffers;	///< buffers of the pairs after the main mix, left then right
+	std::vector<Preferences::OutputRoute> __routes;	///< copied when the pairs are allocated
+
+	/** return the track of a route, -1 if the output has no such pair */
+	int __route_track( const Preferences::OutputRoute& route ) const;
 
 };
 
@@ -27,6 +27,8 @@
 
 #include <inttypes.h>
 
+#include <QStringList>
+
 #include <hydrogen/IO/AudioOutput.h>
 #include <hydrogen/object.h>
 
@@ -44,18 +46,30 @@ class DiskWriterDriver : public AudioOutput
 	public:
 
 		unsigned m_nSampleRate;
-		QString m_sFilename;
+		QStringList m_filenames;	///< the files written, the same render is encoded into each
 		unsigned m_nBufferSize;
 		int m_nSampleDepth;
 		audioProcessCallback m_processCallback;
 		float* m_pOut_L;
 		float* m_pOut_R;
+		int m_nChannelPairs;	///< stereo pairs written to the files, the main mix included
 
-		DiskWriterDriver( audioProcessCallback processCallback, unsigned nSamplerate, const QString& sFilename, int nSampleDepth );
+		/**
+		 * \param nChannelPairs the stereo pairs of the files, the main mix followed by the pairs
+		 * routed in the Preferences
+		 */
+		DiskWriterDriver( audioProcessCallback processCallback, unsigned nSamplerate, const QStringList& filenames, int nSampleDepth, int nChannelPairs = 1 );
 		~DiskWriterDriver();
 
 		int init( unsigned nBufferSize );
 
+		/**
+		 * return the libsndfile format matching a file extension and a sample depth
+		 * \param sFilename the file to write, its extension selects the container
+		 * \param nSampleDepth the bits per sample, ignored by lossy formats
+		 */
+		static int sndfile_format( const QString& sFilename, int nSampleDepth );
+
 		int connect();
 		void disconnect();
 
@@ -52,6 +52,9 @@ public:
 	float* getOut_L();
 	float* getOut_R();
 
+	/// run the process callback once, returns its result
+	int processCycle();
+
 	virtual void play();
 	virtual void stop();
 	virtual void locate( unsigned long nFrame );
@@ -41,6 +41,9 @@
 
 #include <hydrogen/globals.h>
 #include <hydrogen/hydrogen.h>
+#include <hydrogen/basics/tempo_map.h>
+
+#include <QMutex>
 
 
 
@@ -92,8 +95,8 @@ public:
 	float* getOut_R();
 	float* getTrackOut_L( unsigned nTrack );
 	float* getTrackOut_R( unsigned nTrack );
-	float* getTrackOut_L( Instrument *, InstrumentComponent * );
-    float* getTrackOut_R( Instrument *, InstrumentComponent * );
+	virtual int getTrackIndex( Instrument *, InstrumentComponent * );
+	virtual void prepareTrackOuts( unsigned nFrames );
 
 	int init( unsigned bufferSize );
 
@@ -108,6 +111,8 @@ public:
 //jack timebase callback
 	void initTimeMaster();
 	void com_release();
+	/// rebuild the tempo map reported by the timebase callback, called once the song, its pattern groups or the timeline changed
+	void updateTempoMap( Song* pSong, Timeline* pTimeline );
 //~ jack timebase callback
 
 protected:
@@ -141,7 +146,10 @@ private:
 	jack_port_t *			output_port_2;
 	QString					output_port_name_1;
 	QString					output_port_name_2;
-	int						track_map[MAX_INSTRUMENTS][MAX_COMPONENTS];
+	int						track_map[2][MAX_INSTRUMENTS][MAX_COMPONENTS];	// Track of each instrument component, -1 for none.
+	std::atomic<int>		m_nTrackMap;		// The track_map read by the audio thread, makeTrackOutputs() fills the other one.
+	std::atomic<int>		m_nTrackMapSeen;	// The track_map the audio thread started its last cycle with.
+	QMutex					m_trackMapMutex;	// Serializes makeTrackOutputs().
 	int						track_port_count;
 	jack_port_t *			track_output_ports_L[MAX_INSTRUMENTS];
 	jack_port_t *			track_output_ports_R[MAX_INSTRUMENTS];
@@ -153,6 +161,9 @@ private:
 
 //jack timebase callback
 	bool					m_bCond;
+	TempoMap				m_tempoMap;		// The tempo along the song, built by updateTempoMap().
+	QMutex					m_tempoMapMutex;	// Held while the map is rebuilt, the callback does not wait for it.
+	float					m_fTimebaseBpm;		// The tempo reported last, kept while the map is rebuilt.
 //~ jack timebase callback
 
 };
@@ -0,0 +1,319 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef OFFLINE_RENDERER_H
+#define OFFLINE_RENDERER_H
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <queue>
+#include <vector>
+
+#include <QStringList>
+
+#include <pthread.h>
+
+#include <hydrogen/IO/AudioOutput.h>
+#include <hydrogen/object.h>
+#include <hydrogen/basics/tempo_map.h>
+#include <hydrogen/sampler/Sampler.h>
+
+namespace H2Core
+{
+
+class Song;
+class Note;
+class Instrument;
+class InstrumentList;
+class InstrumentLayer;
+
+///
+/// Renders a range of the song sequence as fast as the CPU allows.
+///
+/// The renderer takes a snapshot of the song when it is built: the instruments,
+/// the drumkit components and the notes are copied, the samples are shared through
+/// the SamplePool. It then runs its own Sampler and note scheduler, so the live
+/// audio driver keeps playing and the song can be edited while rendering.
+/// The renderer is the AudioOutput its Sampler reads the transport from,
+/// it is never installed as the audio driver.
+///
+/// Besides the master bus, the renderer can split the mix into a track per
+/// instrument or per instrument component in the same pass, the sampler mixes
+/// the voices into them as it does into the JACK track outputs.
+///
+/// The LADSPA effects are bound to the live engine and are not rendered,
+/// see uses_effects().
+///
+class OfflineRenderer : public AudioOutput
+{
+	H2_OBJECT
+public:
+	/** how the mix is split into tracks */
+	enum StemMode {
+		NO_STEMS,			///< master bus only
+		INSTRUMENT_STEMS,	///< one track per instrument
+		COMPONENT_STEMS		///< one track per instrument component
+	};
+
+	/** what to render */
+	struct Options
+	{
+		Options();
+		unsigned	m_nSampleRate;		///< output sample rate
+		unsigned	m_nBufferSize;		///< frames rendered per block (1..MAX_BUFFER_SIZE)
+		int			m_nFirstColumn;		///< first pattern group rendered
+		int			m_nLastColumn;		///< last pattern group rendered, -1 for the end of the song
+		bool		m_bUseTimelineBpm;	///< follow the tempo markers of the timeline
+		unsigned long	m_nTailFrames;	///< max frames rendered past the range while voices still sound, 0 to cut at the end
+		Sampler::InterpolateMode	m_interpolation;	///< resampling algorithm
+		StemMode	m_stems;			///< tracks rendered beside the master bus
+		bool		m_bMaster;			///< write the master bus to file, else the tracks only
+	};
+
+	/** figures of a finished render */
+	struct Report
+	{
+		Report();
+		unsigned long	m_nFrames;		///< frames rendered
+		float	m_fDuration;			///< rendered audio (s)
+		float	m_fRenderTime;			///< time spent rendering (s)
+		float	m_fSpeed;				///< rendered audio per second of render time, 1 is realtime
+		float	m_fPeak_L;				///< highest absolute sample of the left channel
+		float	m_fPeak_R;				///< highest absolute sample of the right channel
+	};
+
+	/**
+	 * take a snapshot of a song, the AudioEngine must not be locked by the caller
+	 * \param pSong the song to render, usually the song of the Hydrogen instance
+	 * \param options what to render
+	 */
+	OfflineRenderer( Song* pSong, const Options& options );
+	~OfflineRenderer();
+
+	/** return true if the song sends instruments to LADSPA effects, which the renderer leaves out */
+	static bool uses_effects( Song* pSong );
+
+	/**
+	 * render the next block into getOut_L() and getOut_R()
+	 * \return the number of frames rendered, 0 at the end of the range
+	 */
+	unsigned render_block();
+
+	/**
+	 * render the whole range into memory
+	 * \param pLeft receives the left channel
+	 * \param pRight receives the right channel
+	 * \return false if the render was cancelled
+	 */
+	bool render( std::vector<float>* pLeft, std::vector<float>* pRight );
+
+	/**
+	 * render the whole range into files, EVENT_PROGRESS events are pushed if bProgress is set.
+	 * the same render is encoded into every file, each by its own AudioFileWriter,
+	 * and the tracks are written beside them, see get_stem_filenames()
+	 * \param filenames the files to write, their extension selects the format
+	 * \param nSampleDepth the bits per sample
+	 * \param bProgress push the progress to the EventQueue
+	 * \return false if a file can't be written or the render was cancelled
+	 */
+	bool render_to_files( const QStringList& filenames, int nSampleDepth, bool bProgress = false );
+
+	/**
+	 * render the range in segments split at column boundaries, each on its own renderer and thread.
+	 * a segment starts rendering early enough to rebuild the voices still sounding at its
+	 * first frame and the notes heard early through lead-lag, swing and humanization,
+	 * see seek_column(), then the segments are joined end to end.
+	 * the result matches render() sample for sample as long as the notes are not humanized,
+	 * no random layer or pitch is used and the polyphony stays below Preferences::m_nMaxNotes.
+	 * songs using round robin layers are rendered in one segment. the tracks are not rendered.
+	 * \param pSong the song to render
+	 * \param options what to render
+	 * \param nJobs the number of segments rendered at once
+	 * \param pLeft receives the left channel
+	 * \param pRight receives the right channel
+	 * \param pReport receives the figures of the render if not NULL
+	 * \return false if a segment failed
+	 */
+	static bool render_parallel( Song* pSong, const Options& options, int nJobs,
+								 std::vector<float>* pLeft, std::vector<float>* pRight, Report* pReport = NULL );
+	/**
+	 * render_parallel() into files, the same render is encoded into each
+	 * \return false if the render failed or a file can't be written
+	 */
+	static bool render_parallel_to_files( Song* pSong, const Options& options, int nJobs,
+										  const QStringList& filenames, int nSampleDepth, Report* pReport = NULL );
+
+	/**
+	 * start at a column of the range instead of its first one, before anything is rendered.
+	 * the frame counter is set as if the columns skipped had been rendered,
+	 * so the notes fall on the same frames, and the notes due before the column are dropped.
+	 * the pattern groups holding tempo changes are split in a column per tempo.
+	 */
+	void seek_column( int nColumn );
+
+	/**
+	 * run render_to_files() in a thread, with progress events if bProgress is set.
+	 * the last EVENT_PROGRESS event (100) is pushed once the files are closed,
+	 * without progress events is_running() tells when the render is over.
+	 */
+	void start( const QStringList& filenames, int nSampleDepth, bool bProgress = true );
+	/** wait for the thread started by start() */
+	void wait();
+	/** ask a running render to stop */
+	void cancel()						{ __cancel = true; }
+	/** true while the thread started by start() runs */
+	bool is_running() const				{ return __running; }
+	/** return true if the last render completed */
+	bool succeeded() const				{ return __success; }
+
+	/** return the figures of the last render, valid once it is over */
+	const Report& get_report() const	{ return __report; }
+	/** return the number of frames of the range, tail excluded */
+	unsigned long get_length() const	{ return __length; }
+	/** return the song snapshot played by the renderer */
+	Song* get_song() const				{ return __song; }
+
+	/** return the number of tracks, only the instruments having notes in the range get one */
+	int get_stem_count() const			{ return __stems.size(); }
+	/** return the name of a track, the instrument name followed by the component name */
+	const QString& get_stem_name( int nStem ) const	{ return __stems[ nStem ].m_sName; }
+	/** return the left channel of a track, for the block last rendered */
+	float* get_stem_L( int nStem ) const	{ return __stems[ nStem ].m_pOut_L; }
+	/** return the right channel of a track, for the block last rendered */
+	float* get_stem_R( int nStem ) const	{ return __stems[ nStem ].m_pOut_R; }
+	/**
+	 * return the files the tracks are written to, sFilename with the track name
+	 * inserted before its extension
+	 */
+	QStringList get_stem_filenames( const QString& sFilename ) const;
+
+	/* AudioOutput, the renderer is the clock of its sampler */
+	int init( unsigned nBufferSize )	{ return 0; }
+	int connect()						{ return 0; }
+	void disconnect()					{}
+	unsigned getBufferSize()			{ return __options.m_nBufferSize; }
+	unsigned getSampleRate()			{ return __options.m_nSampleRate; }
+	float* getOut_L()					{ return __out_L; }
+	float* getOut_R()					{ return __out_R; }
+	void updateTransportInfo()			{}
+	void play()							{}
+	void stop()							{}
+	void locate( unsigned long nFrame )	{ m_transport.m_nFrames = nFrame; }
+	void setBpm( float fBPM )			{ m_transport.m_nBPM = fBPM; }
+	int getTrackIndex( Instrument* pInstr, InstrumentComponent* pCompo );
+	void prepareTrackOuts( unsigned nFrames );
+
+private:
+	/** a pattern group of the range, or the part of one played at a tempo */
+	struct Column
+	{
+		int		m_nStartTick;			///< first tick, counted from the start of the song
+		int		m_nLength;				///< length in ticks
+		int		m_nPatternTick;			///< first tick within the pattern group
+		unsigned long	m_nOffset;		///< first frame in the output of a render from the start of the range
+		float	m_fBpm;					///< tempo
+		std::vector<int>	m_patterns;	///< indices in __patterns, virtual patterns flattened
+	};
+	/** a track of the mix */
+	struct Stem
+	{
+		QString	m_sName;
+		float*	m_pOut_L;
+		float*	m_pOut_R;
+	};
+	/** the notes of a pattern, by position */
+	typedef std::multimap<int, Note*> PatternNotes;
+	/** a scheduled note and its scheduling order */
+	typedef std::pair<Note*, unsigned long> QueuedNote;
+
+	/**
+	 * orders the note queue like the audio engine does, the notes due on the same frame
+	 * in scheduling order so every render starts them in the same order
+	 */
+	struct NoteCompare
+	{
+		NoteCompare( const TransportInfo* pTransport ) : m_pTransport( pTransport ) {}
+		const TransportInfo* m_pTransport;
+		bool operator()( const QueuedNote& note1, const QueuedNote& note2 ) const;
+	};
+
+	Options __options;
+	Song* __song;						///< the snapshot, owns the copied instruments
+	std::vector<PatternNotes> __patterns;	///< copies of the notes of every pattern
+	std::vector<Column> __columns;		///< the range
+	TempoMap __tempo_map;				///< the tempo of the song along the range
+	std::map<Instrument*, Instrument*> __instruments;	///< song instrument to copy
+	std::vector<InstrumentLayer*> __unresident;	///< copied layers whose sample is streamed or not loaded yet
+	std::vector<Stem> __stems;
+	std::map<std::pair<Instrument*, int>, int> __stem_index;	///< copied instrument and drumkit component to track
+	Sampler* __sampler;
+	std::priority_queue<QueuedNote, std::deque<QueuedNote>, NoteCompare> __queue;	///< notes scheduled but not started
+	unsigned long __sequence;			///< notes scheduled so far
+	float* __out_L;
+	float* __out_R;
+
+	int __column;						///< column being rendered, __columns.size() in the tail
+	long long __column_left;			///< frames left in the column
+	int __next_tick;					///< next tick to schedule
+	int __schedule_column;				///< column holding __next_tick
+	unsigned long __tail_left;			///< frames left in the tail
+	unsigned long __length;
+	long long __drop_before;			///< notes due before this frame are dropped, -1 to play them late
+
+	Report __report;
+	std::atomic<bool> __cancel;
+	std::atomic<bool> __running;
+	bool __success;
+	pthread_t __thread;
+	bool __thread_started;
+	QStringList __filenames;
+	int __sample_depth;
+	bool __progress;					///< push the progress of the thread started by start()
+
+	/** copy the song, called with the AudioEngine locked */
+	void __snapshot( Song* pSong );
+	/**
+	 * load the whole data of the streamed and lazily loaded layers of the copy,
+	 * called once the AudioEngine is unlocked. The streamer can't keep up with the
+	 * render and a layer not loaded yet would be replaced by another one
+	 */
+	void __load_unresident();
+	/** create the tracks of the instruments playing in the range */
+	void __make_stems();
+	/** return the frames a voice of the range may last, plus the lookahead of the notes */
+	unsigned long __get_preroll() const;
+	/** move to a column, updating the tick size like the audio engine does on a tempo change */
+	void __enter_column( int nColumn );
+	/** queue the notes of the ticks heard within the next nFrames */
+	void __schedule( unsigned nFrames );
+	/** start the queued notes falling within the next nFrames */
+	void __play_notes( unsigned nFrames );
+	/** the render thread */
+	static void* render_thread( void* param );
+};
+
+};
+
+#endif
+
+/* vim: set softtabstop=4 expandtab: */
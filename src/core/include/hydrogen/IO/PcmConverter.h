@@ -0,0 +1,69 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef PCM_CONVERTER_H
+#define PCM_CONVERTER_H
+
+namespace H2Core
+{
+
+///
+/// Converts the float buffers of the engine to the interleaved integer or float
+/// samples a sound card takes.
+///
+/// The samples are clamped to [-1,1] before they are scaled, an over saturates at
+/// full scale instead of wrapping around. With SSE2 four frames are converted at
+/// once and stereo streams are interleaved in registers.
+///
+class PcmConverter
+{
+public:
+	/** sample formats, in host byte order except S24_3 which is packed little endian */
+	enum Format {
+		S16,		///< 16 bit integer
+		S24,		///< 24 bit integer in the low bits of 32
+		S24_3,		///< 24 bit integer in 3 bytes
+		S32,		///< 32 bit integer
+		FLOAT		///< 32 bit float
+	};
+
+	/** return the bytes of a sample */
+	static int sample_bytes( Format format );
+	/** return the name of a format */
+	static const char* name( Format format );
+
+	/**
+	 * convert and interleave the channels into pOut
+	 * \param ppIn a buffer per channel
+	 * \param nChannels the channels of the stream
+	 * \param nFrames the frames to convert
+	 * \param format the format of pOut
+	 * \param pOut room for nFrames * nChannels samples
+	 */
+	static void interleave( const float* const* ppIn, int nChannels, unsigned nFrames, Format format, void* pOut );
+};
+
+};
+
+#endif
+
+/* vim: set softtabstop=4 expandtab: */
@@ -109,6 +109,11 @@ public:
 
 	// Returns 0 on success.
 	int writeSong( Song *song, const QString& filename );
+	/**
+	 * write the content of writeSong() in the chunked binary layout read by SongReader::readSongBinary()
+	 * Returns 0 on success.
+	 */
+	int writeSongBinary( Song *song, const QString& filename );
 };
 
 };
@@ -157,6 +157,21 @@ public:
 			UI_LAYOUT_TABBED
 	};
 
+	/**
+	 * a part of the mix sent to an output channel pair of the multichannel drivers
+	 * (ALSA, PortAudio and the disk writer), on top of the main mix
+	 */
+	struct OutputRoute {
+		enum Source {
+			INSTRUMENT,		///< the voices of an instrument
+			COMPONENT,		///< the voices of a drumkit component, the instrument routes coming first
+			FX				///< the return of a LADSPA effect
+		};
+		Source	m_source;
+		QString	m_sName;	///< instrument or drumkit component name, slot number of an effect
+		int		m_nPair;	///< channel pair, 1 for channels 3 and 4, the main mix being pair 0
+	};
+
 
 	QString				m_sPreferencesFilename;
 	QString				m_sPreferencesDirectory;
@@ -198,6 +213,13 @@ public:
 	unsigned			m_nMaxNotes;		///< max notes
 	unsigned			m_nBufferSize;		///< Audio buffer size
 	unsigned			m_nSampleRate;		///< Audio sample rate
+	bool				m_bSampleStreaming;	///< stream large samples from disk instead of keeping them in memory
+	int					m_nSampleStreamingThreshold;	///< decoded size in KB above which a sample is streamed
+	int					m_nSampleStreamingPreload;	///< milliseconds of a streamed sample kept in memory
+	bool				m_bSampleCache;		///< keep decoded samples on disk, see SampleCache
+	int					m_nSampleCacheSize;	///< size in MB the sample cache is pruned down to, 0 for no limit
+	bool				m_bLazyLayerLoading;	///< load the layers of song instruments in the background, see LayerLoader
+	QString				m_sSampleStorage;	///< in memory format of the instrument samples, "float", "native" or "half", see SamplePacker
 
 	//	OSS driver properties ___
 	QString				m_sOSSDevice;		///< Device used for output
@@ -216,6 +238,13 @@ public:
 
 	//	alsa audio driver properties ___
 	QString				m_sAlsaAudioDevice;
+	bool				m_bAlsaMmap;			///< write the periods straight into the ring of the device when it allows it
+	int					m_nAlsaPeriodSize;		///< frames per period, 0 to use the buffer size
+	int					m_nAlsaPeriods;			///< periods in the ring of the device
+
+	//	multichannel drivers properties ___
+	int					m_nOutputChannelPairs;	///< stereo pairs opened by ALSA and PortAudio, the main mix included
+	std::vector<OutputRoute>	m_outputRoutes;	///< parts of the mix sent to the pairs after the main mix
 
 	//	jack driver properties ___
 	QString				m_sJackPortName1;
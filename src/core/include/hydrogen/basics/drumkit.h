@@ -29,6 +29,8 @@ namespace H2Core
 {
 
 class XMLNode;
+class XMLRecord;
+class XMLStreamReader;
 class InstrumentList;
 class DrumkitComponent;
 
@@ -66,8 +68,9 @@ class Drumkit : public H2Core::Object
 		static Drumkit* load_file( const QString& dk_path, bool load_samples=false );
 		/**
 		 * load the instrument samples
+		 * \param progress push EVENT_PROGRESS events while loading
 		 */
-		void load_samples( );
+		void load_samples( bool progress=false );
 		/**
 		 * unload the instrument samples
 		 */
@@ -176,6 +179,10 @@ class Drumkit : public H2Core::Object
 		void set_image_license( const QString& imageLicense );
 		/** __imageLicense accessor */
 		const QString& get_image_license() const;
+		/** __sample_storage setter */
+		void set_sample_storage( const QString& storage );
+		/** __sample_storage accessor */
+		const QString& get_sample_storage() const;
 		/** return true if the samples are loaded */
 		const bool samples_loaded() const;
 
@@ -192,6 +199,7 @@ class Drumkit : public H2Core::Object
 		QString __license;              ///< drumkit license description
 		QString __image;		///< drumkit image filename
 		QString __imageLicense;		///< drumkit image license
+		QString __sample_storage;	///< in memory format of the samples, empty to follow the preferences, see SamplePacker
 
 		bool __samples_loaded;          ///< true if the instrument samples are loaded
 		InstrumentList* __instruments;  ///< the list of instruments
@@ -206,6 +214,19 @@ class Drumkit : public H2Core::Object
 		 * \param dk_path the directory holding the drumkit data
 		 */
 		static Drumkit* load_from( XMLNode* node, const QString& dk_path );
+		/**
+		 * load a drumkit from the root element of an XMLStreamReader
+		 * \param reader the XMLStreamReader to read from
+		 * \param dk_path the directory holding the drumkit data
+		 * \return 0 if the drumkit has no name, or is not in the current format
+		 */
+		static Drumkit* load_from( XMLStreamReader* reader, const QString& dk_path );
+		/**
+		 * set the name, author, info, licenses, image and sample storage from the leaves of the drumkit element, shared by both loaders
+		 * \param record the XMLRecord to read from
+		 * \return false if the drumkit has no name
+		 */
+		bool load_record( const XMLRecord& record );
 		std::vector<DrumkitComponent*>* __components;  ///< list of drumkit component
 };
 
@@ -286,6 +307,16 @@ inline const QString& Drumkit::get_image_license() const
 	return __imageLicense;
 }
 
+inline void Drumkit::set_sample_storage( const QString& storage )
+{
+	__sample_storage = storage;
+}
+
+inline const QString& Drumkit::get_sample_storage() const
+{
+	return __sample_storage;
+}
+
 inline const bool Drumkit::samples_loaded() const
 {
 	return __samples_loaded;
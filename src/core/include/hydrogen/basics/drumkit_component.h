@@ -32,6 +32,7 @@ namespace H2Core
 {
 
 class XMLNode;
+class XMLRecord;
 class ADSR;
 class Drumkit;
 class InstrumentLayer;
@@ -46,6 +47,8 @@ class DrumkitComponent : public H2Core::Object
 
 		void save_to( XMLNode* node );
 		static DrumkitComponent* load_from( XMLNode* node, const QString& dk_path );
+		/** build a component from the leaves of a drumkitComponent element of a drumkit or a song, a missing id reads as -1 */
+		static DrumkitComponent* load_from( const XMLRecord& record );
 
 		void load_from( DrumkitComponent* component, bool is_live = true );
 
@@ -35,11 +35,14 @@ namespace H2Core
 {
 
 class XMLNode;
+class XMLRecord;
+class XMLStreamReader;
 class ADSR;
 class Drumkit;
 class DrumkitComponent;
 class InstrumentLayer;
 class InstrumentComponent;
+class SampleLoader;
 
 
 /**
@@ -88,13 +91,26 @@ class Instrument : public H2Core::Object
 		 * \param drumkit the drumkit the instrument belongs to
 		 * \param instrument to load samples and members from
 		 * \param is_live is it performed while playing
+		 * \param lazy create the samples without data, to be loaded by a LayerLoader
 		 */
-		void load_from( Drumkit* drumkit, Instrument* instrument, bool is_live = true );
+		void load_from( Drumkit* drumkit, Instrument* instrument, bool is_live = true, bool lazy = false );
+
+		/**
+		 * exchange the members set by load_from( Drumkit*, Instrument*, bool ) with another instrument.
+		 * nothing is allocated nor freed so the audio thread can do it
+		 * \param other the instrument to exchange the drumkit data with
+		 */
+		void swap_drumkit_data( Instrument* other );
 
 		/**
 		 * load samples data
 		 */
 		void load_samples();
+		/**
+		 * queue the samples of all layers in a loader
+		 * \param loader the loader which will load the samples data
+		 */
+		void queue_samples( SampleLoader* loader );
 		/*
 		 * unload instrument samples
 		 */
@@ -113,6 +129,14 @@ class Instrument : public H2Core::Object
 		 * \return a new Instrument instance
 		 */
 		static Instrument* load_from( XMLNode* node, const QString& dk_path, const QString& dk_name );
+		/**
+		 * load an instrument from the current element of an XMLStreamReader
+		 * \param reader the XMLStreamReader to read from, left at the end of the element
+		 * \param dk_path the directory holding the drumkit data
+		 * \param dk_name the name of the drumkit
+		 * \return a new Instrument instance, 0 if the element has no id
+		 */
+		static Instrument* load_from( XMLStreamReader* reader, const QString& dk_path, const QString& dk_name );
 
 		///< set the name of the instrument
 		void set_name( const QString& name );
@@ -257,6 +281,10 @@ class Instrument : public H2Core::Object
 		void set_apply_velocity( bool apply_velocity );
 		bool get_apply_velocity() const;
 
+		/** stream the samples of the instrument from disk whatever their size, applied when they are loaded */
+		void set_disk_streaming( bool disk_streaming );
+		bool get_disk_streaming() const;
+
 
 	private:
 		int __id;			                    ///< instrument id, should be unique
@@ -290,6 +318,10 @@ class Instrument : public H2Core::Object
 		bool __is_metronome_instrument;			///< is the instrument an metronome instrument?
 		std::vector<InstrumentComponent*>* __components;  ///< InstrumentLayer array
 		bool __apply_velocity;			///< change the sample gain based on velocity
+		bool __disk_streaming;			///< always stream the samples from disk
+
+		/// build an instrument from the leaves of an instrument element and its components, shared by both loaders, the components are deleted if it has no id
+		static Instrument* load_from( const XMLRecord& record, const std::vector<InstrumentComponent*>& components, const QString& dk_name );
 };
 
 // DEFINITIONS
@@ -613,6 +645,16 @@ inline bool Instrument::get_apply_velocity() const
 	return __apply_velocity;
 }
 
+inline void Instrument::set_disk_streaming( bool disk_streaming )
+{
+	__disk_streaming = disk_streaming;
+}
+
+inline bool Instrument::get_disk_streaming() const
+{
+	return __disk_streaming;
+}
+
 
 };
 
@@ -23,14 +23,21 @@
 #ifndef H2C_INSTRUMENTCOMPONENT_H
 #define H2C_INSTRUMENTCOMPONENT_H
 
+#include <algorithm>
 #include <cassert>
+#include <vector>
 
 #include <hydrogen/object.h>
 
+#define VELOCITY_LAYER_EDGES    ( 2 * MAX_LAYERS )                  ///< distinct start and end velocities of the layers
+#define VELOCITY_LAYER_REGIONS  ( 2 * VELOCITY_LAYER_EDGES + 1 )    ///< the edges and the ranges between them
+
 namespace H2Core
 {
 
 class XMLNode;
+class XMLRecord;
+class XMLStreamReader;
 class ADSR;
 class Drumkit;
 class InstrumentLayer;
@@ -47,11 +54,36 @@ class InstrumentComponent : public H2Core::Object
 
 		void save_to( XMLNode* node, int component_id );
 		static InstrumentComponent* load_from( XMLNode* node, const QString& dk_path );
+		static InstrumentComponent* load_from( XMLStreamReader* reader, const QString& dk_path );
 
 		InstrumentLayer* operator[]( int idx );
 		InstrumentLayer* get_layer( int idx );
 		void set_layer( InstrumentLayer* layer, int idx );
 
+		/**
+		 * rebuild the velocity to layers lookup table,
+		 * has to be called when the velocity range of a layer changed
+		 */
+		void update_layer_table();
+		/**
+		 * get the group of layers matching a velocity
+		 * \param velocity the note velocity (0..1)
+		 * \return the group index, -1 if no layer matches
+		 */
+		int get_layer_group( float velocity ) const;
+		/** return the number of layers of a group */
+		int get_group_size( int group ) const;
+		/** return the index of the nth layer of a group */
+		int get_group_layer( int group, int n ) const;
+		/** advance the round robin counter of a group and return the layer index to play */
+		int next_round_robin( int group );
+		/**
+		 * find the layer to play instead of one whose sample is not loaded yet
+		 * \param velocity the note velocity (0..1)
+		 * \return the index of the loaded layer with the closest velocity range, -1 if none is loaded
+		 */
+		int get_nearest_loaded_layer( float velocity ) const;
+
 		void set_drumkit_componentID( int related_drumkit_componentID );
 		int get_drumkit_componentID();
 
@@ -73,6 +105,17 @@ class InstrumentComponent : public H2Core::Object
 		float __gain;
 		//float __volume;
 		InstrumentLayer* __layers[MAX_LAYERS];
+		float __edges[VELOCITY_LAYER_EDGES];		///< sorted start and end velocities of the layers
+		int __edge_count;							///< number of distinct edges
+		int __velocity_group[VELOCITY_LAYER_REGIONS];	///< layer group of each edge and range between edges, -1 if none
+		int __group_start[VELOCITY_LAYER_REGIONS];	///< first entry of each group within __group_layers
+		int __group_size[VELOCITY_LAYER_REGIONS];	///< number of layers of each group
+		int __round_robin[VELOCITY_LAYER_REGIONS];	///< last round robin entry played of each group
+		/// layer indexes of all groups, a fixed array as the audio thread reads it while set_layer() rebuilds it
+		int __group_layers[MAX_LAYERS * VELOCITY_LAYER_REGIONS];
+
+		/// build a component from the leaves of an instrumentComponent element and its layers, shared by both loaders, the layers are deleted if it has no id
+		static InstrumentComponent* load_from( const XMLRecord& record, const std::vector<InstrumentLayer*>& layers );
 };
 
 // DEFINITIONS
@@ -113,6 +156,35 @@ inline void InstrumentComponent::set_layer( InstrumentLayer* layer, int idx )
 {
 	assert( idx>=0 && idx <MAX_LAYERS );
 	__layers[ idx ] = layer;
+	update_layer_table();
+}
+
+inline int InstrumentComponent::get_layer_group( float velocity ) const
+{
+	// an edge has a region of its own, the layers ending or starting on it match it as well
+	const float* edge = std::lower_bound( __edges, __edges + __edge_count, velocity );
+	int n = edge - __edges;
+	return __velocity_group[ ( n < __edge_count && *edge == velocity ) ? 2 * n + 1 : 2 * n ];
+}
+
+inline int InstrumentComponent::get_group_size( int group ) const
+{
+	return __group_size[ group ];
+}
+
+inline int InstrumentComponent::get_group_layer( int group, int n ) const
+{
+	return __group_layers[ __group_start[ group ] + n ];
+}
+
+inline int InstrumentComponent::next_round_robin( int group )
+{
+	int n = __round_robin[ group ] + 1;
+	if ( n >= __group_size[ group ] ) {
+		n = 0;
+	}
+	__round_robin[ group ] = n;
+	return get_group_layer( group, n );
 }
 
 };
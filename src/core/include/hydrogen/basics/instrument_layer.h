@@ -29,6 +29,7 @@ namespace H2Core
 {
 
 class XMLNode;
+class XMLRecord;
 class Sample;
 
 /**
@@ -102,6 +103,13 @@ class InstrumentLayer : public H2Core::Object
 		 * \return a new InstrumentLayer instance
 		 */
 		static InstrumentLayer* load_from( XMLNode* node, const QString& dk_path );
+		/**
+		 * load an instrument layer from the child elements of a layer element
+		 * \param record the XMLRecord to read from
+		 * \param dk_path the directory holding the drumkit data
+		 * \return a new InstrumentLayer instance
+		 */
+		static InstrumentLayer* load_from( const XMLRecord& record, const QString& dk_path );
 
 	private:
 		float __gain;               ///< ratio between the input sample and the output signal, 1.0 by default
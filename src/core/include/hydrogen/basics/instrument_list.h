@@ -31,6 +31,7 @@ namespace H2Core
 {
 
 class XMLNode;
+class XMLStreamReader;
 class Instrument;
 
 /**
@@ -127,10 +128,11 @@ class InstrumentList : public H2Core::Object
 		 */
 		void move( int idx_a, int idx_b );
 
-		/*
-		 * load instrument samples
+		/**
+		 * load instrument samples, all at once with a SampleLoader
+		 * \param progress push EVENT_PROGRESS events while loading
 		 */
-		void load_samples();
+		void load_samples( bool progress=false );
 		/*
 		 * unload instrument samples
 		 */
@@ -147,6 +149,13 @@ class InstrumentList : public H2Core::Object
 		 * \return a new InstrumentList instance
 		 */
 		static InstrumentList* load_from( XMLNode* node, const QString& dk_path, const QString& dk_name );
+		/**
+		 * load an instrument list from the current element of an XMLStreamReader
+		 * \param reader the XMLStreamReader to read from, left at the end of the element
+		 * \param dk_path the directory holding the drumkit data
+		 * \return a new InstrumentList instance
+		 */
+		static InstrumentList* load_from( XMLStreamReader* reader, const QString& dk_path, const QString& dk_name );
 
 	private:
 		std::vector<Instrument*> __instruments;            ///< the list of instruments
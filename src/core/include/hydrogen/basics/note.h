@@ -23,6 +23,8 @@
 #ifndef H2C_NOTE_H
 #define H2C_NOTE_H
 
+#include <inttypes.h>
+
 #include <hydrogen/object.h>
 #include <hydrogen/basics/instrument.h>
 
@@ -48,13 +50,28 @@ namespace H2Core
 {
 
 class XMLNode;
+class XMLRecord;
 class ADSR;
 class Instrument;
 class InstrumentList;
+class SampleStream;
+
+/**
+ * position of a voice within its sample, 32.32 fixed point:
+ * the upper word holds the frame, the lower word the fraction of frame
+ */
+typedef uint64_t sample_position_t;
+
+#define SAMPLE_POSITION_SHIFT   32
+#define SAMPLE_POSITION_ONE     ( ( sample_position_t )1 << SAMPLE_POSITION_SHIFT )
+#define SAMPLE_POSITION_MASK    ( SAMPLE_POSITION_ONE - 1 )
 
 struct SelectedLayerInfo {
-	int SelectedLayer;		///< selected layer during layer selection
-	float SamplePosition;	///< place marker for overlapping process() cycles
+	int SelectedLayer;					///< selected layer during layer selection
+	sample_position_t SamplePosition;	///< place marker for overlapping process() cycles
+	SampleStream* Stream;				///< disk stream of the voice if the sample is streamed, released with the note
+	int TrackOut;						///< track output of the voice, -1 if it has none
+	int TrackRouting;					///< AudioOutput::get_track_routing() TrackOut was looked up with, -1 if not yet
 };
 
 /**
@@ -101,6 +118,13 @@ class Note : public H2Core::Object
 		 * \return a new Note instance
 		 */
 		static Note* load_from( XMLNode* node, InstrumentList* instruments );
+		/**
+		 * load a note from the child elements of a note element
+		 * \param record the XMLRecord to read from
+		 * \param instruments the current instrument list to search instrument into
+		 * \return a new Note instance
+		 */
+		static Note* load_from( const XMLRecord& record, InstrumentList* instruments );
 
 		/** output details through logger with DEBUG severity */
 		void dump();
@@ -112,6 +136,17 @@ class Note : public H2Core::Object
 		void map_instrument( InstrumentList* instruments );
 		/** __instrument accessor */
 		Instrument* get_instrument();
+		/**
+		 * point to another instrument holding the data the note was created with,
+		 * see Sampler::retire_notes()
+		 * \param instrument the instrument to play
+		 */
+		void set_instrument( Instrument* instrument );
+		/**
+		 * copy again what the note takes from its instrument, once the instrument data was replaced
+		 * before the note started, see Hydrogen::loadDrumkitAsync()
+		 */
+		void refresh_instrument_data();
 		/** return true if __instrument is set */
 		bool has_instrument() const;
 		/**
@@ -277,11 +312,20 @@ class Note : public H2Core::Object
 		bool match( Instrument* instrument, Key key, Octave octave ) const;
 
 		/**
-		 * compute left and right output based on filters
-		 * \param val_l the left channel value
-		 * \param val_r the right channel value
+		 * start the filter ramp of a process cycle, to be called once per cycle before filter_block().
+		 * The ramp goes from the values reached by the previous cycle to the current knobs of the instrument.
+		 */
+		void ramp_filter();
+		/**
+		 * run the low pass resonant filter of the instrument on a block of frames,
+		 * every component of the note follows the cutoff and resonance ramp set by ramp_filter()
+		 * \param buf_l the left channel frames of the cycle, filtered in place
+		 * \param buf_r the right channel frames of the cycle, filtered in place
+		 * \param first the first frame to process
+		 * \param nframes the number of frames to process
+		 * \param cycle_frames the number of frames of the cycle the ramp spans
 		 */
-		void compute_lr_values( float* val_l, float* val_r );
+		void filter_block( float* buf_l, float* buf_r, int first, int nframes, int cycle_frames );
 
 	private:
 		Instrument* __instrument;   ///< the instrument to be played by this note
@@ -297,10 +341,14 @@ class Note : public H2Core::Object
 		Octave __octave;            ///< the octave [-3;3]
 		ADSR* __adsr;               ///< attack decay sustain release
 		float __lead_lag;           ///< lead or lag offset of the note
-		float __cut_off;            ///< filter cutoff [0;1]
-		float __resonance;          ///< filter resonant frequency [0;1]
+		float __cut_off;            ///< filter cutoff at the start of the cycle [0;1]
+		float __resonance;          ///< filter resonance at the start of the cycle [0;1]
+		float __cut_off_target;     ///< filter cutoff at the end of the cycle [0;1]
+		float __resonance_target;   ///< filter resonance at the end of the cycle [0;1]
 		int __humanize_delay;       ///< used in "humanize" function
 		std::map< int, SelectedLayerInfo* > __layers_selected;
+		/** add an unselected entry to __layers_selected for each component of __instrument */
+		void __init_layers_selected();
 		float __bpfb_l;             ///< left band pass filter buffer
 		float __bpfb_r;             ///< right band pass filter buffer
 		float __lpfb_l;             ///< left low pass filter buffer
@@ -325,6 +373,11 @@ inline Instrument* Note::get_instrument()
 	return __instrument;
 }
 
+inline void Note::set_instrument( Instrument* instrument )
+{
+	__instrument = instrument;
+}
+
 inline bool Note::has_instrument() const
 {
 	return __instrument!=0;
@@ -447,7 +500,9 @@ inline void Note::set_probability( float value )
 
 inline SelectedLayerInfo* Note::get_layer_selected( int CompoID )
 {
-	return __layers_selected[ CompoID ];
+	// operator[] would insert a NULL entry, this runs in the audio thread
+	std::map< int, SelectedLayerInfo* >::const_iterator it = __layers_selected.find( CompoID );
+	return ( it != __layers_selected.end() ) ? it->second : 0;
 }
 
 inline void Note::set_humanize_delay( int value )
@@ -541,25 +596,6 @@ inline bool Note::match( Instrument* instrument, Key key, Octave octave ) const
 	return ( ( __instrument==instrument ) && ( __key==key ) && ( __octave==octave ) );
 }
 
-inline void Note::compute_lr_values( float* val_l, float* val_r )
-{
-	/* TODO ???
-	if( !has_instrument() ) {
-		*val_l = 0.0f;
-		*val_r = 0.0f;
-		return;
-	}
-	*/
-	float cut_off = __instrument->get_filter_cutoff();
-	float resonance = __instrument->get_filter_resonance();
-	__bpfb_l  =  resonance * __bpfb_l  + cut_off * ( *val_l - __lpfb_l );
-	__lpfb_l +=  cut_off   * __bpfb_l;
-	__bpfb_r  =  resonance * __bpfb_r  + cut_off * ( *val_r - __lpfb_r );
-	__lpfb_r +=  cut_off   * __bpfb_r;
-	*val_l = __lpfb_l;
-	*val_r = __lpfb_r;
-}
-
 };
 
 #endif // H2C_NOTE_H
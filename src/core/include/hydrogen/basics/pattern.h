@@ -32,6 +32,8 @@ namespace H2Core
 {
 
 class XMLNode;
+class XMLRecord;
+class XMLStreamReader;
 class Instrument;
 class InstrumentList;
 class PatternList;
@@ -200,6 +202,18 @@ class Pattern : public H2Core::Object
 		 * \return a new Pattern instance
 		 */
 		static Pattern* load_from( XMLNode* node, InstrumentList* instruments );
+		/**
+		 * load a pattern from the current element of an XMLStreamReader
+		 * \param reader the XMLStreamReader to read from, left at the end of the element
+		 * \param instruments the current instrument list to search instrument into
+		 * \return a new Pattern instance
+		 */
+		static Pattern* load_from( XMLStreamReader* reader, InstrumentList* instruments );
+		/**
+		 * set the name, info, category and length from the leaves of a pattern element, shared by both loaders
+		 * \param record the XMLRecord to read from
+		 */
+		void load_record( const XMLRecord& record );
 };
 
 #define FOREACH_NOTE_CST_IT_BEGIN_END(_notes,_it) \
@@ -27,10 +27,13 @@
 #include <sndfile.h>
 
 #include <hydrogen/object.h>
+#include <hydrogen/helpers/sample_packer.h>
 
 namespace H2Core
 {
 
+class SampleBuffer;
+
 /**
  * A container for a sample, beeing able to apply modifications on it
  */
@@ -126,7 +129,7 @@ class Sample : public H2Core::Object
 		 * \param frames the number of frames per channel in the sample
 		 * \param sample_rate the sample rate of the sample
 		 * \param data_l the left channel array of data
-		 * \param data_l the right channel array of data
+		 * \param data_l the right channel array of data, data_l for a mono sample
 		 */
 		Sample( const QString& filepath, int frames=0, int sample_rate=0, float* data_l=0, float* data_r=0 );
 		/** copy constructor */
@@ -154,8 +157,10 @@ class Sample : public H2Core::Object
 		 * \param rubber band transformation parameters
 		 * \param velocity envelope points
 		 * \param pan envelope points
+		 * \param bpm the tempo the rubberband transformation fits the sample to, 0 for the current tempo.
+		 * the time-stretched data is kept in the SampleCache, so a tempo used before is not computed again
 		 */
-		static Sample* load( const QString& filepath, const Loops& loops, const Rubberband& rubber, const VelocityEnvelope& velocity, const PanEnvelope& pan );
+		static Sample* load( const QString& filepath, const Loops& loops, const Rubberband& rubber, const VelocityEnvelope& velocity, const PanEnvelope& pan, float bpm=0 );
 
 		/**
 		 * load sample data
@@ -165,6 +170,46 @@ class Sample : public H2Core::Object
 		 * unload sample data
 		 */
 		void unload();
+		/**
+		 * use the pooled data of another sample, nothing is allocated nor decoded
+		 * so it can be done while the audio engine is locked
+		 * \param other a loaded sample of the same file
+		 * \return false if the data of other is not pooled
+		 */
+		bool share( Sample* other );
+		/**
+		 * keep only the first frames of the sample in memory, the rest will be streamed from disk while playing.
+		 * modified samples can't be streamed as their data no longer matches the file
+		 * \param preload_frames the number of frames to keep in memory
+		 * \return true on success
+		 */
+		bool stream( int preload_frames );
+		/** return true if the end of the sample data is streamed from disk */
+		bool is_streamed() const;
+		/** return the number of frames held by the data arrays */
+		int get_resident_frames() const;
+		/**
+		 * hold the data in a compact format, it is converted back to float while rendering.
+		 * modified and streamed samples are kept as they are
+		 * \param format the compact format
+		 * \return true on success
+		 */
+		bool compact( SamplePacker::Format format );
+		/** return true if the data is held in a compact format, get_data_l() and get_data_r() then return 0 */
+		bool is_compact() const;
+		/** return the format the data is held in */
+		SamplePacker::Format get_format() const;
+		/** return true if both channels share the same data, as loaded from a mono file */
+		bool is_mono() const;
+		/**
+		 * convert resident frames to float whatever the format of the data
+		 * \param first the first frame to read
+		 * \param count the number of frames to read, limited to the resident frames
+		 * \param data_l receives the left channel frames
+		 * \param data_r receives the right channel frames, 0 to read the left channel only
+		 * \return the number of frames read
+		 */
+		int read( int first, int count, float* data_l, float* data_r ) const;
 
 		/**
 		 * apply the transformations to the sample data
@@ -172,8 +217,9 @@ class Sample : public H2Core::Object
 		 * \param rubber band transformation parameters
 		 * \param velocity envelope points
 		 * \param pan envelope points
+		 * \param bpm the tempo of the rubberband transformation, 0 for the current tempo
 		 */
-		void apply( const Loops& loops, const Rubberband& rubber, const VelocityEnvelope& velocity, const PanEnvelope& pan );
+		void apply( const Loops& loops, const Rubberband& rubber, const VelocityEnvelope& velocity, const PanEnvelope& pan, float bpm=0 );
 		/**
 		 * aplly loop transformation to the sample
 		 * \param lo loops parameters
@@ -192,15 +238,17 @@ class Sample : public H2Core::Object
 		/**
 		 * aplly rubberband transformation to the sample
 		 * \param r rubberband parameters
+		 * \param bpm the tempo to fit the sample to, 0 for the current tempo
 		 */
-		void apply_rubberband( const Rubberband& rb );
+		void apply_rubberband( const Rubberband& rb, float bpm=0 );
 		/**
 		 * call rubberband cli to modify the sample
 		 * \param r rubberband parameters
+		 * \param bpm the tempo to fit the sample to, 0 for the current tempo
 		 */
-		bool exec_rubberband_cli( const Rubberband& rb );
+		bool exec_rubberband_cli( const Rubberband& rb, float bpm=0 );
 
-		/** return true if both data channels are null pointers */
+		/** return true if the sample holds no data */
 		bool is_empty() const;
 		/** __filepath accessor */
 		const QString get_filepath() const;
@@ -227,9 +275,9 @@ class Sample : public H2Core::Object
 
 		/** return data size */
 		int get_size() const;
-		/** __data_l accessor */
+		/** __data_l accessor, the data may be shared with other samples and must not be modified */
 		float* get_data_l() const;
-		/** __data_r accessor */
+		/** __data_r accessor, the data may be shared with other samples and must not be modified */
 		float* get_data_r() const;
 		/**
 		 * __is_modified setter
@@ -261,28 +309,70 @@ class Sample : public H2Core::Object
 		float* __data_l;                        ///< left channel data
 		float* __data_r;                        ///< right channel data
 		bool __is_modified;                     ///< true if sample is modified
+		int __preload_frames;                   ///< frames held in memory when the sample is streamed, 0 if the whole sample is in memory
+		SampleBuffer* __buffer;                 ///< SamplePool buffer holding the data arrays, 0 if they are owned by this sample
+		SamplePacker::Format __format;          ///< format of the compact data, FLOAT when the float arrays are used
+		const char* __packed_l;                 ///< left channel compact data, owned by __buffer
+		const char* __packed_r;                 ///< right channel compact data, owned by __buffer
 		PanEnvelope __pan_envelope;             ///< pan envelope vector
 		VelocityEnvelope __velocity_envelope;   ///< velocity envelope vector
 		Loops __loops;                          ///< set of loop parameters
 		Rubberband __rubberband;                ///< set of rubberband parameters
 		/** loop modes string */
 		static const char* __loop_modes[];
+		/** release the data arrays, dropping the pool reference if needed */
+		void __free_data();
+		/** copy shared data arrays into memory owned by this sample so they can be modified in place */
+		void __detach();
+		/** use the data of a pool buffer, the current data must have been freed */
+		void __attach( SampleBuffer* buffer );
+		/**
+		 * decode a sample file, using the SampleCache if enabled
+		 * \param filepath the file to decode
+		 * \return a buffer not in the pool yet, 0 on failure
+		 */
+		static SampleBuffer* __decode( const QString& filepath );
+		/**
+		 * decode a sample file into new arrays, without the SamplePool or the SampleCache
+		 * \param filepath the file to decode
+		 * \param frames, sample_rate, data_l, data_r filled on success, data_r is data_l for a mono file
+		 * \return false on failure
+		 */
+		static bool __read_file( const QString& filepath, int* frames, int* sample_rate, float** data_l, float** data_r );
+		/** describe the processing parameters of a sample for SamplePool::key() */
+		static QString __processing( const Loops& loops, const Rubberband& rubber, const VelocityEnvelope& velocity, const PanEnvelope& pan, float bpm );
 };
 
 // DEFINITIONS
 
-inline void Sample::unload()
+inline bool Sample::is_streamed() const
+{
+	return __preload_frames > 0;
+}
+
+inline int Sample::get_resident_frames() const
+{
+	return ( __preload_frames > 0 ) ? __preload_frames : __frames;
+}
+
+inline bool Sample::is_compact() const
+{
+	return __packed_l != 0;
+}
+
+inline SamplePacker::Format Sample::get_format() const
+{
+	return __format;
+}
+
+inline bool Sample::is_mono() const
 {
-	if( __data_l ) delete __data_l;
-	if( __data_r ) delete __data_r;
-	__frames = __sample_rate = 0;
-	__data_l = __data_r = 0;
-	// __is_modified = false; leave this unchanged as pan, velocity, loop and rubberband are kept unchanged
+	return __data_l ? __data_r == __data_l : ( __packed_l && __packed_r == __packed_l );
 }
 
 inline bool Sample::is_empty() const
 {
-	return ( __data_l==__data_r==0 );
+	return ( __data_l==0 && __packed_l==0 );
 }
 
 inline const QString Sample::get_filepath() const
@@ -0,0 +1,145 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef H2C_SAMPLE_POOL_H
+#define H2C_SAMPLE_POOL_H
+
+#include <atomic>
+#include <map>
+#include <QtCore/QMutex>
+
+#include <hydrogen/object.h>
+#include <hydrogen/helpers/sample_packer.h>
+
+class QFile;
+
+namespace H2Core
+{
+
+/**
+ * the audio data of a sample, shared by all the Sample instances
+ * loaded from the same file with the same processing parameters.
+ * the data must not be modified once the buffer is in the SamplePool
+ */
+class SampleBuffer : public H2Core::Object
+{
+		H2_OBJECT
+	public:
+		/**
+		 * constructor, takes ownership of the data
+		 * \param frames the number of frames
+		 * \param sample_rate the sample rate
+		 * \param data_l the left channel data, allocated with new[] unless mapping is set
+		 * \param data_r the right channel data, allocated with new[] unless mapping is set, data_l for a mono sample
+		 * \param mapping the SampleCache file the data points into, 0 if the data is allocated
+		 */
+		SampleBuffer( int frames, int sample_rate, float* data_l, float* data_r, QFile* mapping=0 );
+		/**
+		 * constructor of a compact buffer, takes ownership of the data
+		 * \param frames the number of frames
+		 * \param sample_rate the sample rate
+		 * \param format the format of the data, see SamplePacker
+		 * \param packed_l the left channel data, allocated with new[]
+		 * \param packed_r the right channel data, allocated with new[], packed_l for a mono sample
+		 */
+		SampleBuffer( int frames, int sample_rate, SamplePacker::Format format, char* packed_l, char* packed_r );
+		/** destructor, frees or unmaps the data */
+		~SampleBuffer();
+
+		int frames;                 ///< number of frames
+		int sample_rate;            ///< sample rate
+		float* data_l;              ///< left channel data, 0 if the buffer is compact
+		float* data_r;              ///< right channel data, 0 if the buffer is compact
+		SamplePacker::Format format;    ///< format of the packed data, FLOAT if the buffer is not compact
+		char* packed_l;             ///< left channel compact data
+		char* packed_r;             ///< right channel compact data
+
+	private:
+		friend class SamplePool;
+		QFile* __mapping;           ///< see SampleCache::map()
+		std::atomic<int> __refs;    ///< Sample instances using the buffer
+};
+
+/**
+ * SamplePool hands out the shared buffers of the samples,
+ * so a file used by several instruments, songs or editors is decoded and held once.
+ * Buffers are only freed by purge() which is called from non realtime code,
+ * so dropping a sample while the audio engine is locked stays cheap.
+ */
+class SamplePool : public H2Core::Object
+{
+		H2_OBJECT
+	public:
+		/**
+		 * build a pool key
+		 * \param filepath the sample file
+		 * \param processing a description of the processing applied to the decoded data, empty for none
+		 * \return the key, empty if the file can't be found
+		 */
+		static QString key( const QString& filepath, const QString& processing=QString() );
+		/**
+		 * take a reference on a pooled buffer
+		 * \param key the buffer key
+		 * \return the buffer, 0 if not in the pool
+		 */
+		static SampleBuffer* acquire( const QString& key );
+		/**
+		 * add a buffer to the pool and take a reference on it.
+		 * if another thread published the same key meanwhile, buffer is deleted and the pooled one is returned
+		 * \param key the buffer key, must not be empty
+		 * \param buffer a buffer not shared yet
+		 */
+		static SampleBuffer* publish( const QString& key, SampleBuffer* buffer );
+		/** take another reference on a buffer obtained from acquire() or publish() */
+		static void retain( SampleBuffer* buffer );
+		/** drop a reference, never blocks nor frees memory */
+		static void release( SampleBuffer* buffer );
+		/** free the buffers no longer referenced, must not be called from the audio thread */
+		static void purge();
+		/** return the number of buffers in the pool */
+		static int size();
+
+	private:
+		typedef std::map<QString, SampleBuffer*> Buffers;
+		static Buffers __buffers;
+		static QMutex __mutex;
+		/** free unreferenced buffers, __mutex must be locked */
+		static void __purge();
+};
+
+// DEFINITIONS
+
+inline void SamplePool::retain( SampleBuffer* buffer )
+{
+	buffer->__refs.fetch_add( 1, std::memory_order_relaxed );
+}
+
+inline void SamplePool::release( SampleBuffer* buffer )
+{
+	buffer->__refs.fetch_sub( 1, std::memory_order_release );
+}
+
+};
+
+#endif  // H2C_SAMPLE_POOL_H
+
+/* vim: set softtabstop=4 expandtab: */
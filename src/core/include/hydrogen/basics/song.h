@@ -33,6 +33,13 @@
 
 class TiXmlNode;
 
+/// the magic starting the binary song files, see SongWriter::writeSongBinary()
+#define SONG_BINARY_MAGIC       "H2SB"
+/// the layout version of the binary song files
+#define SONG_BINARY_VERSION     1
+/// the extension of the binary song files
+#define SONG_BINARY_EXT         ".h2songb"
+
 namespace H2Core
 {
 
@@ -121,8 +128,12 @@ class Song : public H2Core::Object
 			__pattern_group_sequence = vect;
 		}
 
+		/** load a song, either XML or binary, see is_binary() */
 		static Song* load( const QString& sFilename );
+		/** save a song, in the binary format if sFilename ends with SONG_BINARY_EXT */
 		bool save( const QString& sFilename );
+		/** return true if a file is a binary song */
+		static bool is_binary( const QString& sFilename );
 
 		InstrumentList* get_instrument_list() {
 			return __instrument_list;
@@ -204,17 +215,6 @@ class Song : public H2Core::Object
 
 		void readTempPatternList( QString filename );
 
-		int get_latest_round_robin( float start_velocity ) {
-			if ( __latest_round_robins.find(start_velocity) == __latest_round_robins.end() )
-				return 0;
-			else
-				return __latest_round_robins[start_velocity];
-		}
-		void set_latest_round_robin( float start_velocity, int latest_round_robin ) {
-			__latest_round_robins[start_velocity] = latest_round_robin;
-		}
-
-
 	private:
 		float								__volume;						///< volume of the song (0.0..1.0)
 		float								__metronome_volume;				///< Metronome volume
@@ -229,7 +229,6 @@ class Song : public H2Core::Object
 		float								__humanize_velocity_value;
 		float								__swing_factor;
 		bool								__is_modified;
-		std::map< float, int> 				__latest_round_robins;
 		SongMode							__song_mode;
 };
 
@@ -246,13 +245,19 @@ class SongReader : public H2Core::Object
 		SongReader();
 		~SongReader();
 		const QString getPath( const QString& filename );
+		/**
+		 * read an XML song in one pass over the file, without building a QDomDocument,
+		 * a patternList found before the instrumentList is read in a second pass
+		 */
 		Song* readSong( const QString& filename );
+		/**
+		 * read a song written by SongWriter::writeSongBinary(),
+		 * the file is mapped into memory and the notes are read from their arrays in place
+		 */
+		Song* readSongBinary( const QString& filename );
 
 	private:
 		QString m_sSongVersion;
-
-		/// Dato un XmlNode restituisce un oggetto Pattern
-		Pattern* getPattern( QDomNode pattern, InstrumentList* instrList );
 };
 
 };
@@ -0,0 +1,134 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef H2C_TEMPO_MAP_H
+#define H2C_TEMPO_MAP_H
+
+#include <vector>
+
+#include <hydrogen/object.h>
+
+namespace H2Core
+{
+
+class Song;
+class Timeline;
+
+/**
+ * TempoMap converts between ticks and frames across tempo changes.
+ * The song is cut in segments of constant tempo, each one holding its first tick
+ * and its first frame, the sum of the lengths of the segments before it.
+ * A conversion looks the segment up by binary search and stays in double precision,
+ * so positions far into the song do not drift however many tempo changes there are.
+ * A tempo can change on any tick, in the middle of a pattern as well.
+ */
+class TempoMap : public H2Core::Object
+{
+		H2_OBJECT
+	public:
+		/**
+		 * constructor, a single tempo from tick 0
+		 * \param bpm the tempo
+		 * \param resolution the ticks per quarter note
+		 * \param sample_rate the frames per second
+		 */
+		TempoMap( float bpm=120.0, int resolution=48, unsigned sample_rate=44100 );
+
+		/**
+		 * drop the tempo changes and start over with a single tempo
+		 * \param bpm the tempo from tick 0
+		 * \param resolution the ticks per quarter note
+		 * \param sample_rate the frames per second
+		 */
+		void reset( float bpm, int resolution, unsigned sample_rate );
+		/**
+		 * change the tempo from a tick on, replacing a tempo set on the same tick
+		 * \param tick the first tick of the new tempo
+		 * \param bpm the tempo
+		 */
+		void add_tempo( double tick, float bpm );
+		/**
+		 * build the map of a song, the tempo markers of the timeline are placed at
+		 * the first tick of their pattern group plus their own tick
+		 * \param song the song giving the initial tempo and the pattern group lengths
+		 * \param timeline the tempo markers
+		 * \param sample_rate the frames per second
+		 * \param use_timeline false to keep the tempo of the song throughout
+		 */
+		void load( Song* song, Timeline* timeline, unsigned sample_rate, bool use_timeline );
+
+		/** return the frame a tick falls on, counted from tick 0 */
+		double tick_to_frame( double tick ) const;
+		/** return the tick played on a frame */
+		double frame_to_tick( double frame ) const;
+		/** return the tempo at a tick */
+		float get_bpm( double tick ) const;
+		/** return the frames per tick at a tick */
+		double get_tick_size( double tick ) const;
+		/** return the first tick after a tick where the tempo changes, -1 if there is none */
+		double next_tempo_change( double tick ) const;
+		/** return the number of segments of constant tempo */
+		int size() const;
+
+	private:
+		/** a range of constant tempo */
+		struct Segment {
+			double tick;            ///< first tick
+			double frame;           ///< first frame
+			double tick_size;       ///< frames per tick
+			float bpm;              ///< tempo
+		};
+		std::vector<Segment> __segments;    ///< sorted by tick, the first one starts on tick 0
+		int __resolution;                   ///< ticks per quarter note
+		unsigned __sample_rate;             ///< frames per second
+
+		/** return the frames per tick of a tempo */
+		double __tick_size( float bpm ) const;
+		/** update the first frame of the segments from one on */
+		void __update_frames( int from );
+		/** return the segment holding a tick */
+		const Segment& __find_tick( double tick ) const;
+		/** return the segment holding a frame */
+		const Segment& __find_frame( double frame ) const;
+		/** order a tick and a segment for the binary searches */
+		static bool tick_before( double tick, const Segment& segment );
+		/** order a frame and a segment for the binary searches */
+		static bool frame_before( double frame, const Segment& segment );
+};
+
+// DEFINITIONS
+
+inline int TempoMap::size() const
+{
+	return __segments.size();
+}
+
+inline double TempoMap::__tick_size( float bpm ) const
+{
+	return __sample_rate * 60.0 / bpm / __resolution;
+}
+
+};
+
+#endif  // H2C_TEMPO_MAP_H
+
+/* vim: set softtabstop=4 expandtab: */
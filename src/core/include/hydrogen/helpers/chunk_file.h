@@ -0,0 +1,152 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef H2C_CHUNK_FILE_H
+#define H2C_CHUNK_FILE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+class QFile;
+
+namespace H2Core
+{
+
+/**
+ * ChunkWriter builds a chunked binary file.
+ * The file starts with a 4 bytes magic and a version number,
+ * followed by chunks made of a 4 bytes id, the payload size and the payload.
+ * All the numbers are stored little endian.
+ */
+class ChunkWriter
+{
+	public:
+		/**
+		 * start a file
+		 * \param magic the 4 characters identifying the file type
+		 * \param version the layout version
+		 */
+		ChunkWriter( const char* magic, quint32 version );
+
+		/** start a chunk, \param id its 4 characters id */
+		void begin_chunk( const char* id );
+		/** close the chunk started by begin_chunk(), storing its size */
+		void end_chunk();
+
+		void write_u8( quint8 value );
+		void write_bool( bool value );
+		void write_i32( qint32 value );
+		void write_u32( quint32 value );
+		void write_float( float value );
+		/** write the UTF-8 length then the UTF-8 bytes of a string */
+		void write_string( const QString& value );
+
+		/** write the content to a file, return false on error */
+		bool save( const QString& path ) const;
+
+	private:
+		QByteArray __data;                  ///< the file content
+		int __chunk_start;                  ///< the offset of the size of the opened chunk, -1 if none
+};
+
+/**
+ * ChunkReader reads a file written by ChunkWriter.
+ * The file is mapped into memory when possible, and the chunks are read
+ * in place through readers sharing that memory.
+ * Reading past the end of a chunk sets an error flag and returns zeroes,
+ * so the content can be read without checking every value.
+ */
+class ChunkReader
+{
+	public:
+		ChunkReader();
+		~ChunkReader();
+
+		/**
+		 * check the magic of a file without reading it
+		 * \param path the file to check
+		 * \param magic the 4 characters identifying the file type
+		 */
+		static bool is_chunk_file( const QString& path, const char* magic );
+
+		/**
+		 * open a file
+		 * \param path the file to read
+		 * \param magic the 4 characters identifying the file type
+		 * \param version receives the layout version
+		 * \return false if the file can't be read or has another type
+		 */
+		bool open( const QString& path, const char* magic, quint32* version );
+
+		/**
+		 * move to the next chunk
+		 * \param id receives the 4 characters id of the chunk
+		 * \param chunk receives a reader over the payload
+		 * \return false at the end of the file or if the remaining data is truncated
+		 */
+		bool next_chunk( QByteArray* id, ChunkReader* chunk );
+
+		quint8 read_u8();
+		bool read_bool();
+		qint32 read_i32();
+		quint32 read_u32();
+		float read_float();
+		QString read_string();
+		/**
+		 * return a pointer to an array stored in place, 0 if it overflows the chunk
+		 * \param count the number of elements
+		 * \param element_size the size of an element in bytes
+		 */
+		const uchar* read_array( quint32 count, int element_size );
+
+		/** return an element of an array of little endian 32 bits integers */
+		static qint32 i32_at( const uchar* array, int i );
+		/** return an element of an array of little endian floats */
+		static float float_at( const uchar* array, int i );
+
+		/** true if a read went past the end of the data */
+		bool has_error() const              { return __error; }
+		/** true once all the data has been read */
+		bool at_end() const                 { return __pos >= __size; }
+
+	private:
+		QFile* __file;                      ///< the open file, 0 for a chunk reader
+		QByteArray __copy;                  ///< the file content if it can't be mapped
+		const uchar* __data;                ///< the data to read
+		quint32 __size;                     ///< the size of the data
+		quint32 __pos;                      ///< the read offset
+		bool __error;                       ///< set if a read went past the end of the data
+
+		/** return the address of size bytes and move past them, 0 if there are not enough bytes left */
+		const uchar* __take( quint32 size );
+		/** close the file */
+		void __close();
+
+		ChunkReader( const ChunkReader& );
+		ChunkReader& operator=( const ChunkReader& );
+};
+
+};
+
+#endif  // H2C_CHUNK_FILE_H
+
+/* vim: set softtabstop=4 expandtab: */
@@ -0,0 +1,113 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef H2C_DRUMKIT_INDEX_H
+#define H2C_DRUMKIT_INDEX_H
+
+#include <map>
+#include <vector>
+
+#include <QtCore/QStringList>
+
+#include <hydrogen/object.h>
+
+namespace H2Core
+{
+
+/**
+ * DrumkitIndex keeps what the sound library menus show about the installed drumkits
+ * in Filesystem::drumkit_index_file(), so listing them does not parse every drumkit.xml.
+ * An entry is read again once the modification time of its directory or of its drumkit.xml changes.
+ * It is meant to be used from the GUI thread.
+ */
+class DrumkitIndex : public H2Core::Object
+{
+		H2_OBJECT
+	public:
+		/** a drumkit component as listed in the index */
+		struct Component {
+			int id;                         ///< component id
+			QString name;                   ///< component name
+			float volume;                   ///< component volume
+		};
+
+		/** the description of a drumkit */
+		struct Entry {
+			QString path;                   ///< the drumkit directory
+			qint64 timestamp;               ///< the modification time the entry has been read at, in ms
+			QString name;                   ///< drumkit name
+			QString author;                 ///< drumkit author
+			QString info;                   ///< drumkit free text
+			QString license;                ///< drumkit license
+			QString image;                  ///< drumkit image filename
+			QString image_license;          ///< drumkit image license
+			QStringList instruments;        ///< the instrument names, in the drumkit order
+			std::vector<Component> components;  ///< the drumkit components
+		};
+		typedef std::vector<Entry> Entries;
+
+		/** return the entries of the system drumkits, see Filesystem::sys_drumkits_list() */
+		static Entries sys_drumkits();
+		/** return the entries of the user drumkits, see Filesystem::usr_drumkits_list() */
+		static Entries usr_drumkits();
+		/**
+		 * get the entry of a drumkit directory
+		 * \param dk_path the drumkit directory
+		 * \param entry receives the entry
+		 * \return false if the drumkit can't be read
+		 */
+		static bool get( const QString& dk_path, Entry* entry );
+		/**
+		 * find a drumkit by name, user drumkits first
+		 * \param dk_name the drumkit name, as in its drumkit.xml
+		 * \param entry receives the entry
+		 * \return false if no drumkit has that name
+		 */
+		static bool find( const QString& dk_name, Entry* entry );
+
+	private:
+		typedef std::map<QString, Entry> Index;
+		static Index __index;               ///< the entries, by drumkit directory
+		static bool __loaded;               ///< true once the index file has been read
+		static bool __dirty;                ///< true if the index file has to be written
+
+		/**
+		 * list the drumkits of a directory, reading the ones which changed
+		 * \param dir the drumkits directory
+		 * \param names the usable drumkit directories within dir
+		 */
+		static Entries __list( const QString& dir, const QStringList& names );
+		/** bring the entry of a drumkit directory up to date, return 0 if the drumkit can't be read */
+		static const Entry* __update( const QString& dk_path );
+		/** return the modification time of a drumkit, -1 if it has no drumkit.xml */
+		static qint64 __timestamp( const QString& dk_path );
+		/** read the index file */
+		static void __load();
+		/** write the index file if it changed */
+		static void __save();
+};
+
+};
+
+#endif  // H2C_DRUMKIT_INDEX_H
+
+/* vim: set softtabstop=4 expandtab: */
@@ -0,0 +1,102 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef H2C_LAYER_LOADER_H
+#define H2C_LAYER_LOADER_H
+
+#include <atomic>
+#include <vector>
+#include <pthread.h>
+
+#include <hydrogen/object.h>
+
+namespace H2Core
+{
+
+class Song;
+class Sample;
+
+/**
+ * LayerLoader fills the layers of the song instruments whose samples were created
+ * without data, see Preferences::m_bLazyLayerLoading.
+ * The files of layers reached by the velocity of a song note are loaded first.
+ * Until a layer is loaded the sampler plays the closest loaded layer instead,
+ * see InstrumentComponent::get_nearest_loaded_layer().
+ */
+class LayerLoader : public H2Core::Object
+{
+		H2_OBJECT
+	public:
+		/** constructor */
+		LayerLoader();
+		/** destructor, stops the loading thread */
+		~LayerLoader();
+
+		/**
+		 * start loading the missing layers of a song in the background, a running load is stopped first.
+		 * the song must not be deleted before stop() is called
+		 * \param song the song to load the layers of
+		 */
+		void start( Song* song );
+		/** stop loading, the layers not loaded yet stay empty */
+		void stop();
+		/** wait until all the layers are loaded */
+		void wait();
+		/** return true while layers are being loaded */
+		bool is_running() const;
+
+		/**
+		 * list the files of the layers having no sample data
+		 * \param song the song to look into
+		 * \return the file paths, the ones reached by a song note velocity first
+		 */
+		static std::vector<QString> schedule( Song* song );
+		/**
+		 * give the data of a loaded sample to the empty samples of the same file, the audio engine must be locked
+		 * \param song the song to look into
+		 * \param loaded a sample holding pooled data
+		 * \return the number of samples filled
+		 */
+		static int fill( Song* song, Sample* loaded );
+
+	private:
+		Song* __song;                       ///< the song being loaded
+		std::vector<QString> __files;       ///< the files to load, in priority order
+		std::atomic<bool> __abort;          ///< set to stop the loading thread
+		std::atomic<bool> __running;        ///< true until the loading thread is done
+		pthread_t __thread;                 ///< the loading thread
+		bool __thread_started;              ///< true if __thread has to be joined
+
+		/** the loading thread main loop */
+		static void* loader_thread( void* param );
+};
+
+inline bool LayerLoader::is_running() const
+{
+	return __running.load();
+}
+
+};
+
+#endif  // H2C_LAYER_LOADER_H
+
+/* vim: set softtabstop=4 expandtab: */
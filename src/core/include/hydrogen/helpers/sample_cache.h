@@ -0,0 +1,109 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef H2C_SAMPLE_CACHE_H
+#define H2C_SAMPLE_CACHE_H
+
+#include <atomic>
+
+#include <hydrogen/object.h>
+
+class QFile;
+
+namespace H2Core
+{
+
+/**
+ * SampleCache keeps decoded samples under Filesystem::samples_cache_dir()
+ * as page aligned planar float files which are mapped read only,
+ * so loading a sample again skips the decoding and processes share the pages.
+ * Entries are keyed by the canonical path, modification time and size of the source file
+ * and by the decoding parameters, so edited files are decoded again.
+ * Processed data, such as time-stretched samples, is stored beside the decoded data
+ * under a description of the processing.
+ */
+class SampleCache : public H2Core::Object
+{
+		H2_OBJECT
+	public:
+		/**
+		 * enable or disable the cache, disabled by default
+		 * \param enabled the new state
+		 * \param size_limit the size in MB the cache is pruned down to, 0 for no limit
+		 */
+		static void set_enabled( bool enabled, int size_limit );
+		/** return true if the cache is enabled */
+		static bool is_enabled();
+		/**
+		 * map the decoded data of a sample file
+		 * \param filepath the sample file
+		 * \param frames set to the number of frames
+		 * \param sample_rate set to the sample rate
+		 * \param data_l set to the left channel data
+		 * \param data_r set to the right channel data, equal to data_l for a mono sample
+		 * \param processing the processing applied to the decoded data, empty for none
+		 * \return the mapped cache file, which has to be deleted to unmap the data, 0 if not cached
+		 */
+		static QFile* map( const QString& filepath, int* frames, int* sample_rate, float** data_l, float** data_r,
+						   const QString& processing=QString() );
+		/**
+		 * store the decoded data of a sample file
+		 * \param filepath the sample file
+		 * \param frames the number of frames
+		 * \param sample_rate the sample rate
+		 * \param data_l the left channel data
+		 * \param data_r the right channel data, data_l for a mono sample which is then stored once
+		 * \param processing the processing applied to the decoded data, empty for none
+		 * \return true on success
+		 */
+		static bool store( const QString& filepath, int frames, int sample_rate, const float* data_l, const float* data_r,
+						   const QString& processing=QString() );
+		/**
+		 * start a batch of stores, such as the samples of a drumkit,
+		 * the cache is pruned once when the last started batch ends instead of after each store
+		 */
+		static void begin_batch();
+		/** end a batch started with begin_batch() */
+		static void end_batch();
+		/** remove all cached samples */
+		static void clear();
+
+	private:
+		static std::atomic<bool> __enabled;     ///< is the cache used
+		static std::atomic<int> __size_limit;   ///< size in MB, 0 for no limit
+		static std::atomic<qint64> __total;     ///< running size of the cache files in bytes, -1 until the directory is scanned
+		static std::atomic<int> __batches;      ///< number of batches in progress
+		/** return the cache key of a sample file and its processing, empty if the file can't be read */
+		static QString key( const QString& filepath, const QString& processing );
+		/** return the cache file path of a key */
+		static QString cache_path( const QString& key );
+		/** return true if __total is known and above __size_limit */
+		static bool over_limit();
+		/** scan the cache directory and remove the oldest cache files until the cache fits in __size_limit */
+		static void prune();
+};
+
+};
+
+#endif  // H2C_SAMPLE_CACHE_H
+
+/* vim: set softtabstop=4 expandtab: */
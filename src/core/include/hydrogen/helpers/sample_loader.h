@@ -0,0 +1,86 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef H2C_SAMPLE_LOADER_H
+#define H2C_SAMPLE_LOADER_H
+
+#include <atomic>
+#include <vector>
+
+#include <hydrogen/object.h>
+
+#define MAX_LOADER_THREADS  8   ///< upper bound of the threads a SampleLoader runs
+
+namespace H2Core
+{
+
+class Sample;
+
+/**
+ * SampleLoader loads the data of a batch of samples with a bounded set of threads,
+ * so the file reads of some samples overlap the decoding of others.
+ * Samples are loaded in place, the caller keeps them in its own order.
+ */
+class SampleLoader : public H2Core::Object
+{
+		H2_OBJECT
+	public:
+		/**
+		 * constructor
+		 * \param threads the number of loading threads, 0 for one per core up to MAX_LOADER_THREADS
+		 */
+		SampleLoader( int threads=0 );
+
+		/**
+		 * queue a sample, see Sample::load()
+		 * \param sample a sample knowing its file path, not owned by the loader
+		 */
+		void add( Sample* sample );
+		/** return the number of queued samples */
+		int size() const;
+		/**
+		 * load the queued samples and return once they all are loaded
+		 * \param progress push EVENT_PROGRESS events going from 0 to 100
+		 */
+		void run( bool progress );
+
+	private:
+		int __threads;                      ///< loading threads to use
+		std::vector<Sample*> __samples;     ///< all the queued samples
+		std::vector<Sample*> __unique;      ///< the first sample queued for each file, loaded by the threads
+		std::atomic<int> __next;            ///< index of the next __unique sample to load
+		std::atomic<int> __done;            ///< number of __unique samples loaded
+
+		/** the loading threads main loop */
+		static void* loader_thread( void* param );
+};
+
+inline int SampleLoader::size() const
+{
+	return __samples.size();
+}
+
+};
+
+#endif  // H2C_SAMPLE_LOADER_H
+
+/* vim: set softtabstop=4 expandtab: */
@@ -0,0 +1,96 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef H2C_SAMPLE_PACKER_H
+#define H2C_SAMPLE_PACKER_H
+
+#include <hydrogen/object.h>
+
+namespace H2Core
+{
+
+class Sample;
+
+/**
+ * SamplePacker converts sample data between float and the compact formats
+ * a Sample can be held in, see Sample::compact().
+ * The sampler converts the frames each voice needs within a cycle,
+ * so the conversion loops are kept simple enough to be vectorized by the compiler.
+ */
+class SamplePacker : public H2Core::Object
+{
+		H2_OBJECT
+	public:
+		/** in memory formats of the sample data */
+		enum Format {
+			FLOAT=0,    ///< 32 bits float, no conversion
+			INT16,      ///< 16 bits signed integer, lossless for 8 and 16 bits files
+			INT24,      ///< 24 bits signed integer, lossless for 24 bits files
+			HALF        ///< 16 bits float, about 11 bits of precision
+		};
+
+		/** return the number of bytes a frame of one channel takes */
+		static int bytes_per_frame( Format format );
+		/**
+		 * convert float data into a new compact array
+		 * \param format the compact format
+		 * \param data the float data
+		 * \param frames the number of frames to convert
+		 * \return an array allocated with new[]
+		 */
+		static char* pack( Format format, const float* data, int frames );
+		/**
+		 * convert compact data to float
+		 * \param format the format of packed
+		 * \param packed the compact array
+		 * \param first the first frame to convert
+		 * \param count the number of frames to convert
+		 * \param data receives count float frames
+		 */
+		static void unpack( Format format, const char* packed, int first, int count, float* data );
+
+		/**
+		 * the format matching the sample depth of a file, FLOAT if it has no integer depth or can't be read
+		 * \param filepath the sample file
+		 */
+		static Format native_format( const QString& filepath );
+		/**
+		 * parse a storage setting
+		 * \param storage one of "float", "native" or "half"
+		 * \param filepath the sample file, used by "native"
+		 */
+		static Format parse( const QString& storage, const QString& filepath );
+
+		/**
+		 * compact a sample as set up by the preferences or by its drumkit
+		 * \param sample the sample to compact
+		 * \param kit_storage the storage of the drumkit, empty to use Preferences::m_sSampleStorage
+		 * \return true if the sample has been compacted
+		 */
+		static bool apply_policy( Sample* sample, const QString& kit_storage );
+};
+
+};
+
+#endif  // H2C_SAMPLE_PACKER_H
+
+/* vim: set softtabstop=4 expandtab: */
@@ -0,0 +1,119 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef H2C_SAMPLE_STRETCHER_H
+#define H2C_SAMPLE_STRETCHER_H
+
+#include <atomic>
+#include <list>
+#include <vector>
+
+#include <QMutex>
+
+#include <hydrogen/object.h>
+#include <hydrogen/basics/sample.h>
+
+namespace H2Core
+{
+
+class Song;
+class InstrumentLayer;
+
+/**
+ * SampleStretcher fits the rubberband samples of a song to a tempo.
+ * The samples are stretched on a pool of threads, then swapped into their layers at once.
+ * The stretched data is pooled under a key made of the file, the tempo and the rubberband
+ * parameters, see Sample::load(). The samples of the last tempos are kept referenced so
+ * going back to one of them only swaps the samples, and with the SampleCache enabled the
+ * stretched data is also found on disk by later runs.
+ */
+class SampleStretcher : public H2Core::Object
+{
+		H2_OBJECT
+	public:
+		/**
+		 * constructor
+		 * \param kept_tempos the number of tempos whose samples are kept in memory
+		 */
+		SampleStretcher( int kept_tempos=8 );
+		/** destructor, drops the kept samples */
+		~SampleStretcher();
+
+		/**
+		 * stretch the rubberband samples of a song to a tempo and put them in their layers,
+		 * returns once they are all in place. Takes the AudioEngine lock to swap the samples,
+		 * so the caller must not hold it.
+		 * \param song the song to stretch the samples of
+		 * \param bpm the tempo
+		 * \param threads the number of threads, 0 for one per CPU
+		 * \return the number of samples replaced
+		 */
+		int stretch( Song* song, float bpm, int threads=0 );
+		/** drop the samples kept for the previous tempos */
+		void clear();
+		/** return the number of tempos whose samples are kept */
+		int get_kept_tempos() const;
+
+	private:
+		/** a layer to stretch, the parameters are copied so the threads don't read the song */
+		struct Job {
+			InstrumentLayer* layer;
+			QString filepath;
+			Sample::Loops loops;
+			Sample::Rubberband rubberband;
+			Sample::VelocityEnvelope velocity;
+			Sample::PanEnvelope pan;
+			Sample* result;
+		};
+		/** the samples of a tempo */
+		struct Tempo {
+			float bpm;
+			std::vector<Sample*> samples;
+		};
+
+		int __kept_tempos;                  ///< the most tempos kept in __tempos
+		std::list<Tempo> __tempos;          ///< kept samples, the last tempo used first
+		Song* __song;                       ///< the song the kept samples belong to
+		QMutex __mutex;                     ///< one stretch at a time
+
+		std::vector<Job> __jobs;            ///< the layers being stretched
+		float __bpm;                        ///< the tempo being stretched to
+		std::atomic<int> __next_job;        ///< next job for a worker
+
+		/** drop the kept samples, __mutex must be locked */
+		void __clear();
+		/** keep the samples of a tempo, dropping the oldest tempo if needed */
+		void __keep( float bpm, const std::vector<Sample*>& samples );
+		/** a worker thread */
+		static void* worker_thread( void* param );
+};
+
+inline int SampleStretcher::get_kept_tempos() const
+{
+	return __tempos.size();
+}
+
+};
+
+#endif  // H2C_SAMPLE_STRETCHER_H
+
+/* vim: set softtabstop=4 expandtab: */
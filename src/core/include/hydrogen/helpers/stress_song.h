@@ -0,0 +1,118 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef H2C_STRESS_SONG_H
+#define H2C_STRESS_SONG_H
+
+#include <hydrogen/object.h>
+
+namespace H2Core
+{
+
+class Song;
+class Sample;
+class Timeline;
+
+/**
+ * StressSong builds synthetic songs in memory to put a known,
+ * reproducible load on the sampler and the note scheduler,
+ * and runs them through the audio engine for soak tests.
+ */
+class StressSong : public H2Core::Object
+{
+		H2_OBJECT
+	public:
+		/** parameters of the generated song */
+		struct Options
+		{
+			Options();
+			int		m_nInstruments;		///< number of instruments
+			int		m_nLayers;			///< velocity layers per component (1..MAX_LAYERS)
+			int		m_nComponents;		///< drumkit components
+			int		m_nSampleFrames;	///< length of each synthetic sample
+			int		m_nSampleRate;		///< sample rate of the synthetic samples
+			int		m_nPatterns;		///< number of plain patterns
+			int		m_nVirtualPatterns;	///< number of virtual patterns built on top of the plain ones
+			int		m_nPatternLength;	///< pattern length in ticks
+			int		m_nStep;			///< grid used to place notes, in ticks
+			int		m_nColumns;			///< number of pattern groups in the song sequence
+			int		m_nPatternsPerColumn;	///< patterns played together in each column
+			float	m_fNoteDensity;		///< probability of a note on each step of each instrument (0..1)
+			float	m_fBpm;				///< song tempo
+			float	m_fHumanizeTime;	///< song humanize time value (0..1)
+			float	m_fHumanizeVelocity;	///< song humanize velocity value (0..1)
+			float	m_fSwing;			///< song swing factor (0..1)
+			float	m_fLeadLag;			///< max absolute lead/lag of the notes (0..1)
+			int		m_nTempoChanges;	///< number of timeline tempo markers
+			bool	m_bMixedSelection;	///< cycle instruments through all sample selection algorithms
+			bool	m_bFilters;			///< enable the instrument filter on every other instrument
+			unsigned m_nSeed;			///< seed of the generator, same seed same song
+		};
+
+		/** figures collected during a soak run */
+		struct Report
+		{
+			Report();
+			unsigned long	m_nCycles;			///< process cycles run
+			unsigned long	m_nFrames;			///< frames rendered
+			float			m_fMaxProcessTime;	///< worst process time (ms)
+			float			m_fAvgProcessTime;	///< average process time (ms)
+			float			m_fBudget;			///< time available per cycle (ms)
+			unsigned long	m_nOverruns;		///< cycles where the process time exceeded the budget
+			int				m_nMaxPlayingNotes;	///< max sampler polyphony
+			int				m_nMaxQueuedNotes;	///< max depth of the song note queue
+			long			m_nMemoryStart;		///< resident memory at start (bytes, 0 if unknown)
+			long			m_nMemoryEnd;		///< resident memory at end (bytes, 0 if unknown)
+		};
+
+		/**
+		 * build a new song out of the given options
+		 * \param options the song parameters
+		 * \return a new Song, owned by the caller
+		 */
+		static Song* generate( const Options& options );
+		/**
+		 * fill the timeline with the tempo markers described by the options
+		 * \param timeline the timeline to fill, previous markers are dropped
+		 * \param options the song parameters
+		 */
+		static void fill_timeline( Timeline* timeline, const Options& options );
+		/**
+		 * play the current song of the Hydrogen instance through the Fake audio driver
+		 * \param seconds the amount of audio to render
+		 * \param report the figures collected during the run
+		 * \return false if the Fake driver is not in use or no song is set
+		 */
+		static bool soak( float seconds, Report* report );
+		/** return the resident memory of the process in bytes, 0 if not available */
+		static long resident_memory();
+
+	private:
+		/** build a decaying sine sample */
+		static Sample* synth_sample( const QString& name, int frames, int sample_rate, float freq );
+};
+
+};
+
+#endif  // H2C_STRESS_SONG_H
+
+/* vim: set softtabstop=4 expandtab: */
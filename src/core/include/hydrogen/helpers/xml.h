@@ -2,13 +2,19 @@
 #ifndef H2C_XML_H
 #define H2C_XML_H
 
+#include <vector>
+
 #include <hydrogen/object.h>
+#include <QtCore/QFile>
 #include <QtCore/QString>
+#include <QtCore/QXmlStreamReader>
 #include <QtXml/QDomDocument>
 
 namespace H2Core
 {
 
+class XMLRecord;
+
 /**
  * XMLNode is a subclass of QDomNode with read and write values methods
 */
@@ -53,6 +59,11 @@ class XMLNode : public H2Core::Object, public QDomNode
 		 * \param empty_ok if set to false output a DEBUG log lline if the child node is empty
 		 */
 		QString read_string( const QString& node, const QString& default_value, bool inexistent_ok=true, bool empty_ok=true );
+		/**
+		 * store the text of each child element into record, as XMLStreamReader::read_record() does,
+		 * so that both readers can share the loaders taking an XMLRecord
+		 */
+		void read_record( XMLRecord* record );
 
 		/**
 		 * write an integer into a child node
@@ -122,6 +133,70 @@ class XMLDoc : public H2Core::Object, public QDomDocument
 		void set_root( const QString& node_name, const QString& xmlns );
 };
 
+/**
+ * XMLRecord holds the text of the child elements of an element read by XMLStreamReader,
+ * its read methods return what the XMLNode ones return for the same element
+*/
+class XMLRecord
+{
+	public:
+		/** forget the stored values, keeping the storage */
+		void clear();
+		/** store the text of a child element, only the first child of a given name is kept */
+		void add( const QString& node, const QString& text );
+		/** return true if a child element of that name has been stored */
+		bool has( const QString& node ) const;
+		/** see XMLNode::read_int() */
+		int read_int( const QString& node, int default_value, bool inexistent_ok=true, bool empty_ok=true ) const;
+		/** see XMLNode::read_bool() */
+		bool read_bool( const QString& node, bool default_value, bool inexistent_ok=true, bool empty_ok=true ) const;
+		/** see XMLNode::read_float() */
+		float read_float( const QString& node, float default_value, bool inexistent_ok=true, bool empty_ok=true ) const;
+		/** see XMLNode::read_string() */
+		QString read_string( const QString& node, const QString& default_value, bool inexistent_ok=true, bool empty_ok=true ) const;
+	private:
+		std::vector< std::pair<QString, QString> > __values;
+		/** return the stored text, a null string if the node is missing or empty */
+		QString read_child_node( const QString& node, bool inexistent_ok, bool empty_ok ) const;
+};
+
+/**
+ * XMLStreamReader is a subclass of QXmlStreamReader which reads a file in one pass,
+ * without building the document tree XMLDoc keeps.
+ * TinyXML files are converted on the fly, see LocalFileMng::openXmlDocument().
+ *
+ * Loaders walk the elements with readNextStartElement(), and gather
+ * the leaves of an element with read_record().
+*/
+class XMLStreamReader : public H2Core::Object, public QXmlStreamReader
+{
+		H2_OBJECT
+	public:
+		/** basic constructor */
+		XMLStreamReader( );
+		~XMLStreamReader();
+		/**
+		 * open an xml file and move to its root element
+		 * \param filepath the path to the file to read from
+		 * \param root_name the expected name of the root element
+		 * \param xmlns if not empty, the xml namespace suffix the root element must declare after XMLNS_BASE
+		 * \return false if the file can't be read or the root element doesn't match
+		 */
+		bool open( const QString& filepath, const QString& root_name, const QString& xmlns="" );
+		/** read the text of the current element and of its descendants, as QDomElement::text() does */
+		QString read_text();
+		/**
+		 * store the text of each child element of the current element into record,
+		 * leaving the reader at the end of the current element
+		 */
+		void read_record( XMLRecord* record );
+		/** return false and log the error if the document turned out to be malformed */
+		bool check();
+	private:
+		QFile __file;               ///< the file being read
+		QByteArray __buffer;        ///< the converted content of a TinyXML file
+};
+
 };
 
 #endif  // H2C_XML_H
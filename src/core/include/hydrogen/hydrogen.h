@@ -35,6 +35,7 @@
 #include <hydrogen/basics/drumkit.h>
 #include <cassert>
 #include <hydrogen/timehelper.h>
+#include <QStringList>
 
 // Engine states  (It's ok to use ==, <, and > when testing)
 #define STATE_UNINITIALIZED	1     // Not even the constructors have been called.
@@ -116,7 +117,7 @@ public:
 
 	int				getPatternPos();
 	void			setPatternPos( int pos );
-	int				getPosForTick( unsigned long TickPos );
+	int				getPosForTick( unsigned long TickPos, int* pPatternTick = NULL );
 
 	void			triggerRelocateDuringPlay();
 
@@ -124,7 +125,11 @@ public:
 
 	void			restartDrivers();
 
-	void			startExportSong( const QString& filename, int rate, int depth  );
+	/**
+	 * export the song through the disk writer driver, the same render is encoded into every file.
+	 * With more than one channel pair, the pairs routed in the Preferences follow the main mix in the files.
+	 */
+	void			startExportSong( const QStringList& filenames, int rate, int depth, int nChannelPairs = 1 );
 	void			stopExportSong( bool reconnectOldDriver );
 
 	AudioOutput*	getAudioOutput();
@@ -135,10 +140,34 @@ public:
 
 	float			getProcessTime();
 	float			getMaxProcessTime();
+	/// number of notes waiting in the song note queue
+	int				getSongNoteQueueSize();
 
 	int			loadDrumkit( Drumkit *pDrumkitInfo );
 	int			loadDrumkit( Drumkit *pDrumkitInfo, bool conditional );
 
+	/// when a drumkit loaded by loadDrumkitAsync() replaces the current one
+	enum DrumkitSwitch {
+		SWITCH_NOW,				///< as soon as it is loaded
+		SWITCH_NEXT_BAR,		///< on the first bar starting once it is loaded
+		SWITCH_NEXT_PATTERN		///< on the first pattern starting once it is loaded
+	};
+	/// load a drumkit in the background while the current one keeps playing.
+	/// The instruments data is switched by the audio thread at the chosen boundary,
+	/// or right away when the transport is stopped, the playing notes end on the previous data.
+	/// EVENT_DRUMKIT_LOADED is pushed once the switch is done, its handler has to call finishDrumkitLoad().
+	/// \param pDrumkitInfo the drumkit to load, copied so the caller keeps it
+	/// \param switchAt when to switch
+	/// \param conditional keep the instruments beyond the new kit which have notes
+	/// \return false if a drumkit is already being loaded in the background
+	bool		loadDrumkitAsync( Drumkit *pDrumkitInfo, DrumkitSwitch switchAt, bool conditional = true );
+	/// true while a drumkit is being loaded in the background, until finishDrumkitLoad()
+	bool		isDrumkitLoading();
+	/// complete a switch done by loadDrumkitAsync(), on the thread handling EVENT_DRUMKIT_LOADED.
+	/// Instruments beyond the new kit are removed as loadDrumkit() does,
+	/// the previous instruments data is deleted once its notes ended.
+	void		finishDrumkitLoad();
+
 	//  Test if an instrument has notes in the pattern (used to test before deleting an insturment)
 	bool 			instrumentHasNotes( Instrument *pInst );
 
@@ -216,6 +245,12 @@ public:
 	long			getTickForHumanPosition( int humanpos );
 	float			getNewBpmJTM();
 	void			setNewBpmJTM( float bpmJTM);
+	/**
+	 * fit the rubberband samples of the song to a tempo, see SampleStretcher.
+	 * the AudioEngine must not be locked by the caller
+	 * \return the number of samples replaced
+	 */
+	int				stretchRubberbandSamples( float fBpm );
 	void			ComputeHumantimeFrames(uint32_t nFrames);
 
 	void			__panic();
@@ -223,8 +258,19 @@ public:
 	unsigned int	__getMidiRealtimeNoteTickPosition();
 
 	void			setTimelineBpm();
-	float			getTimelineBpm( int Beat );
+	/**
+	 * return the tempo of the timeline at a position, the last tempo marker
+	 * at or before it, or the song tempo if the timeline is not used
+	 * \param Beat the pattern group
+	 * \param Tick the tick within the pattern group
+	 */
+	float			getTimelineBpm( int Beat, int Tick = 0 );
 	Timeline*		getTimeline() const;
+	/**
+	 * rebuild the tempo map the JACK timebase master reports, outside of the process cycle,
+	 * to be called once the timeline or the pattern groups of the song changed
+	 */
+	void			updateTempoMap();
 
 	///midi lookuptable
 	int m_nInstrumentLookupTable[MAX_INSTRUMENTS];
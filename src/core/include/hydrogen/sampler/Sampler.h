@@ -42,6 +42,7 @@ class Instrument;
 struct SelectedLayerInfo;
 class InstrumentComponent;
 class AudioOutput;
+class SampleStreamer;
 
 ///
 /// Waveform based sampler.
@@ -53,7 +54,12 @@ public:
 	float *__main_out_L;	///< sampler main out (left channel)
 	float *__main_out_R;	///< sampler main out (right channel)
 
-	Sampler();
+	/**
+	 * \param pOutput the output giving the transport position and the sample rate of an offline render,
+	 * NULL to follow the audio driver of the Hydrogen instance.
+	 * an offline sampler neither sends MIDI nor feeds the LADSPA effects.
+	 */
+	Sampler( AudioOutput* pOutput = NULL );
 	~Sampler();
 
 	void process( uint32_t nFrames, Song* pSong );
@@ -66,6 +72,9 @@ public:
 	void midi_keyboard_note_off( int key );
 
 	void stop_playing_notes( Instrument *instr = NULL );
+	/// Move the notes playing an instrument to another one holding the data they started with,
+	/// so they end on it while the instrument plays new data.
+	void retire_notes( Instrument *instr, Instrument *retired );
 
 	int get_playing_notes_number() {
 		return __playing_notes_queue.size();
@@ -77,6 +86,9 @@ public:
 	void setPlayingNotelength( Instrument* instrument, unsigned long ticks, unsigned long noteOnTick );
 	bool is_instrument_playing( Instrument* pInstr );
 
+	/// Streams the samples too large to stay in memory, NULL for an offline render or until a sample is streamed.
+	SampleStreamer* get_streamer();
+
 		enum InterpolateMode { LINEAR,
 							   COSINE,
 							   THIRD,
@@ -90,13 +102,22 @@ public:
 		InterpolateMode getInterpolateMode(){ return __interpolateMode; }
 
 private:
+	AudioOutput* __output;		///< the clock of an offline render, NULL for the audio driver
 	std::vector<Note*> __playing_notes_queue;
 	std::vector<Note*> __queuedNoteOffs;
 
 	/// Instrument used for the preview feature.
 	Instrument* __preview_instrument;
 
+	float *__voice_buffer_L;	///< enveloped frames of the voice being rendered (left channel)
+	float *__voice_buffer_R;	///< enveloped frames of the voice being rendered (right channel)
+
+	float *__stream_window_L;	///< frames of a streamed sample gathered for the voice being rendered (left channel)
+	float *__stream_window_R;	///< frames of a streamed sample gathered for the voice being rendered (right channel)
+
 	bool __render_note( Note* pNote, unsigned nBufferSize, Song* pSong );
+	/// Return the output driving the sampler.
+	AudioOutput* __get_output() const;
 
 		InterpolateMode __interpolateMode;
 
@@ -200,6 +221,42 @@ private:
 				return( a0 * mu * mu2 + a1 * mu2 + a2 * mu + a3 );
 		};
 
+		/// Interpolate one channel of the sample data between nSamplePos and nSamplePos + 1.
+		inline float __interpolate( const float* pData, int nSamplePos, double fDiff, int nSampleFrames ) const
+		{
+				// some interpolation methods need 4 frames data.
+				float last = ( ( nSamplePos + 2 ) >= nSampleFrames ) ? 0.0 : pData[nSamplePos + 2];
+
+				switch( __interpolateMode ){
+
+				case LINEAR:
+						return pData[nSamplePos] * (1 - fDiff ) + pData[nSamplePos + 1] * fDiff;
+				case COSINE:
+						return cosine_Interpolate( pData[nSamplePos], pData[nSamplePos + 1], fDiff);
+				case THIRD:
+						return third_Interpolate( pData[ nSamplePos -1], pData[nSamplePos], pData[nSamplePos + 1], last, fDiff);
+				case CUBIC:
+						return cubic_Interpolate( pData[ nSamplePos -1], pData[nSamplePos], pData[nSamplePos + 1], last, fDiff);
+				case HERMITE:
+						return hermite_Interpolate( pData[ nSamplePos -1], pData[nSamplePos], pData[nSamplePos + 1], last, fDiff);
+				}
+				return 0.0;
+		};
+
+	/**
+	 * get the data of the sample frames [nFirst, nLast) as arrays indexed by sample frame.
+	 * streamed samples get their frames gathered from memory and from the voice stream.
+	 * both arrays are the same for a mono sample.
+	 */
+	void __get_sample_data(
+		Sample *pSample,
+		SelectedLayerInfo *pSelectedLayerInfo,
+		int nFirst,
+		int nLast,
+		float **ppData_L,
+		float **ppData_R
+	);
+
 	bool __render_note_no_resample(
 		Sample *pSample,
 		Note *pNote,
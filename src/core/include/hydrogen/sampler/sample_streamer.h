@@ -0,0 +1,176 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef H2C_SAMPLE_STREAMER_H
+#define H2C_SAMPLE_STREAMER_H
+
+#include <atomic>
+#include <vector>
+#include <pthread.h>
+#include <sndfile.h>
+
+#include <QMutex>
+
+#include <hydrogen/object.h>
+
+#define STREAM_SLOTS            32      ///< voices able to stream from disk at the same time
+#define STREAM_RING_FRAMES      32768   ///< frames buffered ahead of a streaming voice, must be a power of 2
+#define STREAM_CHUNK_FRAMES     4096    ///< frames read from disk at once
+
+namespace H2Core
+{
+
+class Sample;
+class SampleStreamer;
+
+/**
+ * the disk side of a voice playing a streamed sample,
+ * a ring buffer filled by the SampleStreamer thread and drained by the sampler
+ */
+class SampleStream
+{
+	public:
+		/**
+		 * copy frames of the sample out of the ring buffer,
+		 * frames not read from disk yet are replaced by silence.
+		 * must only be called by the audio thread
+		 * \param frame the first frame to copy
+		 * \param nframes the number of frames to copy
+		 * \param dst_l the left channel destination
+		 * \param dst_r the right channel destination
+		 * \return the number of frames missing
+		 */
+		int read( int frame, int nframes, float* dst_l, float* dst_r );
+		/**
+		 * tell the reader the frames before frame won't be needed anymore
+		 * \param frame the first frame still needed
+		 */
+		void consume( int frame );
+		/** hand the stream back to the streamer, the voice must not use it anymore */
+		void release();
+
+	private:
+		friend class SampleStreamer;
+		/** slot states */
+		enum State {
+			FREE=0,         ///< available for a new voice
+			CLAIMED,        ///< taken by the audio thread, being set up
+			STARTING,       ///< waiting for the reader thread to open the file
+			RUNNING,        ///< being filled by the reader thread
+			RELEASED        ///< waiting for the reader thread to close the file
+		};
+		SampleStream();
+		~SampleStream();
+
+		std::atomic<int> __state;       ///< one of State
+		std::atomic<int> __start;       ///< first frame held by the ring, written by the audio thread
+		std::atomic<int> __end;         ///< frame after the last one held by the ring, written by the reader thread
+		QString __filepath;             ///< file to stream from
+		int __frames;                   ///< frames of the sample
+		SNDFILE* __file;                ///< opened by the reader thread
+		int __channels;                 ///< channels of __file
+		int __file_pos;                 ///< next frame sf_readf_float() will return
+		float* __ring_l;                ///< left channel ring buffer
+		float* __ring_r;                ///< right channel ring buffer
+};
+
+/**
+ * SampleStreamer owns the streams of the voices playing streamed samples
+ * and runs the thread reading their frames from disk
+ */
+class SampleStreamer : public H2Core::Object
+{
+		H2_OBJECT
+	public:
+		/** constructor, starts the reader thread */
+		SampleStreamer();
+		/** destructor, stops the reader thread and closes all files */
+		~SampleStreamer();
+
+		/**
+		 * get a stream for a voice, never blocks.
+		 * must only be called by the audio thread
+		 * \param sample the streamed sample to play
+		 * \param frame the first frame to read from disk
+		 * \return the stream or NULL if all slots are in use
+		 */
+		SampleStream* acquire( Sample* sample, int frame );
+		/** count frames played as silence because they were not read from disk in time */
+		void add_underruns( int frames );
+		/** return the number of frames played as silence so far */
+		int get_underruns() const;
+
+		/**
+		 * keep only the beginning of a sample in memory if the streaming policy says so,
+		 * the shared streamer is started along with the first streamed sample
+		 * \param sample a freshly loaded sample, not played yet
+		 * \param force stream whatever the sample size, see Instrument::get_disk_streaming()
+		 * \return true if the sample is now streamed
+		 */
+		static bool apply_policy( Sample* sample, bool force );
+
+		/** return the streamer of the live sampler, NULL until a sample is streamed. Safe from the audio thread */
+		static SampleStreamer* get_shared();
+		/** stop and free the shared streamer, once no voice plays anymore */
+		static void destroy_shared();
+
+	private:
+		static std::atomic<SampleStreamer*> __shared;	///< see get_shared()
+		static QMutex __shared_mutex;			///< one thread starts the shared streamer
+
+		SampleStream __streams[STREAM_SLOTS];
+		std::vector<float> __read_buffer;       ///< interleaved frames read from disk
+		std::atomic<bool> __running;            ///< false to stop the reader thread
+		std::atomic<int> __underruns;           ///< see add_underruns()
+		pthread_t __thread;
+
+		/** the reader thread main loop */
+		static void* reader_thread( void* param );
+		/**
+		 * service a stream on the reader thread
+		 * \return true if frames were read from disk
+		 */
+		bool fill( SampleStream* stream );
+		/** close the file of a stream on the reader thread */
+		void close( SampleStream* stream );
+};
+
+inline void SampleStreamer::add_underruns( int frames )
+{
+	__underruns.fetch_add( frames, std::memory_order_relaxed );
+}
+
+inline int SampleStreamer::get_underruns() const
+{
+	return __underruns.load( std::memory_order_relaxed );
+}
+
+inline SampleStreamer* SampleStreamer::get_shared()
+{
+	return __shared.load( std::memory_order_acquire );
+}
+
+};
+
+#endif  // H2C_SAMPLE_STREAMER_H
+
+/* vim: set softtabstop=4 expandtab: */
@@ -42,6 +42,7 @@ namespace H2Core
 			struct HTimelineVector
 			{
 				int		m_htimelinebeat;		//beat position in timeline
+				int		m_htimelinetick;		//tick position in the beat, for a tempo change within a pattern
 				float	m_htimelinebpm;		//BPM
 			};
 
@@ -60,7 +61,8 @@ namespace H2Core
 			{
 				bool operator()( HTimelineVector const& lhs, HTimelineVector const& rhs)
 				{
-					return lhs.m_htimelinebeat < rhs.m_htimelinebeat;
+					return lhs.m_htimelinebeat < rhs.m_htimelinebeat
+						|| ( lhs.m_htimelinebeat == rhs.m_htimelinebeat && lhs.m_htimelinetick < rhs.m_htimelinetick );
 				}
 			};
 
@@ -25,7 +25,9 @@
 #ifdef H2CORE_HAVE_ALSA
 
 #include <pthread.h>
+#include <algorithm>
 #include <iostream>
+#include <vector>
 #include <hydrogen/Preferences.h>
 
 namespace H2Core
@@ -50,6 +52,51 @@ static int alsa_xrun_recovery( snd_pcm_t *handle, int err )
 	return err;
 }
 
+/// convert a period into the ring of the device, starting the device once the ring is full
+static int alsa_mmap_write( AlsaAudioDriver* pDriver, const std::vector<float*>& channels, std::vector<const float*>& offsets, snd_pcm_uframes_t nFrames )
+{
+	snd_pcm_t* handle = pDriver->m_pPlayback_handle;
+	int err;
+	snd_pcm_uframes_t nDone = 0;
+	while ( nDone < nFrames ) {
+		snd_pcm_sframes_t nAvail = snd_pcm_avail_update( handle );
+		if ( nAvail < 0 ) {
+			return nAvail;
+		}
+		if ( nAvail == 0 ) {
+			if ( snd_pcm_state( handle ) == SND_PCM_STATE_PREPARED && ( err = snd_pcm_start( handle ) ) < 0 ) {
+				return err;
+			}
+			if ( ( err = snd_pcm_wait( handle, 1000 ) ) < 0 ) {
+				return err;
+			}
+			continue;
+		}
+
+		const snd_pcm_channel_area_t* areas;
+		snd_pcm_uframes_t nOffset;
+		snd_pcm_uframes_t nCount = nFrames - nDone;
+		if ( ( err = snd_pcm_mmap_begin( handle, &areas, &nOffset, &nCount ) ) < 0 ) {
+			return err;
+		}
+		// the access is interleaved, the channels follow each other from the area of the first one
+		char* pOut = ( char* )areas[0].addr + areas[0].first / 8 + nOffset * ( areas[0].step / 8 );
+		for ( int c = 0; c < channels.size(); ++c ) {
+			offsets[ c ] = channels[ c ] + nDone;
+		}
+		PcmConverter::interleave( &offsets[0], channels.size(), nCount, pDriver->m_format, pOut );
+		snd_pcm_sframes_t nCommitted = snd_pcm_mmap_commit( handle, nOffset, nCount );
+		if ( nCommitted < 0 ) {
+			return nCommitted;
+		}
+		if ( ( snd_pcm_uframes_t )nCommitted != nCount ) {
+			return -EPIPE;
+		}
+		nDone += nCount;
+	}
+	return 0;
+}
+
 void* alsaAudioDriver_processCaller( void* param )
 {
 	Object *__object = (Object*)param;
@@ -74,20 +121,33 @@ void* alsaAudioDriver_processCaller( void* param )
 
 	int nFrames = pDriver->m_nBufferSize;
 // 	_INFOLOG( "nFrames: " + to_string( nFrames ) );
-	short pBuffer[ nFrames * 2 ];
+	int nChannels = pDriver->getChannels();
 
-	float *pOut_L = pDriver->m_pOut_L;
-	float *pOut_R = pDriver->m_pOut_R;
+	// the main mix and the channel pairs after it keep their buffers while connected
+	std::vector<float*> channels;
+	for ( int c = 0; c < nChannels; ++c ) {
+		channels.push_back( pDriver->getOut( c ) );
+	}
+	std::vector<const float*> offsets( channels.begin(), channels.end() );
+	void* pBuffer = pDriver->m_bMmap ? NULL : &pDriver->m_buffer[0];
 
 	while ( pDriver->m_bIsRunning ) {
 		// prepare the audio data
 		pDriver->m_processCallback( nFrames, NULL );
 
-		for ( int i = 0; i < nFrames; ++i ) {
-			pBuffer[ i * 2 ] = ( short )( pOut_L[ i ] * 32768.0 );
-			pBuffer[ i * 2 + 1 ] = ( short )( pOut_R[ i ] * 32768.0 );
+		if ( pDriver->m_bMmap ) {
+			if ( ( err = alsa_mmap_write( pDriver, channels, offsets, nFrames ) ) < 0 ) {
+				__ERRORLOG( "XRUN" );
+				if ( alsa_xrun_recovery( pDriver->m_pPlayback_handle, err ) < 0 ) {
+					__ERRORLOG( "Can't recovery from XRUN" );
+				}
+				pDriver->m_nXRuns++;
+			}
+			continue;
 		}
 
+		PcmConverter::interleave( &offsets[0], nChannels, nFrames, pDriver->m_format, pBuffer );
+
 		if ( ( err = snd_pcm_writei( pDriver->m_pPlayback_handle, pBuffer, nFrames ) ) < 0 ) {
 			__ERRORLOG( "XRUN" );
 
@@ -118,6 +178,8 @@ AlsaAudioDriver::AlsaAudioDriver( audioProcessCallback processCallback )
 		, m_pOut_R( NULL )
 		, m_nXRuns( 0 )
 		, m_nBufferSize( 0 )
+		, m_bMmap( false )
+		, m_format( PcmConverter::S16 )
 		, m_pPlayback_handle( NULL )
 		, m_processCallback( processCallback )
 {
@@ -147,8 +209,15 @@ int AlsaAudioDriver::init( unsigned nBufferSize )
 int AlsaAudioDriver::connect()
 {
 	INFOLOG( "alsa device: " + m_sAlsaAudioDevice );
-	int nChannels = 2;
-	int period_size = m_nBufferSize / 2;
+	Preferences* pPref = Preferences::get_instance();
+	int nPairs = std::max( 1, pPref->m_nOutputChannelPairs );
+	int nChannels = nPairs * 2;
+	snd_pcm_uframes_t period_size = pPref->m_nAlsaPeriodSize > 0 ? pPref->m_nAlsaPeriodSize : m_nBufferSize;
+	// the period becomes the engine buffer size, which can't exceed MAX_BUFFER_SIZE
+	if ( period_size > MAX_BUFFER_SIZE ) {
+		WARNINGLOG( QString( "ALSA: period size %1 exceeds %2, clamping" ).arg( period_size ).arg( MAX_BUFFER_SIZE ) );
+		period_size = MAX_BUFFER_SIZE;
+	}
 
 	int err;
 
@@ -183,67 +252,110 @@ int AlsaAudioDriver::connect()
 		ERRORLOG( QString( "error in snd_pcm_hw_params_any: %1" ).arg( QString::fromLocal8Bit(snd_strerror(err)) ) );
 		return 1;
 	}
-//	snd_pcm_hw_params_set_access( m_pPlayback_handle, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED  );
 
-	if ( ( err = snd_pcm_hw_params_set_access( m_pPlayback_handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED ) ) < 0 ) {
+	m_bMmap = pPref->m_bAlsaMmap && snd_pcm_hw_params_set_access( m_pPlayback_handle, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED ) == 0;
+	if ( !m_bMmap && ( err = snd_pcm_hw_params_set_access( m_pPlayback_handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED ) ) < 0 ) {
 		ERRORLOG( QString( "error in snd_pcm_hw_params_set_access: %1" ).arg( QString::fromLocal8Bit(snd_strerror(err)) ) );
 		return 1;
 	}
 
-	if ( ( err = snd_pcm_hw_params_set_format( m_pPlayback_handle, hw_params, SND_PCM_FORMAT_S16_LE ) ) < 0 ) {
+	// the widest format the device takes, the engine mixes in float
+	static const struct {
+		snd_pcm_format_t alsa;
+		PcmConverter::Format format;
+	} formats[] = {
+		{ SND_PCM_FORMAT_FLOAT, PcmConverter::FLOAT },
+		{ SND_PCM_FORMAT_S32, PcmConverter::S32 },
+		{ SND_PCM_FORMAT_S24, PcmConverter::S24 },
+		{ SND_PCM_FORMAT_S24_3LE, PcmConverter::S24_3 },
+		{ SND_PCM_FORMAT_S16, PcmConverter::S16 }
+	};
+	err = -EINVAL;
+	for ( int i = 0; i < sizeof( formats ) / sizeof( formats[0] ) && err < 0; i++ ) {
+		if ( snd_pcm_hw_params_test_format( m_pPlayback_handle, hw_params, formats[i].alsa ) == 0 ) {
+			err = snd_pcm_hw_params_set_format( m_pPlayback_handle, hw_params, formats[i].alsa );
+			m_format = formats[i].format;
+		}
+	}
+	if ( err < 0 ) {
 		ERRORLOG( QString( "error in snd_pcm_hw_params_set_format: %1" ).arg( QString::fromLocal8Bit(snd_strerror(err)) ) );
 		return 1;
 	}
 
 	snd_pcm_hw_params_set_rate_near( m_pPlayback_handle, hw_params, &m_nSampleRate, 0 );
 
-	if ( ( err = snd_pcm_hw_params_set_channels( m_pPlayback_handle, hw_params, nChannels ) ) < 0 ) {
+	if ( ( err = snd_pcm_hw_params_set_channels( m_pPlayback_handle, hw_params, nChannels ) ) < 0 && nPairs > 1 ) {
+		// the device can't take the channel pairs, the main mix is played alone
+		WARNINGLOG( QString( "%1 channels not supported by %2, using 2: %3" ).arg( nChannels ).arg( m_sAlsaAudioDevice ).arg( QString::fromLocal8Bit(snd_strerror(err)) ) );
+		nPairs = 1;
+		nChannels = 2;
+		err = snd_pcm_hw_params_set_channels( m_pPlayback_handle, hw_params, nChannels );
+	}
+	if ( err < 0 ) {
 		ERRORLOG( QString( "error in snd_pcm_hw_params_set_channels: %1" ).arg( QString::fromLocal8Bit(snd_strerror(err)) ) );
 		return 1;
 	}
 
-	unsigned nPeriods = 2;
-	if ( ( err = snd_pcm_hw_params_set_periods_near( m_pPlayback_handle, hw_params, &nPeriods, 0 ) ) < 0 ) {
-		ERRORLOG( QString( "error in snd_pcm_hw_params_set_periods: %1" ).arg( QString::fromLocal8Bit(snd_strerror(err)) ) );
+	snd_pcm_uframes_t max_period_size = MAX_BUFFER_SIZE;
+	if ( ( err = snd_pcm_hw_params_set_period_size_max( m_pPlayback_handle, hw_params, &max_period_size, 0 ) ) < 0 ) {
+		ERRORLOG( QString( "error in snd_pcm_hw_params_set_period_size_max: %1" ).arg( QString::fromLocal8Bit(snd_strerror(err)) ) );
 		return 1;
 	}
-	INFOLOG( QString( "nPeriods: %1" ).arg( nPeriods ) );
-
-	// Set buffer size (in frames). The resulting latency is given by
-	// latency = periodsize * periods / (rate * bytes_per_frame)
-//	m_nBufferSize = period_size * 2;
-//	infoLog( "buffer size preferita:" + to_string( m_nBufferSize ) );
 
-//	if ( ( err = snd_pcm_hw_params_set_buffer_size_near( m_pPlayback_handle, hw_params, &m_nBufferSize ) ) < 0 ) {
-//		errorLog( "[connect] error in snd_pcm_hw_params_set_buffer_size: " + string( QString::fromLocal8Bit(snd_strerror(err)) ) );
-//		return 1;
-//	}
-//	infoLog( "buffer size scelta:" + to_string( m_nBufferSize ) );
-
-	if ( ( err = snd_pcm_hw_params_set_period_size( m_pPlayback_handle, hw_params, period_size, 0 ) ) < 0 ) {
+	if ( ( err = snd_pcm_hw_params_set_period_size_near( m_pPlayback_handle, hw_params, &period_size, 0 ) ) < 0 ) {
 		ERRORLOG( QString( "error in snd_pcm_hw_params_set_period_size: %1" ).arg( QString::fromLocal8Bit(snd_strerror(err)) ) );
 	}
 
+	// The resulting latency is periods * period size / rate
+	unsigned nPeriods = std::max( 2, pPref->m_nAlsaPeriods );
+	if ( ( err = snd_pcm_hw_params_set_periods_near( m_pPlayback_handle, hw_params, &nPeriods, 0 ) ) < 0 ) {
+		ERRORLOG( QString( "error in snd_pcm_hw_params_set_periods: %1" ).arg( QString::fromLocal8Bit(snd_strerror(err)) ) );
+		return 1;
+	}
+	INFOLOG( QString( "nPeriods: %1" ).arg( nPeriods ) );
 
 	if ( ( err = snd_pcm_hw_params( m_pPlayback_handle, hw_params ) ) < 0 ) {
 		ERRORLOG( QString( "error in snd_pcm_hw_params: %1" ).arg( QString::fromLocal8Bit(snd_strerror(err)) ) );
 		return 1;
 	}
 
+	snd_pcm_uframes_t buffer_size;
 	snd_pcm_hw_params_get_rate( hw_params, &m_nSampleRate, 0 );
-	snd_pcm_hw_params_get_buffer_size( hw_params, &m_nBufferSize );
+	snd_pcm_hw_params_get_period_size( hw_params, &period_size, 0 );
+	snd_pcm_hw_params_get_buffer_size( hw_params, &buffer_size );
+	if ( period_size > MAX_BUFFER_SIZE ) {
+		ERRORLOG( QString( "ALSA: period size %1 exceeds %2" ).arg( period_size ).arg( MAX_BUFFER_SIZE ) );
+		return 1;
+	}
+	m_nBufferSize = period_size;
 
 	INFOLOG( QString( "*** PERIOD SIZE: %1" ).arg( period_size ) );
 	INFOLOG( QString( "*** SAMPLE RATE: %1" ).arg( m_nSampleRate ) );
-	INFOLOG( QString( "*** BUFFER SIZE: %1" ).arg( m_nBufferSize ) );
+	INFOLOG( QString( "*** BUFFER SIZE: %1" ).arg( buffer_size ) );
+	INFOLOG( QString( "*** FORMAT: %1, %2" ).arg( PcmConverter::name( m_format ) ).arg( m_bMmap ? "mmap" : "read/write" ) );
 
 	//snd_pcm_hw_params_free( hw_params );
 
+	// a period wakes the thread up, the rw access starts the device once the ring is full
+	snd_pcm_sw_params_t *sw_params;
+	snd_pcm_sw_params_alloca( &sw_params );
+	if ( ( err = snd_pcm_sw_params_current( m_pPlayback_handle, sw_params ) ) < 0
+		 || ( err = snd_pcm_sw_params_set_avail_min( m_pPlayback_handle, sw_params, period_size ) ) < 0
+		 || ( err = snd_pcm_sw_params_set_start_threshold( m_pPlayback_handle, sw_params, buffer_size ) ) < 0
+		 || ( err = snd_pcm_sw_params( m_pPlayback_handle, sw_params ) ) < 0 ) {
+		ERRORLOG( QString( "error in snd_pcm_sw_params: %1" ).arg( QString::fromLocal8Bit(snd_strerror(err)) ) );
+	}
+
 	m_pOut_L = new float[ m_nBufferSize ];
 	m_pOut_R = new float[ m_nBufferSize ];
 
 	memset( m_pOut_L, 0, m_nBufferSize * sizeof( float ) );
 	memset( m_pOut_R, 0, m_nBufferSize * sizeof( float ) );
+	init_channel_pairs( m_nBufferSize, nPairs );
+	INFOLOG( QString( "*** CHANNELS: %1" ).arg( getChannels() ) );
+	if ( !m_bMmap ) {
+		m_buffer.resize( m_nBufferSize * getChannels() * PcmConverter::sample_bytes( m_format ) );
+	}
 
 	m_bIsRunning = true;
 
@@ -273,6 +385,9 @@ void AlsaAudioDriver::disconnect()
 
 	delete[] m_pOut_R;
 	m_pOut_R = NULL;
+
+	free_channel_pairs();
+	std::vector<char>().swap( m_buffer );
 }
 
 unsigned AlsaAudioDriver::getBufferSize()
@@ -0,0 +1,233 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <hydrogen/IO/AudioFileWriter.h>
+
+#include <algorithm>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include <hydrogen/IO/DiskWriterDriver.h>
+
+namespace H2Core
+{
+
+const char* AudioFileWriter::__class_name = "AudioFileWriter";
+
+AudioFileWriter::AudioFileWriter( const QString& sFilename, unsigned nSampleRate, int nSampleDepth, int nChannels )
+	: Object( __class_name )
+	, __filename( sFilename )
+	, __sample_rate( nSampleRate )
+	, __sample_depth( nSampleDepth )
+	, __channels( std::max( 1, nChannels ) )
+	, __file( NULL )
+	, __chunk_size( 0 )
+	, __head( 0 )
+	, __head_frames( 0 )
+	, __tail( 0 )
+	, __queued( 0 )
+	, __closing( false )
+	, __failed( false )
+	, __thread_started( false )
+{
+	pthread_mutex_init( &__mutex, 0 );
+	pthread_cond_init( &__not_empty, 0 );
+	pthread_cond_init( &__not_full, 0 );
+}
+
+AudioFileWriter::~AudioFileWriter()
+{
+	close();
+	pthread_cond_destroy( &__not_full );
+	pthread_cond_destroy( &__not_empty );
+	pthread_mutex_destroy( &__mutex );
+}
+
+bool AudioFileWriter::open( unsigned nChunkFrames, int nChunks )
+{
+	SF_INFO soundInfo;
+	soundInfo.samplerate = __sample_rate;
+	soundInfo.channels = __channels;
+	soundInfo.format = DiskWriterDriver::sndfile_format( __filename, __sample_depth );
+	if ( !sf_format_check( &soundInfo ) ) {
+		ERRORLOG( "Error in soundInfo" );
+		__failed = true;
+		return false;
+	}
+	__file = sf_open( __filename.toLocal8Bit(), SFM_WRITE, &soundInfo );
+	if ( !__file ) {
+		ERRORLOG( QString( "Unable to open %1: %2" ).arg( __filename ).arg( sf_strerror( NULL ) ) );
+		__failed = true;
+		return false;
+	}
+
+	__chunk_size = std::max( 1u, nChunkFrames );
+	nChunks = std::max( 2, nChunks );
+	for ( int i = 0; i < nChunks; i++ ) {
+		__chunks.push_back( new float[ __chunk_size * __channels ] );
+	}
+	__chunk_frames.assign( nChunks, 0 );
+	__head = __tail = __queued = 0;
+	__head_frames = 0;
+	__closing = false;
+	__failed = false;
+
+	if ( pthread_create( &__thread, 0, writer_thread, this ) != 0 ) {
+		ERRORLOG( "unable to start the writer thread" );
+		__failed = true;
+		close();
+		return false;
+	}
+	__thread_started = true;
+	return true;
+}
+
+bool AudioFileWriter::write( const float* pIn_L, const float* pIn_R, unsigned nFrames )
+{
+	const float* channels[2] = { pIn_L, pIn_R };
+	return write( channels, nFrames );
+}
+
+bool AudioFileWriter::write( const float* const* ppIn, unsigned nFrames )
+{
+	unsigned nDone = 0;
+	while ( nDone < nFrames ) {
+		if ( __failed || !__file ) return false;
+		if ( __head_frames == 0 ) {
+			// the head chunk may still be queued for the writer
+			pthread_mutex_lock( &__mutex );
+			while ( __queued == ( int )__chunks.size() && !__failed ) {
+				pthread_cond_wait( &__not_full, &__mutex );
+			}
+			pthread_mutex_unlock( &__mutex );
+			if ( __failed ) return false;
+		}
+		unsigned nCopy = std::min( nFrames - nDone, __chunk_size - __head_frames );
+		float* pOut = __chunks[ __head ] + __head_frames * __channels;
+		if ( __channels == 2 ) {
+			interleave( ppIn[0] + nDone, ppIn[1] + nDone, pOut, nCopy );
+		} else {
+			for ( int c = 0; c < __channels; c++ ) {
+				const float* pIn = ppIn[c] + nDone;
+				for ( unsigned i = 0; i < nCopy; i++ ) {
+					pOut[ i * __channels + c ] = std::min( 1.0f, std::max( -1.0f, pIn[i] ) );
+				}
+			}
+		}
+		__head_frames += nCopy;
+		nDone += nCopy;
+		if ( __head_frames == __chunk_size ) {
+			__push_head();
+		}
+	}
+	return !__failed;
+}
+
+bool AudioFileWriter::close()
+{
+	if ( __thread_started ) {
+		if ( __head_frames > 0 ) {
+			__push_head();
+		}
+		pthread_mutex_lock( &__mutex );
+		__closing = true;
+		pthread_cond_signal( &__not_empty );
+		pthread_mutex_unlock( &__mutex );
+		pthread_join( __thread, 0 );
+		__thread_started = false;
+	}
+	if ( __file ) {
+		sf_close( __file );
+		__file = NULL;
+	}
+	for ( int i = 0; i < __chunks.size(); i++ ) {
+		delete[] __chunks[i];
+	}
+	__chunks.clear();
+	__chunk_frames.clear();
+	return !__failed;
+}
+
+void AudioFileWriter::__push_head()
+{
+	pthread_mutex_lock( &__mutex );
+	__chunk_frames[ __head ] = __head_frames;
+	__queued++;
+	pthread_cond_signal( &__not_empty );
+	pthread_mutex_unlock( &__mutex );
+	__head = ( __head + 1 ) % __chunks.size();
+	__head_frames = 0;
+}
+
+void* AudioFileWriter::writer_thread( void* param )
+{
+	AudioFileWriter* pWriter = ( AudioFileWriter* )param;
+	while ( true ) {
+		pthread_mutex_lock( &pWriter->__mutex );
+		while ( pWriter->__queued == 0 && !pWriter->__closing ) {
+			pthread_cond_wait( &pWriter->__not_empty, &pWriter->__mutex );
+		}
+		bool bDone = ( pWriter->__queued == 0 );
+		pthread_mutex_unlock( &pWriter->__mutex );
+		if ( bDone ) break;
+
+		// after a failure the chunks are dropped, the renderer is not kept waiting
+		int nChunk = pWriter->__tail;
+		sf_count_t nFrames = pWriter->__chunk_frames[ nChunk ];
+		if ( !pWriter->__failed && sf_writef_float( pWriter->__file, pWriter->__chunks[ nChunk ], nFrames ) != nFrames ) {
+			___ERRORLOG( QString( "Error during sf_write_float on %1" ).arg( pWriter->__filename ) );
+			pWriter->__failed = true;
+		}
+		pWriter->__tail = ( nChunk + 1 ) % pWriter->__chunks.size();
+
+		pthread_mutex_lock( &pWriter->__mutex );
+		pWriter->__queued--;
+		pthread_cond_signal( &pWriter->__not_full );
+		pthread_mutex_unlock( &pWriter->__mutex );
+	}
+	return 0;
+}
+
+void AudioFileWriter::interleave( const float* pIn_L, const float* pIn_R, float* pOut, unsigned nFrames )
+{
+	unsigned i = 0;
+#ifdef __SSE__
+	const __m128 one = _mm_set1_ps( 1.0f );
+	const __m128 minus_one = _mm_set1_ps( -1.0f );
+	for ( ; i + 4 <= nFrames; i += 4 ) {
+		__m128 left = _mm_min_ps( _mm_max_ps( _mm_loadu_ps( pIn_L + i ), minus_one ), one );
+		__m128 right = _mm_min_ps( _mm_max_ps( _mm_loadu_ps( pIn_R + i ), minus_one ), one );
+		_mm_storeu_ps( pOut + i * 2, _mm_unpacklo_ps( left, right ) );
+		_mm_storeu_ps( pOut + i * 2 + 4, _mm_unpackhi_ps( left, right ) );
+	}
+#endif
+	for ( ; i < nFrames; i++ ) {
+		pOut[i * 2] = std::min( 1.0f, std::max( -1.0f, pIn_L[i] ) );
+		pOut[i * 2 + 1] = std::min( 1.0f, std::max( -1.0f, pIn_R[i] ) );
+	}
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
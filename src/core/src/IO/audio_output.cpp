@@ -0,0 +1,137 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <hydrogen/IO/AudioOutput.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <hydrogen/hydrogen.h>
+#include <hydrogen/basics/song.h>
+#include <hydrogen/basics/instrument.h>
+#include <hydrogen/basics/instrument_component.h>
+#include <hydrogen/basics/drumkit_component.h>
+
+namespace H2Core
+{
+
+AudioOutput::~AudioOutput()
+{
+	free_channel_pairs();
+}
+
+void AudioOutput::init_channel_pairs( unsigned nBufferSize, int nPairs )
+{
+	free_channel_pairs();
+	Preferences* pPref = Preferences::get_instance();
+	if ( nPairs < 0 ) {
+		nPairs = pPref->m_nOutputChannelPairs;
+	}
+	__channel_pairs = std::max( 1, nPairs );
+	for ( int i = 1; i < __channel_pairs; i++ ) {
+		float* pOut_L = new float[ nBufferSize ];
+		float* pOut_R = new float[ nBufferSize ];
+		memset( pOut_L, 0, nBufferSize * sizeof( float ) );
+		memset( pOut_R, 0, nBufferSize * sizeof( float ) );
+		__channel_buffers.push_back( pOut_L );
+		__channel_buffers.push_back( pOut_R );
+		__track_buffers_L.push_back( pOut_L );
+		__track_buffers_R.push_back( pOut_R );
+	}
+	__routes = pPref->m_outputRoutes;
+	__track_buffer_count = __channel_pairs - 1;
+	__track_out_enabled = ( __channel_pairs > 1 );
+	__track_routing.fetch_add( 1, std::memory_order_release );
+}
+
+void AudioOutput::free_channel_pairs()
+{
+	if ( __channel_pairs == 1 ) return;
+	__track_out_enabled = false;
+	__track_buffer_count = 0;
+	__track_buffers_L.clear();
+	__track_buffers_R.clear();
+	for ( int i = 0; i < __channel_buffers.size(); i++ ) {
+		delete[] __channel_buffers[i];
+	}
+	__channel_buffers.clear();
+	__routes.clear();
+	__channel_pairs = 1;
+}
+
+int AudioOutput::__route_track( const Preferences::OutputRoute& route ) const
+{
+	return ( route.m_nPair >= 1 && route.m_nPair < __channel_pairs ) ? route.m_nPair - 1 : -1;
+}
+
+int AudioOutput::getTrackIndex( Instrument* pInstr, InstrumentComponent* pCompo )
+{
+	if ( __routes.empty() ) return -1;
+
+	// a route of the instrument comes before a route of its drumkit component
+	for ( int i = 0; i < __routes.size(); i++ ) {
+		if ( __routes[i].m_source == Preferences::OutputRoute::INSTRUMENT && __routes[i].m_sName == pInstr->get_name() ) {
+			int nTrack = __route_track( __routes[i] );
+			if ( nTrack != -1 ) return nTrack;
+		}
+	}
+	Song* pSong = Hydrogen::get_instance()->getSong();
+	DrumkitComponent* pMainCompo = pSong ? pSong->get_component( pCompo->get_drumkit_componentID() ) : NULL;
+	if ( !pMainCompo ) return -1;
+	for ( int i = 0; i < __routes.size(); i++ ) {
+		if ( __routes[i].m_source == Preferences::OutputRoute::COMPONENT && __routes[i].m_sName == pMainCompo->get_name() ) {
+			int nTrack = __route_track( __routes[i] );
+			if ( nTrack != -1 ) return nTrack;
+		}
+	}
+	return -1;
+}
+
+int AudioOutput::getFXTrackIndex( int nFX ) const
+{
+	for ( int i = 0; i < __routes.size(); i++ ) {
+		if ( __routes[i].m_source == Preferences::OutputRoute::FX && __routes[i].m_sName.toInt() == nFX ) {
+			return __route_track( __routes[i] );
+		}
+	}
+	return -1;
+}
+
+void AudioOutput::prepareTrackOuts( unsigned nFrames )
+{
+	for ( int i = 0; i < __track_buffer_count; i++ ) {
+		memset( __track_buffers_L[i], 0, nFrames * sizeof( float ) );
+		memset( __track_buffers_R[i], 0, nFrames * sizeof( float ) );
+	}
+}
+
+float* AudioOutput::getOut( int nChannel )
+{
+	if ( nChannel == 0 ) return getOut_L();
+	if ( nChannel == 1 ) return getOut_R();
+	int nTrack = nChannel / 2 - 1;
+	return ( nChannel % 2 == 0 ) ? getTrackBuffer_L( nTrack ) : getTrackBuffer_R( nTrack );
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
@@ -28,22 +28,15 @@
 #include <hydrogen/timeline.h>
 #include <hydrogen/basics/pattern.h>
 #include <hydrogen/basics/pattern_list.h>
+#include <hydrogen/basics/song.h>
+#include <hydrogen/basics/tempo_map.h>
 #include <hydrogen/IO/DiskWriterDriver.h>
+#include <hydrogen/IO/AudioFileWriter.h>
 
 #include <pthread.h>
+#include <algorithm>
 #include <cassert>
-
-#ifdef WIN32
-#include <windows.h>
-/*
- * In Windows the unistd function sleep( seconds ) is not available.
- * Treat sleep( SECONDS ) as a macro that uses SleepEx.
- * Convert seconds to milliseconds for the first argument of SleepEx.
- * Use false for the second argument of SleepEx.
- * This way SleepEx always returns 0, after the specified time has passed.
- */
-#define sleep( SECONDS ) SleepEx( SECONDS * 1000, false )
-#endif
+#include <cmath>
 
 namespace H2Core
 {
@@ -63,43 +56,149 @@ void* diskWriterDriver_thread( void* param )
 	// always rolling, no user interaction
 	pDriver->m_transport.m_status = TransportInfo::ROLLING;
 
-	SF_INFO soundInfo;
-	soundInfo.samplerate = pDriver->m_nSampleRate;
-//	soundInfo.frames = -1;//getNFrames();		///\todo: da terminare
-	soundInfo.channels = 2;
+	// every file is encoded and written by its own thread while the song renders
+	std::vector<AudioFileWriter*> writers;
+	for ( int i = 0; i < pDriver->m_filenames.size(); i++ ) {
+		AudioFileWriter* pWriter = new AudioFileWriter( pDriver->m_filenames[i], pDriver->m_nSampleRate, pDriver->m_nSampleDepth, pDriver->getChannels() );
+		if ( !pWriter->open() ) {
+			delete pWriter;
+			continue;
+		}
+		writers.push_back( pWriter );
+	}
+
+	// the main mix, then the channel pairs
+	std::vector<float*> channels;
+	for ( int c = 0; c < pDriver->getChannels(); c++ ) {
+		channels.push_back( pDriver->getOut( c ) );
+	}
+
+
+	Hydrogen* engine = Hydrogen::get_instance();
+	Song* pSong = engine->getSong();
+	bool bUseTimeline = Preferences::get_instance()->getUseTimelineBpm();
+
+	// the pieces rendered end on frames of the tempo map, rounded from the start
+	// of the song so their lengths don't add up their rounding errors
+	TempoMap tempoMap;
+	tempoMap.load( pSong, engine->getTimeline(), pDriver->m_nSampleRate, bUseTimeline );
+
+	std::vector<PatternList*> *pPatternColumns = pSong->get_pattern_group_vector();
+	int nColumns = pPatternColumns->size();
+
+	int nPatternSize;
+	double fColumnTick = 0;
+	float oldBPM = 0;
+	for ( int patternposition = 0; patternposition < nColumns; ++patternposition ) {
+		PatternList *pColumn = ( *pPatternColumns )[ patternposition ];
+		if ( pColumn->size() != 0 ) {
+			nPatternSize = pColumn->get( 0 )->get_length();
+		} else {
+			nPatternSize = MAX_NOTES;
+		}
+
+		// the column is rendered in pieces, split where the tempo changes within it
+		double fTick = fColumnTick;
+		double fColumnEnd = fColumnTick + nPatternSize;
+		while ( fTick < fColumnEnd ) {
+			double fNextTick = tempoMap.next_tempo_change( fTick );
+			if ( fNextTick < 0 || fNextTick > fColumnEnd ) {
+				fNextTick = fColumnEnd;
+			}
+
+			if ( bUseTimeline ) {
+				float fBpm = tempoMap.get_bpm( fTick );
+				engine->setBPM( fBpm );
+				pDriver->audioEngine_process_checkBPMChanged();
+				if ( fTick == fColumnTick ) {
+					engine->setPatternPos( patternposition );
+				}
+
+				// the rubberband samples are ready when this returns, at once for a tempo met before
+				if( Preferences::get_instance()->getRubberBandBatchMode() && fBpm != oldBPM ){
+					engine->stretchRubberbandSamples( fBpm );
+				}
+				oldBPM = fBpm;
+			}
+
+			unsigned long nFrames = llround( tempoMap.tick_to_frame( fNextTick ) ) - llround( tempoMap.tick_to_frame( fTick ) );
+			unsigned long frameNumber = 0;
+			while ( frameNumber < nFrames ) {
+				// the last buffer of the piece is mostly smaller than pDriver->m_nBufferSize
+				int usedBuffer = std::min( ( unsigned long )pDriver->m_nBufferSize, nFrames - frameNumber );
+				frameNumber += usedBuffer;
+				pDriver->m_processCallback( usedBuffer, NULL );
+
+				for ( int i = 0; i < writers.size(); i++ ) {
+					writers[i]->write( &channels[0], usedBuffer );
+				}
+			}
+			fTick = fNextTick;
+		}
+		fColumnTick = fColumnEnd;
+
+		// this progress bar methode is not exact but ok enough to give users a usable visible progress feedback
+		// 100 is sent once the files are complete
+		float fPercent = ( float )(patternposition +1) / ( float )nColumns * 100.0;
+		if ( patternposition + 1 < nColumns ) {
+			EventQueue::get_instance()->push_event( EVENT_PROGRESS, ( int )fPercent );
+		}
+	}
+
+	for ( int i = 0; i < writers.size(); i++ ) {
+		if ( !writers[i]->close() ) {
+			__ERRORLOG( QString( "Unable to write %1" ).arg( writers[i]->get_filename() ) );
+		}
+		delete writers[i];
+	}
+	EventQueue::get_instance()->push_event( EVENT_PROGRESS, 100 );
+
+	__INFOLOG( "DiskWriterDriver thread end" );
+
+	pthread_exit( NULL );
+
+	return NULL;
+}
+
+
+
+const char* DiskWriterDriver::__class_name = "DiskWriterDriver";
+
+int DiskWriterDriver::sndfile_format( const QString& sFilename, int nSampleDepth )
+{
 	//default format
 	int sfformat = 0x010000; //wav format (default)
 	int bits = 0x0002; //16 bit PCM (default)
 	//sf_format switch
-	if( pDriver->m_sFilename.endsWith(".aiff") || pDriver->m_sFilename.endsWith(".AIFF") ){
+	if( sFilename.endsWith(".aiff") || sFilename.endsWith(".AIFF") ){
 		sfformat =  0x020000; //Apple/SGI AIFF format (big endian)
 	}
-	if( pDriver->m_sFilename.endsWith(".flac") || pDriver->m_sFilename.endsWith(".FLAC") ){
+	if( sFilename.endsWith(".flac") || sFilename.endsWith(".FLAC") ){
 		sfformat =  0x170000; //FLAC lossless file format
 	}
-	if( ( pDriver->m_nSampleDepth == 8 ) && ( pDriver->m_sFilename.endsWith(".aiff") || pDriver->m_sFilename.endsWith(".AIFF") ) ){
+	if( ( nSampleDepth == 8 ) && ( sFilename.endsWith(".aiff") || sFilename.endsWith(".AIFF") ) ){
 		bits = 0x0001; //Signed 8 bit data works with aiff
 	}
-	if( ( pDriver->m_nSampleDepth == 8 ) && ( pDriver->m_sFilename.endsWith(".wav") || pDriver->m_sFilename.endsWith(".WAV") ) ){
+	if( ( nSampleDepth == 8 ) && ( sFilename.endsWith(".wav") || sFilename.endsWith(".WAV") ) ){
 		bits = 0x0005; //Unsigned 8 bit data needed for Microsoft WAV format
 	}
-	if( pDriver->m_nSampleDepth == 16 ){
+	if( nSampleDepth == 16 ){
 		bits = 0x0002; //Signed 16 bit data
 	}
-	if( pDriver->m_nSampleDepth == 24 ){
+	if( nSampleDepth == 24 ){
 		bits = 0x0003; //Signed 24 bit data
 	}
-	if( pDriver->m_nSampleDepth == 32 ){
+	if( nSampleDepth == 32 ){
 		bits = 0x0004; ////Signed 32 bit data
 	}
 
-	soundInfo.format =  sfformat|bits;
+	int format = sfformat|bits;
 
 //	#ifdef HAVE_OGGVORBIS
 
 	//ogg vorbis option
-	if( pDriver->m_sFilename.endsWith( ".ogg" ) | pDriver->m_sFilename.endsWith( ".OGG" ) )
-		soundInfo.format = SF_FORMAT_OGG | SF_FORMAT_VORBIS;
+	if( sFilename.endsWith( ".ogg" ) | sFilename.endsWith( ".OGG" ) )
+		format = SF_FORMAT_OGG | SF_FORMAT_VORBIS;
 
 //	#endif
 
@@ -135,148 +234,20 @@ void* diskWriterDriver_thread( void* param )
 ///used for ogg
 //          SF_FORMAT_VORBIS
 
-	if ( !sf_format_check( &soundInfo ) ) {
-		__ERRORLOG( "Error in soundInfo" );
-		return 0;
-	}
-
-
-	SNDFILE* m_file = sf_open( pDriver->m_sFilename.toLocal8Bit(), SFM_WRITE, &soundInfo );
-
-	float *pData = new float[ pDriver->m_nBufferSize * 2 ];	// always stereo
-
-	float *pData_L = pDriver->m_pOut_L;
-	float *pData_R = pDriver->m_pOut_R;
-
-
-		Hydrogen* engine = Hydrogen::get_instance();
-
-	std::vector<PatternList*> *pPatternColumns = Hydrogen::get_instance()->getSong()->get_pattern_group_vector();
-	int nColumns = pPatternColumns->size();
-
-	int nPatternSize;
-		int validBpm = engine->getSong()->__bpm;
-		float oldBPM = 0;
-		float ticksize = 0;
-		for ( int patternposition = 0; patternposition < nColumns; ++patternposition ) {
-				PatternList *pColumn = ( *pPatternColumns )[ patternposition ];
-		if ( pColumn->size() != 0 ) {
-			nPatternSize = pColumn->get( 0 )->get_length();
-		} else {
-			nPatternSize = MAX_NOTES;
-				}
-
-				ticksize = pDriver->m_nSampleRate * 60.0 /  engine->getSong()->__bpm / engine->getSong()->__resolution;
-				// check pattern bpm if timeline bpm is in use
-				Timeline* pTimeline = engine->getTimeline();
-				if(Preferences::get_instance()->getUseTimelineBpm() ){
-						if( pTimeline->m_timelinevector.size() >= 1 ){
-
-								for ( int t = 0; t < pTimeline->m_timelinevector.size(); t++){
-										if(pTimeline->m_timelinevector[t].m_htimelinebeat == patternposition &&
-											pTimeline->m_timelinevector[t].m_htimelinebpm != validBpm){
-												validBpm =  pTimeline->m_timelinevector[t].m_htimelinebpm;
-										}
-
-								}
-						}
-						pDriver->setBpm(validBpm);
-						ticksize = pDriver->m_nSampleRate * 60.0 / validBpm / Hydrogen::get_instance()->getSong()->__resolution;
-						pDriver->audioEngine_process_checkBPMChanged();
-						engine->setPatternPos(patternposition);
-
-						// delay needed time to calculate all rubberband samples
-						if( Preferences::get_instance()->getRubberBandBatchMode() && validBpm != oldBPM ){
-								EventQueue::get_instance()->push_event( EVENT_RECALCULATERUBBERBAND, -1);
-								int sleepTime = Preferences::get_instance()->getRubberBandCalcTime()+1;
-								while ((sleepTime = sleep(sleepTime)) > 0);
-						}
-						oldBPM = validBpm;
-
-				}
-				else
-				{
-						ticksize = pDriver->m_nSampleRate * 60.0 /  Hydrogen::get_instance()->getSong()->__bpm / Hydrogen::get_instance()->getSong()->__resolution;
-						//pDriver->m_transport.m_nTickSize = ticksize;
-				}
-
-
-				 //here we have the pattern length in frames dependent from bpm and samplerate
-				unsigned patternLengthInFrames = ticksize * nPatternSize;
-
-				unsigned frameNumber = 0;
-				int lastRun = 0;
-				while ( frameNumber < patternLengthInFrames ) {
-
-						int usedBuffer = pDriver->m_nBufferSize;
-
-						//this will calculate the the size from -last- (end of pattern) used frame buffer,
-						//which is mostly smaller than pDriver->m_nBufferSize
-						if( patternLengthInFrames - frameNumber <  pDriver->m_nBufferSize ){
-								lastRun = patternLengthInFrames - frameNumber;
-								usedBuffer = lastRun;
-						};
-
-						frameNumber += usedBuffer;
-						int ret = pDriver->m_processCallback( usedBuffer, NULL );
-
-						for ( unsigned i = 0; i < usedBuffer; i++ ) {
-								if(pData_L[i] > 1){
-										pData[i * 2] = 1;
-								}
-								else if(pData_L[i] < -1){
-										pData[i * 2] = -1;
-								}else
-								{
-										pData[i * 2] = pData_L[i];
-								}
-
-								if(pData_R[i] > 1){
-										pData[i * 2 + 1] = 1;
-								}
-								else if(pData_R[i] < -1){
-										pData[i * 2 + 1] = -1;
-								}else
-								{
-										pData[i * 2 + 1] = pData_R[i];
-								}
-						}
-						int res = sf_writef_float( m_file, pData, usedBuffer );
-						if ( res != ( int )usedBuffer ) {
-								__ERRORLOG( "Error during sf_write_float" );
-						}
-				}
-
-				// this progress bar methode is not exact but ok enough to give users a usable visible progress feedback
-				float fPercent = ( float )(patternposition +1) / ( float )nColumns * 100.0;
-				EventQueue::get_instance()->push_event( EVENT_PROGRESS, ( int )fPercent );
-		}
-
-	delete[] pData;
-	pData = NULL;
-
-	sf_close( m_file );
-
-	__INFOLOG( "DiskWriterDriver thread end" );
-
-	pthread_exit( NULL );
-
-	return NULL;
+	return format;
 }
 
 
-
-const char* DiskWriterDriver::__class_name = "DiskWriterDriver";
-
-DiskWriterDriver::DiskWriterDriver( audioProcessCallback processCallback, unsigned nSamplerate, const QString& sFilename, int nSampleDepth )
+DiskWriterDriver::DiskWriterDriver( audioProcessCallback processCallback, unsigned nSamplerate, const QStringList& filenames, int nSampleDepth, int nChannelPairs )
 		: AudioOutput( __class_name )
 		, m_nSampleRate( nSamplerate )
-		, m_sFilename( sFilename )
+		, m_filenames( filenames )
 		, m_nSampleDepth ( nSampleDepth )
 		, m_processCallback( processCallback )
 		, m_nBufferSize( 0 )
 		, m_pOut_L( NULL )
 		, m_pOut_R( NULL )
+		, m_nChannelPairs( nChannelPairs )
 {
 	INFOLOG( "INIT" );
 }
@@ -297,6 +268,7 @@ int DiskWriterDriver::init( unsigned nBufferSize )
 	m_nBufferSize = nBufferSize;
 	m_pOut_L = new float[nBufferSize];
 	m_pOut_R = new float[nBufferSize];
+	init_channel_pairs( nBufferSize, m_nChannelPairs );
 
 	return 0;
 }
@@ -332,6 +304,7 @@ void DiskWriterDriver::disconnect()
 	delete[] m_pOut_R;
 	m_pOut_R = NULL;
 
+	free_channel_pairs();
 }
 
 
@@ -387,9 +360,9 @@ void DiskWriterDriver::audioEngine_process_checkBPMChanged()
 
 		if ( fNewTickSize != m_transport.m_nTickSize ) {
 				// cerco di convertire ...
-				float fTickNumber =
-								( float )m_transport.m_nFrames
-								/ ( float )m_transport.m_nTickSize;
+				double fTickNumber =
+								( double )m_transport.m_nFrames
+								/ m_transport.m_nTickSize;
 
 				m_transport.m_nTickSize = fNewTickSize;
 
@@ -398,7 +371,7 @@ void DiskWriterDriver::audioEngine_process_checkBPMChanged()
 				}
 
 				// update frame position
-				m_transport.m_nFrames = ( long long )( fTickNumber * fNewTickSize );
+				m_transport.m_nFrames = ( long long )round( fTickNumber * fNewTickSize );
 
 				// currently unuseble here
 				//EventQueue::get_instance()->push_event( EVENT_RECALCULATERUBBERBAND, -1);
@@ -96,11 +96,16 @@ float* FakeDriver::getOut_R()
 }
 
 
+int FakeDriver::processCycle()
+{
+	return m_processCallback( m_nBufferSize, NULL );
+}
+
 void FakeDriver::play()
 {
 	m_transport.m_status = TransportInfo::ROLLING;
 
-	while ( m_processCallback( m_nBufferSize, NULL ) == 0 ) {
+	while ( processCycle() == 0 ) {
 		// process...
 	}
 }
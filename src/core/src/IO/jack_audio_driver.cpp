@@ -97,6 +97,12 @@ JackAudioDriver::JackAudioDriver( JackProcessCallback processCallback )
 
 	memset( track_output_ports_L, 0, sizeof(track_output_ports_L) );
 	memset( track_output_ports_R, 0, sizeof(track_output_ports_R) );
+	memset( track_map, -1, sizeof(track_map) );
+	m_nTrackMap = 0;
+	m_nTrackMapSeen = 0;
+	m_fTimebaseBpm = 120.0;
+	__track_buffers_L.resize( MAX_INSTRUMENTS, 0 );
+	__track_buffers_R.resize( MAX_INSTRUMENTS, 0 );
 }
 
 JackAudioDriver::~JackAudioDriver()
@@ -440,14 +446,32 @@ float* JackAudioDriver::getTrackOut_R( unsigned nTrack )
 	return out;
 }
 
-float* JackAudioDriver::getTrackOut_L( Instrument * instr, InstrumentComponent * pCompo)
+int JackAudioDriver::getTrackIndex( Instrument * instr, InstrumentComponent * pCompo )
 {
-	return getTrackOut_L(track_map[instr->get_id()][pCompo->get_drumkit_componentID()]);
+	int nId = instr->get_id();
+	int nCompo = pCompo->get_drumkit_componentID();
+	if ( nId < 0 || nId >= MAX_INSTRUMENTS || nCompo < 0 || nCompo >= MAX_COMPONENTS ) return -1;
+	return track_map[ m_nTrackMap.load( std::memory_order_acquire ) ][ nId ][ nCompo ];
 }
 
-float* JackAudioDriver::getTrackOut_R( Instrument * instr, InstrumentComponent * pCompo)
+void JackAudioDriver::prepareTrackOuts( unsigned nFrames )
 {
-	return getTrackOut_R(track_map[instr->get_id()][pCompo->get_drumkit_componentID()]);
+	// no lookup of the previous cycle is left, the track_map not published is free
+	m_nTrackMapSeen.store( m_nTrackMap.load( std::memory_order_acquire ), std::memory_order_release );
+
+	// the port buffers are fetched once per cycle, not for every voice
+	int nTracks = track_port_count;
+	for ( int k = 0; k < nTracks; ++k ) {
+		__track_buffers_L[k] = getTrackOut_L( k );
+		if ( __track_buffers_L[k] ) {
+			memset( __track_buffers_L[k], 0, nFrames * sizeof( float ) );
+		}
+		__track_buffers_R[k] = getTrackOut_R( k );
+		if ( __track_buffers_R[k] ) {
+			memset( __track_buffers_R[k], 0, nFrames * sizeof( float ) );
+		}
+	}
+	__track_buffer_count = nTracks;
 }
 
 
@@ -645,21 +669,33 @@ void JackAudioDriver::makeTrackOutputs( Song * song )
 
 	int p_trackCount = 0;
 
-	for( int i = 0 ; i < MAX_INSTRUMENTS ; i++ ){
-		for ( int j = 0 ; j < MAX_COMPONENTS ; j++ ){
-			track_map[i][j] = 0;
-		}
+	QMutexLocker lock( &m_trackMapMutex );
+
+	// the new routing is built beside the one the audio thread reads, then swapped in.
+	// the other one may still be read until a process cycle starts with the current one,
+	// a client which is not running never gets there and is waited for a few periods at most
+	int nCurrent = m_nTrackMap.load();
+	int nMap = 1 - nCurrent;
+	unsigned nSampleRate = getSampleRate();
+	int nTimeout = nSampleRate ? ( int )( 4000000.0 * getBufferSize() / nSampleRate ) : 0;
+	if ( nTimeout < 10000 ) nTimeout = 10000;
+	for ( int nWaited = 0; m_nTrackMapSeen.load( std::memory_order_acquire ) != nCurrent && nWaited < nTimeout; nWaited += 1000 ) {
+		usleep( 1000 );
 	}
+	memset( track_map[nMap], -1, sizeof(track_map[nMap]) );
 
 	for ( int n = nInstruments - 1; n >= 0; n-- ) {
 		instr = instruments->get( n );
 		for (std::vector<InstrumentComponent*>::iterator it = instr->get_components()->begin() ; it != instr->get_components()->end(); ++it) {
 			InstrumentComponent* pCompo = *it;
 			setTrackOutput( p_trackCount, instr , pCompo, song);
-			track_map[instr->get_id()][pCompo->get_drumkit_componentID()] = p_trackCount;
+			track_map[nMap][instr->get_id()][pCompo->get_drumkit_componentID()] = p_trackCount;
 			p_trackCount++;
 		}
 	}
+	m_nTrackMap.store( nMap, std::memory_order_release );
+	__track_routing.fetch_add( 1, std::memory_order_release );
+
 	// clean up unused ports
 	jack_port_t *p_L, *p_R;
 	for ( int n = p_trackCount; n < track_port_count; n++ ) {
@@ -862,6 +898,8 @@ void JackAudioDriver::initTimeMaster()
 
 	Preferences* pref = Preferences::get_instance();
 	if ( pref->m_bJackMasterMode == Preferences::USE_JACK_TIME_MASTER) {
+		Hydrogen* H = Hydrogen::get_instance();
+		updateTempoMap( H->getSong(), H->getTimeline() );
 		int ret = jack_set_timebase_callback(client, m_bCond, jack_timebase_callback, this);
 		if (ret != 0) pref->m_bJackMasterMode = Preferences::NO_JACK_TIME_MASTER;
 	} else {
@@ -876,6 +914,16 @@ void JackAudioDriver::com_release()
 	jack_release_timebase(client);
 }
 
+void JackAudioDriver::updateTempoMap( Song* pSong, Timeline* pTimeline )
+{
+	QMutexLocker lock( &m_tempoMapMutex );
+	if ( pSong ) {
+		m_tempoMap.load( pSong, pTimeline, getSampleRate(), true );
+	} else {
+		m_tempoMap.reset( 120.0, 48, getSampleRate() );
+	}
+}
+
 void JackAudioDriver::jack_timebase_callback(jack_transport_state_t state,
 										jack_nframes_t nframes,
 										jack_position_t *pos,
@@ -890,7 +938,8 @@ void JackAudioDriver::jack_timebase_callback(jack_transport_state_t state,
 	if ( ! S ) return;
 
 	unsigned long PlayTick = ( pos->frame - me->bbt_frame_offset ) / me->m_transport.m_nTickSize;
-	pos->bar = H->getPosForTick ( PlayTick );
+	int nPatternTick;
+	pos->bar = H->getPosForTick ( PlayTick, &nPatternTick );
 
 	double TPB = H->getTickForHumanPosition( pos->bar );
 	if ( TPB < 1 ) return;
@@ -901,7 +950,16 @@ void JackAudioDriver::jack_timebase_callback(jack_transport_state_t state,
 	pos->valid = JackPositionBBT;
 	pos->beats_per_bar = TPB / 48;
 	pos->beat_type = 4.0;
-	pos->beats_per_minute = H->getTimelineBpm ( pos->bar );
+	// the tempo of the tick played, a tempo marker may change it within the bar.
+	// the map is built by updateTempoMap(), the last tempo is reported again while it is rebuilt
+	if ( S->get_mode() != Song::SONG_MODE || !Preferences::get_instance()->getUseTimelineBpm() ) {
+		me->m_fTimebaseBpm = S->__bpm;
+	} else if ( me->m_tempoMapMutex.tryLock() ) {
+		long nBarTick = pos->bar >= 0 ? H->getTickForPosition( pos->bar ) : -1;
+		me->m_fTimebaseBpm = me->m_tempoMap.get_bpm( nBarTick >= 0 ? nBarTick + nPatternTick : PlayTick );
+		me->m_tempoMapMutex.unlock();
+	}
+	pos->beats_per_minute = me->m_fTimebaseBpm;
 	pos->bar++;
 
 	// Probably there will never be an offset, cause we are the master ;-)
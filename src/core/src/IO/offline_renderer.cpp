@@ -0,0 +1,939 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <hydrogen/IO/OfflineRenderer.h>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <set>
+
+#include <QTime>
+
+#include <hydrogen/audio_engine.h>
+#include <hydrogen/event_queue.h>
+#include <hydrogen/hydrogen.h>
+#include <hydrogen/basics/song.h>
+#include <hydrogen/basics/note.h>
+#include <hydrogen/basics/pattern.h>
+#include <hydrogen/basics/pattern_list.h>
+#include <hydrogen/basics/instrument.h>
+#include <hydrogen/basics/instrument_list.h>
+#include <hydrogen/basics/instrument_component.h>
+#include <hydrogen/basics/instrument_layer.h>
+#include <hydrogen/basics/sample.h>
+#include <hydrogen/basics/drumkit_component.h>
+#include <hydrogen/helpers/sample_packer.h>
+#include <hydrogen/IO/AudioFileWriter.h>
+#include <hydrogen/fx/Effects.h>
+
+namespace H2Core
+{
+
+namespace
+{
+
+/* the audio engine scheduling constants */
+const int MAX_TIME_HUMANIZE = 2000;
+const int LEAD_LAG_TICKS = 5;
+
+float getGaussian( float z )
+{
+	// gaussian distribution -- dimss
+	float x1, x2, w;
+	do {
+		x1 = 2.0 * ( ( ( float ) rand() ) / RAND_MAX ) - 1.0;
+		x2 = 2.0 * ( ( ( float ) rand() ) / RAND_MAX ) - 1.0;
+		w = x1 * x1 + x2 * x2;
+	} while ( w >= 1.0 );
+
+	w = sqrtf( ( -2.0 * logf( w ) ) / w );
+	return x1 * w * z + 0.0; // tunable
+}
+
+/** a part of a parallel render */
+struct Segment
+{
+	OfflineRenderer* m_pRenderer;
+	unsigned long m_nSkip;			///< frames rendered before the segment, to rebuild its voices
+	unsigned long m_nFrames;		///< frames kept, ULONG_MAX for the end of the range and the tail
+	std::vector<float> m_left;
+	std::vector<float> m_right;
+	bool m_bSuccess;
+	pthread_t m_thread;
+};
+
+void* segment_thread( void* param )
+{
+	Segment* pSegment = ( Segment* )param;
+	OfflineRenderer* pRenderer = pSegment->m_pRenderer;
+	if ( pSegment->m_nFrames != ULONG_MAX ) {
+		pSegment->m_left.reserve( pSegment->m_nFrames );
+		pSegment->m_right.reserve( pSegment->m_nFrames );
+	}
+	unsigned long nSkip = pSegment->m_nSkip;
+	unsigned nFrames;
+	while ( pSegment->m_left.size() < pSegment->m_nFrames && ( nFrames = pRenderer->render_block() ) > 0 ) {
+		unsigned nStart = std::min( ( unsigned long )nFrames, nSkip );
+		nSkip -= nStart;
+		unsigned nEnd = std::min( ( unsigned long )nFrames, nStart + pSegment->m_nFrames - pSegment->m_left.size() );
+		pSegment->m_left.insert( pSegment->m_left.end(), pRenderer->getOut_L() + nStart, pRenderer->getOut_L() + nEnd );
+		pSegment->m_right.insert( pSegment->m_right.end(), pRenderer->getOut_R() + nStart, pRenderer->getOut_R() + nEnd );
+	}
+	// only the last segment may end early
+	pSegment->m_bSuccess = pSegment->m_nFrames == ULONG_MAX || pSegment->m_left.size() == pSegment->m_nFrames;
+	return 0;
+}
+
+};
+
+const char* OfflineRenderer::__class_name = "OfflineRenderer";
+
+OfflineRenderer::Options::Options()
+	: m_nSampleRate( 44100 )
+	, m_nBufferSize( 1024 )
+	, m_nFirstColumn( 0 )
+	, m_nLastColumn( -1 )
+	, m_bUseTimelineBpm( false )
+	, m_nTailFrames( 0 )
+	, m_interpolation( Sampler::LINEAR )
+	, m_stems( NO_STEMS )
+	, m_bMaster( true )
+{
+}
+
+OfflineRenderer::Report::Report()
+	: m_nFrames( 0 )
+	, m_fDuration( 0 )
+	, m_fRenderTime( 0 )
+	, m_fSpeed( 0 )
+	, m_fPeak_L( 0 )
+	, m_fPeak_R( 0 )
+{
+}
+
+bool OfflineRenderer::NoteCompare::operator()( const QueuedNote& note1, const QueuedNote& note2 ) const
+{
+	float fTime1 = note1.first->get_humanize_delay() + note1.first->get_position() * m_pTransport->m_nTickSize;
+	float fTime2 = note2.first->get_humanize_delay() + note2.first->get_position() * m_pTransport->m_nTickSize;
+	if ( fTime1 != fTime2 ) {
+		return fTime1 > fTime2;
+	}
+	return note1.second > note2.second;
+}
+
+OfflineRenderer::OfflineRenderer( Song* pSong, const Options& options )
+	: AudioOutput( __class_name )
+	, __options( options )
+	, __song( NULL )
+	, __sampler( NULL )
+	, __queue( NoteCompare( &m_transport ) )
+	, __sequence( 0 )
+	, __out_L( NULL )
+	, __out_R( NULL )
+	, __column( 0 )
+	, __column_left( 0 )
+	, __next_tick( 0 )
+	, __schedule_column( 0 )
+	, __tail_left( options.m_nTailFrames )
+	, __length( 0 )
+	, __drop_before( -1 )
+	, __cancel( false )
+	, __running( false )
+	, __success( false )
+	, __thread_started( false )
+	, __sample_depth( 16 )
+	, __progress( true )
+{
+	INFOLOG( "INIT" );
+	if ( __options.m_nBufferSize == 0 || __options.m_nBufferSize > MAX_BUFFER_SIZE ) {
+		__options.m_nBufferSize = MAX_BUFFER_SIZE;
+	}
+	m_transport.m_status = TransportInfo::ROLLING;
+	m_transport.m_nFrames = 0;
+	m_transport.m_nTickSize = 0;
+	__out_L = new float[ MAX_BUFFER_SIZE ];
+	__out_R = new float[ MAX_BUFFER_SIZE ];
+
+	AudioEngine::get_instance()->lock( RIGHT_HERE );
+	__snapshot( pSong );
+	AudioEngine::get_instance()->unlock();
+	__load_unresident();
+
+	__sampler = new Sampler( this );
+	__sampler->setInterpolateMode( __options.m_interpolation );
+	__make_stems();
+
+	// the columns start on frames of the tempo map, rounded from the start of the range
+	// so their lengths don't add up their rounding errors
+	if ( !__columns.empty() ) {
+		long long nFirstFrame = llround( __tempo_map.tick_to_frame( __columns[0].m_nStartTick ) );
+		for ( int i = 0; i < __columns.size(); i++ ) {
+			__columns[i].m_nOffset = llround( __tempo_map.tick_to_frame( __columns[i].m_nStartTick ) ) - nFirstFrame;
+		}
+		const Column& last = __columns.back();
+		__length = llround( __tempo_map.tick_to_frame( last.m_nStartTick + last.m_nLength ) ) - nFirstFrame;
+		__next_tick = __columns[0].m_nStartTick;
+		__enter_column( 0 );
+	}
+}
+
+OfflineRenderer::~OfflineRenderer()
+{
+	INFOLOG( "DESTROY" );
+	cancel();
+	wait();
+
+	// the notes refer to the copied instruments, they go first
+	__sampler->stop_playing_notes();
+	delete __sampler;
+	while ( !__queue.empty() ) {
+		delete __queue.top().first;
+		__queue.pop();
+	}
+	for ( int i = 0; i < __patterns.size(); i++ ) {
+		for ( PatternNotes::iterator it = __patterns[i].begin(); it != __patterns[i].end(); ++it ) {
+			delete it->second;
+		}
+	}
+
+	// the instruments don't own their components, the copies are freed here
+	InstrumentList* pInstruments = __song->get_instrument_list();
+	for ( int i = 0; i < pInstruments->size(); i++ ) {
+		std::vector<InstrumentComponent*>* pComponents = pInstruments->get( i )->get_components();
+		for ( int j = 0; j < pComponents->size(); j++ ) {
+			delete ( *pComponents )[j];
+		}
+		pComponents->clear();
+	}
+	for ( int i = 0; i < __song->get_components()->size(); i++ ) {
+		delete ( *__song->get_components() )[i];
+	}
+	__song->get_components()->clear();
+	delete __song;
+
+	for ( int i = 0; i < __stems.size(); i++ ) {
+		delete[] __stems[i].m_pOut_L;
+		delete[] __stems[i].m_pOut_R;
+	}
+	delete[] __out_L;
+	delete[] __out_R;
+}
+
+void OfflineRenderer::__load_unresident()
+{
+	for ( int i = 0; i < __unresident.size(); i++ ) {
+		Sample* pSample = __unresident[i]->get_sample();
+		// the pool shares the data with the other layers and renderers of the same file
+		pSample->load();
+		if ( pSample->is_empty() ) {
+			ERRORLOG( QString( "unable to load %1, its notes play the nearest loaded layer" ).arg( pSample->get_filepath() ) );
+			continue;
+		}
+		SamplePacker::apply_policy( pSample, QString() );
+	}
+	__unresident.clear();
+}
+
+bool OfflineRenderer::uses_effects( Song* pSong )
+{
+#ifdef H2CORE_HAVE_LADSPA
+	InstrumentList* pInstruments = pSong->get_instrument_list();
+	for ( unsigned nFX = 0; nFX < MAX_FX; ++nFX ) {
+		LadspaFX* pFX = Effects::get_instance()->getLadspaFX( nFX );
+		if ( !pFX || !pFX->isEnabled() ) continue;
+		for ( int i = 0; i < pInstruments->size(); i++ ) {
+			if ( pInstruments->get( i )->get_fx_level( nFX ) != 0.0 ) return true;
+		}
+	}
+#endif
+	return false;
+}
+
+void OfflineRenderer::__snapshot( Song* pSong )
+{
+	__song = new Song( pSong->__name, pSong->get_author(), pSong->__bpm, pSong->get_volume() );
+	__song->__resolution = pSong->__resolution;
+	__song->__is_muted = pSong->__is_muted;
+	__song->set_humanize_time_value( pSong->get_humanize_time_value() );
+	__song->set_humanize_velocity_value( pSong->get_humanize_velocity_value() );
+	__song->set_swing_factor( pSong->get_swing_factor() );
+	__song->set_mode( Song::SONG_MODE );
+
+	for ( int i = 0; i < pSong->get_components()->size(); i++ ) {
+		__song->get_components()->push_back( new DrumkitComponent( ( *pSong->get_components() )[i] ) );
+	}
+
+	// the instruments get their own layers, whose samples share the pooled data
+	InstrumentList* pInstruments = new InstrumentList();
+	for ( int i = 0; i < pSong->get_instrument_list()->size(); i++ ) {
+		Instrument* pInstr = pSong->get_instrument_list()->get( i );
+		Instrument* pCopy = new Instrument( pInstr );
+		pCopy->get_components()->clear();
+		while ( pCopy->is_queued() ) {
+			pCopy->dequeue();
+		}
+		for ( int j = 0; j < pInstr->get_components()->size(); j++ ) {
+			InstrumentComponent* pCompo = ( *pInstr->get_components() )[j];
+			InstrumentComponent* pCompoCopy = new InstrumentComponent( pCompo->get_drumkit_componentID() );
+			pCompoCopy->set_gain( pCompo->get_gain() );
+			for ( int nLayer = 0; nLayer < MAX_LAYERS; nLayer++ ) {
+				InstrumentLayer* pLayer = pCompo->get_layer( nLayer );
+				if ( !pLayer || !pLayer->get_sample() ) continue;
+				Sample* pSample = pLayer->get_sample();
+				if ( pSample->is_streamed() || pSample->is_empty() ) {
+					// neither is modified, the data of the file is loaded once unlocked
+					InstrumentLayer* pLayerCopy = new InstrumentLayer( pLayer, new Sample( pSample->get_filepath() ) );
+					pCompoCopy->set_layer( pLayerCopy, nLayer );
+					__unresident.push_back( pLayerCopy );
+				} else {
+					pCompoCopy->set_layer( new InstrumentLayer( pLayer ), nLayer );
+				}
+			}
+			pCopy->get_components()->push_back( pCompoCopy );
+		}
+		pInstruments->add( pCopy );
+		__instruments[ pInstr ] = pCopy;
+	}
+	__song->set_instrument_list( pInstruments );
+
+	PatternList* pPatterns = pSong->get_pattern_list();
+	__patterns.resize( pPatterns->size() );
+	for ( int i = 0; i < pPatterns->size(); i++ ) {
+		FOREACH_NOTE_CST_IT_BEGIN_END( pPatterns->get( i )->get_notes(), it ) {
+			Note* pNote = it->second;
+			std::map<Instrument*, Instrument*>::iterator found = __instruments.find( pNote->get_instrument() );
+			if ( found == __instruments.end() ) continue;
+			__patterns[i].insert( std::make_pair( it->first, new Note( pNote, found->second ) ) );
+		}
+	}
+
+	std::vector<PatternList*>* pColumns = pSong->get_pattern_group_vector();
+	int nFirst = std::max( __options.m_nFirstColumn, 0 );
+	int nLast = __options.m_nLastColumn;
+	if ( nLast < 0 || nLast >= ( int )pColumns->size() ) {
+		nLast = pColumns->size() - 1;
+	}
+	__tempo_map.load( pSong, Hydrogen::get_instance()->getTimeline(), __options.m_nSampleRate, __options.m_bUseTimelineBpm );
+	int nTick = 0;
+	for ( int i = 0; i <= nLast; i++ ) {
+		PatternList* pColumn = ( *pColumns )[i];
+		int nLength = pColumn->size() != 0 ? pColumn->get( 0 )->get_length() : MAX_NOTES;
+		if ( i >= nFirst ) {
+			Column column;
+			PatternList playing;
+			for ( int j = 0; j < pColumn->size(); j++ ) {
+				playing.add( pColumn->get( j ) );
+				pColumn->get( j )->extand_with_flattened_virtual_patterns( &playing );
+			}
+			for ( int j = 0; j < playing.size(); j++ ) {
+				int nPattern = pPatterns->index( playing.get( j ) );
+				if ( nPattern != -1 ) {
+					column.m_patterns.push_back( nPattern );
+				}
+			}
+			playing.clear();
+
+			// a pattern group holding tempo changes is played as a column per tempo
+			int nPieceTick = nTick;
+			while ( nPieceTick < nTick + nLength ) {
+				double fNext = __tempo_map.next_tempo_change( nPieceTick );
+				int nNext = ( fNext < 0 || fNext > nTick + nLength ) ? nTick + nLength : ( int )ceil( fNext );
+				column.m_nStartTick = nPieceTick;
+				column.m_nLength = nNext - nPieceTick;
+				column.m_nPatternTick = nPieceTick - nTick;
+				column.m_fBpm = __tempo_map.get_bpm( nPieceTick );
+				__columns.push_back( column );
+				nPieceTick = nNext;
+			}
+		}
+		nTick += nLength;
+	}
+}
+
+void OfflineRenderer::__make_stems()
+{
+	if ( __options.m_stems == NO_STEMS ) return;
+
+	// like the track export did, the instruments without notes get no file
+	std::set<Instrument*> playing;
+	for ( int i = 0; i < __columns.size(); i++ ) {
+		for ( int j = 0; j < __columns[i].m_patterns.size(); j++ ) {
+			const PatternNotes& notes = __patterns[ __columns[i].m_patterns[j] ];
+			for ( PatternNotes::const_iterator it = notes.begin(); it != notes.end(); ++it ) {
+				playing.insert( it->second->get_instrument() );
+			}
+		}
+	}
+
+	InstrumentList* pInstruments = __song->get_instrument_list();
+	for ( int i = 0; i < pInstruments->size(); i++ ) {
+		Instrument* pInstr = pInstruments->get( i );
+		if ( playing.find( pInstr ) == playing.end() ) continue;
+		std::vector<InstrumentComponent*>* pComponents = pInstr->get_components();
+		for ( int j = 0; j < pComponents->size(); j++ ) {
+			int nComponent = ( *pComponents )[j]->get_drumkit_componentID();
+			if ( __options.m_stems == INSTRUMENT_STEMS && j > 0 ) {
+				__stem_index[ std::make_pair( pInstr, nComponent ) ] = __stems.size() - 1;
+				continue;
+			}
+			Stem stem;
+			stem.m_sName = pInstr->get_name();
+			DrumkitComponent* pMainCompo = __song->get_component( nComponent );
+			if ( __options.m_stems == COMPONENT_STEMS && pMainCompo ) {
+				stem.m_sName += "-" + pMainCompo->get_name();
+			}
+			stem.m_pOut_L = new float[ MAX_BUFFER_SIZE ];
+			stem.m_pOut_R = new float[ MAX_BUFFER_SIZE ];
+			__stem_index[ std::make_pair( pInstr, nComponent ) ] = __stems.size();
+			__stems.push_back( stem );
+		}
+	}
+	// the stems keep their buffers, the voices look their track up once
+	for ( int i = 0; i < __stems.size(); i++ ) {
+		__track_buffers_L.push_back( __stems[i].m_pOut_L );
+		__track_buffers_R.push_back( __stems[i].m_pOut_R );
+	}
+	__track_buffer_count = __stems.size();
+	__track_out_enabled = !__stems.empty();
+}
+
+int OfflineRenderer::getTrackIndex( Instrument* pInstr, InstrumentComponent* pCompo )
+{
+	std::map<std::pair<Instrument*, int>, int>::const_iterator it =
+		__stem_index.find( std::make_pair( pInstr, pCompo->get_drumkit_componentID() ) );
+	return it != __stem_index.end() ? it->second : -1;
+}
+
+void OfflineRenderer::prepareTrackOuts( unsigned nFrames )
+{
+	for ( int i = 0; i < __stems.size(); i++ ) {
+		memset( __stems[i].m_pOut_L, 0, nFrames * sizeof( float ) );
+		memset( __stems[i].m_pOut_R, 0, nFrames * sizeof( float ) );
+	}
+}
+
+QStringList OfflineRenderer::get_stem_filenames( const QString& sFilename ) const
+{
+	int nDot = sFilename.lastIndexOf( '.' );
+	if ( nDot <= sFilename.lastIndexOf( '/' ) ) {
+		nDot = sFilename.size();
+	}
+	QStringList filenames;
+	for ( int i = 0; i < __stems.size(); i++ ) {
+		QString sName = __stems[i].m_sName;
+		sName.replace( '/', '_' );
+		filenames << sFilename.left( nDot ) + "-" + sName + sFilename.mid( nDot );
+	}
+	return filenames;
+}
+
+void OfflineRenderer::__enter_column( int nColumn )
+{
+	__column = nColumn;
+	const Column& column = __columns[ nColumn ];
+	float fNewTickSize = __options.m_nSampleRate * 60.0 / column.m_fBpm / __song->__resolution;
+	// the notes are placed with the tick size of the column, the position is set on its
+	// first tick instead of being rescaled from the previous tempo
+	m_transport.m_nTickSize = fNewTickSize;
+	m_transport.m_nBPM = column.m_fBpm;
+	m_transport.m_nFrames = ( long long )( column.m_nStartTick * m_transport.m_nTickSize );
+	unsigned long nEnd = nColumn + 1 < ( int )__columns.size() ? __columns[ nColumn + 1 ].m_nOffset : __length;
+	__column_left = nEnd - column.m_nOffset;
+}
+
+void OfflineRenderer::seek_column( int nColumn )
+{
+	if ( nColumn <= __column || nColumn >= ( int )__columns.size() ) return;
+
+	// render_block() enters the column in the same way
+	__enter_column( nColumn );
+	__next_tick = __columns[ nColumn ].m_nStartTick;
+	__schedule_column = nColumn;
+	__drop_before = m_transport.m_nFrames;
+}
+
+unsigned long OfflineRenderer::__get_preroll() const
+{
+	float fMaxTickSize = 0;
+	for ( int i = 0; i < __columns.size(); i++ ) {
+		fMaxTickSize = std::max( fMaxTickSize, ( float )( __options.m_nSampleRate * 60.0 / __columns[i].m_fBpm / __song->__resolution ) );
+	}
+	// lead-lag, swing and humanization move a note by less than this, the block size delays it
+	double fShift = fMaxTickSize * ( LEAD_LAG_TICKS + 6 + 1 ) + MAX_TIME_HUMANIZE + __options.m_nBufferSize;
+
+	// the longest layer of each instrument, played at its own pitch
+	std::map<Instrument*, double> longest;
+	InstrumentList* pInstruments = __song->get_instrument_list();
+	for ( int i = 0; i < pInstruments->size(); i++ ) {
+		Instrument* pInstr = pInstruments->get( i );
+		double fFrames = 0;
+		std::vector<InstrumentComponent*>* pComponents = pInstr->get_components();
+		for ( int j = 0; j < pComponents->size(); j++ ) {
+			for ( int nLayer = 0; nLayer < MAX_LAYERS; nLayer++ ) {
+				InstrumentLayer* pLayer = ( *pComponents )[j]->get_layer( nLayer );
+				if ( !pLayer || !pLayer->get_sample() ) continue;
+				Sample* pSample = pLayer->get_sample();
+				fFrames = std::max( fFrames, ( double )pSample->get_frames() * __options.m_nSampleRate
+									/ pSample->get_sample_rate() / pow( 2.0, pLayer->get_pitch() / 12.0 ) );
+			}
+		}
+		longest[ pInstr ] = fFrames;
+	}
+
+	// a lower note lasts longer, the random pitch lowers it by up to twice its factor
+	double fVoice = 0;
+	for ( int i = 0; i < __patterns.size(); i++ ) {
+		for ( PatternNotes::const_iterator it = __patterns[i].begin(); it != __patterns[i].end(); ++it ) {
+			Instrument* pInstr = it->second->get_instrument();
+			double fPitch = it->second->get_total_pitch() - 2.0 * pInstr->get_random_pitch_factor();
+			fVoice = std::max( fVoice, longest[ pInstr ] / pow( 2.0, fPitch / 12.0 ) );
+		}
+	}
+	return ( unsigned long )( fVoice + 2 * fShift ) + 1;
+}
+
+void OfflineRenderer::__schedule( unsigned nFrames )
+{
+	if ( __column >= ( int )__columns.size() ) return;
+
+	float fTickSize = m_transport.m_nTickSize;
+	int nLeadLagFactor = fTickSize * LEAD_LAG_TICKS;
+	int nLookahead = nLeadLagFactor + MAX_TIME_HUMANIZE + 1;
+	int nTickEnd = ( m_transport.m_nFrames + nFrames + nLookahead ) / fTickSize;
+	const Column& last = __columns.back();
+	nTickEnd = std::min( nTickEnd, last.m_nStartTick + last.m_nLength );
+
+	for ( ; __next_tick < nTickEnd; __next_tick++ ) {
+		while ( __next_tick >= __columns[ __schedule_column ].m_nStartTick + __columns[ __schedule_column ].m_nLength ) {
+			__schedule_column++;
+		}
+		const Column& column = __columns[ __schedule_column ];
+		int nPatternTick = __next_tick - column.m_nStartTick + column.m_nPatternTick;
+		for ( int i = 0; i < column.m_patterns.size(); i++ ) {
+			std::pair<PatternNotes::iterator, PatternNotes::iterator> range = __patterns[ column.m_patterns[i] ].equal_range( nPatternTick );
+			for ( PatternNotes::iterator it = range.first; it != range.second; ++it ) {
+				Note* pNote = it->second;
+				int nOffset = 0;
+
+				// Swing
+				if ( ( ( nPatternTick % 12 ) == 0 ) && ( ( nPatternTick % 24 ) != 0 ) ) {
+					nOffset += ( int )( 6.0 * fTickSize * __song->get_swing_factor() );
+				}
+				// Humanize - Time parameter
+				if ( __song->get_humanize_time_value() != 0 ) {
+					nOffset += ( int )( getGaussian( 0.3 ) * __song->get_humanize_time_value() * MAX_TIME_HUMANIZE );
+				}
+				// Lead or Lag - timing parameter
+				nOffset += ( int )( pNote->get_lead_lag() * nLeadLagFactor );
+
+				if ( ( __next_tick == 0 ) && ( nOffset < 0 ) ) {
+					nOffset = 0;
+				}
+				Note* pCopiedNote = new Note( pNote );
+				pCopiedNote->set_position( __next_tick );
+				pCopiedNote->set_humanize_delay( nOffset );
+				pNote->get_instrument()->enqueue();
+				__queue.push( std::make_pair( pCopiedNote, __sequence++ ) );
+			}
+		}
+	}
+}
+
+void OfflineRenderer::__play_notes( unsigned nFrames )
+{
+	long long nFramepos = m_transport.m_nFrames;
+	while ( !__queue.empty() ) {
+		Note* pNote = __queue.top().first;
+		long long nNoteStart = ( int )( pNote->get_position() * m_transport.m_nTickSize );
+		// the sampler handles the positive delays
+		if ( pNote->get_humanize_delay() < 0 ) {
+			nNoteStart += pNote->get_humanize_delay();
+		}
+		if ( nNoteStart >= nFramepos + nFrames ) break;
+
+		__queue.pop();
+		Instrument* pInstr = pNote->get_instrument();
+		pInstr->dequeue();
+
+		// due before the column the render was moved to
+		if ( nNoteStart < __drop_before ) {
+			delete pNote;
+			continue;
+		}
+
+		float fRandom = ( float )rand() / ( float )RAND_MAX;
+		if ( pNote->get_probability() < fRandom ) {
+			delete pNote;
+			continue;
+		}
+
+		// Humanize - Velocity parameter
+		float fHumanize = __song->get_humanize_velocity_value();
+		if ( fHumanize != 0 ) {
+			float fVelocity = pNote->get_velocity() + ( fHumanize * getGaussian( 0.2 ) - fHumanize / 2.0 );
+			pNote->set_velocity( std::min( 1.0f, std::max( 0.0f, fVelocity ) ) );
+		}
+
+		// Random Pitch ;)
+		const float fMaxPitchDeviation = 2.0;
+		pNote->set_pitch( pNote->get_pitch()
+						  + ( fMaxPitchDeviation * getGaussian( 0.2 ) - fMaxPitchDeviation / 2.0 )
+						  * pInstr->get_random_pitch_factor() );
+
+		if ( pInstr->is_stop_notes() ) {
+			Note* pOffNote = new Note( pInstr, 0.0, 0.0, 0.0, 0.0, -1, 0 );
+			pOffNote->set_note_off( true );
+			__sampler->note_on( pOffNote );
+			delete pOffNote;
+		}
+
+		__sampler->note_on( pNote );
+		if ( pNote->get_note_off() ) {
+			delete pNote;
+		}
+	}
+}
+
+unsigned OfflineRenderer::render_block()
+{
+	if ( __cancel ) return 0;
+
+	unsigned nFrames = __options.m_nBufferSize;
+	while ( __column < ( int )__columns.size() && __column_left <= 0 ) {
+		if ( __column + 1 < ( int )__columns.size() ) {
+			__enter_column( __column + 1 );
+		} else {
+			__column = __columns.size();
+		}
+	}
+	bool bTail = __column >= ( int )__columns.size();
+	if ( bTail ) {
+		if ( __tail_left == 0 || ( __queue.empty() && __sampler->get_playing_notes_number() == 0 ) ) {
+			return 0;
+		}
+		nFrames = std::min( ( unsigned long )nFrames, __tail_left );
+		__tail_left -= nFrames;
+	} else {
+		nFrames = std::min( ( long long )nFrames, __column_left );
+	}
+
+	prepareTrackOuts( nFrames );
+
+	__schedule( nFrames );
+	__play_notes( nFrames );
+	__sampler->process( nFrames, __song );
+
+	// the sampler fills the tracks before the song volume, the main mix after
+	float fVolume = __song->get_volume();
+	for ( int i = 0; i < __stems.size(); i++ ) {
+		for ( unsigned j = 0; j < nFrames; j++ ) {
+			__stems[i].m_pOut_L[j] *= fVolume;
+			__stems[i].m_pOut_R[j] *= fVolume;
+		}
+	}
+
+	float fPeak_L = __report.m_fPeak_L;
+	float fPeak_R = __report.m_fPeak_R;
+	for ( unsigned i = 0; i < nFrames; i++ ) {
+		__out_L[i] = __sampler->__main_out_L[i];
+		__out_R[i] = __sampler->__main_out_R[i];
+		fPeak_L = std::max( fPeak_L, fabsf( __out_L[i] ) );
+		fPeak_R = std::max( fPeak_R, fabsf( __out_R[i] ) );
+	}
+	__report.m_fPeak_L = fPeak_L;
+	__report.m_fPeak_R = fPeak_R;
+	__report.m_nFrames += nFrames;
+
+	m_transport.m_nFrames += nFrames;
+	if ( !bTail ) {
+		__column_left -= nFrames;
+	}
+	return nFrames;
+}
+
+bool OfflineRenderer::render( std::vector<float>* pLeft, std::vector<float>* pRight )
+{
+	QTime timer;
+	timer.start();
+	pLeft->clear();
+	pRight->clear();
+	pLeft->reserve( __length );
+	pRight->reserve( __length );
+
+	unsigned nFrames;
+	while ( ( nFrames = render_block() ) > 0 ) {
+		pLeft->insert( pLeft->end(), __out_L, __out_L + nFrames );
+		pRight->insert( pRight->end(), __out_R, __out_R + nFrames );
+	}
+
+	__report.m_fRenderTime = timer.elapsed() / 1000.0;
+	__report.m_fDuration = ( float )__report.m_nFrames / __options.m_nSampleRate;
+	__report.m_fSpeed = __report.m_fDuration / std::max( __report.m_fRenderTime, 0.001f );
+	return !__cancel;
+}
+
+bool OfflineRenderer::render_to_files( const QStringList& filenames, int nSampleDepth, bool bProgress )
+{
+	QTime timer;
+	timer.start();
+
+	// every output gets its master bus and its tracks, the master bus first
+	std::vector<AudioFileWriter*> writers;
+	std::vector<int> sources;			// track written by each writer, -1 for the master bus
+	bool bSuccess = true;
+	for ( int nFile = 0; nFile < filenames.size() && bSuccess; nFile++ ) {
+		QStringList files = get_stem_filenames( filenames[ nFile ] );
+		int nFirstStem = 0;
+		if ( __options.m_bMaster || __stems.empty() ) {
+			files.prepend( filenames[ nFile ] );
+			nFirstStem = -1;
+		}
+		for ( int i = 0; i < files.size(); i++ ) {
+			AudioFileWriter* pWriter = new AudioFileWriter( files[i], __options.m_nSampleRate, nSampleDepth );
+			writers.push_back( pWriter );
+			sources.push_back( i + nFirstStem );
+			if ( !pWriter->open() ) {
+				bSuccess = false;
+				break;
+			}
+		}
+	}
+
+	if ( bProgress ) {
+		EventQueue::get_instance()->push_event( EVENT_PROGRESS, 0 );
+	}
+	int nPercent = 0;
+	unsigned nFrames;
+	while ( bSuccess && ( nFrames = render_block() ) > 0 ) {
+		for ( int i = 0; i < writers.size() && bSuccess; i++ ) {
+			int nStem = sources[i];
+			bSuccess = writers[i]->write( nStem == -1 ? __out_L : __stems[ nStem ].m_pOut_L,
+										  nStem == -1 ? __out_R : __stems[ nStem ].m_pOut_R, nFrames );
+		}
+		// 100 is sent once the files are complete
+		int nNewPercent = __length ? std::min( 99, ( int )( __report.m_nFrames * 100 / __length ) ) : 99;
+		if ( bProgress && nNewPercent != nPercent ) {
+			nPercent = nNewPercent;
+			EventQueue::get_instance()->push_event( EVENT_PROGRESS, nPercent );
+		}
+	}
+	for ( int i = 0; i < writers.size(); i++ ) {
+		if ( !writers[i]->close() ) {
+			bSuccess = false;
+		}
+		delete writers[i];
+	}
+
+	__report.m_fRenderTime = timer.elapsed() / 1000.0;
+	__report.m_fDuration = ( float )__report.m_nFrames / __options.m_nSampleRate;
+	__report.m_fSpeed = __report.m_fDuration / std::max( __report.m_fRenderTime, 0.001f );
+	INFOLOG( QString( "%1 rendered with %2 tracks, %3 s of audio in %4 s, %5x realtime" )
+			 .arg( filenames.join( ", " ) ).arg( __stems.size() ).arg( __report.m_fDuration )
+			 .arg( __report.m_fRenderTime ).arg( __report.m_fSpeed ) );
+	return bSuccess && !__cancel;
+}
+
+bool OfflineRenderer::render_parallel( Song* pSong, const Options& options, int nJobs,
+									   std::vector<float>* pLeft, std::vector<float>* pRight, Report* pReport )
+{
+	QTime timer;
+	timer.start();
+	pLeft->clear();
+	pRight->clear();
+
+	Options segmentOptions = options;
+	segmentOptions.m_stems = NO_STEMS;
+	std::vector<Segment*> segments;
+	Segment* pFirst = new Segment();
+	pFirst->m_pRenderer = new OfflineRenderer( pSong, segmentOptions );
+	pFirst->m_nSkip = 0;
+	pFirst->m_nFrames = ULONG_MAX;
+	segments.push_back( pFirst );
+
+	// the round robin layers depend on every note played before
+	const std::vector<Column>& columns = pFirst->m_pRenderer->__columns;
+	InstrumentList* pInstruments = pFirst->m_pRenderer->__song->get_instrument_list();
+	for ( int i = 0; i < pInstruments->size(); i++ ) {
+		if ( pInstruments->get( i )->sample_selection_alg() == Instrument::ROUND_ROBIN ) {
+			nJobs = 1;
+		}
+	}
+
+	// every segment renders the whole range with the same frame arithmetic,
+	// it starts early enough to hear the voices sounding at its first column
+	if ( nJobs > 1 && columns.size() > 1 ) {
+		unsigned long nLength = pFirst->m_pRenderer->get_length();
+		unsigned long nPreroll = pFirst->m_pRenderer->__get_preroll();
+		int nColumn = 0;
+		for ( int nJob = 1; nJob < nJobs; nJob++ ) {
+			unsigned long nTarget = nLength * nJob / nJobs;
+			int nNext = nColumn + 1;
+			while ( nNext < ( int )columns.size() && columns[ nNext ].m_nOffset < nTarget ) {
+				nNext++;
+			}
+			if ( nNext >= ( int )columns.size() ) break;
+
+			int nStart = nNext;
+			while ( nStart > 0 && columns[ nNext ].m_nOffset - columns[ nStart ].m_nOffset < nPreroll ) {
+				nStart--;
+			}
+			Segment* pSegment = new Segment();
+			pSegment->m_pRenderer = new OfflineRenderer( pSong, segmentOptions );
+			pSegment->m_pRenderer->seek_column( nStart );
+			pSegment->m_nSkip = columns[ nNext ].m_nOffset - columns[ nStart ].m_nOffset;
+			pSegment->m_nFrames = ULONG_MAX;
+			segments.back()->m_nFrames = columns[ nNext ].m_nOffset - columns[ nColumn ].m_nOffset;
+			segments.push_back( pSegment );
+			nColumn = nNext;
+		}
+	}
+
+	int nStarted = 0;
+	for ( ; nStarted < segments.size(); nStarted++ ) {
+		segments[ nStarted ]->m_bSuccess = false;
+		if ( pthread_create( &segments[ nStarted ]->m_thread, 0, segment_thread, segments[ nStarted ] ) != 0 ) {
+			___ERRORLOG( "unable to start a segment thread" );
+			break;
+		}
+	}
+	for ( int i = 0; i < nStarted; i++ ) {
+		pthread_join( segments[i]->m_thread, 0 );
+	}
+	for ( int i = nStarted; i < segments.size(); i++ ) {
+		segments[i]->m_bSuccess = false;
+	}
+
+	bool bSuccess = true;
+	Report report;
+	for ( int i = 0; i < segments.size(); i++ ) {
+		Segment* pSegment = segments[i];
+		bSuccess = bSuccess && pSegment->m_bSuccess;
+		pLeft->insert( pLeft->end(), pSegment->m_left.begin(), pSegment->m_left.end() );
+		pRight->insert( pRight->end(), pSegment->m_right.begin(), pSegment->m_right.end() );
+		delete pSegment->m_pRenderer;
+		delete pSegment;
+	}
+	for ( int i = 0; i < pLeft->size(); i++ ) {
+		report.m_fPeak_L = std::max( report.m_fPeak_L, fabsf( ( *pLeft )[i] ) );
+		report.m_fPeak_R = std::max( report.m_fPeak_R, fabsf( ( *pRight )[i] ) );
+	}
+	report.m_nFrames = pLeft->size();
+	report.m_fRenderTime = timer.elapsed() / 1000.0;
+	report.m_fDuration = ( float )report.m_nFrames / options.m_nSampleRate;
+	report.m_fSpeed = report.m_fDuration / std::max( report.m_fRenderTime, 0.001f );
+	___INFOLOG( QString( "%1 segments, %2 s of audio in %3 s, %4x realtime" )
+				.arg( segments.size() ).arg( report.m_fDuration ).arg( report.m_fRenderTime ).arg( report.m_fSpeed ) );
+	if ( pReport ) {
+		*pReport = report;
+	}
+	return bSuccess;
+}
+
+bool OfflineRenderer::render_parallel_to_files( Song* pSong, const Options& options, int nJobs,
+												 const QStringList& filenames, int nSampleDepth, Report* pReport )
+{
+	QTime timer;
+	timer.start();
+	std::vector<float> left, right;
+	Report report;
+	if ( !render_parallel( pSong, options, nJobs, &left, &right, &report ) ) {
+		return false;
+	}
+
+	bool bSuccess = true;
+	std::vector<AudioFileWriter*> writers;
+	for ( int i = 0; i < filenames.size(); i++ ) {
+		AudioFileWriter* pWriter = new AudioFileWriter( filenames[i], options.m_nSampleRate, nSampleDepth );
+		writers.push_back( pWriter );
+		if ( !pWriter->open() ) {
+			bSuccess = false;
+			break;
+		}
+	}
+	// the writers encode concurrently, fed a chunk at a time
+	const unsigned nChunk = 16384;
+	for ( unsigned long nPos = 0; bSuccess && nPos < left.size(); nPos += nChunk ) {
+		unsigned nFrames = std::min( ( unsigned long )nChunk, left.size() - nPos );
+		for ( int i = 0; i < writers.size() && bSuccess; i++ ) {
+			bSuccess = writers[i]->write( &left[ nPos ], &right[ nPos ], nFrames );
+		}
+	}
+	for ( int i = 0; i < writers.size(); i++ ) {
+		if ( !writers[i]->close() ) {
+			bSuccess = false;
+		}
+		delete writers[i];
+	}
+
+	report.m_fRenderTime = timer.elapsed() / 1000.0;
+	report.m_fSpeed = report.m_fDuration / std::max( report.m_fRenderTime, 0.001f );
+	if ( pReport ) {
+		*pReport = report;
+	}
+	return bSuccess;
+}
+
+void OfflineRenderer::start( const QStringList& filenames, int nSampleDepth, bool bProgress )
+{
+	wait();
+	__filenames = filenames;
+	__sample_depth = nSampleDepth;
+	__progress = bProgress;
+	__success = false;
+	__running = true;
+	if ( pthread_create( &__thread, 0, render_thread, this ) != 0 ) {
+		ERRORLOG( "unable to start the render thread" );
+		__running = false;
+		if ( __progress ) {
+			EventQueue::get_instance()->push_event( EVENT_PROGRESS, 100 );
+		}
+		return;
+	}
+	__thread_started = true;
+}
+
+void OfflineRenderer::wait()
+{
+	if ( __thread_started ) {
+		pthread_join( __thread, 0 );
+		__thread_started = false;
+	}
+}
+
+void* OfflineRenderer::render_thread( void* param )
+{
+	OfflineRenderer* pRenderer = ( OfflineRenderer* )param;
+	bool bProgress = pRenderer->__progress;
+	pRenderer->__success = pRenderer->render_to_files( pRenderer->__filenames, pRenderer->__sample_depth, bProgress );
+	pRenderer->__running = false;
+	// sent last, the listener may delete the renderer
+	if ( bProgress ) {
+		EventQueue::get_instance()->push_event( EVENT_PROGRESS, 100 );
+	}
+	return 0;
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
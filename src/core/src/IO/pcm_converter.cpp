@@ -0,0 +1,179 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <hydrogen/IO/PcmConverter.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace H2Core
+{
+
+static const float S16_SCALE = 32767.0;
+static const float S24_SCALE = 8388607.0;	///< the 32 bit samples are 24 bit ones shifted, full scale stays exact in a float
+static const unsigned BLOCK_FRAMES = 256;
+
+/** clamp a block of samples to [-1,1], scale them and round them to the nearest integer */
+static void scale_block( const float* pIn, unsigned nFrames, float fScale, int32_t* pOut )
+{
+	unsigned i = 0;
+#ifdef __SSE2__
+	const __m128 one = _mm_set1_ps( 1.0f );
+	const __m128 minus_one = _mm_set1_ps( -1.0f );
+	const __m128 scale = _mm_set1_ps( fScale );
+	for ( ; i + 4 <= nFrames; i += 4 ) {
+		__m128 x = _mm_min_ps( _mm_max_ps( _mm_loadu_ps( pIn + i ), minus_one ), one );
+		_mm_storeu_si128( ( __m128i* )( pOut + i ), _mm_cvtps_epi32( _mm_mul_ps( x, scale ) ) );
+	}
+#endif
+	for ( ; i < nFrames; i++ ) {
+		pOut[i] = lrintf( std::min( 1.0f, std::max( -1.0f, pIn[i] ) ) * fScale );
+	}
+}
+
+#ifdef __SSE2__
+/** convert and interleave two channels four frames at a time, nFrames is a multiple of 4 */
+static void interleave_stereo( const float* pIn_L, const float* pIn_R, unsigned nFrames, PcmConverter::Format format, void* pOut )
+{
+	const __m128 one = _mm_set1_ps( 1.0f );
+	const __m128 minus_one = _mm_set1_ps( -1.0f );
+	const __m128 scale = _mm_set1_ps( format == PcmConverter::S16 ? S16_SCALE : S24_SCALE );
+	for ( unsigned i = 0; i < nFrames; i += 4 ) {
+		__m128 left = _mm_min_ps( _mm_max_ps( _mm_loadu_ps( pIn_L + i ), minus_one ), one );
+		__m128 right = _mm_min_ps( _mm_max_ps( _mm_loadu_ps( pIn_R + i ), minus_one ), one );
+		if ( format == PcmConverter::FLOAT ) {
+			_mm_storeu_ps( ( float* )pOut + i * 2, _mm_unpacklo_ps( left, right ) );
+			_mm_storeu_ps( ( float* )pOut + i * 2 + 4, _mm_unpackhi_ps( left, right ) );
+			continue;
+		}
+		__m128i l = _mm_cvtps_epi32( _mm_mul_ps( left, scale ) );
+		__m128i r = _mm_cvtps_epi32( _mm_mul_ps( right, scale ) );
+		__m128i lo = _mm_unpacklo_epi32( l, r );
+		__m128i hi = _mm_unpackhi_epi32( l, r );
+		if ( format == PcmConverter::S16 ) {
+			// the pack saturates as well
+			_mm_storeu_si128( ( __m128i* )( ( int16_t* )pOut + i * 2 ), _mm_packs_epi32( lo, hi ) );
+			continue;
+		}
+		if ( format == PcmConverter::S32 ) {
+			lo = _mm_slli_epi32( lo, 8 );
+			hi = _mm_slli_epi32( hi, 8 );
+		}
+		_mm_storeu_si128( ( __m128i* )( ( int32_t* )pOut + i * 2 ), lo );
+		_mm_storeu_si128( ( __m128i* )( ( int32_t* )pOut + i * 2 + 4 ), hi );
+	}
+}
+#endif
+
+int PcmConverter::sample_bytes( Format format )
+{
+	switch ( format ) {
+	case S16:
+		return 2;
+	case S24_3:
+		return 3;
+	default:
+		return 4;
+	}
+}
+
+const char* PcmConverter::name( Format format )
+{
+	switch ( format ) {
+	case S16:
+		return "S16";
+	case S24:
+		return "S24";
+	case S24_3:
+		return "S24_3";
+	case S32:
+		return "S32";
+	default:
+		return "FLOAT";
+	}
+}
+
+void PcmConverter::interleave( const float* const* ppIn, int nChannels, unsigned nFrames, Format format, void* pOut )
+{
+	unsigned nDone = 0;
+#ifdef __SSE2__
+	if ( nChannels == 2 && format != S24_3 ) {
+		nDone = nFrames & ~3u;
+		interleave_stereo( ppIn[0], ppIn[1], nDone, format, pOut );
+	}
+#endif
+
+	// the other streams and the last frames go a channel at a time through a block on the stack
+	int32_t block[ BLOCK_FRAMES ];
+	const int nBytes = sample_bytes( format );
+	const size_t nStride = nChannels * nBytes;
+	const float fScale = ( format == S16 ) ? S16_SCALE : S24_SCALE;
+	for ( unsigned nStart = nDone; nStart < nFrames; nStart += BLOCK_FRAMES ) {
+		unsigned nCount = std::min( nFrames - nStart, BLOCK_FRAMES );
+		for ( int c = 0; c < nChannels; c++ ) {
+			const float* pIn = ppIn[c] + nStart;
+			char* pSample = ( char* )pOut + ( ( size_t )nStart * nChannels + c ) * nBytes;
+			if ( format == FLOAT ) {
+				for ( unsigned i = 0; i < nCount; i++, pSample += nStride ) {
+					float fValue = std::min( 1.0f, std::max( -1.0f, pIn[i] ) );
+					memcpy( pSample, &fValue, sizeof( float ) );
+				}
+				continue;
+			}
+			scale_block( pIn, nCount, fScale, block );
+			switch ( format ) {
+			case S16:
+				for ( unsigned i = 0; i < nCount; i++, pSample += nStride ) {
+					*( int16_t* )pSample = block[i];
+				}
+				break;
+			case S24:
+				for ( unsigned i = 0; i < nCount; i++, pSample += nStride ) {
+					*( int32_t* )pSample = block[i];
+				}
+				break;
+			case S32:
+				for ( unsigned i = 0; i < nCount; i++, pSample += nStride ) {
+					*( int32_t* )pSample = ( int32_t )( ( uint32_t )block[i] << 8 );
+				}
+				break;
+			default:
+				for ( unsigned i = 0; i < nCount; i++, pSample += nStride ) {
+					pSample[0] = block[i] & 0xff;
+					pSample[1] = ( block[i] >> 8 ) & 0xff;
+					pSample[2] = ( block[i] >> 16 ) & 0xff;
+				}
+				break;
+			}
+		}
+	}
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
@@ -2,6 +2,7 @@
 #include <hydrogen/IO/PortAudioDriver.h>
 #ifdef H2CORE_HAVE_PORTAUDIO
 
+#include <algorithm>
 #include <iostream>
 
 #include <hydrogen/Preferences.h>
@@ -21,10 +22,21 @@ int portAudioCallback(
 	pDriver->m_processCallback( pDriver->m_nBufferSize, NULL );
 
 	float *out = ( float* )outputBuffer;
-
-	for ( unsigned i = 0; i < framesPerBuffer; i++ ) {
-		*out++ = pDriver->m_pOut_L[ i ];
-		*out++ = pDriver->m_pOut_R[ i ];
+	int nChannels = pDriver->getChannels();
+
+	if ( nChannels == 2 ) {
+		for ( unsigned i = 0; i < framesPerBuffer; i++ ) {
+			*out++ = pDriver->m_pOut_L[ i ];
+			*out++ = pDriver->m_pOut_R[ i ];
+		}
+		return 0;
+	}
+	// the main mix, then the channel pairs
+	for ( int c = 0; c < nChannels; c++ ) {
+		float *in = pDriver->getOut( c );
+		for ( unsigned i = 0; i < framesPerBuffer; i++ ) {
+			out[ i * nChannels + c ] = in[ i ];
+		}
 	}
 	return 0;
 }
@@ -76,21 +88,30 @@ int PortAudioDriver::connect()
 		return 1;
 	}
 
+	int nPairs = std::max( 1, Preferences::get_instance()->m_nOutputChannelPairs );
 	err = Pa_OpenDefaultStream(
 				&m_pStream,        /* passes back stream pointer */
 				0,              /* no input channels */
-				2,              /* stereo output */
+				nPairs * 2,     /* the main mix and the channel pairs */
 				paFloat32,      /* 32 bit floating point output */
 				m_nSampleRate,          // sample rate
 				m_nBufferSize,            // frames per buffer
 				portAudioCallback, /* specify our custom callback */
 				this );        /* pass our data through to callback */
 
+	if ( err != paNoError && nPairs > 1 ) {
+		// the device can't take the channel pairs, the main mix is played alone
+		WARNINGLOG( QString( "Portaudio can't open %1 channels, using 2: %2" ).arg( nPairs * 2 ).arg( Pa_GetErrorText( err ) ) );
+		nPairs = 1;
+		err = Pa_OpenDefaultStream( &m_pStream, 0, 2, paFloat32, m_nSampleRate, m_nBufferSize, portAudioCallback, this );
+	}
 
 	if ( err != paNoError ) {
 		ERRORLOG(  "Portaudio error in Pa_OpenDefaultStream: " + QString( Pa_GetErrorText( err ) ) );
 		return 1;
 	}
+	// allocated before the stream starts calling back
+	init_channel_pairs( m_nBufferSize, nPairs );
 
 	err = Pa_StartStream( m_pStream );
 
@@ -125,6 +146,8 @@ void PortAudioDriver::disconnect()
 
 	delete[] m_pOut_R;
 	m_pOut_R = NULL;
+
+	free_channel_pairs();
 }
 
 unsigned PortAudioDriver::getBufferSize()
@@ -24,6 +24,7 @@
 
 #include <hydrogen/fx/Effects.h>
 #include <hydrogen/sampler/Sampler.h>
+#include <hydrogen/sampler/sample_streamer.h>
 
 #include <hydrogen/hydrogen.h>	// TODO: remove this line as soon as possible
 #include <cassert>
@@ -74,6 +75,7 @@ AudioEngine::~AudioEngine()
 //	delete Sequencer::get_instance();
 	delete __sampler;
 	delete __synth;
+	SampleStreamer::destroy_shared();
 }
 
 
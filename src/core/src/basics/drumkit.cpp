@@ -64,6 +64,7 @@ Drumkit::Drumkit( Drumkit* other ) :
 	__license( other->get_license() ),
 	__image( other->get_image() ),
 	__imageLicense( other->get_image_license() ),
+	__sample_storage( other->get_sample_storage() ),
 	__samples_loaded( other->samples_loaded() ),
 	__components( NULL )
 {
@@ -101,6 +102,15 @@ Drumkit* Drumkit::load( const QString& dk_dir, bool load_samples )
 
 Drumkit* Drumkit::load_file( const QString& dk_path, bool load_samples )
 {
+	// current drumkits are read in one pass, see XMLStreamReader
+	XMLStreamReader reader;
+	if ( reader.open( dk_path, "drumkit_info", "drumkit" ) ) {
+		Drumkit* drumkit = Drumkit::load_from( &reader, dk_path.left( dk_path.lastIndexOf( "/" ) ) );
+		if ( drumkit ) {
+			if( load_samples ) drumkit->load_samples();
+			return drumkit;
+		}
+	}
 	XMLDoc doc;
 	if( !doc.read( dk_path, Filesystem::drumkit_xsd() ) ) {
 		return Legacy::load_drumkit( dk_path );
@@ -117,33 +127,21 @@ Drumkit* Drumkit::load_file( const QString& dk_path, bool load_samples )
 
 Drumkit* Drumkit::load_from( XMLNode* node, const QString& dk_path )
 {
-	QString drumkit_name = node->read_string( "name", "", false, false );
-	if ( drumkit_name.isEmpty() ) {
-		ERRORLOG( "Drumkit has no name, abort" );
-		return NULL;
-	}
+	XMLRecord record, component_record;
+	node->read_record( &record );
 	Drumkit* drumkit = new Drumkit();
 	drumkit->__path = dk_path;
-	drumkit->__name = drumkit_name;
-	drumkit->__author = node->read_string( "author", "undefined author" );
-	drumkit->__info = node->read_string( "info", "No information available." );
-	drumkit->__license = node->read_string( "license", "undefined license" );
-	drumkit->__image = node->read_string( "image", "" );
-	drumkit->__imageLicense = node->read_string( "imageLicense", "undefined license" );
-
+	if ( !drumkit->load_record( record ) ) {
+		delete drumkit;
+		return NULL;
+	}
 
 	XMLNode componentListNode = node->firstChildElement( "componentList" );
 	if ( ! componentListNode.isNull() ) {
 		XMLNode componentNode = componentListNode.firstChildElement( "drumkitComponent" );
 		while ( ! componentNode.isNull()  ) {
-			int id = componentNode.read_int( "id", -1 );			// instrument id
-			QString sName = componentNode.read_string( "name", "" );		// name
-			float fVolume = componentNode.read_float( "volume", 1.0 );	// volume
-			DrumkitComponent* pDrumkitComponent = new DrumkitComponent( id, sName );
-			pDrumkitComponent->set_volume( fVolume );
-
-			drumkit->get_components()->push_back(pDrumkitComponent);
-
+			componentNode.read_record( &component_record );
+			drumkit->get_components()->push_back( DrumkitComponent::load_from( component_record ) );
 			componentNode = componentNode.nextSiblingElement( "drumkitComponent" );
 		}
 	}
@@ -158,16 +156,75 @@ Drumkit* Drumkit::load_from( XMLNode* node, const QString& dk_path )
 		WARNINGLOG( "instrumentList node not found" );
 		drumkit->set_instruments( new InstrumentList() );
 	} else {
-		drumkit->set_instruments( InstrumentList::load_from( &instruments_node, dk_path, drumkit_name ) );
+		drumkit->set_instruments( InstrumentList::load_from( &instruments_node, dk_path, drumkit->__name ) );
 	}
 	return drumkit;
 }
 
-void Drumkit::load_samples( )
+Drumkit* Drumkit::load_from( XMLStreamReader* reader, const QString& dk_path )
+{
+	Drumkit* drumkit = new Drumkit();
+	drumkit->__path = dk_path;
+	XMLRecord record, component_record;
+	bool components_found = false;
+	InstrumentList* instruments = 0;
+	while ( reader->readNextStartElement() ) {
+		if ( reader->name() == "componentList" ) {
+			components_found = true;
+			while ( reader->readNextStartElement() ) {
+				if ( reader->name() != "drumkitComponent" ) {
+					reader->skipCurrentElement();
+					continue;
+				}
+				reader->read_record( &component_record );
+				drumkit->get_components()->push_back( DrumkitComponent::load_from( component_record ) );
+			}
+		} else if ( reader->name() == "instrumentList" && !instruments ) {
+			instruments = InstrumentList::load_from( reader, dk_path, record.read_string( "name", "" ) );
+		} else {
+			record.add( reader->name().toString(), reader->read_text() );
+		}
+	}
+	if ( instruments ) drumkit->set_instruments( instruments );
+
+	// drumkits without components are left to Legacy::load_drumkit()
+	if ( reader->hasError() || !components_found || !drumkit->load_record( record ) ) {
+		for ( int i = 0; i < drumkit->get_components()->size(); i++ ) delete ( *drumkit->get_components() )[i];
+		delete drumkit;
+		return NULL;
+	}
+
+	if ( !instruments ) {
+		WARNINGLOG( "instrumentList node not found" );
+		drumkit->set_instruments( new InstrumentList() );
+	}
+	for ( int i = 0; i < drumkit->get_instruments()->size(); i++ ) {
+		drumkit->get_instruments()->get( i )->set_drumkit_name( drumkit->__name );
+	}
+	return drumkit;
+}
+
+bool Drumkit::load_record( const XMLRecord& record )
+{
+	__name = record.read_string( "name", "", false, false );
+	if ( __name.isEmpty() ) {
+		ERRORLOG( "Drumkit has no name, abort" );
+		return false;
+	}
+	__author = record.read_string( "author", "undefined author" );
+	__info = record.read_string( "info", "No information available." );
+	__license = record.read_string( "license", "undefined license" );
+	__image = record.read_string( "image", "" );
+	__imageLicense = record.read_string( "imageLicense", "undefined license" );
+	__sample_storage = record.read_string( "sampleStorage", "" );
+	return true;
+}
+
+void Drumkit::load_samples( bool progress )
 {
 	INFOLOG( QString( "Loading drumkit %1 instrument samples" ).arg( __name ) );
 	if( !__samples_loaded ) {
-		__instruments->load_samples();
+		__instruments->load_samples( progress );
 		__samples_loaded = true;
 	}
 }
@@ -263,6 +320,7 @@ void Drumkit::save_to( XMLNode* node, int component_id )
 	node->write_string( "license", __license );
 	node->write_string( "image", __image );
 	node->write_string( "imageLicense", __imageLicense );
+	if ( !__sample_storage.isEmpty() ) node->write_string( "sampleStorage", __sample_storage );
 
 	if( component_id == -1 ) {
 		XMLNode components_node = node->ownerDocument().createElement( "componentList" );
@@ -125,6 +125,13 @@ DrumkitComponent* DrumkitComponent::load_from( XMLNode* node, const QString& dk_
 	return pDrumkitComponent;
 }
 
+DrumkitComponent* DrumkitComponent::load_from( const XMLRecord& record )
+{
+	DrumkitComponent* pDrumkitComponent = new DrumkitComponent( record.read_int( "id", -1 ), record.read_string( "name", "" ) );
+	pDrumkitComponent->set_volume( record.read_float( "volume", 1.0 ) );
+	return pDrumkitComponent;
+}
+
 void DrumkitComponent::save_to( XMLNode* node )
 {
 	XMLNode ComponentNode = node->ownerDocument().createElement( "drumkitComponent" );
@@ -23,11 +23,14 @@
 #include <hydrogen/basics/instrument.h>
 
 #include <cassert>
+#include <algorithm>
 
 #include <hydrogen/audio_engine.h>
 
 #include <hydrogen/helpers/xml.h>
 #include <hydrogen/helpers/filesystem.h>
+#include <hydrogen/helpers/sample_loader.h>
+#include <hydrogen/helpers/sample_packer.h>
 
 #include <hydrogen/basics/adsr.h>
 #include <hydrogen/basics/sample.h>
@@ -36,6 +39,7 @@
 #include <hydrogen/basics/instrument_list.h>
 #include <hydrogen/basics/instrument_component.h>
 #include <hydrogen/basics/instrument_layer.h>
+#include <hydrogen/sampler/sample_streamer.h>
 
 namespace H2Core
 {
@@ -73,6 +77,7 @@ Instrument::Instrument( const int id, const QString& name, ADSR* adsr )
 	, __is_preview_instrument(false)
 	, __is_metronome_instrument(false)
 	, __apply_velocity( true )
+	, __disk_streaming( false )
 {
 	if ( __adsr==0 ) __adsr = new ADSR();
 	for ( int i=0; i<MAX_FX; i++ ) __fx_level[i] = 0.0;
@@ -110,6 +115,7 @@ Instrument::Instrument( Instrument* other )
 	, __is_preview_instrument(false)
 	, __is_metronome_instrument(false)
 	, __apply_velocity( other->get_apply_velocity() )
+	, __disk_streaming( other->get_disk_streaming() )
 {
 	for ( int i=0; i<MAX_FX; i++ ) __fx_level[i] = other->get_fx_level( i );
 
@@ -133,7 +139,7 @@ Instrument* Instrument::load_instrument( const QString& drumkit_name, const QStr
 	return pInstrument;
 }
 
-void Instrument::load_from( Drumkit* pDrumkit, Instrument* pInstrument, bool is_live )
+void Instrument::load_from( Drumkit* pDrumkit, Instrument* pInstrument, bool is_live, bool lazy )
 {
 	this->get_components()->clear();
 
@@ -157,7 +163,16 @@ void Instrument::load_from( Drumkit* pDrumkit, Instrument* pInstrument, bool is_
 					AudioEngine::get_instance()->unlock();
 			} else {
 				QString sample_path =  pDrumkit->get_path() + "/" + src_layer->get_sample()->get_filename();
-				Sample* sample = Sample::load( sample_path );
+				Sample* sample = NULL;
+				if ( !lazy ) {
+					sample = Sample::load( sample_path );
+					// samples streamed from disk keep their float preload
+					if ( !SampleStreamer::apply_policy( sample, pInstrument->get_disk_streaming() ) ) {
+						SamplePacker::apply_policy( sample, pDrumkit->get_sample_storage() );
+					}
+				} else if ( Filesystem::file_readable( sample_path ) ) {
+					sample = new Sample( sample_path );
+				}
 				if ( sample==0 ) {
 					_ERRORLOG( QString( "Error loading sample %1. Creating a new empty layer." ).arg( sample_path ) );
 					if ( is_live )
@@ -201,10 +216,39 @@ void Instrument::load_from( Drumkit* pDrumkit, Instrument* pInstrument, bool is_
 	this->set_lower_cc( pInstrument->get_lower_cc() );
 	this->set_higher_cc( pInstrument->get_higher_cc() );
 	this->set_apply_velocity ( pInstrument->get_apply_velocity() );
+	this->set_disk_streaming( pInstrument->get_disk_streaming() );
 	if ( is_live )
 		AudioEngine::get_instance()->unlock();
 }
 
+void Instrument::swap_drumkit_data( Instrument* other )
+{
+	std::swap( __components, other->__components );
+	std::swap( __id, other->__id );
+	std::swap( __name, other->__name );
+	std::swap( __drumkit_name, other->__drumkit_name );
+	std::swap( __gain, other->__gain );
+	std::swap( __volume, other->__volume );
+	std::swap( __pan_l, other->__pan_l );
+	std::swap( __pan_r, other->__pan_r );
+	std::swap( __adsr, other->__adsr );
+	std::swap( __filter_active, other->__filter_active );
+	std::swap( __filter_cutoff, other->__filter_cutoff );
+	std::swap( __filter_resonance, other->__filter_resonance );
+	std::swap( __random_pitch_factor, other->__random_pitch_factor );
+	std::swap( __muted, other->__muted );
+	std::swap( __mute_group, other->__mute_group );
+	std::swap( __midi_out_channel, other->__midi_out_channel );
+	std::swap( __midi_out_note, other->__midi_out_note );
+	std::swap( __stop_notes, other->__stop_notes );
+	std::swap( __sample_selection_alg, other->__sample_selection_alg );
+	std::swap( __hihat_grp, other->__hihat_grp );
+	std::swap( __lower_cc, other->__lower_cc );
+	std::swap( __higher_cc, other->__higher_cc );
+	std::swap( __apply_velocity, other->__apply_velocity );
+	std::swap( __disk_streaming, other->__disk_streaming );
+}
+
 void Instrument::load_from( const QString& dk_name, const QString& instrument_name, bool is_live )
 {
 	Drumkit* drumkit = Drumkit::load_by_name( dk_name );
@@ -223,35 +267,72 @@ void Instrument::load_from( const QString& dk_name, const QString& instrument_na
 
 Instrument* Instrument::load_from( XMLNode* node, const QString& dk_path, const QString& dk_name )
 {
-	int id = node->read_int( "id", EMPTY_INSTR_ID, false, false );
+	XMLRecord record;
+	node->read_record( &record );
+	std::vector<InstrumentComponent*> components;
+	XMLNode ComponentNode = node->firstChildElement( "instrumentComponent" );
+	while ( !ComponentNode.isNull() ) {
+		components.push_back( InstrumentComponent::load_from( &ComponentNode, dk_path ) );
+		ComponentNode = ComponentNode.nextSiblingElement( "instrumentComponent" );
+	}
+	return load_from( record, components, dk_name );
+}
+
+Instrument* Instrument::load_from( XMLStreamReader* reader, const QString& dk_path, const QString& dk_name )
+{
+	XMLRecord record;
+	std::vector<InstrumentComponent*> components;
+	while ( reader->readNextStartElement() ) {
+		if ( reader->name() == "instrumentComponent" ) {
+			components.push_back( InstrumentComponent::load_from( reader, dk_path ) );
+		} else if ( reader->name() == "layer" || reader->name() == "filename" ) {
+			// layers out of any component, Legacy::load_drumkit() handles them
+			reader->raiseError( "instrument layers without component" );
+		} else {
+			record.add( reader->name().toString(), reader->read_text() );
+		}
+	}
+
+	if ( reader->hasError() ) {
+		for ( int i = 0; i < components.size(); i++ ) delete components[i];
+		return 0;
+	}
+	return load_from( record, components, dk_name );
+}
+
+Instrument* Instrument::load_from( const XMLRecord& record, const std::vector<InstrumentComponent*>& components, const QString& dk_name )
+{
+	int id = record.read_int( "id", EMPTY_INSTR_ID, false, false );
 	if ( id==EMPTY_INSTR_ID ){
+		for ( int i = 0; i < components.size(); i++ ) delete components[i];
 		return 0;
 	}
 
-	Instrument* pInstrument = new Instrument( id, node->read_string( "name", "" ), 0 );
+	Instrument* pInstrument = new Instrument( id, record.read_string( "name", "" ), 0 );
 	pInstrument->set_drumkit_name( dk_name );
-	pInstrument->set_volume( node->read_float( "volume", 1.0f ) );
-	pInstrument->set_muted( node->read_bool( "isMuted", false ) );
-	pInstrument->set_pan_l( node->read_float( "pan_L", 1.0f ) );
-	pInstrument->set_pan_r( node->read_float( "pan_R", 1.0f ) );
+	pInstrument->set_volume( record.read_float( "volume", 1.0f ) );
+	pInstrument->set_muted( record.read_bool( "isMuted", false ) );
+	pInstrument->set_pan_l( record.read_float( "pan_L", 1.0f ) );
+	pInstrument->set_pan_r( record.read_float( "pan_R", 1.0f ) );
 	// may not exist, but can't be empty
-	pInstrument->set_apply_velocity( node->read_bool( "applyVelocity", true, false ) );
-	pInstrument->set_filter_active( node->read_bool( "filterActive", true, false ) );
-	pInstrument->set_filter_cutoff( node->read_float( "filterCutoff", 1.0f, true, false ) );
-	pInstrument->set_filter_resonance( node->read_float( "filterResonance", 0.0f, true, false ) );
-	pInstrument->set_random_pitch_factor( node->read_float( "randomPitchFactor", 0.0f, true, false ) );
-	float attack = node->read_float( "Attack", 0.0f, true, false );
-	float decay = node->read_float( "Decay", 0.0f, true, false  );
-	float sustain = node->read_float( "Sustain", 1.0f, true, false );
-	float release = node->read_float( "Release", 1000.0f, true, false );
+	pInstrument->set_apply_velocity( record.read_bool( "applyVelocity", true, false ) );
+	pInstrument->set_disk_streaming( record.read_bool( "diskStreaming", false, true, false ) );
+	pInstrument->set_filter_active( record.read_bool( "filterActive", true, false ) );
+	pInstrument->set_filter_cutoff( record.read_float( "filterCutoff", 1.0f, true, false ) );
+	pInstrument->set_filter_resonance( record.read_float( "filterResonance", 0.0f, true, false ) );
+	pInstrument->set_random_pitch_factor( record.read_float( "randomPitchFactor", 0.0f, true, false ) );
+	float attack = record.read_float( "Attack", 0.0f, true, false );
+	float decay = record.read_float( "Decay", 0.0f, true, false  );
+	float sustain = record.read_float( "Sustain", 1.0f, true, false );
+	float release = record.read_float( "Release", 1000.0f, true, false );
 	pInstrument->set_adsr( new ADSR( attack, decay, sustain, release ) );
-	pInstrument->set_gain( node->read_float( "gain", 1.0f, true, false ) );
-	pInstrument->set_mute_group( node->read_int( "muteGroup", -1, true, false ) );
-	pInstrument->set_midi_out_channel( node->read_int( "midiOutChannel", -1, true, false ) );
-	pInstrument->set_midi_out_note( node->read_int( "midiOutNote", pInstrument->__midi_out_note, true, false ) );
-	pInstrument->set_stop_notes( node->read_bool( "isStopNote", true ,false ) );
+	pInstrument->set_gain( record.read_float( "gain", 1.0f, true, false ) );
+	pInstrument->set_mute_group( record.read_int( "muteGroup", -1, true, false ) );
+	pInstrument->set_midi_out_channel( record.read_int( "midiOutChannel", -1, true, false ) );
+	pInstrument->set_midi_out_note( record.read_int( "midiOutNote", pInstrument->__midi_out_note, true, false ) );
+	pInstrument->set_stop_notes( record.read_bool( "isStopNote", true ,false ) );
 
-	QString sRead_sample_select_algo = node->read_string( "sampleSelectionAlgo", "VELOCITY" );
+	QString sRead_sample_select_algo = record.read_string( "sampleSelectionAlgo", "VELOCITY" );
 	if ( sRead_sample_select_algo.compare("VELOCITY") == 0 )
 		pInstrument->set_sample_selection_alg( VELOCITY );
 	else if ( sRead_sample_select_algo.compare("ROUND_ROBIN") == 0 )
@@ -259,29 +340,32 @@ Instrument* Instrument::load_from( XMLNode* node, const QString& dk_path, const
 	else if ( sRead_sample_select_algo.compare("RANDOM") == 0 )
 			pInstrument->set_sample_selection_alg( RANDOM );
 
-	pInstrument->set_hihat_grp( node->read_int( "isHihat", -1, true ) );
-	pInstrument->set_lower_cc( node->read_int( "lower_cc", 0, true ) );
-	pInstrument->set_higher_cc( node->read_int( "higher_cc", 127, true ) );
+	pInstrument->set_hihat_grp( record.read_int( "isHihat", -1, true ) );
+	pInstrument->set_lower_cc( record.read_int( "lower_cc", 0, true ) );
+	pInstrument->set_higher_cc( record.read_int( "higher_cc", 127, true ) );
 
 	for ( int i=0; i<MAX_FX; i++ ) {
-		pInstrument->set_fx_level( node->read_float( QString( "FX%1Level" ).arg( i+1 ), 0.0 ), i );
+		pInstrument->set_fx_level( record.read_float( QString( "FX%1Level" ).arg( i+1 ), 0.0 ), i );
 	}
 
-	XMLNode ComponentNode = node->firstChildElement( "instrumentComponent" );
-	while ( !ComponentNode.isNull() ) {
-		pInstrument->get_components()->push_back( InstrumentComponent::load_from( &ComponentNode, dk_path ) );
-		ComponentNode = ComponentNode.nextSiblingElement( "instrumentComponent" );
-	}
+	pInstrument->get_components()->insert( pInstrument->get_components()->end(), components.begin(), components.end() );
 	return pInstrument;
 }
 
 void Instrument::load_samples()
+{
+	SampleLoader loader;
+	queue_samples( &loader );
+	loader.run( false );
+}
+
+void Instrument::queue_samples( SampleLoader* loader )
 {
 	for (std::vector<InstrumentComponent*>::iterator it = get_components()->begin() ; it != get_components()->end(); ++it) {
 		InstrumentComponent* component = *it;
 		for ( int i=0; i<MAX_LAYERS; i++ ) {
 			InstrumentLayer* layer = component->get_layer( i );
-			if( layer ) layer->load_sample( );
+			if( layer && layer->get_sample() ) loader->add( layer->get_sample() );
 		}
 	}
 }
@@ -309,6 +393,7 @@ void Instrument::save_to( XMLNode* node, int component_id )
 	InstrumentNode.write_float( "randomPitchFactor", __random_pitch_factor );
 	InstrumentNode.write_float( "gain", __gain );
 	InstrumentNode.write_bool( "applyVelocity", __apply_velocity );
+	InstrumentNode.write_bool( "diskStreaming", __disk_streaming );
 	InstrumentNode.write_bool( "filterActive", __filter_active );
 	InstrumentNode.write_float( "filterCutoff", __filter_cutoff );
 	InstrumentNode.write_float( "filterResonance", __filter_resonance );
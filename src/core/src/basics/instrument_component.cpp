@@ -22,6 +22,7 @@
 
 #include <hydrogen/basics/instrument_component.h>
 
+#include <algorithm>
 #include <cassert>
 
 #include <hydrogen/audio_engine.h>
@@ -47,6 +48,7 @@ InstrumentComponent::InstrumentComponent( int related_drumkit_componentID )
 	, __gain( 1.0 )
 {
 	for ( int i=0; i<MAX_LAYERS; i++ ) __layers[i] = NULL;
+	update_layer_table();
 }
 
 InstrumentComponent::InstrumentComponent( InstrumentComponent* other )
@@ -62,6 +64,7 @@ InstrumentComponent::InstrumentComponent( InstrumentComponent* other )
 			__layers[i] = 0;
 		}
 	}
+	update_layer_table();
 }
 
 InstrumentComponent::~InstrumentComponent()
@@ -72,24 +75,141 @@ InstrumentComponent::~InstrumentComponent()
 	}
 }
 
-InstrumentComponent* InstrumentComponent::load_from( XMLNode* node, const QString& dk_path )
+void InstrumentComponent::update_layer_table()
 {
-	int id = node->read_int( "component_id", EMPTY_INSTR_ID, false, false );
-	if ( id==EMPTY_INSTR_ID ) return 0;
+	// the layers matching a velocity only change on the edges of their ranges
+	__edge_count = 0;
+	for ( int n = 0; n < MAX_LAYERS; n++ ) {
+		InstrumentLayer* layer = __layers[n];
+		if ( !layer ) continue;
+		__edges[ __edge_count++ ] = layer->get_start_velocity();
+		__edges[ __edge_count++ ] = layer->get_end_velocity();
+	}
+	std::sort( __edges, __edges + __edge_count );
+	__edge_count = std::unique( __edges, __edges + __edge_count ) - __edges;
 
-	InstrumentComponent* instrument_component = new InstrumentComponent( id );
-	instrument_component->set_gain( node->read_float( "gain", 1.0f, true, false ) );
+	int candidates[MAX_LAYERS];
+	int groups = 0;
+	int group_layers = 0;
+
+	for ( int region = 0; region < 2 * __edge_count + 1; region++ ) {
+		// an odd region is an edge, an even one the range below the next edge
+		int edge = region / 2;
+		float velocity;
+		if ( region % 2 == 1 ) {
+			velocity = __edges[ edge ];
+		} else if ( edge == 0 || edge == __edge_count ) {
+			// below the first edge or above the last one no layer can match
+			__velocity_group[region] = -1;
+			continue;
+		} else {
+			velocity = ( __edges[ edge - 1 ] + __edges[ edge ] ) / 2;
+		}
+		int count = 0;
+		for ( int n = 0; n < MAX_LAYERS; n++ ) {
+			InstrumentLayer* layer = __layers[n];
+			if ( layer && velocity >= layer->get_start_velocity() && velocity <= layer->get_end_velocity() ) {
+				candidates[count++] = n;
+			}
+		}
+		if ( count == 0 ) {
+			__velocity_group[region] = -1;
+			continue;
+		}
+		// velocities matching the same layers share their group and round robin counter
+		int group = -1;
+		for ( int g = 0; g < groups && group == -1; g++ ) {
+			if ( __group_size[g] != count ) continue;
+			bool same = true;
+			for ( int i = 0; i < count && same; i++ ) {
+				same = ( __group_layers[ __group_start[g] + i ] == candidates[i] );
+			}
+			if ( same ) group = g;
+		}
+		if ( group == -1 ) {
+			group = groups++;
+			// the entries are in place before a region refers to the group
+			std::copy( candidates, candidates + count, __group_layers + group_layers );
+			__group_start[group] = group_layers;
+			__group_size[group] = count;
+			__round_robin[group] = -1;
+			group_layers += count;
+		}
+		__velocity_group[region] = group;
+	}
+	std::fill( __group_size + groups, __group_size + VELOCITY_LAYER_REGIONS, 0 );
+}
+
+int InstrumentComponent::get_nearest_loaded_layer( float velocity ) const
+{
+	int nearest = -1;
+	float nearest_distance = 0;
+	for ( int n = 0; n < MAX_LAYERS; n++ ) {
+		InstrumentLayer* layer = __layers[n];
+		if ( !layer || !layer->get_sample() || layer->get_sample()->is_empty() ) continue;
+		float distance = 0;
+		if ( velocity < layer->get_start_velocity() ) {
+			distance = layer->get_start_velocity() - velocity;
+		} else if ( velocity > layer->get_end_velocity() ) {
+			distance = velocity - layer->get_end_velocity();
+		}
+		if ( nearest == -1 || distance < nearest_distance ) {
+			nearest = n;
+			nearest_distance = distance;
+		}
+	}
+	return nearest;
+}
+
+InstrumentComponent* InstrumentComponent::load_from( XMLNode* node, const QString& dk_path )
+{
+	XMLRecord record;
+	node->read_record( &record );
+	std::vector<InstrumentLayer*> layers;
 	XMLNode layer_node = node->firstChildElement( "layer" );
-	int n = 0;
 	while ( !layer_node.isNull() ) {
-		if ( n >= MAX_LAYERS ) {
+		if ( layers.size() >= MAX_LAYERS ) {
 			ERRORLOG( QString( "n >= MAX_LAYERS (%1)" ).arg( MAX_LAYERS ) );
 			break;
 		}
-		instrument_component->set_layer( InstrumentLayer::load_from( &layer_node, dk_path ), n );
-		n++;
+		layers.push_back( InstrumentLayer::load_from( &layer_node, dk_path ) );
 		layer_node = layer_node.nextSiblingElement( "layer" );
 	}
+	return load_from( record, layers );
+}
+
+InstrumentComponent* InstrumentComponent::load_from( XMLStreamReader* reader, const QString& dk_path )
+{
+	XMLRecord record, layer_record;
+	std::vector<InstrumentLayer*> layers;
+	while ( reader->readNextStartElement() ) {
+		if ( reader->name() == "layer" ) {
+			reader->read_record( &layer_record );
+			if ( layers.size() >= MAX_LAYERS ) {
+				ERRORLOG( QString( "n >= MAX_LAYERS (%1)" ).arg( MAX_LAYERS ) );
+				continue;
+			}
+			layers.push_back( InstrumentLayer::load_from( layer_record, dk_path ) );
+		} else {
+			record.add( reader->name().toString(), reader->read_text() );
+		}
+	}
+	return load_from( record, layers );
+}
+
+InstrumentComponent* InstrumentComponent::load_from( const XMLRecord& record, const std::vector<InstrumentLayer*>& layers )
+{
+	int id = record.read_int( "component_id", EMPTY_INSTR_ID, false, false );
+	if ( id==EMPTY_INSTR_ID ) {
+		for ( int n = 0; n < layers.size(); n++ ) delete layers[n];
+		return 0;
+	}
+
+	InstrumentComponent* instrument_component = new InstrumentComponent( id );
+	instrument_component->set_gain( record.read_float( "gain", 1.0f, true, false ) );
+	for ( int n = 0; n < layers.size(); n++ ) {
+		instrument_component->set_layer( layers[n], n );
+	}
 	return instrument_component;
 }
 
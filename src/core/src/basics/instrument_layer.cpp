@@ -75,12 +75,19 @@ void InstrumentLayer::unload_sample()
 
 InstrumentLayer* InstrumentLayer::load_from( XMLNode* node, const QString& dk_path )
 {
-	Sample* sample = new Sample( dk_path+"/"+node->read_string( "filename", "" ) );
+	XMLRecord record;
+	node->read_record( &record );
+	return load_from( record, dk_path );
+}
+
+InstrumentLayer* InstrumentLayer::load_from( const XMLRecord& record, const QString& dk_path )
+{
+	Sample* sample = new Sample( dk_path+"/"+record.read_string( "filename", "" ) );
 	InstrumentLayer* layer = new InstrumentLayer( sample );
-	layer->set_start_velocity( node->read_float( "min", 0.0 ) );
-	layer->set_end_velocity( node->read_float( "max", 1.0 ) );
-	layer->set_gain( node->read_float( "gain", 1.0, true, false ) );
-	layer->set_pitch( node->read_float( "pitch", 0.0, true, false ) );
+	layer->set_start_velocity( record.read_float( "min", 0.0 ) );
+	layer->set_end_velocity( record.read_float( "max", 1.0 ) );
+	layer->set_gain( record.read_float( "gain", 1.0, true, false ) );
+	layer->set_pitch( record.read_float( "pitch", 0.0, true, false ) );
 	return layer;
 }
 
@@ -23,6 +23,7 @@
 #include <hydrogen/basics/instrument_list.h>
 
 #include <hydrogen/helpers/xml.h>
+#include <hydrogen/helpers/sample_loader.h>
 #include <hydrogen/basics/instrument.h>
 
 namespace H2Core
@@ -49,11 +50,13 @@ InstrumentList::~InstrumentList()
 	}
 }
 
-void InstrumentList::load_samples()
+void InstrumentList::load_samples( bool progress )
 {
+	SampleLoader loader;
 	for( int i=0; i<__instruments.size(); i++ ) {
-		__instruments[i]->load_samples();
+		__instruments[i]->queue_samples( &loader );
 	}
+	loader.run( progress );
 }
 
 void InstrumentList::unload_samples()
@@ -86,6 +89,30 @@ InstrumentList* InstrumentList::load_from( XMLNode* node, const QString& dk_path
 	return instruments;
 }
 
+InstrumentList* InstrumentList::load_from( XMLStreamReader* reader, const QString& dk_path, const QString& dk_name )
+{
+	InstrumentList* instruments = new InstrumentList();
+	int count = 0;
+	while ( reader->readNextStartElement() ) {
+		if ( reader->name() != "instrument" || count >= MAX_INSTRUMENTS ) {
+			if ( reader->name() == "instrument" ) {
+				ERRORLOG( QString( "instrument count >= %2, stop reading instruments" ).arg( MAX_INSTRUMENTS ) );
+			}
+			reader->skipCurrentElement();
+			continue;
+		}
+		count++;
+		Instrument* instrument = Instrument::load_from( reader, dk_path, dk_name );
+		if( instrument ) {
+			( *instruments ) << instrument;
+		} else if ( !reader->hasError() ) {
+			ERRORLOG( QString( "Empty ID for instrument %1. The drumkit is corrupted. Skipping instrument" ).arg( count ) );
+			count--;
+		}
+	}
+	return instruments;
+}
+
 void InstrumentList::save_to( XMLNode* node, int component_id )
 {
 	XMLNode instruments_node = node->ownerDocument().createElement( "instrumentList" );
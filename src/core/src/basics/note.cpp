@@ -24,12 +24,17 @@
 
 #include <cassert>
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
 #include <hydrogen/helpers/xml.h>
 
 #include <hydrogen/basics/adsr.h>
 #include <hydrogen/basics/instrument.h>
 #include <hydrogen/basics/instrument_component.h>
 #include <hydrogen/basics/instrument_list.h>
+#include <hydrogen/sampler/sample_streamer.h>
 
 namespace H2Core
 {
@@ -54,6 +59,8 @@ Note::Note( Instrument* instrument, int position, float velocity, float pan_l, f
 	  __lead_lag( 0.0 ),
 	  __cut_off( 1.0 ),
 	  __resonance( 0.0 ),
+	  __cut_off_target( 1.0 ),
+	  __resonance_target( 0.0 ),
 	  __humanize_delay( 0 ),
 	  __bpfb_l( 0.0 ),
 	  __bpfb_r( 0.0 ),
@@ -68,16 +75,9 @@ Note::Note( Instrument* instrument, int position, float velocity, float pan_l, f
 	if ( __instrument != 0 ) {
 		__adsr = __instrument->copy_adsr();
 		__instrument_id = __instrument->get_id();
-
-		for (std::vector<InstrumentComponent*>::iterator it = __instrument->get_components()->begin() ; it !=__instrument->get_components()->end(); ++it) {
-            InstrumentComponent *pCompo = *it;
-
-			SelectedLayerInfo *sampleInfo = new SelectedLayerInfo;
-			sampleInfo->SelectedLayer = -1;
-			sampleInfo->SamplePosition = 0;
-
-			__layers_selected[ pCompo->get_drumkit_componentID() ] = sampleInfo;
-		}
+		__cut_off = __cut_off_target = __instrument->get_filter_cutoff();
+		__resonance = __resonance_target = __instrument->get_filter_resonance();
+		__init_layers_selected();
 	}
 
 	set_pan_l(pan_l);
@@ -101,6 +101,8 @@ Note::Note( Note* other, Instrument* instrument )
 	  __lead_lag( other->get_lead_lag() ),
 	  __cut_off( other->get_cut_off() ),
 	  __resonance( other->get_resonance() ),
+	  __cut_off_target( other->get_cut_off() ),
+	  __resonance_target( other->get_resonance() ),
 	  __humanize_delay( other->get_humanize_delay() ),
 	  __bpfb_l( other->get_bpfb_l() ),
 	  __bpfb_r( other->get_bpfb_r() ),
@@ -116,25 +118,130 @@ Note::Note( Note* other, Instrument* instrument )
 	if ( __instrument != 0 ) {
 		__adsr = __instrument->copy_adsr();
 		__instrument_id = __instrument->get_id();
+		__cut_off = __cut_off_target = __instrument->get_filter_cutoff();
+		__resonance = __resonance_target = __instrument->get_filter_resonance();
+		__init_layers_selected();
+	}
+}
 
-		for (std::vector<InstrumentComponent*>::iterator it = __instrument->get_components()->begin() ; it !=__instrument->get_components()->end(); ++it) {
-            InstrumentComponent *pCompo = *it;
+void Note::__init_layers_selected()
+{
+	for (std::vector<InstrumentComponent*>::iterator it = __instrument->get_components()->begin() ; it !=__instrument->get_components()->end(); ++it) {
+		InstrumentComponent *pCompo = *it;
 
-			SelectedLayerInfo *sampleInfo = new SelectedLayerInfo;
-			sampleInfo->SelectedLayer = -1;
-			sampleInfo->SamplePosition = 0;
+		SelectedLayerInfo *sampleInfo = new SelectedLayerInfo;
+		sampleInfo->SelectedLayer = -1;
+		sampleInfo->SamplePosition = 0;
+		sampleInfo->Stream = 0;
+		sampleInfo->TrackOut = -1;
+		sampleInfo->TrackRouting = -1;
 
-			__layers_selected[ pCompo->get_drumkit_componentID() ] = sampleInfo;
-        }
+		__layers_selected[ pCompo->get_drumkit_componentID() ] = sampleInfo;
 	}
 }
 
+void Note::refresh_instrument_data()
+{
+	assert( __instrument );
+	delete __adsr;
+	__adsr = __instrument->copy_adsr();
+	__instrument_id = __instrument->get_id();
+	__cut_off = __cut_off_target = __instrument->get_filter_cutoff();
+	__resonance = __resonance_target = __instrument->get_filter_resonance();
+
+	// the entries are keyed by the component IDs of the previous data
+	for ( std::map< int, SelectedLayerInfo* >::iterator it = __layers_selected.begin(); it != __layers_selected.end(); ++it ) {
+		if ( it->second && it->second->Stream ) it->second->Stream->release();
+		delete it->second;
+	}
+	__layers_selected.clear();
+	__init_layers_selected();
+}
+
 Note::~Note()
 {
+	for ( std::map< int, SelectedLayerInfo* >::iterator it = __layers_selected.begin(); it != __layers_selected.end(); ++it ) {
+		if ( it->second && it->second->Stream ) {
+			it->second->Stream->release();
+			it->second->Stream = 0;
+		}
+	}
 	delete __adsr;
 	__adsr = 0;
 }
 
+/* filter states below this level are flushed to zero, long decays would turn them into denormals */
+#define FILTER_FLUSH_LEVEL 1e-15f
+
+static inline float flush_denormal( float v )
+{
+	return ( v > -FILTER_FLUSH_LEVEL && v < FILTER_FLUSH_LEVEL ) ? 0.0f : v;
+}
+
+void Note::ramp_filter()
+{
+	__cut_off = __cut_off_target;
+	__resonance = __resonance_target;
+	__cut_off_target = __instrument->get_filter_cutoff();
+	__resonance_target = __instrument->get_filter_resonance();
+}
+
+void Note::filter_block( float* buf_l, float* buf_r, int first, int nframes, int cycle_frames )
+{
+	if ( nframes <= 0 ) return;
+
+	// the knobs are ramped over the cycle to avoid zipper noise, a block starts where it sits in the cycle
+	float cut_off_step = ( __cut_off_target - __cut_off ) / cycle_frames;
+	float resonance_step = ( __resonance_target - __resonance ) / cycle_frames;
+	float cut_off = __cut_off + cut_off_step * first;
+	float resonance = __resonance + resonance_step * first;
+	int last = first + nframes;
+
+	float bpfb_l, bpfb_r, lpfb_l, lpfb_r;
+#ifdef __SSE__
+	// left and right run together in the two low lanes
+	__m128 bpfb = _mm_setr_ps( __bpfb_l, __bpfb_r, 0.0f, 0.0f );
+	__m128 lpfb = _mm_setr_ps( __lpfb_l, __lpfb_r, 0.0f, 0.0f );
+	for ( int i = first; i < last; i++ ) {
+		cut_off += cut_off_step;
+		resonance += resonance_step;
+		__m128 cut = _mm_set1_ps( cut_off );
+		__m128 in = _mm_unpacklo_ps( _mm_load_ss( buf_l + i ), _mm_load_ss( buf_r + i ) );
+		bpfb = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( resonance ), bpfb ), _mm_mul_ps( cut, _mm_sub_ps( in, lpfb ) ) );
+		lpfb = _mm_add_ps( lpfb, _mm_mul_ps( cut, bpfb ) );
+		_mm_store_ss( buf_l + i, lpfb );
+		_mm_store_ss( buf_r + i, _mm_shuffle_ps( lpfb, lpfb, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+	}
+	float state[4];
+	_mm_storeu_ps( state, bpfb );
+	bpfb_l = state[0];
+	bpfb_r = state[1];
+	_mm_storeu_ps( state, lpfb );
+	lpfb_l = state[0];
+	lpfb_r = state[1];
+#else
+	bpfb_l = __bpfb_l;
+	bpfb_r = __bpfb_r;
+	lpfb_l = __lpfb_l;
+	lpfb_r = __lpfb_r;
+	for ( int i = first; i < last; i++ ) {
+		cut_off += cut_off_step;
+		resonance += resonance_step;
+		bpfb_l  = resonance * bpfb_l + cut_off * ( buf_l[i] - lpfb_l );
+		bpfb_r  = resonance * bpfb_r + cut_off * ( buf_r[i] - lpfb_r );
+		lpfb_l += cut_off * bpfb_l;
+		lpfb_r += cut_off * bpfb_r;
+		buf_l[i] = lpfb_l;
+		buf_r[i] = lpfb_r;
+	}
+#endif
+
+	__bpfb_l = flush_denormal( bpfb_l );
+	__bpfb_r = flush_denormal( bpfb_r );
+	__lpfb_l = flush_denormal( lpfb_l );
+	__lpfb_r = flush_denormal( lpfb_r );
+}
+
 static inline float check_boundary( float v, float min, float max )
 {
 	if ( v>max ) return max;
@@ -226,22 +333,29 @@ void Note::save_to( XMLNode* node )
 }
 
 Note* Note::load_from( XMLNode* node, InstrumentList* instruments )
+{
+	XMLRecord record;
+	node->read_record( &record );
+	return load_from( record, instruments );
+}
+
+Note* Note::load_from( const XMLRecord& record, InstrumentList* instruments )
 {
 	Note* note = new Note(
 		0,
-		node->read_int( "position", 0 ),
-		node->read_float( "velocity", 0.8f ),
-		node->read_float( "pan_L", 0.5f ),
-		node->read_float( "pan_R", 0.5f ),
-		node->read_int( "length", -1 ),
-		node->read_float( "pitch", 0.0f )
+		record.read_int( "position", 0 ),
+		record.read_float( "velocity", 0.8f ),
+		record.read_float( "pan_L", 0.5f ),
+		record.read_float( "pan_R", 0.5f ),
+		record.read_int( "length", -1 ),
+		record.read_float( "pitch", 0.0f )
 	);
-	note->set_lead_lag( node->read_float( "leadlag", 0, false, false ) );
-	note->set_key_octave( node->read_string( "key", "C0", false, false ) );
-	note->set_note_off( node->read_bool( "note_off", false, false, false ) );
-	note->set_instrument_id( node->read_int( "instrument", EMPTY_INSTR_ID ) );
+	note->set_lead_lag( record.read_float( "leadlag", 0, false, false ) );
+	note->set_key_octave( record.read_string( "key", "C0", false, false ) );
+	note->set_note_off( record.read_bool( "note_off", false, false, false ) );
+	note->set_instrument_id( record.read_int( "instrument", EMPTY_INSTR_ID ) );
 	note->map_instrument( instruments );
-    note->set_probability( node->read_float( "probability", 1.0f ));
+	note->set_probability( record.read_float( "probability", 1.0f ) );
 	return note;
 }
 
@@ -69,6 +69,20 @@ Pattern* Pattern::load_file( const QString& pattern_path, InstrumentList* instru
 {
 	INFOLOG( QString( "Load pattern %1" ).arg( pattern_path ) );
 	if ( !Filesystem::file_readable( pattern_path ) ) return 0;
+	// current patterns are read in one pass, see XMLStreamReader
+	XMLStreamReader reader;
+	if ( reader.open( pattern_path, "drumkit_pattern", "drumkit_pattern" ) ) {
+		Pattern* pattern = 0;
+		while ( reader.readNextStartElement() ) {
+			if ( reader.name() == "pattern" && !pattern ) {
+				pattern = load_from( &reader, instruments );
+			} else {
+				reader.skipCurrentElement();
+			}
+		}
+		if ( pattern && !reader.hasError() ) return pattern;
+		delete pattern;
+	}
 	XMLDoc doc;
 	if( !doc.read( pattern_path, Filesystem::drumkit_pattern_xsd() ) ) {
 		return Legacy::load_drumkit_pattern( pattern_path );
@@ -88,12 +102,10 @@ Pattern* Pattern::load_file( const QString& pattern_path, InstrumentList* instru
 
 Pattern* Pattern::load_from( XMLNode* node, InstrumentList* instruments )
 {
-	Pattern* pattern = new Pattern(
-		node->read_string( "name", "unknown", false, false ),
-		node->read_string( "info", "", false, false ),
-		node->read_string( "category", "unknown", false, false ),
-		node->read_int( "size", -1, false, false )
-	);
+	Pattern* pattern = new Pattern();
+	XMLRecord record;
+	node->read_record( &record );
+	pattern->load_record( record );
 	XMLNode note_list_node = node->firstChildElement( "noteList" );
 	if ( !note_list_node.isNull() ) {
 		XMLNode note_node = note_list_node.firstChildElement( "note" );
@@ -108,6 +120,39 @@ Pattern* Pattern::load_from( XMLNode* node, InstrumentList* instruments )
 	return pattern;
 }
 
+Pattern* Pattern::load_from( XMLStreamReader* reader, InstrumentList* instruments )
+{
+	Pattern* pattern = new Pattern();
+	XMLRecord record, note_record;
+	while ( reader->readNextStartElement() ) {
+		if ( reader->name() == "noteList" ) {
+			while ( reader->readNextStartElement() ) {
+				if ( reader->name() == "note" ) {
+					reader->read_record( &note_record );
+					Note* note = Note::load_from( note_record, instruments );
+					if( note ) {
+						pattern->insert_note( note );
+					}
+				} else {
+					reader->skipCurrentElement();
+				}
+			}
+		} else {
+			record.add( reader->name().toString(), reader->read_text() );
+		}
+	}
+	pattern->load_record( record );
+	return pattern;
+}
+
+void Pattern::load_record( const XMLRecord& record )
+{
+	__name = record.read_string( "name", "unknown", false, false );
+	__info = record.read_string( "info", "", false, false );
+	__category = record.read_string( "category", "unknown", false, false );
+	__length = record.read_int( "size", -1, false, false );
+}
+
 bool Pattern::save_file( const QString& pattern_path, bool overwrite )
 {
 	INFOLOG( QString( "Saving pattern into %1" ).arg( pattern_path ) );
@@ -24,15 +24,23 @@
 
 #include <limits>
 
+#include <QCoreApplication>
+#include <QDir>
+#include <QProcess>
+#include <QThread>
+
 #include <hydrogen/hydrogen.h>
 #include <hydrogen/Preferences.h>
 #include <hydrogen/helpers/filesystem.h>
+#include <hydrogen/helpers/sample_cache.h>
 #include <hydrogen/basics/sample.h>
+#include <hydrogen/basics/sample_pool.h>
 
 #ifdef H2CORE_HAVE_RUBBERBAND
 #include <rubberband/RubberBandStretcher.h>
 #define RUBBERBAND_BUFFER_OVERSIZE  500
 #define RUBBERBAND_DEBUG            0
+#define RUBBERBAND_BLOCK_SIZE       1024    ///< fixed, so the result does not depend on the audio driver
 #endif
 
 namespace H2Core
@@ -52,7 +60,12 @@ Sample::Sample( const QString& filepath,  int frames, int sample_rate, float* da
 	__sample_rate( sample_rate ),
 	__data_l( data_l ),
 	__data_r( data_r ),
-	__is_modified( false )
+	__is_modified( false ),
+	__preload_frames( 0 ),
+	__buffer( 0 ),
+	__format( SamplePacker::FLOAT ),
+	__packed_l( 0 ),
+	__packed_r( 0 )
 {
 	assert( filepath.lastIndexOf( "/" ) >0 );
 }
@@ -64,13 +77,28 @@ Sample::Sample( Sample* pOther ): Object( __class_name ),
 	__data_l( 0 ),
 	__data_r( 0 ),
 	__is_modified( pOther->get_is_modified() ),
+	__preload_frames( pOther->__preload_frames ),
+	__buffer( 0 ),
+	__format( SamplePacker::FLOAT ),
+	__packed_l( 0 ),
+	__packed_r( 0 ),
 	__loops( pOther->__loops ),
 	__rubberband( pOther->__rubberband )
 {
-	__data_l = new float[__frames];
-	__data_r = new float[__frames];
-	memcpy( __data_l, pOther->get_data_l(), __frames );
-	memcpy( __data_r, pOther->get_data_r(), __frames );
+	if ( pOther->__buffer ) {
+		SamplePool::retain( pOther->__buffer );
+		__attach( pOther->__buffer );
+	} else {
+		int resident_frames = get_resident_frames();
+		__data_l = new float[resident_frames];
+		memcpy( __data_l, pOther->get_data_l(), resident_frames * sizeof( float ) );
+		if ( pOther->is_mono() ) {
+			__data_r = __data_l;
+		} else {
+			__data_r = new float[resident_frames];
+			memcpy( __data_r, pOther->get_data_r(), resident_frames * sizeof( float ) );
+		}
+	}
 
 	PanEnvelope* pPan = pOther->get_pan_envelope();
 	for( int i=0; i<pPan->size(); i++ )
@@ -88,8 +116,47 @@ Sample::Sample( Sample* pOther ): Object( __class_name ),
 
 Sample::~Sample()
 {
-	if( __data_l!=0 ) delete[] __data_l;
-	if( __data_r!=0 ) delete[] __data_r;
+	__free_data();
+}
+
+void Sample::__free_data()
+{
+	if( __buffer ) {
+		// the pool frees the data once no sample uses it anymore
+		SamplePool::release( __buffer );
+		__buffer = 0;
+	} else {
+		if( __data_r != __data_l ) delete[] __data_r;
+		delete[] __data_l;
+	}
+	__data_l = __data_r = 0;
+	__packed_l = __packed_r = 0;
+	__format = SamplePacker::FLOAT;
+}
+
+void Sample::__detach()
+{
+	// the channels of a mono sample are split as they are modified separately
+	if( !__buffer && !is_mono() ) return;
+	float* data_l = new float[ __frames ];
+	float* data_r = new float[ __frames ];
+	memcpy( data_l, __data_l, __frames * sizeof( float ) );
+	memcpy( data_r, __data_r, __frames * sizeof( float ) );
+	__free_data();
+	__data_l = data_l;
+	__data_r = data_r;
+}
+
+void Sample::__attach( SampleBuffer* buffer )
+{
+	__buffer = buffer;
+	__data_l = buffer->data_l;
+	__data_r = buffer->data_r;
+	__format = buffer->format;
+	__packed_l = buffer->packed_l;
+	__packed_r = buffer->packed_r;
+	__frames = buffer->frames;
+	__sample_rate = buffer->sample_rate;
 }
 
 void Sample::set_filename( const QString& filename )
@@ -111,40 +178,136 @@ Sample* Sample::load( const QString& filepath )
 	return sample;
 }
 
-Sample* Sample::load( const QString& filepath, const Loops& loops, const Rubberband& rubber, const VelocityEnvelope& velocity, const PanEnvelope& pan )
+Sample* Sample::load( const QString& filepath, const Loops& loops, const Rubberband& rubber, const VelocityEnvelope& velocity, const PanEnvelope& pan, float bpm )
 {
+	if( rubber.use && bpm <= 0 ) bpm = Hydrogen::get_instance()->getNewBpmJTM();
+	QString processing = __processing( loops, rubber, velocity, pan, bpm );
+	QString key = SamplePool::key( filepath, processing );
+	SampleBuffer* buffer = SamplePool::acquire( key );
+	if( !buffer && rubber.use && !key.isEmpty() ) {
+		// stretched to this tempo by an earlier run
+		int frames, sample_rate;
+		float* data_l;
+		float* data_r;
+		QFile* mapping = SampleCache::map( filepath, &frames, &sample_rate, &data_l, &data_r, processing );
+		if( mapping ) buffer = SamplePool::publish( key, new SampleBuffer( frames, sample_rate, data_l, data_r, mapping ) );
+	}
+	if( buffer ) {
+		// only modified samples are pooled under a processing key
+		Sample* sample = new Sample( filepath );
+		sample->__attach( buffer );
+		sample->__loops = loops;
+		if( rubber.use ) sample->__rubberband = rubber;
+		sample->__velocity_envelope = velocity;
+		sample->__pan_envelope = pan;
+		sample->__is_modified = true;
+		return sample;
+	}
+
 	Sample* sample = Sample::load( filepath );
 	if( !sample ) return 0;
-	sample->apply( loops, rubber, velocity, pan );
+	sample->apply( loops, rubber, velocity, pan, bpm );
+	if( sample->__is_modified && !sample->__buffer && sample->__data_l && !key.isEmpty() ) {
+		// only the time-stretching is worth keeping on disk, the other transformations are cheap
+		if( rubber.use && sample->__rubberband.use
+				&& SampleCache::store( filepath, sample->__frames, sample->__sample_rate, sample->__data_l, sample->__data_r, processing ) ) {
+			int frames, sample_rate;
+			float* data_l;
+			float* data_r;
+			QFile* mapping = SampleCache::map( filepath, &frames, &sample_rate, &data_l, &data_r, processing );
+			if( mapping ) {
+				sample->__free_data();
+				buffer = new SampleBuffer( frames, sample_rate, data_l, data_r, mapping );
+			}
+		}
+		if( !buffer ) buffer = new SampleBuffer( sample->__frames, sample->__sample_rate, sample->__data_l, sample->__data_r );
+		sample->__attach( SamplePool::publish( key, buffer ) );
+	}
 	return sample;
 }
 
-void Sample::apply( const Loops& loops, const Rubberband& rubber, const VelocityEnvelope& velocity, const PanEnvelope& pan )
+QString Sample::__processing( const Loops& loops, const Rubberband& rubber, const VelocityEnvelope& velocity, const PanEnvelope& pan, float bpm )
+{
+	QString processing = QString( "loops %1 %2 %3 %4 %5" )
+						 .arg( loops.start_frame ).arg( loops.loop_frame ).arg( loops.end_frame ).arg( loops.count ).arg( loops.mode );
+	if( rubber.use ) {
+		// the stretch ratio depends on the tempo
+		processing += QString( " rubberband %1 %2 %3 %4" )
+					  .arg( rubber.divider ).arg( rubber.pitch ).arg( rubber.c_settings ).arg( bpm );
+	}
+	processing += " velocity";
+	for( int i=0; i<velocity.size(); i++ ) processing += QString( " %1:%2" ).arg( velocity[i].frame ).arg( velocity[i].value );
+	processing += " pan";
+	for( int i=0; i<pan.size(); i++ ) processing += QString( " %1:%2" ).arg( pan[i].frame ).arg( pan[i].value );
+	return processing;
+}
+
+void Sample::apply( const Loops& loops, const Rubberband& rubber, const VelocityEnvelope& velocity, const PanEnvelope& pan, float bpm )
 {
 	apply_loops( loops );
 	apply_velocity( velocity );
 	apply_pan( pan );
 #ifdef H2CORE_HAVE_RUBBERBAND
-	apply_rubberband( rubber );
+	apply_rubberband( rubber, bpm );
 #else
-	exec_rubberband_cli( rubber );
+	exec_rubberband_cli( rubber, bpm );
 #endif
 }
 
 void Sample::load()
 {
-	SF_INFO sound_info;
-	SNDFILE* file = sf_open( __filepath.toLocal8Bit(), SFM_READ, &sound_info );
-	if ( !file ) {
+	QString key = SamplePool::key( __filepath );
+	if( key.isEmpty() ) {
 		ERRORLOG( QString( "[Sample::load] Error loading file %1" ).arg( __filepath ) );
 		return;
 	}
+	SampleBuffer* buffer = SamplePool::acquire( key );
+	if( !buffer ) {
+		buffer = __decode( __filepath );
+		if( !buffer ) return;
+		buffer = SamplePool::publish( key, buffer );
+	}
+	unload();
+	__attach( buffer );
+}
+
+SampleBuffer* Sample::__decode( const QString& filepath )
+{
+	int frames, sample_rate;
+	float* data_l;
+	float* data_r;
+	QFile* mapping = SampleCache::map( filepath, &frames, &sample_rate, &data_l, &data_r );
+	if ( mapping ) return new SampleBuffer( frames, sample_rate, data_l, data_r, mapping );
+	if ( !__read_file( filepath, &frames, &sample_rate, &data_l, &data_r ) ) return 0;
+
+	// use the cached copy from now on, its pages can be shared and dropped by the system
+	if ( SampleCache::store( filepath, frames, sample_rate, data_l, data_r ) ) {
+		float* mapped_l;
+		float* mapped_r;
+		mapping = SampleCache::map( filepath, &frames, &sample_rate, &mapped_l, &mapped_r );
+		if ( mapping ) {
+			if ( data_r != data_l ) delete[] data_r;
+			delete[] data_l;
+			return new SampleBuffer( frames, sample_rate, mapped_l, mapped_r, mapping );
+		}
+	}
+	return new SampleBuffer( frames, sample_rate, data_l, data_r );
+}
+
+bool Sample::__read_file( const QString& filepath, int* frames, int* sample_rate, float** data_l, float** data_r )
+{
+	SF_INFO sound_info;
+	SNDFILE* file = sf_open( filepath.toLocal8Bit(), SFM_READ, &sound_info );
+	if ( !file ) {
+		_ERRORLOG( QString( "[Sample::load] Error loading file %1" ).arg( filepath ) );
+		return false;
+	}
 	if ( sound_info.channels > SAMPLE_CHANNELS ) {
-		WARNINGLOG( QString( "can't handle %1 channels, only 2 will be used" ).arg( sound_info.channels ) );
+		_WARNINGLOG( QString( "can't handle %1 channels, only 2 will be used" ).arg( sound_info.channels ) );
 		sound_info.channels = SAMPLE_CHANNELS;
 	}
 	if ( sound_info.frames > ( std::numeric_limits<int>::max()/sound_info.channels ) ) {
-		WARNINGLOG( QString( "sample frames count (%1) and channels (%2) are too much, truncate it." ).arg( sound_info.frames ).arg( sound_info.channels ) );
+		_WARNINGLOG( QString( "sample frames count (%1) and channels (%2) are too much, truncate it." ).arg( sound_info.frames ).arg( sound_info.channels ) );
 		sound_info.frames = ( std::numeric_limits<int>::max()/sound_info.channels );
 	}
 
@@ -152,25 +315,99 @@ void Sample::load()
 	//memset( buffer, 0, sound_info.frames *sound_info.channels );
 	sf_count_t count = sf_read_float( file, buffer, sound_info.frames * sound_info.channels );
 	sf_close( file );
-	if( count==0 ) WARNINGLOG( QString( "%1 is an empty sample" ).arg( __filepath ) );
-
-	unload();
+	if( count==0 ) _WARNINGLOG( QString( "%1 is an empty sample" ).arg( filepath ) );
 
-	__data_l = new float[ sound_info.frames ];
-	__data_r = new float[ sound_info.frames ];
-	__frames = sound_info.frames;
-	__sample_rate = sound_info.samplerate;
+	*frames = sound_info.frames;
+	*sample_rate = sound_info.samplerate;
+	*data_l = new float[ *frames ];
 
 	if ( sound_info.channels == 1 ) {
-		memcpy( __data_l, buffer, __frames * sizeof( float ) );
-		memcpy( __data_r, buffer, __frames * sizeof( float ) );
+		// a mono file is held once, both channels point to it
+		memcpy( *data_l, buffer, *frames * sizeof( float ) );
+		*data_r = *data_l;
 	} else if ( sound_info.channels == SAMPLE_CHANNELS ) {
-		for ( int i = 0; i < __frames; i++ ) {
-			__data_l[i] = buffer[i * SAMPLE_CHANNELS];
-			__data_r[i] = buffer[i * SAMPLE_CHANNELS + 1];
+		*data_r = new float[ *frames ];
+		for ( int i = 0; i < *frames; i++ ) {
+			( *data_l )[i] = buffer[i * SAMPLE_CHANNELS];
+			( *data_r )[i] = buffer[i * SAMPLE_CHANNELS + 1];
 		}
 	}
 	delete[] buffer;
+	return true;
+}
+
+bool Sample::share( Sample* other )
+{
+	if( !other->__buffer ) return false;
+	SamplePool::retain( other->__buffer );
+	unload();
+	__attach( other->__buffer );
+	return true;
+}
+
+void Sample::unload()
+{
+	__free_data();
+	__frames = __sample_rate = 0;
+	__preload_frames = 0;
+	// __is_modified = false; leave this unchanged as pan, velocity, loop and rubberband are kept unchanged
+}
+
+bool Sample::stream( int preload_frames )
+{
+	if ( __is_modified || preload_frames <= 0 || preload_frames >= __frames || !__data_l ) return false;
+
+	float* data_l = new float[ preload_frames ];
+	float* data_r = data_l;
+	memcpy( data_l, __data_l, preload_frames * sizeof( float ) );
+	if ( !is_mono() ) {
+		data_r = new float[ preload_frames ];
+		memcpy( data_r, __data_r, preload_frames * sizeof( float ) );
+	}
+	__free_data();
+	__data_l = data_l;
+	__data_r = data_r;
+	__preload_frames = preload_frames;
+	INFOLOG( QString( "%1 streamed from disk, %2 of %3 frames preloaded" ).arg( __filepath ).arg( preload_frames ).arg( __frames ) );
+	return true;
+}
+
+bool Sample::compact( SamplePacker::Format format )
+{
+	if ( format == SamplePacker::FLOAT || __format == format ) return false;
+	if ( __is_modified || is_streamed() || !__data_l ) return false;
+	QString key = SamplePool::key( __filepath, QString( "storage %1" ).arg( format ) );
+	if ( key.isEmpty() ) return false;
+	SampleBuffer* buffer = SamplePool::acquire( key );
+	if ( !buffer ) {
+		char* packed_l = SamplePacker::pack( format, __data_l, __frames );
+		char* packed_r = is_mono() ? packed_l : SamplePacker::pack( format, __data_r, __frames );
+		buffer = SamplePool::publish( key, new SampleBuffer( __frames, __sample_rate, format, packed_l, packed_r ) );
+	}
+	__free_data();
+	__attach( buffer );
+	return true;
+}
+
+int Sample::read( int first, int count, float* data_l, float* data_r ) const
+{
+	if ( first < 0 ) first = 0;
+	if ( first + count > get_resident_frames() ) count = get_resident_frames() - first;
+	if ( count <= 0 ) return 0;
+	if ( __packed_l ) {
+		SamplePacker::unpack( __format, __packed_l, first, count, data_l );
+	} else {
+		memcpy( data_l, __data_l + first, count * sizeof( float ) );
+	}
+	if ( !data_r ) return count;
+	if ( is_mono() ) {
+		memcpy( data_r, data_l, count * sizeof( float ) );
+	} else if ( __packed_r ) {
+		SamplePacker::unpack( __format, __packed_r, first, count, data_r );
+	} else {
+		memcpy( data_r, __data_r + first, count * sizeof( float ) );
+	}
+	return count;
 }
 
 bool Sample::apply_loops( const Loops& lo )
@@ -197,6 +434,8 @@ bool Sample::apply_loops( const Loops& lo )
 		return false;
 	}
 	//if( lo == __loops ) return true;
+	// transformations need the whole sample in memory as float
+	if( is_streamed() || is_compact() ) load();
 
 	bool full_loop = lo.start_frame==lo.loop_frame;
 	int full_length =  lo.end_frame - lo.start_frame;
@@ -247,8 +486,7 @@ bool Sample::apply_loops( const Loops& lo )
 		assert( x==new_length );
 	}
 	__loops = lo;
-	delete [] __data_l;
-	delete [] __data_r;
+	__free_data();
 	__data_l = new_data_l;
 	__data_r = new_data_r;
 	__frames = new_length;
@@ -263,6 +501,8 @@ void Sample::apply_velocity( const VelocityEnvelope& v )
 	// so that we here have ( int frame_idx, float scale ) points
 	// but that will break the xml storage
 	if( v.empty() && __velocity_envelope.empty() ) return;
+	if( is_streamed() || is_compact() ) load();
+	__detach();
 	__velocity_envelope.clear();
 	if ( v.size() > 0 ) {
 		float inv_resolution = __frames / 841.0F;
@@ -289,6 +529,8 @@ void Sample::apply_pan( const PanEnvelope& p )
 {
 	// TODO see apply_velocity
 	if( p.empty() && __pan_envelope.empty() ) return;
+	if( is_streamed() || is_compact() ) load();
+	__detach();
 	__pan_envelope.clear();
 	if ( p.size() > 0 ) {
 		float inv_resolution = __frames / 841.0F;
@@ -322,14 +564,16 @@ void Sample::apply_pan( const PanEnvelope& p )
 	__is_modified = true;
 }
 
-void Sample::apply_rubberband( const Rubberband& rb )
+void Sample::apply_rubberband( const Rubberband& rb, float bpm )
 {
 	// TODO see Rubberband declaration in sample.h
 #ifdef H2CORE_HAVE_RUBBERBAND
 	//if( __rubberband == rb ) return;
 	if( !rb.use ) return;
+	if( is_streamed() || is_compact() ) load();
+	if( bpm <= 0 ) bpm = Hydrogen::get_instance()->getNewBpmJTM();
 	// compute rubberband options
-	double output_duration = 60.0 / Hydrogen::get_instance()->getNewBpmJTM() * rb.divider;
+	double output_duration = 60.0 / bpm * rb.divider;
 	double time_ratio = output_duration / get_sample_duration();
 	RubberBand::RubberBandStretcher::Options options = compute_rubberband_options( rb );
 	double pitch_scale = compute_pitch_scale( rb );
@@ -342,7 +586,7 @@ void Sample::apply_rubberband( const Rubberband& rb )
 
 	//DEBUGLOG( QString( "on %1\n\toptions\t\t: %2\n\ttime ratio\t: %3\n\tpitch\t\t: %4" ).arg( get_filename() ).arg( options ).arg( time_ratio ).arg( pitch_scale ) );
 
-	int block_size = Hydrogen::get_instance()->getAudioOutput()->getBufferSize();
+	int block_size = RUBBERBAND_BLOCK_SIZE;
 	float* ibuf[2];
 	int studied = 0;
 
@@ -422,8 +666,7 @@ void Sample::apply_rubberband( const Rubberband& rb )
 
 	// DEBUGLOG( QString( "%1 frames processed, %2 frames retrieved" ).arg( __frames ).arg( retrieved ) );
 	// final data buffers
-	delete [] __data_l;
-	delete [] __data_r;
+	__free_data();
 	__data_l = new float[ retrieved ];
 	__data_r = new float[ retrieved ];
 	memcpy( __data_l, out_data_l, retrieved*sizeof( float ) );
@@ -437,7 +680,7 @@ void Sample::apply_rubberband( const Rubberband& rb )
 #endif
 }
 
-bool Sample::exec_rubberband_cli( const Rubberband& rb )
+bool Sample::exec_rubberband_cli( const Rubberband& rb, float bpm )
 {
 	//set the path to rubberband-cli
 	QString program = Preferences::get_instance()->m_rubberBandCLIexecutable;
@@ -448,7 +691,10 @@ bool Sample::exec_rubberband_cli( const Rubberband& rb )
 	}
 
 	if( rb.use ) {
-		QString outfilePath =  QDir::tempPath() + "/tmp_rb_outfile.wav";
+		// several samples may be stretched at once
+		QString tmpPrefix = QDir::tempPath() + QString( "/tmp_rb_%1_%2" )
+							.arg( QCoreApplication::applicationPid() ).arg( ( quintptr )QThread::currentThreadId() );
+		QString outfilePath = tmpPrefix + "_outfile.wav";
 		if( !write( outfilePath ) ) {
 			ERRORLOG( "unable to write sample" );
 			return false;
@@ -456,21 +702,21 @@ bool Sample::exec_rubberband_cli( const Rubberband& rb )
 
 		unsigned rubberoutframes = 0;
 		double ratio = 1.0;
-		double durationtime = 60.0 / Hydrogen::get_instance()->getNewBpmJTM() * rb.divider/*beats*/;
+		if( bpm <= 0 ) bpm = Hydrogen::get_instance()->getNewBpmJTM();
+		double durationtime = 60.0 / bpm * rb.divider/*beats*/;
 		double induration = get_sample_duration();
 		if ( induration != 0.0 ) ratio = durationtime / induration;
 
 		rubberoutframes = int( __frames * ratio + 0.1 );
 		_INFOLOG( QString( "ratio: %1, rubberoutframes: %2, rubberinframes: %3" ).arg( ratio ).arg ( rubberoutframes ).arg ( __frames ) );
 
-		QObject*	pParent = 0;
-		QProcess*	pRrubberbandProc = new QProcess( pParent );
+		QProcess	rubberbandProc;
 
 		QStringList arguments;
 		QString rCs = QString( " %1" ).arg( rb.c_settings );
 		float pitch = pow( 1.0594630943593, ( double )rb.pitch );
 		QString rPs = QString( " %1" ).arg( pitch );
-		QString rubberResultPath = QDir::tempPath() + "/tmp_rb_result_file.wav";
+		QString rubberResultPath = tmpPrefix + "_result_file.wav";
 
 		arguments << "-D" << QString( " %1" ).arg( durationtime ) 	//stretch or squash to make output file X seconds long
 				  << "--threads"					//assume multi-CPU even if only one CPU is identified
@@ -480,33 +726,33 @@ bool Sample::exec_rubberband_cli( const Rubberband& rb )
 				  << outfilePath 					//infile
 				  << rubberResultPath;					//outfile
 
-		pRrubberbandProc->start( program, arguments );
-
-		while( !	pRrubberbandProc->waitForFinished() ) {
-			//_ERRORLOG( QString( "prozessing" ));
-		}
+		rubberbandProc.start( program, arguments );
+		rubberbandProc.waitForFinished( -1 );
 		if ( QFile( rubberResultPath ).exists() == false ) {
 			_ERRORLOG( QString( "Rubberband reimporter File %1 not found" ).arg( rubberResultPath ) );
+			QFile( outfilePath ).remove();
 			return false;
 		}
 
-		Sample* p_Rubberbanded = Sample::load( rubberResultPath.toLocal8Bit() );
-		if( p_Rubberbanded==0 ) {
-			return false;
-		}
-
+		// the temporary files are reused, they must not go through the SamplePool or the SampleCache
+		int frames, sample_rate;
+		float* data_l;
+		float* data_r;
+		bool bRead = __read_file( rubberResultPath, &frames, &sample_rate, &data_l, &data_r );
 		QFile( outfilePath ).remove();
-
 		QFile( rubberResultPath ).remove();
+		if( !bRead ) {
+			return false;
+		}
 
-		__frames = p_Rubberbanded->get_frames();
-		__data_l = p_Rubberbanded->get_data_l();
-		__data_r = p_Rubberbanded->get_data_r();
-		p_Rubberbanded->__data_l = 0;
-		p_Rubberbanded->__data_r = 0;
+		__free_data();
+		__frames = frames;
+		__sample_rate = sample_rate;
+		__data_l = data_l;
+		__data_r = data_r;
+		__detach();
 		__is_modified = true;
 		__rubberband = rb;
-		delete p_Rubberbanded;
 	}
 	return true;
 }
@@ -523,6 +769,7 @@ Sample::Loops::LoopMode Sample::parse_loop_mode( const QString& string )
 
 bool Sample::write( const QString& path, int format )
 {
+	if( is_streamed() || is_compact() ) load();
 	float* obuf = new float[ SAMPLE_CHANNELS * __frames ];
 	for ( int i = 0; i < __frames; ++i ) {
 		float value_l = __data_l[i];
@@ -0,0 +1,140 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <hydrogen/basics/sample_pool.h>
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+
+namespace H2Core
+{
+
+const char* SampleBuffer::__class_name = "SampleBuffer";
+const char* SamplePool::__class_name = "SamplePool";
+SamplePool::Buffers SamplePool::__buffers;
+QMutex SamplePool::__mutex;
+
+SampleBuffer::SampleBuffer( int frames, int sample_rate, float* data_l, float* data_r, QFile* mapping ) : Object( __class_name ),
+	frames( frames ),
+	sample_rate( sample_rate ),
+	data_l( data_l ),
+	data_r( data_r ),
+	format( SamplePacker::FLOAT ),
+	packed_l( 0 ),
+	packed_r( 0 ),
+	__mapping( mapping ),
+	__refs( 0 )
+{
+}
+
+SampleBuffer::SampleBuffer( int frames, int sample_rate, SamplePacker::Format format, char* packed_l, char* packed_r ) : Object( __class_name ),
+	frames( frames ),
+	sample_rate( sample_rate ),
+	data_l( 0 ),
+	data_r( 0 ),
+	format( format ),
+	packed_l( packed_l ),
+	packed_r( packed_r ),
+	__mapping( 0 ),
+	__refs( 0 )
+{
+}
+
+SampleBuffer::~SampleBuffer()
+{
+	// mono buffers use the same array for both channels
+	if ( packed_r != packed_l ) delete[] packed_r;
+	delete[] packed_l;
+	if ( __mapping ) {
+		// the data points into the mapped file
+		delete __mapping;
+	} else {
+		if ( data_r != data_l ) delete[] data_r;
+		delete[] data_l;
+	}
+}
+
+QString SamplePool::key( const QString& filepath, const QString& processing )
+{
+	QFileInfo info( filepath );
+	QString path = info.canonicalFilePath();
+	if ( path.isEmpty() ) return QString();
+	// the modification time makes an edited file load again
+	return QString( "%1|%2|%3" ).arg( path ).arg( info.lastModified().toMSecsSinceEpoch() ).arg( processing );
+}
+
+SampleBuffer* SamplePool::acquire( const QString& key )
+{
+	if ( key.isEmpty() ) return 0;
+	QMutexLocker lock( &__mutex );
+	Buffers::iterator it = __buffers.find( key );
+	if ( it == __buffers.end() ) return 0;
+	retain( it->second );
+	return it->second;
+}
+
+SampleBuffer* SamplePool::publish( const QString& key, SampleBuffer* buffer )
+{
+	assert( !key.isEmpty() );
+	QMutexLocker lock( &__mutex );
+	// a decoding just happened, the scan is cheap compared to it
+	__purge();
+	Buffers::iterator it = __buffers.find( key );
+	if ( it != __buffers.end() ) {
+		delete buffer;
+		buffer = it->second;
+	} else {
+		__buffers[ key ] = buffer;
+	}
+	retain( buffer );
+	return buffer;
+}
+
+void SamplePool::purge()
+{
+	QMutexLocker lock( &__mutex );
+	__purge();
+}
+
+void SamplePool::__purge()
+{
+	Buffers::iterator it = __buffers.begin();
+	while ( it != __buffers.end() ) {
+		if ( it->second->__refs.load( std::memory_order_acquire ) == 0 ) {
+			delete it->second;
+			__buffers.erase( it++ );
+		} else {
+			++it;
+		}
+	}
+}
+
+int SamplePool::size()
+{
+	QMutexLocker lock( &__mutex );
+	return __buffers.size();
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
@@ -41,8 +41,12 @@
 #include <hydrogen/basics/pattern.h>
 #include <hydrogen/basics/pattern_list.h>
 #include <hydrogen/basics/note.h>
+#include <hydrogen/helpers/chunk_file.h>
 #include <hydrogen/helpers/filesystem.h>
+#include <hydrogen/helpers/sample_packer.h>
+#include <hydrogen/helpers/xml.h>
 #include <hydrogen/hydrogen.h>
+#include <hydrogen/sampler/sample_streamer.h>
 
 #include <QDomDocument>
 #include <QDir>
@@ -117,7 +121,17 @@ void Song::purge_instrument( Instrument* I )
 Song* Song::load( const QString& filename )
 {
 	SongReader reader;
-	return reader.readSong( filename );
+	QString sPath = reader.getPath( filename );
+	if ( sPath.isEmpty() ) return NULL;
+	if ( is_binary( sPath ) ) {
+		return reader.readSongBinary( sPath );
+	}
+	return reader.readSong( sPath );
+}
+
+bool Song::is_binary( const QString& filename )
+{
+	return ChunkReader::is_chunk_file( filename, SONG_BINARY_MAGIC );
 }
 
 /// Save a song to file
@@ -125,7 +139,11 @@ bool Song::save( const QString& filename )
 {
 	SongWriter writer;
 	int err;
-	err = writer.writeSong( this, filename );
+	if ( filename.endsWith( SONG_BINARY_EXT ) ) {
+		err = writer.writeSongBinary( this, filename );
+	} else {
+		err = writer.writeSong( this, filename );
+	}
 
 	if( err ) {
 		return false;
@@ -348,6 +366,469 @@ void Song::readTempPatternList( QString filename )
 //	Implementation of SongReader class
 //-----------------------------------------------------------------------------
 
+namespace
+{
+
+/// a layer element read by SongReader::readSong()
+struct LayerRecord {
+	XMLRecord record;
+	Sample::VelocityEnvelope velocity;
+	Sample::PanEnvelope pan;
+};
+
+/// an instrumentComponent element read by SongReader::readSong()
+struct ComponentRecord {
+	XMLRecord record;
+	std::vector<LayerRecord> layers;
+};
+
+/// an fx element read by SongReader::readSong()
+struct FxRecord {
+	XMLRecord record;
+	std::vector<XMLRecord> ports;
+};
+
+void readLayer( XMLStreamReader* reader, LayerRecord* layer )
+{
+	XMLRecord point;
+	while ( reader->readNextStartElement() ) {
+		if ( reader->name() == "volume" ) {
+			reader->read_record( &point );
+			layer->velocity.push_back( Sample::EnvelopePoint( point.read_int( "volume-position", 0 ), point.read_int( "volume-value", 0 ) ) );
+		} else if ( reader->name() == "pan" ) {
+			reader->read_record( &point );
+			layer->pan.push_back( Sample::EnvelopePoint( point.read_int( "pan-position", 0 ), point.read_int( "pan-value", 0 ) ) );
+		} else {
+			layer->record.add( reader->name().toString(), reader->read_text() );
+		}
+	}
+}
+
+/// the settings of a layer, as read from an XML or a binary song
+struct LayerData {
+	QString filename;
+	bool modified;
+	Sample::Loops loops;
+	Sample::Rubberband rubber;
+	float min;
+	float max;
+	float gain;
+	float pitch;
+};
+
+/// build a layer of a song instrument, bComponent is false for the layers of songs without components
+InstrumentLayer* createLayer( const LayerData& data, const Sample::VelocityEnvelope& velocity, const Sample::PanEnvelope& pan,
+							  const QString& drumkitPath, bool bDiskStreaming, bool bComponent, Instrument* pInstrument )
+{
+	QString sFilename = data.filename;
+	bool sIsModified = data.modified;
+	Sample::Rubberband ro = data.rubber;
+
+	if ( !QFile( sFilename ).exists() && !drumkitPath.isEmpty() ) {
+		sFilename = drumkitPath + "/" + sFilename;
+	}
+
+	//test the path. if test fails, disable rubberband
+	if ( QFile( Preferences::get_instance()->m_rubberBandCLIexecutable ).exists() == false ) {
+		ro.use = false;
+	}
+
+	Sample* pSample = NULL;
+	if ( !sIsModified && bComponent && Preferences::get_instance()->m_bLazyLayerLoading ) {
+		// the data is loaded in the background once the song is set, see LayerLoader
+		if ( Filesystem::file_readable( sFilename ) ) {
+			pSample = new Sample( sFilename );
+		}
+	} else if ( !sIsModified ) {
+		pSample = Sample::load( sFilename );
+	} else {
+		pSample = Sample::load( sFilename, data.loops, ro, velocity, pan );
+	}
+	if ( pSample == NULL ) {
+		___ERRORLOG( "Error loading sample: " + sFilename + " not found" );
+		pInstrument->set_muted( true );
+	}
+	if ( !SampleStreamer::apply_policy( pSample, bDiskStreaming ) && bComponent ) {
+		SamplePacker::apply_policy( pSample, QString() );
+	}
+	InstrumentLayer* pLayer = new InstrumentLayer( pSample );
+	pLayer->set_start_velocity( data.min );
+	pLayer->set_end_velocity( data.max );
+	pLayer->set_gain( data.gain );
+	pLayer->set_pitch( data.pitch );
+	return pLayer;
+}
+
+/// build a layer read by readLayer()
+InstrumentLayer* loadLayer( const LayerRecord& layer, const QString& drumkitPath, bool bDiskStreaming, bool bComponent, Instrument* pInstrument )
+{
+	const XMLRecord& record = layer.record;
+	LayerData data;
+	data.filename = record.read_string( "filename", "" );
+	data.modified = record.read_bool( "ismodified", false );
+	data.loops.mode = Sample::parse_loop_mode( record.read_string( "smode", "forward" ) );
+	data.loops.start_frame = record.read_int( "startframe", 0 );
+	data.loops.loop_frame = record.read_int( "loopframe", 0 );
+	data.loops.count = record.read_int( "loops", 0 );
+	data.loops.end_frame = record.read_int( "endframe", 0 );
+	data.rubber.use = record.read_int( "userubber", 0 );
+	data.rubber.divider = record.read_float( "rubberdivider", 0.0 );
+	data.rubber.c_settings = record.read_int( "rubberCsettings", 1 );
+	data.rubber.pitch = record.read_float( "rubberPitch", 0.0 );
+	data.min = record.read_float( "min", 0.0 );
+	data.max = record.read_float( "max", 1.0 );
+	data.gain = record.read_float( "gain", 1.0 );
+	data.pitch = record.read_float( "pitch", 0.0 );
+	return createLayer( data, layer.velocity, layer.pan, drumkitPath, bDiskStreaming, bComponent, pInstrument );
+}
+
+/// read an instrument element of a song, return 0 if it has no id
+Instrument* readInstrument( XMLStreamReader* reader )
+{
+	XMLRecord record;
+	std::vector<ComponentRecord> components;
+	std::vector<LayerRecord> layers;
+	while ( reader->readNextStartElement() ) {
+		if ( reader->name() == "instrumentComponent" ) {
+			components.push_back( ComponentRecord() );
+			ComponentRecord& component = components.back();
+			while ( reader->readNextStartElement() ) {
+				if ( reader->name() == "layer" ) {
+					component.layers.push_back( LayerRecord() );
+					readLayer( reader, &component.layers.back() );
+				} else {
+					component.record.add( reader->name().toString(), reader->read_text() );
+				}
+			}
+		} else if ( reader->name() == "layer" ) {
+			layers.push_back( LayerRecord() );
+			readLayer( reader, &layers.back() );
+		} else {
+			record.add( reader->name().toString(), reader->read_text() );
+		}
+	}
+
+	int id = record.read_int( "id", -1 );
+	QString sDrumkit = record.read_string( "drumkit", "" );
+	Hydrogen::get_instance()->setCurrentDrumkitname( sDrumkit );
+	QString sName = record.read_string( "name", "" );
+	if ( id==-1 ) {
+		___ERRORLOG( "Empty ID for instrument '" + sName + "'. skipping." );
+		return 0;
+	}
+
+	int fAttack = record.read_int( "Attack", 0 );
+	int fDecay = record.read_int( "Decay", 0 );
+	float fSustain = record.read_float( "Sustain", 1.0 );
+	int fRelease = record.read_float( "Release", 1000.0 );
+	bool bDiskStreaming = record.read_bool( "diskStreaming", false );
+
+	Instrument* pInstrument = new Instrument( id, sName, new ADSR( fAttack, fDecay, fSustain, fRelease ) );
+	pInstrument->set_volume( record.read_float( "volume", 1.0 ) );
+	pInstrument->set_muted( record.read_bool( "isMuted", false ) );
+	pInstrument->set_pan_l( record.read_float( "pan_L", 0.5 ) );
+	pInstrument->set_pan_r( record.read_float( "pan_R", 0.5 ) );
+	pInstrument->set_drumkit_name( sDrumkit );
+	pInstrument->set_apply_velocity( record.read_bool( "applyVelocity", true ) );
+	pInstrument->set_disk_streaming( bDiskStreaming );
+	for ( int i = 0; i < MAX_FX; i++ ) {
+		pInstrument->set_fx_level( record.read_float( QString( "FX%1Level" ).arg( i + 1 ), 0.0 ), i );
+	}
+	pInstrument->set_random_pitch_factor( record.read_float( "randomPitchFactor", 0.0f ) );
+	pInstrument->set_filter_active( record.read_bool( "filterActive", false ) );
+	pInstrument->set_filter_cutoff( record.read_float( "filterCutoff", 1.0f ) );
+	pInstrument->set_filter_resonance( record.read_float( "filterResonance", 0.0f ) );
+	pInstrument->set_gain( record.read_float( "gain", 1.0 ) );
+	pInstrument->set_mute_group( record.read_string( "muteGroup", "-1" ).toInt() );
+	pInstrument->set_stop_notes( record.read_bool( "isStopNote", false ) );
+	pInstrument->set_hihat_grp( record.read_int( "isHihat", -1 ) );
+	pInstrument->set_lower_cc( record.read_int( "lower_cc", 0 ) );
+	pInstrument->set_higher_cc( record.read_int( "higher_cc", 127 ) );
+	QString sRead_sample_select_algo = record.read_string( "sampleSelectionAlgo", "VELOCITY" );
+	if ( sRead_sample_select_algo.compare("VELOCITY") == 0 )
+		pInstrument->set_sample_selection_alg( Instrument::VELOCITY );
+	else if ( sRead_sample_select_algo.compare("ROUND_ROBIN") == 0 )
+		pInstrument->set_sample_selection_alg( Instrument::ROUND_ROBIN );
+	else if ( sRead_sample_select_algo.compare("RANDOM") == 0 )
+		pInstrument->set_sample_selection_alg( Instrument::RANDOM );
+	pInstrument->set_midi_out_channel( record.read_string( "midiOutChannel", "-1" ).toInt() );
+	pInstrument->set_midi_out_note( record.read_string( "midiOutNote", "60" ).toInt() );
+
+	QString drumkitPath;
+	if ( ( !sDrumkit.isEmpty() ) && ( sDrumkit != "-" ) ) {
+		drumkitPath = Filesystem::drumkit_path_search( sDrumkit );
+	}
+
+	// back compatibility code ( song version <= 0.9.0 )
+	if ( record.has( "filename" ) ) {
+		___WARNINGLOG( "Using back compatibility code. filename node found" );
+		QString sFilename = record.read_string( "filename", "" );
+
+		if ( !QFile( sFilename ).exists() && !drumkitPath.isEmpty() ) {
+			sFilename = drumkitPath + "/" + sFilename;
+		}
+		Sample* pSample = Sample::load( sFilename );
+		if ( pSample == NULL ) {
+			sFilename = sFilename.left( sFilename.length() - 4 );
+			sFilename += ".flac";
+			pSample = Sample::load( sFilename );
+		}
+		if ( pSample == NULL ) {
+			___ERRORLOG( "Error loading sample: " + sFilename + " not found" );
+			pInstrument->set_muted( true );
+		}
+		InstrumentComponent* pCompo = new InstrumentComponent ( 0 );
+		pCompo->set_layer( new InstrumentLayer( pSample ), 0 );
+		pInstrument->get_components()->push_back( pCompo );
+		return pInstrument;
+	}
+
+	bool bComponents = !components.empty();
+	if ( !bComponents ) {
+		components.push_back( ComponentRecord() );
+		components.back().layers.swap( layers );
+	}
+	for ( int i = 0; i < components.size(); i++ ) {
+		const ComponentRecord& component = components[i];
+		InstrumentComponent* pCompo = new InstrumentComponent( component.record.read_int( "component_id", 0 ) );
+		pCompo->set_gain( component.record.read_float( "gain", 1.0 ) );
+		for ( int nLayer = 0; nLayer < component.layers.size(); nLayer++ ) {
+			if ( nLayer >= MAX_LAYERS ) {
+				___ERRORLOG( "nLayer > MAX_LAYERS" );
+				break;
+			}
+			InstrumentLayer* pLayer = loadLayer( component.layers[ nLayer ], drumkitPath, bDiskStreaming, bComponents, pInstrument );
+			pCompo->set_layer( pLayer, nLayer );
+		}
+		pInstrument->get_components()->push_back( pCompo );
+	}
+	return pInstrument;
+}
+
+/// read the note elements of a noteList element, bLegacy is set for the notes of a sequenceList ( song version < 0.9.4 )
+void readNotes( XMLStreamReader* reader, Pattern* pPattern, InstrumentList* instrList, bool bLegacy )
+{
+	XMLRecord record;
+	while ( reader->readNextStartElement() ) {
+		if ( reader->name() != "note" ) {
+			reader->skipCurrentElement();
+			continue;
+		}
+		reader->read_record( &record );
+		int instrId = record.read_int( "instrument", -1 );
+		Instrument* instrRef = instrList->find( instrId );
+		if ( !instrRef ) {
+			___ERRORLOG( QString( "Instrument with ID: '%1' not found. Note skipped." ).arg( instrId ) );
+			continue;
+		}
+		Note* pNote = new Note( instrRef,
+								record.read_int( "position", 0 ),
+								record.read_float( "velocity", 0.8f ),
+								record.read_float( "pan_L", 0.5 ),
+								record.read_float( "pan_R", 0.5 ),
+								record.read_int( "length", -1 ),
+								record.read_float( "pitch", 0.0 ) );
+		pNote->set_lead_lag( record.read_float( "leadlag", 0.0 ) );
+		if ( !bLegacy ) {
+			pNote->set_key_octave( record.read_string( "key", "C0" ) );
+			pNote->set_note_off( record.read_string( "note_off", "false" ) == "true" );
+			pNote->set_probability( record.read_float( "probability", 1.0 ) );
+		}
+		pPattern->insert_note( pNote );
+	}
+}
+
+/// read a pattern element of a song
+Pattern* readPattern( XMLStreamReader* reader, InstrumentList* instrList )
+{
+	Pattern* pPattern = new Pattern();
+	XMLRecord record;
+	bool bNoteList = false;
+	while ( reader->readNextStartElement() ) {
+		if ( reader->name() == "noteList" ) {
+			bNoteList = true;
+			readNotes( reader, pPattern, instrList, false );
+		} else if ( reader->name() == "sequenceList" && !bNoteList ) {
+			// Back compatibility code. Version < 0.9.4
+			while ( reader->readNextStartElement() ) {
+				if ( reader->name() != "sequence" ) {
+					reader->skipCurrentElement();
+					continue;
+				}
+				while ( reader->readNextStartElement() ) {
+					if ( reader->name() == "noteList" ) {
+						readNotes( reader, pPattern, instrList, true );
+					} else {
+						reader->skipCurrentElement();
+					}
+				}
+			}
+		} else {
+			record.add( reader->name().toString(), reader->read_text() );
+		}
+	}
+	pPattern->set_name( record.read_string( "name", "" ) );
+	pPattern->set_info( record.read_string( "info", "" ) );
+	pPattern->set_category( record.read_string( "category", "" ) );
+	pPattern->set_length( record.read_int( "size", -1 ) );
+	return pPattern;
+}
+
+/// read the pattern elements of a patternList element
+void readPatternList( XMLStreamReader* reader, InstrumentList* instrList, PatternList* patternList )
+{
+	while ( reader->readNextStartElement() ) {
+		if ( reader->name() == "pattern" ) {
+			patternList->add( readPattern( reader, instrList ) );
+		} else {
+			reader->skipCurrentElement();
+		}
+	}
+}
+
+/// read an instrument written by SongWriter::writeSongBinary()
+Instrument* readBinaryInstrument( ChunkReader* chunk )
+{
+	int id = chunk->read_i32();
+	QString sName = chunk->read_string();
+	QString sDrumkit = chunk->read_string();
+	Hydrogen::get_instance()->setCurrentDrumkitname( sDrumkit );
+
+	Instrument* pInstrument = new Instrument( id, sName, new ADSR() );
+	pInstrument->set_drumkit_name( sDrumkit );
+	pInstrument->set_volume( chunk->read_float() );
+	pInstrument->set_muted( chunk->read_bool() );
+	pInstrument->set_pan_l( chunk->read_float() );
+	pInstrument->set_pan_r( chunk->read_float() );
+	pInstrument->set_gain( chunk->read_float() );
+	pInstrument->set_apply_velocity( chunk->read_bool() );
+	bool bDiskStreaming = chunk->read_bool();
+	pInstrument->set_disk_streaming( bDiskStreaming );
+	pInstrument->set_filter_active( chunk->read_bool() );
+	pInstrument->set_filter_cutoff( chunk->read_float() );
+	pInstrument->set_filter_resonance( chunk->read_float() );
+	for ( int i = 0; i < MAX_FX; i++ ) {
+		pInstrument->set_fx_level( chunk->read_float(), i );
+	}
+	float fAttack = chunk->read_float();
+	float fDecay = chunk->read_float();
+	float fSustain = chunk->read_float();
+	float fRelease = chunk->read_float();
+	pInstrument->set_adsr( new ADSR( fAttack, fDecay, fSustain, fRelease ) );
+	pInstrument->set_random_pitch_factor( chunk->read_float() );
+	pInstrument->set_mute_group( chunk->read_i32() );
+	pInstrument->set_stop_notes( chunk->read_bool() );
+	quint8 algo = chunk->read_u8();
+	if ( algo <= Instrument::ROUND_ROBIN ) {
+		pInstrument->set_sample_selection_alg( ( Instrument::SampleSelectionAlgo )algo );
+	}
+	pInstrument->set_midi_out_channel( chunk->read_i32() );
+	pInstrument->set_midi_out_note( chunk->read_i32() );
+	pInstrument->set_hihat_grp( chunk->read_i32() );
+	pInstrument->set_lower_cc( chunk->read_i32() );
+	pInstrument->set_higher_cc( chunk->read_i32() );
+
+	QString drumkitPath;
+	if ( ( !sDrumkit.isEmpty() ) && ( sDrumkit != "-" ) ) {
+		drumkitPath = Filesystem::drumkit_path_search( sDrumkit );
+	}
+
+	quint32 nComponents = chunk->read_u32();
+	for ( quint32 i = 0; i < nComponents && !chunk->has_error(); i++ ) {
+		InstrumentComponent* pCompo = new InstrumentComponent( chunk->read_i32() );
+		pCompo->set_gain( chunk->read_float() );
+		quint32 nLayers = chunk->read_u32();
+		for ( quint32 j = 0; j < nLayers && !chunk->has_error(); j++ ) {
+			int nLayer = chunk->read_u8();
+			LayerData data;
+			data.filename = chunk->read_string();
+			data.modified = chunk->read_bool();
+			quint8 mode = chunk->read_u8();
+			data.loops.mode = mode <= Sample::Loops::PINGPONG ? ( Sample::Loops::LoopMode )mode : Sample::Loops::FORWARD;
+			data.loops.start_frame = chunk->read_i32();
+			data.loops.loop_frame = chunk->read_i32();
+			data.loops.count = chunk->read_i32();
+			data.loops.end_frame = chunk->read_i32();
+			data.rubber.use = chunk->read_bool();
+			data.rubber.divider = chunk->read_float();
+			data.rubber.c_settings = chunk->read_i32();
+			data.rubber.pitch = chunk->read_float();
+			data.min = chunk->read_float();
+			data.max = chunk->read_float();
+			data.gain = chunk->read_float();
+			data.pitch = chunk->read_float();
+			Sample::VelocityEnvelope velocity;
+			quint32 nPoints = chunk->read_u32();
+			for ( quint32 y = 0; y < nPoints && !chunk->has_error(); y++ ) {
+				int frame = chunk->read_i32();
+				velocity.push_back( Sample::EnvelopePoint( frame, chunk->read_i32() ) );
+			}
+			Sample::PanEnvelope pan;
+			nPoints = chunk->read_u32();
+			for ( quint32 y = 0; y < nPoints && !chunk->has_error(); y++ ) {
+				int frame = chunk->read_i32();
+				pan.push_back( Sample::EnvelopePoint( frame, chunk->read_i32() ) );
+			}
+			if ( nLayer >= MAX_LAYERS || chunk->has_error() ) {
+				___ERRORLOG( "nLayer > MAX_LAYERS" );
+				continue;
+			}
+			pCompo->set_layer( createLayer( data, velocity, pan, drumkitPath, bDiskStreaming, true, pInstrument ), nLayer );
+		}
+		pInstrument->get_components()->push_back( pCompo );
+	}
+	return pInstrument;
+}
+
+/// read a pattern written by SongWriter::writeSongBinary(), its notes are read from the arrays in place
+Pattern* readBinaryPattern( ChunkReader* chunk, InstrumentList* instrList )
+{
+	Pattern* pPattern = new Pattern();
+	pPattern->set_name( chunk->read_string() );
+	pPattern->set_category( chunk->read_string() );
+	pPattern->set_length( chunk->read_i32() );
+	pPattern->set_info( chunk->read_string() );
+
+	quint32 nNotes = chunk->read_u32();
+	const uchar* positions = chunk->read_array( nNotes, 4 );
+	const uchar* instruments = chunk->read_array( nNotes, 4 );
+	const uchar* velocities = chunk->read_array( nNotes, 4 );
+	const uchar* pansL = chunk->read_array( nNotes, 4 );
+	const uchar* pansR = chunk->read_array( nNotes, 4 );
+	const uchar* leadLags = chunk->read_array( nNotes, 4 );
+	const uchar* pitches = chunk->read_array( nNotes, 4 );
+	const uchar* lengths = chunk->read_array( nNotes, 4 );
+	const uchar* probabilities = chunk->read_array( nNotes, 4 );
+	const uchar* keys = chunk->read_array( nNotes, 1 );
+	const uchar* octaves = chunk->read_array( nNotes, 1 );
+	const uchar* noteOffs = chunk->read_array( nNotes, 1 );
+	if ( chunk->has_error() ) return pPattern;
+
+	for ( quint32 i = 0; i < nNotes; i++ ) {
+		int instrId = ChunkReader::i32_at( instruments, i );
+		Instrument* instrRef = instrList->find( instrId );
+		if ( !instrRef ) {
+			___ERRORLOG( QString( "Instrument with ID: '%1' not found. Note skipped." ).arg( instrId ) );
+			continue;
+		}
+		Note* pNote = new Note( instrRef,
+								ChunkReader::i32_at( positions, i ),
+								ChunkReader::float_at( velocities, i ),
+								ChunkReader::float_at( pansL, i ),
+								ChunkReader::float_at( pansR, i ),
+								ChunkReader::i32_at( lengths, i ),
+								ChunkReader::float_at( pitches, i ) );
+		pNote->set_lead_lag( ChunkReader::float_at( leadLags, i ) );
+		pNote->set_probability( ChunkReader::float_at( probabilities, i ) );
+		pNote->set_key_octave( ( Note::Key )keys[i], ( Note::Octave )( qint8 )octaves[i] );
+		pNote->set_note_off( noteOffs[i] != 0 );
+		pPattern->insert_note( pNote );
+	}
+	return pPattern;
+}
+
+}//anonymous namespace
+
 const char* SongReader::__class_name = "SongReader";
 
 SongReader::SongReader()
@@ -384,7 +865,7 @@ const QString SongReader::getPath ( const QString& filename )
 }
 
 ///
-/// Reads a song.
+/// Reads a song in one pass, see XMLStreamReader.
 /// return NULL = error reading song file.
 ///
 Song* SongReader::readSong( const QString& filename )
@@ -393,529 +874,264 @@ Song* SongReader::readSong( const QString& filename )
 	if ( FileName.isEmpty() ) return NULL;
 
 	INFOLOG( "Reading " + FileName );
-	Song* song = NULL;
-
-	QDomDocument doc = LocalFileMng::openXmlDocument( FileName );
-	QDomNodeList nodeList = doc.elementsByTagName( "song" );
-
-	if( nodeList.isEmpty() ) {
+	XMLStreamReader reader;
+	if ( !reader.open( FileName, "song" ) ) {
 		ERRORLOG( "Error reading song: song node not found" );
 		return NULL;
 	}
 
-	QDomNode songNode = nodeList.at( 0 );
-
-	m_sSongVersion = LocalFileMng::readXmlString( songNode , "version", "Unknown version" );
-
-	if ( m_sSongVersion != QString( get_version().c_str() ) ) {
-		WARNINGLOG( "Trying to load a song created with a different version of hydrogen." );
-		WARNINGLOG( "Song [" + FileName + "] saved with version " + m_sSongVersion );
-	}
-
-	float fBpm = LocalFileMng::readXmlFloat( songNode, "bpm", 120 );
-	Hydrogen::get_instance()->setNewBpmJTM( fBpm );
-	float fVolume = LocalFileMng::readXmlFloat( songNode, "volume", 0.5 );
-	float fMetronomeVolume = LocalFileMng::readXmlFloat( songNode, "metronomeVolume", 0.5 );
-	QString sName( LocalFileMng::readXmlString( songNode, "name", "Untitled Song" ) );
-	QString sAuthor( LocalFileMng::readXmlString( songNode, "author", "Unknown Author" ) );
-	QString sNotes( LocalFileMng::readXmlString( songNode, "notes", "..." ) );
-	QString sLicense( LocalFileMng::readXmlString( songNode, "license", "Unknown license" ) );
-	bool bLoopEnabled = LocalFileMng::readXmlBool( songNode, "loopEnabled", false );
-	Preferences::get_instance()->setPatternModePlaysSelected( LocalFileMng::readXmlBool( songNode, "patternModeMode", true ) );
-	Song::SongMode nMode = Song::PATTERN_MODE;	// Mode (song/pattern)
-	QString sMode = LocalFileMng::readXmlString( songNode, "mode", "pattern" );
-	if ( sMode == "song" ) {
-		nMode = Song::SONG_MODE;
-	}
-
-	float fHumanizeTimeValue = LocalFileMng::readXmlFloat( songNode, "humanize_time", 0.0 );
-	float fHumanizeVelocityValue = LocalFileMng::readXmlFloat( songNode, "humanize_velocity", 0.0 );
-	float fSwingFactor = LocalFileMng::readXmlFloat( songNode, "swing_factor", 0.0 );
-
-	song = new Song( sName, sAuthor, fBpm, fVolume );
-	song->set_metronome_volume( fMetronomeVolume );
-	song->set_notes( sNotes );
-	song->set_license( sLicense );
-	song->set_loop_enabled( bLoopEnabled );
-	song->set_mode( nMode );
-	song->set_humanize_time_value( fHumanizeTimeValue );
-	song->set_humanize_velocity_value( fHumanizeVelocityValue );
-	song->set_swing_factor( fSwingFactor );
-
-	QDomNode componentListNode = songNode.firstChildElement( "componentList" );
-	if ( ( ! componentListNode.isNull()  ) ) {
-		QDomNode componentNode = componentListNode.firstChildElement( "drumkitComponent" );
-		while ( ! componentNode.isNull()  ) {
-			int id = LocalFileMng::readXmlInt( componentNode, "id", -1 );			// instrument id
-			QString sName = LocalFileMng::readXmlString( componentNode, "name", "" );		// name
-			float fVolume = LocalFileMng::readXmlFloat( componentNode, "volume", 1.0 );	// volume
-			DrumkitComponent* pDrumkitComponent = new DrumkitComponent( id, sName );
-			pDrumkitComponent->set_volume( fVolume );
-
-			song->get_components()->push_back(pDrumkitComponent);
-
-			componentNode = ( QDomNode ) componentNode.nextSiblingElement( "drumkitComponent" );
-		}
-	}
-	else {
-		DrumkitComponent* pDrumkitComponent = new DrumkitComponent( 0, "Main" );
-		song->get_components()->push_back(pDrumkitComponent);
-	}
-
-	//  Instrument List
-	InstrumentList* instrumentList = new InstrumentList();
-
-	QDomNode instrumentListNode = songNode.firstChildElement( "instrumentList" );
-	if ( ( ! instrumentListNode.isNull()  ) ) {
-		// INSTRUMENT NODE
-		int instrumentList_count = 0;
-		QDomNode instrumentNode;
-		instrumentNode = instrumentListNode.firstChildElement( "instrument" );
-		while ( ! instrumentNode.isNull()  ) {
-			instrumentList_count++;
-
-			int id = LocalFileMng::readXmlInt( instrumentNode, "id", -1 );			// instrument id
-			QString sDrumkit = LocalFileMng::readXmlString( instrumentNode, "drumkit", "" );	// drumkit
-			Hydrogen::get_instance()->setCurrentDrumkitname( sDrumkit );
-			QString sName = LocalFileMng::readXmlString( instrumentNode, "name", "" );		// name
-			float fVolume = LocalFileMng::readXmlFloat( instrumentNode, "volume", 1.0 );	// volume
-			bool bIsMuted = LocalFileMng::readXmlBool( instrumentNode, "isMuted", false );	// is muted
-			float fPan_L = LocalFileMng::readXmlFloat( instrumentNode, "pan_L", 0.5 );	// pan L
-			float fPan_R = LocalFileMng::readXmlFloat( instrumentNode, "pan_R", 0.5 );	// pan R
-			float fFX1Level = LocalFileMng::readXmlFloat( instrumentNode, "FX1Level", 0.0 );	// FX level
-			float fFX2Level = LocalFileMng::readXmlFloat( instrumentNode, "FX2Level", 0.0 );	// FX level
-			float fFX3Level = LocalFileMng::readXmlFloat( instrumentNode, "FX3Level", 0.0 );	// FX level
-			float fFX4Level = LocalFileMng::readXmlFloat( instrumentNode, "FX4Level", 0.0 );	// FX level
-			float fGain = LocalFileMng::readXmlFloat( instrumentNode, "gain", 1.0, false, false );	// instrument gain
-
-			int fAttack = LocalFileMng::readXmlInt( instrumentNode, "Attack", 0, false, false );		// Attack
-			int fDecay = LocalFileMng::readXmlInt( instrumentNode, "Decay", 0, false, false );		// Decay
-			float fSustain = LocalFileMng::readXmlFloat( instrumentNode, "Sustain", 1.0, false, false );	// Sustain
-			int fRelease = LocalFileMng::readXmlFloat( instrumentNode, "Release", 1000.0, false, false );	// Release
-
-			float fRandomPitchFactor = LocalFileMng::readXmlFloat( instrumentNode, "randomPitchFactor", 0.0f, false, false );
-
-			bool bApplyVelocity = LocalFileMng::readXmlBool( instrumentNode, "applyVelocity", true );
-			bool bFilterActive = LocalFileMng::readXmlBool( instrumentNode, "filterActive", false );
-			float fFilterCutoff = LocalFileMng::readXmlFloat( instrumentNode, "filterCutoff", 1.0f, false );
-			float fFilterResonance = LocalFileMng::readXmlFloat( instrumentNode, "filterResonance", 0.0f, false );
-			QString sMuteGroup = LocalFileMng::readXmlString( instrumentNode, "muteGroup", "-1", false );
-			QString sMidiOutChannel = LocalFileMng::readXmlString( instrumentNode, "midiOutChannel", "-1", false, false );
-			QString sMidiOutNote = LocalFileMng::readXmlString( instrumentNode, "midiOutNote", "60", false, false );
-			int nMuteGroup = sMuteGroup.toInt();
-			bool isStopNote = LocalFileMng::readXmlBool( instrumentNode, "isStopNote", false );
-			QString sRead_sample_select_algo = LocalFileMng::readXmlString( instrumentNode, "sampleSelectionAlgo", "VELOCITY" );
-
-			int nMidiOutChannel = sMidiOutChannel.toInt();
-			int nMidiOutNote = sMidiOutNote.toInt();
-
-			if ( id==-1 ) {
-				ERRORLOG( "Empty ID for instrument '" + sName + "'. skipping." );
-				instrumentNode = ( QDomNode ) instrumentNode.nextSiblingElement( "instrument" );
-				continue;
-			}
-
-			int iIsHiHat = LocalFileMng::readXmlInt( instrumentNode, "isHihat", -1, true );
-			int iLowerCC = LocalFileMng::readXmlInt( instrumentNode, "lower_cc", 0, true );
-			int iHigherCC = LocalFileMng::readXmlInt( instrumentNode, "higher_cc", 127, true );
-
-			// create a new instrument
-			Instrument* pInstrument = new Instrument( id, sName, new ADSR( fAttack, fDecay, fSustain, fRelease ) );
-			pInstrument->set_volume( fVolume );
-			pInstrument->set_muted( bIsMuted );
-			pInstrument->set_pan_l( fPan_L );
-			pInstrument->set_pan_r( fPan_R );
-			pInstrument->set_drumkit_name( sDrumkit );
-			pInstrument->set_apply_velocity( bApplyVelocity );
-			pInstrument->set_fx_level( fFX1Level, 0 );
-			pInstrument->set_fx_level( fFX2Level, 1 );
-			pInstrument->set_fx_level( fFX3Level, 2 );
-			pInstrument->set_fx_level( fFX4Level, 3 );
-			pInstrument->set_random_pitch_factor( fRandomPitchFactor );
-			pInstrument->set_filter_active( bFilterActive );
-			pInstrument->set_filter_cutoff( fFilterCutoff );
-			pInstrument->set_filter_resonance( fFilterResonance );
-			pInstrument->set_gain( fGain );
-			pInstrument->set_mute_group( nMuteGroup );
-			pInstrument->set_stop_notes( isStopNote );
-			pInstrument->set_hihat_grp( iIsHiHat );
-			pInstrument->set_lower_cc( iLowerCC );
-			pInstrument->set_higher_cc( iHigherCC );
-			if ( sRead_sample_select_algo.compare("VELOCITY") == 0 )
-				pInstrument->set_sample_selection_alg( Instrument::VELOCITY );
-			else if ( sRead_sample_select_algo.compare("ROUND_ROBIN") == 0 )
-				pInstrument->set_sample_selection_alg( Instrument::ROUND_ROBIN );
-			else if ( sRead_sample_select_algo.compare("RANDOM") == 0 )
-				pInstrument->set_sample_selection_alg( Instrument::RANDOM );
-			pInstrument->set_midi_out_channel( nMidiOutChannel );
-			pInstrument->set_midi_out_note( nMidiOutNote );
-
-			QString drumkitPath;
-			if ( ( !sDrumkit.isEmpty() ) && ( sDrumkit != "-" ) ) {
-				drumkitPath = Filesystem::drumkit_path_search( sDrumkit );
+	XMLRecord record, childRecord;
+	bool bComponentList = false;
+	std::vector<DrumkitComponent*> components;
+	InstrumentList* instrumentList = NULL;
+	PatternList* patternList = new PatternList();
+	bool bPatternList = false;
+	bool bPatternListFirst = false;
+	std::vector< std::pair<QString, QStringList> > virtualPatterns;
+	QStringList legacySequence;
+	std::vector<QStringList> groups;
+	bool bLadspa = false;
+	std::vector<FxRecord> fxs;
+	bool bBpmTimeLine = false;
+	std::vector<Timeline::HTimelineVector> bpms;
+	bool bTimeLineTag = false;
+	std::vector<Timeline::HTimelineTagVector> tags;
+
+	while ( reader.readNextStartElement() ) {
+		if ( reader.name() == "componentList" ) {
+			bComponentList = true;
+			while ( reader.readNextStartElement() ) {
+				if ( reader.name() != "drumkitComponent" ) {
+					reader.skipCurrentElement();
+					continue;
+				}
+				reader.read_record( &childRecord );
+				components.push_back( DrumkitComponent::load_from( childRecord ) );
 			}
-
-
-			QDomNode filenameNode = instrumentNode.firstChildElement( "filename" );
-
-			// back compatibility code ( song version <= 0.9.0 )
-			if ( ! filenameNode.isNull() ) {
-				WARNINGLOG( "Using back compatibility code. filename node found" );
-				QString sFilename = LocalFileMng::readXmlString( instrumentNode, "filename", "" );
-
-				if ( !QFile( sFilename ).exists() && !drumkitPath.isEmpty() ) {
-					sFilename = drumkitPath + "/" + sFilename;
+		} else if ( reader.name() == "instrumentList" && !instrumentList ) {
+			instrumentList = new InstrumentList();
+			int instrumentList_count = 0;
+			while ( reader.readNextStartElement() ) {
+				if ( reader.name() != "instrument" ) {
+					reader.skipCurrentElement();
+					continue;
 				}
-				Sample* pSample = Sample::load( sFilename );
-				if ( pSample == NULL ) {
-					// nel passaggio tra 0.8.2 e 0.9.0 il drumkit di default e' cambiato.
-					// Se fallisce provo a caricare il corrispettivo file in formato flac
-//					warningLog( "[readSong] Error loading sample: " + sFilename + " not found. Trying to load a flac..." );
-					sFilename = sFilename.left( sFilename.length() - 4 );
-					sFilename += ".flac";
-					pSample = Sample::load( sFilename );
+				instrumentList_count++;
+				Instrument* pInstrument = readInstrument( &reader );
+				if ( pInstrument ) instrumentList->add( pInstrument );
+			}
+			if ( instrumentList_count == 0 ) {
+				WARNINGLOG( "0 instruments?" );
+			}
+		} else if ( reader.name() == "patternList" && !bPatternList ) {
+			bPatternList = true;
+			if ( !instrumentList ) {
+				// the notes refer to the instruments, the patterns are read in a second pass
+				bPatternListFirst = true;
+				reader.skipCurrentElement();
+				continue;
+			}
+			readPatternList( &reader, instrumentList, patternList );
+		} else if ( reader.name() == "virtualPatternList" ) {
+			while ( reader.readNextStartElement() ) {
+				if ( reader.name() != "pattern" ) {
+					reader.skipCurrentElement();
+					continue;
 				}
-				if ( pSample == NULL ) {
-					ERRORLOG( "Error loading sample: " + sFilename + " not found" );
-					pInstrument->set_muted( true );
+				std::pair<QString, QStringList> virtualPattern;
+				bool bName = false;
+				while ( reader.readNextStartElement() ) {
+					if ( reader.name() == "name" && !bName ) {
+						bName = true;
+						virtualPattern.first = reader.read_text();
+					} else if ( reader.name() == "virtual" ) {
+						virtualPattern.second << reader.read_text();
+					} else {
+						reader.skipCurrentElement();
+					}
 				}
-				InstrumentComponent* pCompo = new InstrumentComponent ( 0 );
-				InstrumentLayer* pLayer = new InstrumentLayer( pSample );
-				pCompo->set_layer( pLayer, 0 );
-				pInstrument->get_components()->push_back( pCompo );
+				virtualPatterns.push_back( virtualPattern );
 			}
-			//~ back compatibility code
-			else {
-				bool p_foundAtLeastOneComponent = false;
-				QDomNode componentNode = instrumentNode.firstChildElement( "instrumentComponent" );
-				while (  ! componentNode.isNull()  ) {
-					p_foundAtLeastOneComponent = true;
-					int id = LocalFileMng::readXmlInt( componentNode, "component_id", 0 );
-					InstrumentComponent* pCompo = new InstrumentComponent( id );
-					float fGainCompo = LocalFileMng::readXmlFloat( componentNode, "gain", 1.0 );
-					pCompo->set_gain( fGainCompo );
-
-					unsigned nLayer = 0;
-					QDomNode layerNode = componentNode.firstChildElement( "layer" );
-					while (  ! layerNode.isNull()  ) {
-						if ( nLayer >= MAX_LAYERS ) {
-							ERRORLOG( "nLayer > MAX_LAYERS" );
-							continue;
-						}
-						//bool sIsModified = false;
-						QString sFilename = LocalFileMng::readXmlString( layerNode, "filename", "" );
-						bool sIsModified = LocalFileMng::readXmlBool( layerNode, "ismodified", false );
-						Sample::Loops lo;
-						lo.mode = Sample::parse_loop_mode( LocalFileMng::readXmlString( layerNode, "smode", "forward" ) );
-						lo.start_frame = LocalFileMng::readXmlInt( layerNode, "startframe", 0 );
-						lo.loop_frame = LocalFileMng::readXmlInt( layerNode, "loopframe", 0 );
-						lo.count = LocalFileMng::readXmlInt( layerNode, "loops", 0 );
-						lo.end_frame = LocalFileMng::readXmlInt( layerNode, "endframe", 0 );
-						Sample::Rubberband ro;
-						ro.use = LocalFileMng::readXmlInt( layerNode, "userubber", 0, false );
-						ro.divider = LocalFileMng::readXmlFloat( layerNode, "rubberdivider", 0.0 );
-						ro.c_settings = LocalFileMng::readXmlInt( layerNode, "rubberCsettings", 1 );
-						ro.pitch = LocalFileMng::readXmlFloat( layerNode, "rubberPitch", 0.0 );
-
-						float fMin = LocalFileMng::readXmlFloat( layerNode, "min", 0.0 );
-						float fMax = LocalFileMng::readXmlFloat( layerNode, "max", 1.0 );
-						float fGain = LocalFileMng::readXmlFloat( layerNode, "gain", 1.0 );
-						float fPitch = LocalFileMng::readXmlFloat( layerNode, "pitch", 0.0, false, false );
-
-						if ( !QFile( sFilename ).exists() && !drumkitPath.isEmpty() ) {
-							sFilename = drumkitPath + "/" + sFilename;
-						}
-
-						QString program = Preferences::get_instance()->m_rubberBandCLIexecutable;
-						//test the path. if test fails, disable rubberband
-						if ( QFile( program ).exists() == false ) {
-							ro.use = false;
-						}
-
-						Sample* pSample = NULL;
-						if ( !sIsModified ) {
-							pSample = Sample::load( sFilename );
+		} else if ( reader.name() == "patternSequence" ) {
+			while ( reader.readNextStartElement() ) {
+				if ( reader.name() == "patternID" ) {
+					// back-compatibility code..
+					QString patId;
+					if ( reader.readNextStartElement() ) {
+						patId = reader.read_text();
+						while ( reader.readNextStartElement() ) reader.skipCurrentElement();
+					}
+					legacySequence << patId;
+				} else if ( reader.name() == "group" ) {
+					QStringList group;
+					while ( reader.readNextStartElement() ) {
+						if ( reader.name() == "patternID" ) {
+							group << reader.read_text();
 						} else {
-							Sample::EnvelopePoint pt;
-
-							Sample::VelocityEnvelope velocity;
-							QDomNode volumeNode = layerNode.firstChildElement( "volume" );
-							while (  ! volumeNode.isNull()  ) {
-								pt.frame = LocalFileMng::readXmlInt( volumeNode, "volume-position", 0 );
-								pt.value = LocalFileMng::readXmlInt( volumeNode, "volume-value", 0 );
-								velocity.push_back( pt );
-								volumeNode = volumeNode.nextSiblingElement( "volume" );
-								//ERRORLOG( QString("volume-posi %1").arg(LocalFileMng::readXmlInt( volumeNode, "volume-position", 0)) );
-							}
-
-							Sample::VelocityEnvelope pan;
-							QDomNode  panNode = layerNode.firstChildElement( "pan" );
-							while (  ! panNode.isNull()  ) {
-								pt.frame = LocalFileMng::readXmlInt( panNode, "pan-position", 0 );
-								pt.value = LocalFileMng::readXmlInt( panNode, "pan-value", 0 );
-								pan.push_back( pt );
-								panNode = panNode.nextSiblingElement( "pan" );
-							}
-
-							pSample = Sample::load( sFilename, lo, ro, velocity, pan );
-						}
-						if ( pSample == NULL ) {
-							ERRORLOG( "Error loading sample: " + sFilename + " not found" );
-							pInstrument->set_muted( true );
+							reader.skipCurrentElement();
 						}
-						InstrumentLayer* pLayer = new InstrumentLayer( pSample );
-						pLayer->set_start_velocity( fMin );
-						pLayer->set_end_velocity( fMax );
-						pLayer->set_gain( fGain );
-						pLayer->set_pitch( fPitch );
-						pCompo->set_layer( pLayer, nLayer );
-						nLayer++;
-
-						layerNode = ( QDomNode ) layerNode.nextSiblingElement( "layer" );
 					}
-
-					pInstrument->get_components()->push_back( pCompo );
-					componentNode = ( QDomNode ) componentNode.nextSiblingElement( "instrumentComponent" );
+					groups.push_back( group );
+				} else {
+					reader.skipCurrentElement();
 				}
-				if(!p_foundAtLeastOneComponent){
-					InstrumentComponent* pCompo = new InstrumentComponent( 0 );
-					float fGainCompo = LocalFileMng::readXmlFloat( componentNode, "gain", 1.0 );
-					pCompo->set_gain( fGainCompo );
-
-					unsigned nLayer = 0;
-					QDomNode layerNode = instrumentNode.firstChildElement( "layer" );
-					while (  ! layerNode.isNull()  ) {
-						if ( nLayer >= MAX_LAYERS ) {
-							ERRORLOG( "nLayer > MAX_LAYERS" );
-							continue;
-						}
-						QString sFilename = LocalFileMng::readXmlString( layerNode, "filename", "" );
-						bool sIsModified = LocalFileMng::readXmlBool( layerNode, "ismodified", false );
-						Sample::Loops lo;
-						lo.mode = Sample::parse_loop_mode( LocalFileMng::readXmlString( layerNode, "smode", "forward" ) );
-						lo.start_frame = LocalFileMng::readXmlInt( layerNode, "startframe", 0 );
-						lo.loop_frame = LocalFileMng::readXmlInt( layerNode, "loopframe", 0 );
-						lo.count = LocalFileMng::readXmlInt( layerNode, "loops", 0 );
-						lo.end_frame = LocalFileMng::readXmlInt( layerNode, "endframe", 0 );
-						Sample::Rubberband ro;
-						ro.use = LocalFileMng::readXmlInt( layerNode, "userubber", 0, false );
-						ro.divider = LocalFileMng::readXmlFloat( layerNode, "rubberdivider", 0.0 );
-						ro.c_settings = LocalFileMng::readXmlInt( layerNode, "rubberCsettings", 1 );
-						ro.pitch = LocalFileMng::readXmlFloat( layerNode, "rubberPitch", 0.0 );
-
-						float fMin = LocalFileMng::readXmlFloat( layerNode, "min", 0.0 );
-						float fMax = LocalFileMng::readXmlFloat( layerNode, "max", 1.0 );
-						float fGain = LocalFileMng::readXmlFloat( layerNode, "gain", 1.0 );
-						float fPitch = LocalFileMng::readXmlFloat( layerNode, "pitch", 0.0, false, false );
-
-						if ( !QFile( sFilename ).exists() && !drumkitPath.isEmpty() ) {
-							sFilename = drumkitPath + "/" + sFilename;
-						}
-
-						QString program = Preferences::get_instance()->m_rubberBandCLIexecutable;
-						//test the path. if test fails, disable rubberband
-						if ( QFile( program ).exists() == false ) {
-							ro.use = false;
-						}
-
-						Sample* pSample = NULL;
-						if ( !sIsModified ) {
-							pSample = Sample::load( sFilename );
-						} else {
-							Sample::EnvelopePoint pt;
-
-							Sample::VelocityEnvelope velocity;
-							QDomNode volumeNode = layerNode.firstChildElement( "volume" );
-							while (  ! volumeNode.isNull()  ) {
-								pt.frame = LocalFileMng::readXmlInt( volumeNode, "volume-position", 0 );
-								pt.value = LocalFileMng::readXmlInt( volumeNode, "volume-value", 0 );
-								velocity.push_back( pt );
-								volumeNode = volumeNode.nextSiblingElement( "volume" );
-								//ERRORLOG( QString("volume-posi %1").arg(LocalFileMng::readXmlInt( volumeNode, "volume-position", 0)) );
-							}
-
-							Sample::VelocityEnvelope pan;
-							QDomNode  panNode = layerNode.firstChildElement( "pan" );
-							while (  ! panNode.isNull()  ) {
-								pt.frame = LocalFileMng::readXmlInt( panNode, "pan-position", 0 );
-								pt.value = LocalFileMng::readXmlInt( panNode, "pan-value", 0 );
-								pan.push_back( pt );
-								panNode = panNode.nextSiblingElement( "pan" );
-							}
-
-							pSample = Sample::load( sFilename, lo, ro, velocity, pan );
-						}
-						if ( pSample == NULL ) {
-							ERRORLOG( "Error loading sample: " + sFilename + " not found" );
-							pInstrument->set_muted( true );
-						}
-						InstrumentLayer* pLayer = new InstrumentLayer( pSample );
-						pLayer->set_start_velocity( fMin );
-						pLayer->set_end_velocity( fMax );
-						pLayer->set_gain( fGain );
-						pLayer->set_pitch( fPitch );
-						pCompo->set_layer( pLayer, nLayer );
-						nLayer++;
-
-						layerNode = ( QDomNode ) layerNode.nextSiblingElement( "layer" );
+			}
+		} else if ( reader.name() == "ladspa" ) {
+			bLadspa = true;
+			while ( reader.readNextStartElement() ) {
+				if ( reader.name() != "fx" ) {
+					reader.skipCurrentElement();
+					continue;
+				}
+				fxs.push_back( FxRecord() );
+				FxRecord& fx = fxs.back();
+				while ( reader.readNextStartElement() ) {
+					if ( reader.name() == "inputControlPort" ) {
+						fx.ports.push_back( XMLRecord() );
+						reader.read_record( &fx.ports.back() );
+					} else {
+						fx.record.add( reader.name().toString(), reader.read_text() );
 					}
-					pInstrument->get_components()->push_back( pCompo );
 				}
 			}
-			instrumentList->add( pInstrument );
-			instrumentNode = ( QDomNode ) instrumentNode.nextSiblingElement( "instrument" );
-		}
-
-		if ( instrumentList_count == 0 ) {
-			WARNINGLOG( "0 instruments?" );
+		} else if ( reader.name() == "BPMTimeLine" ) {
+			bBpmTimeLine = true;
+			while ( reader.readNextStartElement() ) {
+				if ( reader.name() != "newBPM" ) {
+					reader.skipCurrentElement();
+					continue;
+				}
+				reader.read_record( &childRecord );
+				Timeline::HTimelineVector tlvector;
+				tlvector.m_htimelinebeat = childRecord.read_int( "BAR", 0 );
+				tlvector.m_htimelinetick = childRecord.read_int( "TICK", 0 );
+				tlvector.m_htimelinebpm = childRecord.read_float( "BPM", 120.0 );
+				bpms.push_back( tlvector );
+			}
+		} else if ( reader.name() == "timeLineTag" ) {
+			bTimeLineTag = true;
+			while ( reader.readNextStartElement() ) {
+				if ( reader.name() != "newTAG" ) {
+					reader.skipCurrentElement();
+					continue;
+				}
+				reader.read_record( &childRecord );
+				Timeline::HTimelineTagVector tltagvector;
+				tltagvector.m_htimelinetagbeat = childRecord.read_int( "BAR", 0 );
+				tltagvector.m_htimelinetag = childRecord.read_string( "TAG", "" );
+				tags.push_back( tltagvector );
+			}
+		} else {
+			record.add( reader.name().toString(), reader.read_text() );
 		}
+	}
 
-		song->set_instrument_list( instrumentList );
-	} else {
+	bool bOk = reader.check();
+	if ( bOk && !instrumentList ) {
 		ERRORLOG( "Error reading song: instrumentList node not found" );
-		delete song;
-		return NULL;
+		bOk = false;
 	}
-
-	// Pattern list
-	QDomNode patterns = songNode.firstChildElement( "patternList" );
-
-	PatternList* patternList = new PatternList();
-	int pattern_count = 0;
-
-	QDomNode patternNode =  patterns.firstChildElement( "pattern" );
-	while (  !patternNode.isNull()  ) {
-		pattern_count++;
-		Pattern* pat = getPattern( patternNode, instrumentList );
-		if ( pat ) {
-			patternList->add( pat );
-		} else {
-			ERRORLOG( "Error loading pattern" );
-			delete patternList;
-			delete song;
-			return NULL;
+	if ( bOk && bPatternListFirst ) {
+		WARNINGLOG( "patternList found before instrumentList, reading it in a second pass" );
+		XMLStreamReader patternReader;
+		bOk = patternReader.open( FileName, "song" );
+		while ( bOk && patternReader.readNextStartElement() ) {
+			if ( patternReader.name() == "patternList" ) {
+				readPatternList( &patternReader, instrumentList, patternList );
+				break;
+			}
+			patternReader.skipCurrentElement();
 		}
-		patternNode = ( QDomNode ) patternNode.nextSiblingElement( "pattern" );
+		bOk = bOk && patternReader.check();
 	}
-	if ( pattern_count == 0 ) {
-		WARNINGLOG( "0 patterns?" );
+	if ( !bOk ) {
+		for ( int i = 0; i < components.size(); i++ ) delete components[i];
+		delete patternList;
+		delete instrumentList;
+		return NULL;
 	}
-	song->set_pattern_list( patternList );
 
-	// Virtual Patterns
-	QDomNode  virtualPatternListNode = songNode.firstChildElement( "virtualPatternList" );
-	QDomNode virtualPatternNode = virtualPatternListNode.firstChildElement( "pattern" );
-	if ( !virtualPatternNode.isNull() ) {
+	m_sSongVersion = record.read_string( "version", "Unknown version" );
 
-		while (  ! virtualPatternNode.isNull()  ) {
-			QString sName = "";
-			sName = LocalFileMng::readXmlString( virtualPatternNode, "name", sName );
-
-			Pattern* curPattern = NULL;
-			unsigned nPatterns = patternList->size();
-			for ( unsigned i = 0; i < nPatterns; i++ ) {
-				Pattern* pat = patternList->get( i );
-
-				if ( pat->get_name() == sName ) {
-					curPattern = pat;
-					break;
-				}//if
-			}//for
+	if ( m_sSongVersion != QString( get_version().c_str() ) ) {
+		WARNINGLOG( "Trying to load a song created with a different version of hydrogen." );
+		WARNINGLOG( "Song [" + FileName + "] saved with version " + m_sSongVersion );
+	}
 
-			if ( curPattern != NULL ) {
-				QDomNode  virtualNode = virtualPatternNode.firstChildElement( "virtual" );
-				while (  !virtualNode.isNull()  ) {
-					QString virtName = virtualNode.firstChild().nodeValue();
+	float fBpm = record.read_float( "bpm", 120 );
+	Hydrogen::get_instance()->setNewBpmJTM( fBpm );
+	Preferences::get_instance()->setPatternModePlaysSelected( record.read_bool( "patternModeMode", true ) );
+
+	Song* song = new Song( record.read_string( "name", "Untitled Song" ), record.read_string( "author", "Unknown Author" ),
+						   fBpm, record.read_float( "volume", 0.5 ) );
+	song->set_metronome_volume( record.read_float( "metronomeVolume", 0.5 ) );
+	song->set_notes( record.read_string( "notes", "..." ) );
+	song->set_license( record.read_string( "license", "Unknown license" ) );
+	song->set_loop_enabled( record.read_bool( "loopEnabled", false ) );
+	song->set_mode( record.read_string( "mode", "pattern" ) == "song" ? Song::SONG_MODE : Song::PATTERN_MODE );
+	song->set_humanize_time_value( record.read_float( "humanize_time", 0.0 ) );
+	song->set_humanize_velocity_value( record.read_float( "humanize_velocity", 0.0 ) );
+	song->set_swing_factor( record.read_float( "swing_factor", 0.0 ) );
+
+	if ( !bComponentList ) {
+		components.push_back( new DrumkitComponent( 0, "Main" ) );
+	}
+	song->get_components()->insert( song->get_components()->end(), components.begin(), components.end() );
 
-					Pattern* virtPattern = NULL;
-					for ( unsigned i = 0; i < nPatterns; i++ ) {
-						Pattern* pat = patternList->get( i );
+	song->set_instrument_list( instrumentList );
 
-						if ( pat->get_name() == virtName ) {
-							virtPattern = pat;
-							break;
-						}//if
-					}//for
+	if ( patternList->size() == 0 ) {
+		WARNINGLOG( "0 patterns?" );
+	}
+	song->set_pattern_list( patternList );
 
-					if ( virtPattern != NULL ) {
-						curPattern->virtual_patterns_add( virtPattern );
-					} else {
-						ERRORLOG( "Song had invalid virtual pattern list data (virtual)" );
-					}//if
-					virtualNode = ( QDomNode ) virtualNode.nextSiblingElement( "virtual" );
-				}//while
+	// Virtual Patterns
+	for ( int i = 0; i < virtualPatterns.size(); i++ ) {
+		Pattern* curPattern = patternList->find( virtualPatterns[i].first );
+		if ( curPattern == NULL ) {
+			ERRORLOG( "Song had invalid virtual pattern list data (name)" );
+			continue;
+		}
+		const QStringList& virtNames = virtualPatterns[i].second;
+		for ( int j = 0; j < virtNames.size(); j++ ) {
+			Pattern* virtPattern = patternList->find( virtNames[j] );
+			if ( virtPattern != NULL ) {
+				curPattern->virtual_patterns_add( virtPattern );
 			} else {
-				ERRORLOG( "Song had invalid virtual pattern list data (name)" );
-			}//if
-			virtualPatternNode = ( QDomNode ) virtualPatternNode.nextSiblingElement( "pattern" );
-		}//while
-	}//if
+				ERRORLOG( "Song had invalid virtual pattern list data (virtual)" );
+			}
+		}
+	}
 
 	patternList->flattened_virtual_patterns_compute();
 
 	// Pattern sequence
-	QDomNode patternSequenceNode = songNode.firstChildElement( "patternSequence" );
-
 	std::vector<PatternList*>* pPatternGroupVector = new std::vector<PatternList*>;
 
 	// back-compatibility code..
-	QDomNode pPatternIDNode = patternSequenceNode.firstChildElement( "patternID" );
-	while ( ! pPatternIDNode.isNull()  ) {
+	for ( int i = 0; i < legacySequence.size(); i++ ) {
 		WARNINGLOG( "Using old patternSequence code for back compatibility" );
-		PatternList* patternSequence = new PatternList();
-		QString patId = pPatternIDNode.firstChildElement().text();
-		ERRORLOG( patId );
-
-		Pattern* pat = NULL;
-		for ( unsigned i = 0; i < patternList->size(); i++ ) {
-			Pattern* tmp = patternList->get( i );
-			if ( tmp ) {
-				if ( tmp->get_name() == patId ) {
-					pat = tmp;
-					break;
-				}
-			}
-		}
+		Pattern* pat = patternList->find( legacySequence[i] );
 		if ( pat == NULL ) {
 			WARNINGLOG( "patternid not found in patternSequence" );
-			pPatternIDNode = ( QDomNode ) pPatternIDNode.nextSiblingElement( "patternID" );
 			continue;
 		}
+		PatternList* patternSequence = new PatternList();
 		patternSequence->add( pat );
-
 		pPatternGroupVector->push_back( patternSequence );
-
-		pPatternIDNode = ( QDomNode ) pPatternIDNode.nextSiblingElement( "patternID" );
 	}
 
-	QDomNode groupNode = patternSequenceNode.firstChildElement( "group" );
-	while (  !groupNode.isNull()  ) {
+	for ( int i = 0; i < groups.size(); i++ ) {
 		PatternList* patternSequence = new PatternList();
-		QDomNode patternId = groupNode.firstChildElement( "patternID" );
-		while (  !patternId.isNull()  ) {
-			QString patId = patternId.firstChild().nodeValue();
-
-			Pattern* pat = NULL;
-			for ( unsigned i = 0; i < patternList->size(); i++ ) {
-				Pattern* tmp = patternList->get( i );
-				if ( tmp ) {
-					if ( tmp->get_name() == patId ) {
-						pat = tmp;
-						break;
-					}
-				}
-			}
+		for ( int j = 0; j < groups[i].size(); j++ ) {
+			Pattern* pat = patternList->find( groups[i][j] );
 			if ( pat == NULL ) {
 				WARNINGLOG( "patternid not found in patternSequence" );
-				patternId = ( QDomNode ) patternId.nextSiblingElement( "patternID" );
 				continue;
 			}
 			patternSequence->add( pat );
-			patternId = ( QDomNode ) patternId.nextSiblingElement( "patternID" );
 		}
 		pPatternGroupVector->push_back( patternSequence );
-
-		groupNode = groupNode.nextSiblingElement( "group" );
 	}
 
 	song->set_pattern_group_vector( pPatternGroupVector );
@@ -923,84 +1139,51 @@ Song* SongReader::readSong( const QString& filename )
 #ifdef H2CORE_HAVE_LADSPA
 	// reset FX
 	for ( int fx = 0; fx < MAX_FX; ++fx ) {
-		//LadspaFX* pFX = Effects::get_instance()->getLadspaFX( fx );
-		//delete pFX;
 		Effects::get_instance()->setLadspaFX( NULL, fx );
 	}
 #endif
 
 	// LADSPA FX
-	QDomNode ladspaNode = songNode.firstChildElement( "ladspa" );
-	if ( !ladspaNode.isNull() ) {
-		int nFX = 0;
-		QDomNode fxNode = ladspaNode.firstChildElement( "fx" );
-		while (  !fxNode.isNull()  ) {
-			QString sName = LocalFileMng::readXmlString( fxNode, "name", "" );
-			QString sFilename = LocalFileMng::readXmlString( fxNode, "filename", "" );
-			bool bEnabled = LocalFileMng::readXmlBool( fxNode, "enabled", false );
-			float fVolume = LocalFileMng::readXmlFloat( fxNode, "volume", 1.0 );
-
+	if ( bLadspa ) {
+		for ( int nFX = 0; nFX < fxs.size(); nFX++ ) {
+			const XMLRecord& fx = fxs[ nFX ].record;
+			QString sName = fx.read_string( "name", "" );
 			if ( sName != "no plugin" ) {
-				// FIXME: il caricamento va fatto fare all'engine, solo lui sa il samplerate esatto
 #ifdef H2CORE_HAVE_LADSPA
-				LadspaFX* pFX = LadspaFX::load( sFilename, sName, 44100 );
+				LadspaFX* pFX = LadspaFX::load( fx.read_string( "filename", "" ), sName, 44100 );
 				Effects::get_instance()->setLadspaFX( pFX, nFX );
 				if ( pFX ) {
-					pFX->setEnabled( bEnabled );
-					pFX->setVolume( fVolume );
-					QDomNode inputControlNode = fxNode.firstChildElement( "inputControlPort" );
-					while ( !inputControlNode.isNull() ) {
-						QString sName = LocalFileMng::readXmlString( inputControlNode, "name", "" );
-						float fValue = LocalFileMng::readXmlFloat( inputControlNode, "value", 0.0 );
-
+					pFX->setEnabled( fx.read_bool( "enabled", false ) );
+					pFX->setVolume( fx.read_float( "volume", 1.0 ) );
+					for ( int i = 0; i < fxs[ nFX ].ports.size(); i++ ) {
+						const XMLRecord& port = fxs[ nFX ].ports[i];
+						QString sPortName = port.read_string( "name", "" );
+						float fValue = port.read_float( "value", 0.0 );
 						for ( unsigned nPort = 0; nPort < pFX->inputControlPorts.size(); nPort++ ) {
-							LadspaControlPort* port = pFX->inputControlPorts[ nPort ];
-							if ( QString( port->sName ) == sName ) {
-								port->fControlValue = fValue;
+							LadspaControlPort* pPort = pFX->inputControlPorts[ nPort ];
+							if ( QString( pPort->sName ) == sPortName ) {
+								pPort->fControlValue = fValue;
 							}
 						}
-						inputControlNode = ( QDomNode ) inputControlNode.nextSiblingElement( "inputControlPort" );
 					}
 				}
 #endif
 			}
-			nFX++;
-			fxNode = ( QDomNode ) fxNode.nextSiblingElement( "fx" );
 		}
 	} else {
 		WARNINGLOG( "ladspa node not found" );
 	}
 
 	Timeline* pTimeline = Hydrogen::get_instance()->getTimeline();
-	pTimeline->m_timelinevector.clear();
-	Timeline::HTimelineVector tlvector;
-	QDomNode bpmTimeLine = songNode.firstChildElement( "BPMTimeLine" );
-	if ( !bpmTimeLine.isNull() ) {
-		QDomNode newBPMNode = bpmTimeLine.firstChildElement( "newBPM" );
-		while( !newBPMNode.isNull() ) {
-			tlvector.m_htimelinebeat = LocalFileMng::readXmlInt( newBPMNode, "BAR", 0 );
-			tlvector.m_htimelinebpm = LocalFileMng::readXmlFloat( newBPMNode, "BPM", 120.0 );
-			pTimeline->m_timelinevector.push_back( tlvector );
-			pTimeline->sortTimelineVector();
-			newBPMNode = newBPMNode.nextSiblingElement( "newBPM" );
-		}
-	} else {
+	pTimeline->m_timelinevector = bpms;
+	pTimeline->sortTimelineVector();
+	if ( !bBpmTimeLine ) {
 		WARNINGLOG( "bpmTimeLine node not found" );
 	}
 
-	pTimeline->m_timelinetagvector.clear();
-	Timeline::HTimelineTagVector tltagvector;
-	QDomNode timeLineTag = songNode.firstChildElement( "timeLineTag" );
-	if ( !timeLineTag.isNull() ) {
-		QDomNode newTAGNode = timeLineTag.firstChildElement( "newTAG" );
-		while( !newTAGNode.isNull() ) {
-			tltagvector.m_htimelinetagbeat = LocalFileMng::readXmlInt( newTAGNode, "BAR", 0 );
-			tltagvector.m_htimelinetag = LocalFileMng::readXmlString( newTAGNode, "TAG", "" );
-			pTimeline->m_timelinetagvector.push_back( tltagvector );
-			pTimeline->sortTimelineTagVector();
-			newTAGNode = newTAGNode.nextSiblingElement( "newTAG" );
-		}
-	} else {
+	pTimeline->m_timelinetagvector = tags;
+	pTimeline->sortTimelineTagVector();
+	if ( !bTimeLineTag ) {
 		WARNINGLOG( "TagTimeLine node not found" );
 	}
 
@@ -1010,105 +1193,229 @@ Song* SongReader::readSong( const QString& filename )
 	return song;
 }
 
-Pattern* SongReader::getPattern( QDomNode pattern, InstrumentList* instrList )
+///
+/// Reads a binary song, see SongWriter::writeSongBinary().
+/// return NULL = error reading song file.
+///
+Song* SongReader::readSongBinary( const QString& filename )
 {
-	Pattern* pPattern = NULL;
-
-	QString sName;	// name
-	sName = LocalFileMng::readXmlString( pattern, "name", sName );
-	QString sInfo;
-	sInfo = LocalFileMng::readXmlString( pattern, "info", sInfo ,false ,false );
-	QString sCategory; // category
-	sCategory = LocalFileMng::readXmlString( pattern, "category", sCategory ,false ,false );
-
-	int nSize = -1;
-	nSize = LocalFileMng::readXmlInt( pattern, "size", nSize, false, false );
-
-	pPattern = new Pattern( sName, sInfo, sCategory, nSize );
-
-	QDomNode pNoteListNode = pattern.firstChildElement( "noteList" );
-	if ( ! pNoteListNode.isNull() ) {
-		// new code :)
-		QDomNode noteNode = pNoteListNode.firstChildElement( "note" );
-		while ( ! noteNode.isNull()  ) {
-
-			Note* pNote = NULL;
-
-			unsigned nPosition = LocalFileMng::readXmlInt( noteNode, "position", 0 );
-			float fLeadLag = LocalFileMng::readXmlFloat( noteNode, "leadlag", 0.0 , false , false );
-			float fVelocity = LocalFileMng::readXmlFloat( noteNode, "velocity", 0.8f );
-			float fPan_L = LocalFileMng::readXmlFloat( noteNode, "pan_L", 0.5 );
-			float fPan_R = LocalFileMng::readXmlFloat( noteNode, "pan_R", 0.5 );
-			int nLength = LocalFileMng::readXmlInt( noteNode, "length", -1, true );
-			float nPitch = LocalFileMng::readXmlFloat( noteNode, "pitch", 0.0, false, false );
-			float fProbability = LocalFileMng::readXmlFloat( noteNode, "probability", 1.0 , false , false );
-			QString sKey = LocalFileMng::readXmlString( noteNode, "key", "C0", false, false );
-			QString nNoteOff = LocalFileMng::readXmlString( noteNode, "note_off", "false", false, false );
-
-			int instrId = LocalFileMng::readXmlInt( noteNode, "instrument", -1 );
-
-			Instrument* instrRef = NULL;
-			// search instrument by ref
-			instrRef = instrList->find( instrId );
-			if ( !instrRef ) {
-				ERRORLOG( QString( "Instrument with ID: '%1' not found. Note skipped." ).arg( instrId ) );
-				noteNode = ( QDomNode ) noteNode.nextSiblingElement( "note" );
-				continue;
-			}
-			//assert( instrRef );
-			bool noteoff = false;
-			if ( nNoteOff == "true" )
-				noteoff = true;
-
-			pNote = new Note( instrRef, nPosition, fVelocity, fPan_L, fPan_R, nLength, nPitch );
-			pNote->set_key_octave( sKey );
-			pNote->set_lead_lag( fLeadLag );
-			pNote->set_note_off( noteoff );
-			pNote->set_probability( fProbability );
-			pPattern->insert_note( pNote );
-
-			noteNode = ( QDomNode ) noteNode.nextSiblingElement( "note" );
-		}
-	} else {
-		// Back compatibility code. Version < 0.9.4
-		QDomNode sequenceListNode = pattern.firstChildElement( "sequenceList" );
-
-		int sequence_count = 0;
-		QDomNode sequenceNode = sequenceListNode.firstChildElement( "sequence" );
-		while ( ! sequenceNode.isNull()  ) {
-			sequence_count++;
+	QString FileName = getPath ( filename );
+	if ( FileName.isEmpty() ) return NULL;
 
-			QDomNode noteListNode = sequenceNode.firstChildElement( "noteList" );
-			QDomNode noteNode = noteListNode.firstChildElement( "note" );
-			while (  !noteNode.isNull() ) {
+	INFOLOG( "Reading " + FileName );
+	ChunkReader reader;
+	quint32 nVersion;
+	if ( !reader.open( FileName, SONG_BINARY_MAGIC, &nVersion ) ) {
+		return NULL;
+	}
+	if ( nVersion > SONG_BINARY_VERSION ) {
+		ERRORLOG( QString( "Error reading song: binary layout version %1 is not supported" ).arg( nVersion ) );
+		return NULL;
+	}
 
-				Note* pNote = NULL;
+	Song* song = NULL;
+	InstrumentList* instrumentList = NULL;
+	PatternList* patternList = new PatternList();
+	std::vector<PatternList*>* pPatternGroupVector = new std::vector<PatternList*>;
+	bool bLadspa = false;
+	std::vector<Timeline::HTimelineVector> bpms;
+	std::vector<int> bpmTicks;
+	std::vector<Timeline::HTimelineTagVector> tags;
 
-				unsigned nPosition = LocalFileMng::readXmlInt( noteNode, "position", 0 );
-				float fLeadLag = LocalFileMng::readXmlFloat( noteNode, "leadlag", 0.0 , false , false );
-				float fVelocity = LocalFileMng::readXmlFloat( noteNode, "velocity", 0.8f );
-				float fPan_L = LocalFileMng::readXmlFloat( noteNode, "pan_L", 0.5 );
-				float fPan_R = LocalFileMng::readXmlFloat( noteNode, "pan_R", 0.5 );
-				int nLength = LocalFileMng::readXmlInt( noteNode, "length", -1, true );
-				float nPitch = LocalFileMng::readXmlFloat( noteNode, "pitch", 0.0, false, false );
+#ifdef H2CORE_HAVE_LADSPA
+	// reset FX
+	for ( int fx = 0; fx < MAX_FX; ++fx ) {
+		Effects::get_instance()->setLadspaFX( NULL, fx );
+	}
+#endif
 
-				int instrId = LocalFileMng::readXmlInt( noteNode, "instrument", -1 );
+	QByteArray id;
+	ChunkReader chunk;
+	bool bError = false;
+	while ( !bError && reader.next_chunk( &id, &chunk ) ) {
+		if ( id == "SONG" && !song ) {
+			m_sSongVersion = chunk.read_string();
+			if ( m_sSongVersion != QString( get_version().c_str() ) ) {
+				WARNINGLOG( "Trying to load a song created with a different version of hydrogen." );
+				WARNINGLOG( "Song [" + FileName + "] saved with version " + m_sSongVersion );
+			}
+			float fBpm = chunk.read_float();
+			Hydrogen::get_instance()->setNewBpmJTM( fBpm );
+			float fVolume = chunk.read_float();
+			float fMetronomeVolume = chunk.read_float();
+			QString sName = chunk.read_string();
+			QString sAuthor = chunk.read_string();
+			song = new Song( sName, sAuthor, fBpm, fVolume );
+			song->set_metronome_volume( fMetronomeVolume );
+			song->set_notes( chunk.read_string() );
+			song->set_license( chunk.read_string() );
+			song->set_loop_enabled( chunk.read_bool() );
+			Preferences::get_instance()->setPatternModePlaysSelected( chunk.read_bool() );
+			song->set_mode( chunk.read_bool() ? Song::SONG_MODE : Song::PATTERN_MODE );
+			song->set_humanize_time_value( chunk.read_float() );
+			song->set_humanize_velocity_value( chunk.read_float() );
+			song->set_swing_factor( chunk.read_float() );
+		} else if ( id == "COMP" && song ) {
+			quint32 nComponents = chunk.read_u32();
+			for ( quint32 i = 0; i < nComponents && !chunk.has_error(); i++ ) {
+				int nId = chunk.read_i32();
+				DrumkitComponent* pDrumkitComponent = new DrumkitComponent( nId, chunk.read_string() );
+				pDrumkitComponent->set_volume( chunk.read_float() );
+				song->get_components()->push_back( pDrumkitComponent );
+			}
+		} else if ( id == "INST" && !instrumentList ) {
+			instrumentList = new InstrumentList();
+			quint32 nInstruments = chunk.read_u32();
+			for ( quint32 i = 0; i < nInstruments && !chunk.has_error(); i++ ) {
+				instrumentList->add( readBinaryInstrument( &chunk ) );
+			}
+			if ( nInstruments == 0 ) {
+				WARNINGLOG( "0 instruments?" );
+			}
+		} else if ( id == "PATT" && instrumentList && patternList->size() == 0 ) {
+			quint32 nPatterns = chunk.read_u32();
+			for ( quint32 i = 0; i < nPatterns && !chunk.has_error(); i++ ) {
+				patternList->add( readBinaryPattern( &chunk, instrumentList ) );
+			}
+		} else if ( id == "VPAT" ) {
+			while ( !chunk.at_end() && !chunk.has_error() ) {
+				Pattern* curPattern = patternList->get( chunk.read_u32() );
+				quint32 nVirtuals = chunk.read_u32();
+				for ( quint32 i = 0; i < nVirtuals && !chunk.has_error(); i++ ) {
+					Pattern* virtPattern = patternList->get( chunk.read_u32() );
+					if ( curPattern && virtPattern ) {
+						curPattern->virtual_patterns_add( virtPattern );
+					} else {
+						ERRORLOG( "Song had invalid virtual pattern list data" );
+					}
+				}
+			}
+		} else if ( id == "SEQU" ) {
+			quint32 nGroups = chunk.read_u32();
+			for ( quint32 i = 0; i < nGroups && !chunk.has_error(); i++ ) {
+				PatternList* patternSequence = new PatternList();
+				quint32 nPatterns = chunk.read_u32();
+				for ( quint32 j = 0; j < nPatterns && !chunk.has_error(); j++ ) {
+					Pattern* pat = patternList->get( chunk.read_u32() );
+					if ( pat == NULL ) {
+						WARNINGLOG( "patternid not found in patternSequence" );
+						continue;
+					}
+					patternSequence->add( pat );
+				}
+				pPatternGroupVector->push_back( patternSequence );
+			}
+		} else if ( id == "LFX " ) {
+			bLadspa = true;
+			quint32 nFXs = chunk.read_u32();
+			for ( quint32 nFX = 0; nFX < nFXs && !chunk.has_error(); nFX++ ) {
+				if ( !chunk.read_bool() ) continue;
+				QString sName = chunk.read_string();
+				QString sFilename = chunk.read_string();
+				bool bEnabled = chunk.read_bool();
+				float fVolume = chunk.read_float();
+				std::vector< std::pair<QString, float> > ports;
+				quint32 nPorts = chunk.read_u32();
+				for ( quint32 i = 0; i < nPorts && !chunk.has_error(); i++ ) {
+					QString sPortName = chunk.read_string();
+					ports.push_back( std::make_pair( sPortName, chunk.read_float() ) );
+				}
+#ifdef H2CORE_HAVE_LADSPA
+				if ( nFX >= MAX_FX ) continue;
+				LadspaFX* pFX = LadspaFX::load( sFilename, sName, 44100 );
+				Effects::get_instance()->setLadspaFX( pFX, nFX );
+				if ( pFX ) {
+					pFX->setEnabled( bEnabled );
+					pFX->setVolume( fVolume );
+					for ( int i = 0; i < ports.size(); i++ ) {
+						for ( unsigned nPort = 0; nPort < pFX->inputControlPorts.size(); nPort++ ) {
+							LadspaControlPort* pPort = pFX->inputControlPorts[ nPort ];
+							if ( QString( pPort->sName ) == ports[i].first ) {
+								pPort->fControlValue = ports[i].second;
+							}
+						}
+					}
+				}
+#endif
+			}
+		} else if ( id == "TIML" ) {
+			quint32 nBpms = chunk.read_u32();
+			for ( quint32 i = 0; i < nBpms && !chunk.has_error(); i++ ) {
+				Timeline::HTimelineVector tlvector;
+				tlvector.m_htimelinebeat = chunk.read_i32();
+				tlvector.m_htimelinetick = 0;
+				tlvector.m_htimelinebpm = chunk.read_float();
+				bpms.push_back( tlvector );
+			}
+		} else if ( id == "TIMT" ) {
+			// the ticks of the tempo markers within their pattern, only written when one is not 0
+			quint32 nTicks = chunk.read_u32();
+			for ( quint32 i = 0; i < nTicks && !chunk.has_error(); i++ ) {
+				bpmTicks.push_back( chunk.read_i32() );
+			}
+		} else if ( id == "TAGS" ) {
+			quint32 nTags = chunk.read_u32();
+			for ( quint32 i = 0; i < nTags && !chunk.has_error(); i++ ) {
+				Timeline::HTimelineTagVector tltagvector;
+				tltagvector.m_htimelinetagbeat = chunk.read_i32();
+				tltagvector.m_htimelinetag = chunk.read_string();
+				tags.push_back( tltagvector );
+			}
+		} else {
+			// chunks of later versions
+			continue;
+		}
+		if ( chunk.has_error() ) {
+			ERRORLOG( QString( "Error reading song: chunk %1 is truncated" ).arg( QString( id ) ) );
+			bError = true;
+		}
+	}
+	bError = bError || reader.has_error();
 
-				Instrument* instrRef = instrList->find( instrId );
-				assert( instrRef );
+	if ( bError || !song || !instrumentList ) {
+		if ( !bError ) {
+			ERRORLOG( "Error reading song: song or instrument chunk not found" );
+		}
+		for ( int i = 0; i < pPatternGroupVector->size(); i++ ) {
+			( *pPatternGroupVector )[i]->clear();
+			delete ( *pPatternGroupVector )[i];
+		}
+		delete pPatternGroupVector;
+		delete patternList;
+		delete instrumentList;
+		delete song;
+		return NULL;
+	}
 
-				pNote = new Note( instrRef, nPosition, fVelocity, fPan_L, fPan_R, nLength, nPitch );
-				pNote->set_lead_lag( fLeadLag );
+	if ( song->get_components()->empty() ) {
+		song->get_components()->push_back( new DrumkitComponent( 0, "Main" ) );
+	}
+	song->set_instrument_list( instrumentList );
+	if ( patternList->size() == 0 ) {
+		WARNINGLOG( "0 patterns?" );
+	}
+	song->set_pattern_list( patternList );
+	patternList->flattened_virtual_patterns_compute();
+	song->set_pattern_group_vector( pPatternGroupVector );
 
-				//infoLog( "new note!! pos: " + toString( pNote->m_nPosition ) + "\t instr: " + instrId );
-				pPattern->insert_note( pNote );
+	if ( !bLadspa ) {
+		WARNINGLOG( "ladspa chunk not found" );
+	}
 
-				noteNode = ( QDomNode ) noteNode.nextSiblingElement( "note" );
-			}
-			sequenceNode = ( QDomNode ) sequenceNode.nextSiblingElement( "sequence" );
+	if ( bpmTicks.size() == bpms.size() ) {
+		for ( int i = 0; i < bpms.size(); i++ ) {
+			bpms[i].m_htimelinetick = bpmTicks[i];
 		}
 	}
+	Timeline* pTimeline = Hydrogen::get_instance()->getTimeline();
+	pTimeline->m_timelinevector = bpms;
+	pTimeline->sortTimelineVector();
+	pTimeline->m_timelinetagvector = tags;
+	pTimeline->sortTimelineTagVector();
 
-	return pPattern;
+	song->set_is_modified( false );
+	song->set_filename( FileName );
+
+	return song;
 }
 };
@@ -0,0 +1,165 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <algorithm>
+
+#include <hydrogen/basics/tempo_map.h>
+
+#include <hydrogen/globals.h>
+#include <hydrogen/timeline.h>
+#include <hydrogen/basics/song.h>
+#include <hydrogen/basics/pattern.h>
+#include <hydrogen/basics/pattern_list.h>
+
+namespace H2Core
+{
+
+const char* TempoMap::__class_name = "TempoMap";
+
+TempoMap::TempoMap( float bpm, int resolution, unsigned sample_rate ) : Object( __class_name )
+{
+	reset( bpm, resolution, sample_rate );
+}
+
+void TempoMap::reset( float bpm, int resolution, unsigned sample_rate )
+{
+	__resolution = resolution;
+	__sample_rate = sample_rate;
+	Segment segment;
+	segment.tick = 0;
+	segment.frame = 0;
+	segment.tick_size = __tick_size( bpm );
+	segment.bpm = bpm;
+	// clear() keeps the storage, a map reloaded in a process cycle does not allocate
+	__segments.clear();
+	__segments.push_back( segment );
+}
+
+void TempoMap::add_tempo( double tick, float bpm )
+{
+	if ( tick < 0 || bpm <= 0 ) return;
+	int n = __segments.size();
+	// the changes come in order when the map is built, the last segment is checked first
+	while ( n > 0 && __segments[ n - 1 ].tick > tick ) n--;
+	if ( __segments[ n - 1 ].tick == tick ) {
+		__segments[ n - 1 ].bpm = bpm;
+		__segments[ n - 1 ].tick_size = __tick_size( bpm );
+		__update_frames( n );
+		return;
+	}
+	Segment segment;
+	segment.tick = tick;
+	segment.frame = 0;
+	segment.tick_size = __tick_size( bpm );
+	segment.bpm = bpm;
+	__segments.insert( __segments.begin() + n, segment );
+	__update_frames( n );
+}
+
+void TempoMap::load( Song* song, Timeline* timeline, unsigned sample_rate, bool use_timeline )
+{
+	reset( song->__bpm, song->__resolution, sample_rate );
+	if ( !use_timeline || !timeline ) return;
+
+	// the markers are sorted, the first tick of their pattern group is found walking the groups once
+	std::vector<PatternList*>* columns = song->get_pattern_group_vector();
+	int column = 0;
+	long column_tick = 0;
+	for ( int i = 0; i < timeline->m_timelinevector.size(); i++ ) {
+		const Timeline::HTimelineVector& marker = timeline->m_timelinevector[i];
+		if ( marker.m_htimelinebeat < column ) {
+			continue;
+		}
+		while ( column < marker.m_htimelinebeat && column < ( int )columns->size() ) {
+			PatternList* patterns = ( *columns )[ column ];
+			column_tick += patterns->size() != 0 ? patterns->get( 0 )->get_length() : MAX_NOTES;
+			column++;
+		}
+		if ( column != marker.m_htimelinebeat ) {
+			break;
+		}
+		add_tempo( column_tick + marker.m_htimelinetick, marker.m_htimelinebpm );
+	}
+}
+
+void TempoMap::__update_frames( int from )
+{
+	for ( int i = std::max( from, 1 ); i < __segments.size(); i++ ) {
+		const Segment& previous = __segments[ i - 1 ];
+		__segments[i].frame = previous.frame + ( __segments[i].tick - previous.tick ) * previous.tick_size;
+	}
+}
+
+bool TempoMap::tick_before( double tick, const Segment& segment )
+{
+	return tick < segment.tick;
+}
+
+bool TempoMap::frame_before( double frame, const Segment& segment )
+{
+	return frame < segment.frame;
+}
+
+const TempoMap::Segment& TempoMap::__find_tick( double tick ) const
+{
+	std::vector<Segment>::const_iterator it = std::upper_bound( __segments.begin(), __segments.end(), tick, tick_before );
+	// before tick 0 the first tempo goes on
+	return it == __segments.begin() ? *it : *( it - 1 );
+}
+
+const TempoMap::Segment& TempoMap::__find_frame( double frame ) const
+{
+	std::vector<Segment>::const_iterator it = std::upper_bound( __segments.begin(), __segments.end(), frame, frame_before );
+	return it == __segments.begin() ? *it : *( it - 1 );
+}
+
+double TempoMap::tick_to_frame( double tick ) const
+{
+	const Segment& segment = __find_tick( tick );
+	return segment.frame + ( tick - segment.tick ) * segment.tick_size;
+}
+
+double TempoMap::frame_to_tick( double frame ) const
+{
+	const Segment& segment = __find_frame( frame );
+	return segment.tick + ( frame - segment.frame ) / segment.tick_size;
+}
+
+float TempoMap::get_bpm( double tick ) const
+{
+	return __find_tick( tick ).bpm;
+}
+
+double TempoMap::get_tick_size( double tick ) const
+{
+	return __find_tick( tick ).tick_size;
+}
+
+double TempoMap::next_tempo_change( double tick ) const
+{
+	std::vector<Segment>::const_iterator it = std::upper_bound( __segments.begin(), __segments.end(), tick, tick_before );
+	return it == __segments.end() ? -1 : it->tick;
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
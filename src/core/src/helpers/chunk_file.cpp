@@ -0,0 +1,264 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <hydrogen/helpers/chunk_file.h>
+
+#include <cstring>
+
+#include <QFile>
+#include <QtEndian>
+
+#include <hydrogen/object.h>
+
+#define HEADER_SIZE     8
+#define CHUNK_HEADER    8
+
+namespace H2Core
+{
+
+ChunkWriter::ChunkWriter( const char* magic, quint32 version ) : __chunk_start( -1 )
+{
+	__data.append( magic, 4 );
+	write_u32( version );
+}
+
+void ChunkWriter::begin_chunk( const char* id )
+{
+	if ( __chunk_start >= 0 ) end_chunk();
+	__data.append( id, 4 );
+	__chunk_start = __data.size();
+	write_u32( 0 );
+}
+
+void ChunkWriter::end_chunk()
+{
+	if ( __chunk_start < 0 ) return;
+	quint32 size = __data.size() - __chunk_start - 4;
+	qToLittleEndian<quint32>( size, ( uchar* )__data.data() + __chunk_start );
+	__chunk_start = -1;
+}
+
+void ChunkWriter::write_u8( quint8 value )
+{
+	__data.append( ( char )value );
+}
+
+void ChunkWriter::write_bool( bool value )
+{
+	write_u8( value ? 1 : 0 );
+}
+
+void ChunkWriter::write_i32( qint32 value )
+{
+	write_u32( ( quint32 )value );
+}
+
+void ChunkWriter::write_u32( quint32 value )
+{
+	uchar bytes[4];
+	qToLittleEndian<quint32>( value, bytes );
+	__data.append( ( const char* )bytes, 4 );
+}
+
+void ChunkWriter::write_float( float value )
+{
+	quint32 bits;
+	memcpy( &bits, &value, 4 );
+	write_u32( bits );
+}
+
+void ChunkWriter::write_string( const QString& value )
+{
+	QByteArray utf8 = value.toUtf8();
+	write_u32( utf8.size() );
+	__data.append( utf8 );
+}
+
+bool ChunkWriter::save( const QString& path ) const
+{
+	QFile file( path );
+	if ( !file.open( QIODevice::WriteOnly | QIODevice::Truncate ) ) {
+		___ERRORLOG( QString( "Unable to open %1 for writing" ).arg( path ) );
+		return false;
+	}
+	if ( file.write( __data ) != __data.size() ) {
+		___ERRORLOG( QString( "Unable to write %1" ).arg( path ) );
+		return false;
+	}
+	return true;
+}
+
+ChunkReader::ChunkReader() : __file( 0 ), __data( 0 ), __size( 0 ), __pos( 0 ), __error( false )
+{
+}
+
+ChunkReader::~ChunkReader()
+{
+	__close();
+}
+
+void ChunkReader::__close()
+{
+	if ( __file ) {
+		__file->close();    // unmaps the file
+		delete __file;
+		__file = 0;
+	}
+	__copy.clear();
+	__data = 0;
+	__size = __pos = 0;
+	__error = false;
+}
+
+bool ChunkReader::is_chunk_file( const QString& path, const char* magic )
+{
+	QFile file( path );
+	if ( !file.open( QIODevice::ReadOnly ) ) return false;
+	QByteArray header = file.read( 4 );
+	return header.size() == 4 && memcmp( header.constData(), magic, 4 ) == 0;
+}
+
+bool ChunkReader::open( const QString& path, const char* magic, quint32* version )
+{
+	__close();
+	__file = new QFile( path );
+	if ( !__file->open( QIODevice::ReadOnly ) ) {
+		___ERRORLOG( QString( "Unable to open %1" ).arg( path ) );
+		__close();
+		return false;
+	}
+	qint64 size = __file->size();
+	if ( size < HEADER_SIZE || size > 0xffffffff ) {
+		___ERRORLOG( QString( "%1 is not a valid file" ).arg( path ) );
+		__close();
+		return false;
+	}
+	__data = __file->map( 0, size );
+	if ( !__data ) {
+		__copy = __file->readAll();
+		__data = ( const uchar* )__copy.constData();
+		size = __copy.size();
+	}
+	__size = size;
+	const uchar* header = __take( 4 );
+	if ( !header || memcmp( header, magic, 4 ) != 0 ) {
+		___ERRORLOG( QString( "%1 is not a valid file" ).arg( path ) );
+		__close();
+		return false;
+	}
+	*version = read_u32();
+	return !__error;
+}
+
+bool ChunkReader::next_chunk( QByteArray* id, ChunkReader* chunk )
+{
+	if ( __error || __pos == __size ) return false;
+	if ( __size - __pos < CHUNK_HEADER ) {
+		___ERRORLOG( "chunk header is truncated" );
+		__error = true;
+		return false;
+	}
+	const uchar* chunk_id = __take( 4 );
+	quint32 size = read_u32();
+	const uchar* payload = __take( size );
+	if ( !payload ) {
+		___ERRORLOG( QString( "chunk %1 is truncated" ).arg( QString::fromLatin1( ( const char* )chunk_id, 4 ) ) );
+		return false;
+	}
+	*id = QByteArray( ( const char* )chunk_id, 4 );
+	chunk->__close();
+	chunk->__data = payload;
+	chunk->__size = size;
+	return true;
+}
+
+const uchar* ChunkReader::__take( quint32 size )
+{
+	if ( __error || size > __size - __pos ) {
+		__error = true;
+		return 0;
+	}
+	const uchar* data = __data + __pos;
+	__pos += size;
+	return data;
+}
+
+quint8 ChunkReader::read_u8()
+{
+	const uchar* data = __take( 1 );
+	return data ? *data : 0;
+}
+
+bool ChunkReader::read_bool()
+{
+	return read_u8() != 0;
+}
+
+qint32 ChunkReader::read_i32()
+{
+	return ( qint32 )read_u32();
+}
+
+quint32 ChunkReader::read_u32()
+{
+	const uchar* data = __take( 4 );
+	return data ? qFromLittleEndian<quint32>( data ) : 0;
+}
+
+float ChunkReader::read_float()
+{
+	const uchar* data = __take( 4 );
+	return data ? float_at( data, 0 ) : 0.0f;
+}
+
+QString ChunkReader::read_string()
+{
+	quint32 size = read_u32();
+	const uchar* data = __take( size );
+	return data ? QString::fromUtf8( ( const char* )data, size ) : QString();
+}
+
+const uchar* ChunkReader::read_array( quint32 count, int element_size )
+{
+	if ( element_size > 0 && count > ( __size - __pos ) / element_size ) {
+		__error = true;
+		return 0;
+	}
+	return __take( count * element_size );
+}
+
+qint32 ChunkReader::i32_at( const uchar* array, int i )
+{
+	return ( qint32 )qFromLittleEndian<quint32>( array + i * 4 );
+}
+
+float ChunkReader::float_at( const uchar* array, int i )
+{
+	quint32 bits = qFromLittleEndian<quint32>( array + i * 4 );
+	float value;
+	memcpy( &value, &bits, 4 );
+	return value;
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
@@ -0,0 +1,239 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <hydrogen/helpers/drumkit_index.h>
+
+#include <QDateTime>
+#include <QFileInfo>
+
+#include <hydrogen/helpers/xml.h>
+#include <hydrogen/helpers/filesystem.h>
+#include <hydrogen/basics/drumkit.h>
+#include <hydrogen/basics/drumkit_component.h>
+#include <hydrogen/basics/instrument.h>
+#include <hydrogen/basics/instrument_list.h>
+
+#define INDEX_VERSION   1
+
+namespace H2Core
+{
+
+const char* DrumkitIndex::__class_name = "DrumkitIndex";
+DrumkitIndex::Index DrumkitIndex::__index;
+bool DrumkitIndex::__loaded = false;
+bool DrumkitIndex::__dirty = false;
+
+DrumkitIndex::Entries DrumkitIndex::sys_drumkits()
+{
+	return __list( Filesystem::sys_drumkits_dir(), Filesystem::sys_drumkits_list() );
+}
+
+DrumkitIndex::Entries DrumkitIndex::usr_drumkits()
+{
+	return __list( Filesystem::usr_drumkits_dir(), Filesystem::usr_drumkits_list() );
+}
+
+bool DrumkitIndex::get( const QString& dk_path, Entry* entry )
+{
+	__load();
+	const Entry* found = __update( dk_path );
+	__save();
+	if ( !found ) return false;
+	*entry = *found;
+	return true;
+}
+
+bool DrumkitIndex::find( const QString& dk_name, Entry* entry )
+{
+	Entries entries = usr_drumkits();
+	Entries sys_entries = sys_drumkits();
+	entries.insert( entries.end(), sys_entries.begin(), sys_entries.end() );
+	for ( int i = 0; i < entries.size(); i++ ) {
+		if ( entries[i].name == dk_name ) {
+			*entry = entries[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+DrumkitIndex::Entries DrumkitIndex::__list( const QString& dir, const QStringList& names )
+{
+	__load();
+	Entries entries;
+	QStringList paths;
+	for ( int i = 0; i < names.size(); i++ ) {
+		QString dk_path = dir + "/" + names[i];
+		paths << dk_path;
+		const Entry* entry = __update( dk_path );
+		if ( entry ) entries.push_back( *entry );
+	}
+	// forget the drumkits removed from dir
+	Index::iterator it = __index.begin();
+	while ( it != __index.end() ) {
+		if ( it->first.startsWith( dir + "/" ) && !paths.contains( it->first ) ) {
+			__index.erase( it++ );
+			__dirty = true;
+		} else {
+			++it;
+		}
+	}
+	__save();
+	return entries;
+}
+
+const DrumkitIndex::Entry* DrumkitIndex::__update( const QString& dk_path )
+{
+	qint64 timestamp = __timestamp( dk_path );
+	Index::iterator it = __index.find( dk_path );
+	if ( it != __index.end() && it->second.timestamp == timestamp ) return &it->second;
+
+	Drumkit* drumkit = ( timestamp >= 0 ) ? Drumkit::load( dk_path, false ) : 0;
+	if ( !drumkit ) {
+		if ( it != __index.end() ) {
+			__index.erase( it );
+			__dirty = true;
+		}
+		return 0;
+	}
+	Entry& entry = __index[ dk_path ];
+	entry.path = dk_path;
+	entry.timestamp = timestamp;
+	entry.name = drumkit->get_name();
+	entry.author = drumkit->get_author();
+	entry.info = drumkit->get_info();
+	entry.license = drumkit->get_license();
+	entry.image = drumkit->get_image();
+	entry.image_license = drumkit->get_image_license();
+	entry.instruments.clear();
+	InstrumentList* instruments = drumkit->get_instruments();
+	for ( int i = 0; i < instruments->size(); i++ ) entry.instruments << instruments->get( i )->get_name();
+	entry.components.clear();
+	std::vector<DrumkitComponent*>* components = drumkit->get_components();
+	for ( int i = 0; i < components->size(); i++ ) {
+		Component component;
+		component.id = ( *components )[i]->get_id();
+		component.name = ( *components )[i]->get_name();
+		component.volume = ( *components )[i]->get_volume();
+		entry.components.push_back( component );
+	}
+	delete drumkit;
+	__dirty = true;
+	return &entry;
+}
+
+qint64 DrumkitIndex::__timestamp( const QString& dk_path )
+{
+	QFileInfo file( Filesystem::drumkit_file( dk_path ) );
+	if ( !file.exists() ) return -1;
+	// the directory changes when samples are added or removed
+	return qMax( QFileInfo( dk_path ).lastModified().toMSecsSinceEpoch(), file.lastModified().toMSecsSinceEpoch() );
+}
+
+void DrumkitIndex::__load()
+{
+	if ( __loaded ) return;
+	__loaded = true;
+	QString index_file = Filesystem::drumkit_index_file();
+	if ( !Filesystem::file_readable( index_file, true ) ) return;
+	XMLDoc doc;
+	if ( !doc.read( index_file ) ) return;
+	XMLNode root = doc.firstChildElement( "drumkit_index" );
+	if ( root.isNull() || root.read_int( "version", 0 ) != INDEX_VERSION ) {
+		_INFOLOG( QString( "%1 is outdated, drumkits will be read again" ).arg( index_file ) );
+		return;
+	}
+	XMLNode drumkit_node = root.firstChildElement( "drumkit" );
+	while ( !drumkit_node.isNull() ) {
+		Entry entry;
+		entry.path = drumkit_node.read_string( "path", "" );
+		entry.timestamp = drumkit_node.read_string( "timestamp", "-1" ).toLongLong();
+		entry.name = drumkit_node.read_string( "name", "" );
+		entry.author = drumkit_node.read_string( "author", "" );
+		entry.info = drumkit_node.read_string( "info", "" );
+		entry.license = drumkit_node.read_string( "license", "" );
+		entry.image = drumkit_node.read_string( "image", "" );
+		entry.image_license = drumkit_node.read_string( "imageLicense", "" );
+		XMLNode instrument_node = drumkit_node.firstChildElement( "instrumentList" ).firstChildElement( "instrument" );
+		while ( !instrument_node.isNull() ) {
+			entry.instruments << instrument_node.read_string( "name", "" );
+			instrument_node = instrument_node.nextSiblingElement( "instrument" );
+		}
+		XMLNode component_node = drumkit_node.firstChildElement( "componentList" ).firstChildElement( "drumkitComponent" );
+		while ( !component_node.isNull() ) {
+			Component component;
+			component.id = component_node.read_int( "id", EMPTY_INSTR_ID );
+			component.name = component_node.read_string( "name", "" );
+			component.volume = component_node.read_float( "volume", 1.0f );
+			entry.components.push_back( component );
+			component_node = component_node.nextSiblingElement( "drumkitComponent" );
+		}
+		if ( !entry.path.isEmpty() ) __index[ entry.path ] = entry;
+		drumkit_node = drumkit_node.nextSiblingElement( "drumkit" );
+	}
+}
+
+void DrumkitIndex::__save()
+{
+	if ( !__dirty ) return;
+	__dirty = false;
+	XMLDoc doc;
+	doc.set_root( "drumkit_index", "drumkit_index" );
+	XMLNode root = doc.firstChildElement( "drumkit_index" );
+	root.write_int( "version", INDEX_VERSION );
+	for ( Index::iterator it = __index.begin(); it != __index.end(); ++it ) {
+		const Entry& entry = it->second;
+		XMLNode drumkit_node = doc.createElement( "drumkit" );
+		drumkit_node.write_string( "path", entry.path );
+		drumkit_node.write_string( "timestamp", QString::number( entry.timestamp ) );
+		drumkit_node.write_string( "name", entry.name );
+		drumkit_node.write_string( "author", entry.author );
+		drumkit_node.write_string( "info", entry.info );
+		drumkit_node.write_string( "license", entry.license );
+		drumkit_node.write_string( "image", entry.image );
+		drumkit_node.write_string( "imageLicense", entry.image_license );
+		XMLNode instruments_node = doc.createElement( "instrumentList" );
+		for ( int i = 0; i < entry.instruments.size(); i++ ) {
+			XMLNode instrument_node = doc.createElement( "instrument" );
+			instrument_node.write_string( "name", entry.instruments[i] );
+			instruments_node.appendChild( instrument_node );
+		}
+		drumkit_node.appendChild( instruments_node );
+		XMLNode components_node = doc.createElement( "componentList" );
+		for ( int i = 0; i < entry.components.size(); i++ ) {
+			XMLNode component_node = doc.createElement( "drumkitComponent" );
+			component_node.write_int( "id", entry.components[i].id );
+			component_node.write_string( "name", entry.components[i].name );
+			component_node.write_float( "volume", entry.components[i].volume );
+			components_node.appendChild( component_node );
+		}
+		drumkit_node.appendChild( components_node );
+		root.appendChild( drumkit_node );
+	}
+	if ( !doc.write( Filesystem::drumkit_index_file() ) ) {
+		_ERRORLOG( QString( "unable to write %1" ).arg( Filesystem::drumkit_index_file() ) );
+	}
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
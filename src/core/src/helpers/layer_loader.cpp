@@ -0,0 +1,189 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <set>
+
+#include <QTime>
+
+#include <hydrogen/helpers/layer_loader.h>
+#include <hydrogen/helpers/sample_packer.h>
+
+#include <hydrogen/audio_engine.h>
+#include <hydrogen/basics/song.h>
+#include <hydrogen/basics/note.h>
+#include <hydrogen/basics/sample.h>
+#include <hydrogen/basics/pattern.h>
+#include <hydrogen/basics/pattern_list.h>
+#include <hydrogen/basics/instrument.h>
+#include <hydrogen/basics/instrument_list.h>
+#include <hydrogen/basics/instrument_layer.h>
+#include <hydrogen/basics/instrument_component.h>
+
+namespace H2Core
+{
+
+const char* LayerLoader::__class_name = "LayerLoader";
+
+LayerLoader::LayerLoader()
+	: Object( __class_name )
+	, __song( 0 )
+	, __abort( false )
+	, __running( false )
+	, __thread_started( false )
+{
+}
+
+LayerLoader::~LayerLoader()
+{
+	stop();
+}
+
+void LayerLoader::start( Song* song )
+{
+	stop();
+	__song = song;
+	__files = schedule( song );
+	if ( __files.empty() ) return;
+
+	__abort = false;
+	__running = true;
+	if ( pthread_create( &__thread, 0, loader_thread, this ) != 0 ) {
+		ERRORLOG( "unable to start the layer loader thread" );
+		__running = false;
+		return;
+	}
+	__thread_started = true;
+}
+
+void LayerLoader::stop()
+{
+	if ( __thread_started ) {
+		__abort = true;
+		pthread_join( __thread, 0 );
+		__thread_started = false;
+	}
+	__running = false;
+	__files.clear();
+	__song = 0;
+}
+
+void LayerLoader::wait()
+{
+	if ( __thread_started ) {
+		pthread_join( __thread, 0 );
+		__thread_started = false;
+	}
+}
+
+std::vector<QString> LayerLoader::schedule( Song* song )
+{
+	InstrumentList* instruments = song->get_instrument_list();
+
+	// the velocities each instrument is played with
+	std::vector< std::set<float> > velocities( instruments->size() );
+	PatternList* patterns = song->get_pattern_list();
+	for ( int p = 0; p < patterns->size(); p++ ) {
+		const Pattern::notes_t* notes = patterns->get( p )->get_notes();
+		FOREACH_NOTE_CST_IT_BEGIN_END( notes, it ) {
+			int idx = instruments->index( it->second->get_instrument() );
+			if ( idx != -1 ) velocities[ idx ].insert( it->second->get_velocity() );
+		}
+	}
+
+	std::vector<QString> played;
+	std::vector<QString> others;
+	std::set<QString> files;
+	for ( int i = 0; i < instruments->size(); i++ ) {
+		std::vector<InstrumentComponent*>* components = instruments->get( i )->get_components();
+		for ( int c = 0; c < components->size(); c++ ) {
+			for ( int n = 0; n < MAX_LAYERS; n++ ) {
+				InstrumentLayer* layer = components->at( c )->get_layer( n );
+				if ( !layer || !layer->get_sample() || !layer->get_sample()->is_empty() ) continue;
+				bool reached = false;
+				std::set<float>::const_iterator v = velocities[ i ].lower_bound( layer->get_start_velocity() );
+				if ( v != velocities[ i ].end() && *v <= layer->get_end_velocity() ) reached = true;
+				QString filepath = layer->get_sample()->get_filepath();
+				if ( reached ) {
+					played.push_back( filepath );
+				} else {
+					others.push_back( filepath );
+				}
+			}
+		}
+	}
+
+	std::vector<QString> ordered;
+	for ( int i = 0; i < played.size(); i++ ) {
+		if ( files.insert( played[i] ).second ) ordered.push_back( played[i] );
+	}
+	for ( int i = 0; i < others.size(); i++ ) {
+		if ( files.insert( others[i] ).second ) ordered.push_back( others[i] );
+	}
+	return ordered;
+}
+
+int LayerLoader::fill( Song* song, Sample* loaded )
+{
+	int filled = 0;
+	InstrumentList* instruments = song->get_instrument_list();
+	for ( int i = 0; i < instruments->size(); i++ ) {
+		std::vector<InstrumentComponent*>* components = instruments->get( i )->get_components();
+		for ( int c = 0; c < components->size(); c++ ) {
+			for ( int n = 0; n < MAX_LAYERS; n++ ) {
+				InstrumentLayer* layer = components->at( c )->get_layer( n );
+				if ( !layer || !layer->get_sample() || !layer->get_sample()->is_empty() ) continue;
+				if ( layer->get_sample()->get_filepath() != loaded->get_filepath() ) continue;
+				if ( layer->get_sample()->share( loaded ) ) filled++;
+			}
+		}
+	}
+	return filled;
+}
+
+void* LayerLoader::loader_thread( void* param )
+{
+	LayerLoader* loader = ( LayerLoader* )param;
+	QTime timer;
+	timer.start();
+	int loaded_files = 0;
+	for ( int i = 0; i < loader->__files.size() && !loader->__abort; i++ ) {
+		// decode without the lock, the audio engine keeps playing the loaded layers meanwhile
+		Sample* loaded = new Sample( loader->__files[i] );
+		loaded->load();
+		SamplePacker::apply_policy( loaded, QString() );
+		if ( !loaded->is_empty() ) {
+			AudioEngine::get_instance()->lock( RIGHT_HERE );
+			fill( loader->__song, loaded );
+			AudioEngine::get_instance()->unlock();
+			loaded_files++;
+		}
+		delete loaded;
+	}
+	_INFOLOG( QString( "%1 of %2 layer files loaded in %3 ms" )
+			  .arg( loaded_files ).arg( loader->__files.size() ).arg( timer.elapsed() ) );
+	loader->__running = false;
+	return 0;
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
@@ -0,0 +1,239 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <hydrogen/helpers/sample_cache.h>
+
+#include <inttypes.h>
+#include <cstring>
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+
+#include <hydrogen/helpers/filesystem.h>
+
+#define CACHE_MAGIC         "H2SCACHE"
+#define CACHE_VERSION       1
+#define CACHE_PAGE_SIZE     4096                ///< alignment of the header and of each channel
+#define CACHE_DECODING      "float32 planar 1-2ch"  ///< what Sample::load() produces, part of the key
+#define CACHE_EXT           ".h2cache"
+
+namespace H2Core
+{
+
+const char* SampleCache::__class_name = "SampleCache";
+std::atomic<bool> SampleCache::__enabled( false );
+std::atomic<int> SampleCache::__size_limit( 0 );
+std::atomic<qint64> SampleCache::__total( -1 );
+std::atomic<int> SampleCache::__batches( 0 );
+
+/** first page of a cache file, followed by the left then the right channel data */
+struct CacheHeader {
+	char magic[8];
+	int32_t version;
+	int32_t frames;
+	int32_t sample_rate;
+	int32_t key_length;
+	int64_t data_l;         ///< offset of the left channel
+	int64_t data_r;         ///< offset of the right channel, data_l for a mono sample
+	char key[ CACHE_PAGE_SIZE - 40 ];
+};
+
+static_assert( sizeof( CacheHeader ) == CACHE_PAGE_SIZE, "the cache header has to fill one page" );
+
+void SampleCache::set_enabled( bool enabled, int size_limit )
+{
+	__enabled = enabled;
+	__size_limit = size_limit;
+	// a lower limit applies right away, unless a batch prunes when it ends
+	if ( enabled && __batches.load() == 0 ) prune();
+}
+
+bool SampleCache::is_enabled()
+{
+	return __enabled;
+}
+
+QString SampleCache::key( const QString& filepath, const QString& processing )
+{
+	QFileInfo info( filepath );
+	if ( !info.isFile() ) return QString();
+	QString k = QString( "%1|%2|%3|%4" )
+				.arg( info.canonicalFilePath() )
+				.arg( info.lastModified().toTime_t() )
+				.arg( info.size() )
+				.arg( CACHE_DECODING );
+	if ( !processing.isEmpty() ) k += "|" + processing;
+	return k;
+}
+
+QString SampleCache::cache_path( const QString& key )
+{
+	QByteArray hash = QCryptographicHash::hash( key.toUtf8(), QCryptographicHash::Sha1 ).toHex();
+	return Filesystem::samples_cache_dir() + "/" + QString( hash ) + CACHE_EXT;
+}
+
+QFile* SampleCache::map( const QString& filepath, int* frames, int* sample_rate, float** data_l, float** data_r,
+						 const QString& processing )
+{
+	if ( !__enabled ) return 0;
+	QString k = key( filepath, processing );
+	if ( k.isEmpty() ) return 0;
+
+	QFile* file = new QFile( cache_path( k ) );
+	if ( !file->exists() || !file->open( QIODevice::ReadOnly ) ) {
+		delete file;
+		return 0;
+	}
+	qint64 size = file->size();
+	uchar* data = ( size >= CACHE_PAGE_SIZE ) ? file->map( 0, size ) : 0;
+	if ( !data ) {
+		delete file;
+		return 0;
+	}
+
+	const CacheHeader* header = ( const CacheHeader* )data;
+	QByteArray key_utf8 = k.toUtf8();
+	qint64 data_size = ( qint64 )header->frames * sizeof( float );
+	bool valid = memcmp( header->magic, CACHE_MAGIC, sizeof( header->magic ) ) == 0
+				 && header->version == CACHE_VERSION
+				 && header->key_length == key_utf8.size()
+				 && memcmp( header->key, key_utf8.constData(), key_utf8.size() ) == 0
+				 && header->frames >= 0
+				 && header->data_l >= CACHE_PAGE_SIZE && header->data_l + data_size <= size
+				 && header->data_r >= CACHE_PAGE_SIZE && header->data_r + data_size <= size;
+	if ( !valid ) {
+		_WARNINGLOG( QString( "invalid cache file %1 for %2" ).arg( file->fileName() ).arg( filepath ) );
+		delete file;
+		return 0;
+	}
+
+	*frames = header->frames;
+	*sample_rate = header->sample_rate;
+	*data_l = ( float* )( data + header->data_l );
+	*data_r = ( float* )( data + header->data_r );
+	return file;
+}
+
+bool SampleCache::store( const QString& filepath, int frames, int sample_rate, const float* data_l, const float* data_r,
+						 const QString& processing )
+{
+	if ( !__enabled ) return false;
+	QString k = key( filepath, processing );
+	if ( k.isEmpty() ) return false;
+	QByteArray key_utf8 = k.toUtf8();
+	if ( key_utf8.size() > ( int )sizeof( CacheHeader().key ) ) return false;
+
+	qint64 data_size = ( qint64 )frames * sizeof( float );
+	qint64 padded_size = ( data_size + CACHE_PAGE_SIZE - 1 ) / CACHE_PAGE_SIZE * CACHE_PAGE_SIZE;
+
+	CacheHeader header;
+	memset( &header, 0, sizeof( header ) );
+	memcpy( header.magic, CACHE_MAGIC, sizeof( header.magic ) );
+	header.version = CACHE_VERSION;
+	header.frames = frames;
+	header.sample_rate = sample_rate;
+	header.key_length = key_utf8.size();
+	header.data_l = CACHE_PAGE_SIZE;
+	// a mono sample is stored once, the mapping then gives the same pointer for both channels
+	bool mono = ( data_r == data_l );
+	header.data_r = mono ? header.data_l : CACHE_PAGE_SIZE + padded_size;
+	memcpy( header.key, key_utf8.constData(), key_utf8.size() );
+
+	// write aside and rename, processes mapping the previous file keep their pages
+	QString path = cache_path( k );
+	QString tmp_path = path + QString( ".%1.%2.tmp" ).arg( QCoreApplication::applicationPid() ).arg( ( quintptr )QThread::currentThreadId() );
+	QFile file( tmp_path );
+	if ( !file.open( QIODevice::WriteOnly | QIODevice::Truncate ) ) {
+		_ERRORLOG( QString( "unable to write %1" ).arg( tmp_path ) );
+		return false;
+	}
+	bool ok = file.write( ( const char* )&header, sizeof( header ) ) == sizeof( header )
+			  && file.write( ( const char* )data_l, data_size ) == data_size
+			  && ( mono || ( file.seek( header.data_r )
+							 && file.write( ( const char* )data_r, data_size ) == data_size ) );
+	file.close();
+	if ( !ok ) {
+		_ERRORLOG( QString( "unable to write %1" ).arg( tmp_path ) );
+		QFile::remove( tmp_path );
+		return false;
+	}
+	qint64 replaced = QFileInfo( path ).size();
+	QFile::remove( path );
+	if ( !QFile::rename( tmp_path, path ) ) {
+		QFile::remove( tmp_path );
+		// the previous file is gone too
+		if ( __total.load() >= 0 ) __total -= replaced;
+		return false;
+	}
+	// stores before the first scan are counted by it
+	if ( __total.load() >= 0 ) __total += QFileInfo( path ).size() - replaced;
+	if ( __batches.load() == 0 && ( __total.load() < 0 || over_limit() ) ) prune();
+	return true;
+}
+
+void SampleCache::begin_batch()
+{
+	__batches++;
+}
+
+void SampleCache::end_batch()
+{
+	if ( --__batches == 0 && __enabled && ( __total.load() < 0 || over_limit() ) ) prune();
+}
+
+bool SampleCache::over_limit()
+{
+	int size_limit = __size_limit;
+	return size_limit > 0 && __total.load() > ( qint64 )size_limit * 1024 * 1024;
+}
+
+void SampleCache::prune()
+{
+	// oldest first, a hit does not refresh an entry
+	QFileInfoList files = QDir( Filesystem::samples_cache_dir() ).entryInfoList( QStringList( "*" CACHE_EXT ), QDir::Files, QDir::Time | QDir::Reversed );
+	qint64 total = 0;
+	for ( int i = 0; i < files.size(); i++ ) total += files[i].size();
+	int size_limit = __size_limit;
+	if ( size_limit > 0 ) {
+		qint64 limit = ( qint64 )size_limit * 1024 * 1024;
+		for ( int i = 0; i < files.size() - 1 && total > limit; i++ ) {
+			if ( QFile::remove( files[i].absoluteFilePath() ) ) total -= files[i].size();
+		}
+	}
+	__total = total;
+}
+
+void SampleCache::clear()
+{
+	QFileInfoList files = QDir( Filesystem::samples_cache_dir() ).entryInfoList( QStringList( "*" CACHE_EXT ), QDir::Files );
+	for ( int i = 0; i < files.size(); i++ ) QFile::remove( files[i].absoluteFilePath() );
+	__total = 0;
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
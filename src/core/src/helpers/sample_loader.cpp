@@ -0,0 +1,122 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <algorithm>
+#include <set>
+#include <pthread.h>
+
+#include <QThread>
+#include <QTime>
+
+#include <hydrogen/helpers/sample_loader.h>
+
+#include <hydrogen/event_queue.h>
+#include <hydrogen/basics/sample.h>
+#include <hydrogen/helpers/sample_cache.h>
+
+#ifdef WIN32
+#include <windows.h>
+#define LOADER_SLEEP( ms ) Sleep( ms )
+#else
+#include <unistd.h>
+#define LOADER_SLEEP( ms ) usleep( 1000 * ( ms ) )
+#endif
+
+namespace H2Core
+{
+
+const char* SampleLoader::__class_name = "SampleLoader";
+
+SampleLoader::SampleLoader( int threads )
+	: Object( __class_name )
+	, __threads( threads )
+	, __next( 0 )
+	, __done( 0 )
+{
+	if ( __threads <= 0 ) __threads = std::min( std::max( QThread::idealThreadCount(), 1 ), MAX_LOADER_THREADS );
+}
+
+void SampleLoader::add( Sample* sample )
+{
+	__samples.push_back( sample );
+}
+
+void SampleLoader::run( bool progress )
+{
+	QTime timer;
+	timer.start();
+	EventQueue* queue = progress ? EventQueue::get_instance() : 0;
+	if ( queue ) queue->push_event( EVENT_PROGRESS, 0 );
+
+	// a file used by several samples is decoded once, the others get it from the SamplePool afterwards
+	std::set<QString> paths;
+	std::vector<Sample*> duplicates;
+	__unique.clear();
+	for ( int i = 0; i < __samples.size(); i++ ) {
+		if ( paths.insert( __samples[i]->get_filepath() ).second ) {
+			__unique.push_back( __samples[i] );
+		} else {
+			duplicates.push_back( __samples[i] );
+		}
+	}
+
+	// the decoded files are stored in the cache as they come, it is pruned once at the end
+	SampleCache::begin_batch();
+	__next = 0;
+	__done = 0;
+	int threads = std::min( __threads, ( int )__unique.size() );
+	std::vector<pthread_t> ids( threads );
+	for ( int i = 0; i < threads; i++ ) pthread_create( &ids[i], 0, loader_thread, this );
+	int reported = 0;
+	while ( __done.load() < ( int )__unique.size() ) {
+		int percent = __done.load() * 100 / __unique.size();
+		if ( queue && percent != reported ) {
+			queue->push_event( EVENT_PROGRESS, percent );
+			reported = percent;
+		}
+		LOADER_SLEEP( 10 );
+	}
+	for ( int i = 0; i < threads; i++ ) pthread_join( ids[i], 0 );
+
+	for ( int i = 0; i < duplicates.size(); i++ ) duplicates[i]->load();
+	SampleCache::end_batch();
+
+	if ( queue ) queue->push_event( EVENT_PROGRESS, 100 );
+	INFOLOG( QString( "%1 samples from %2 files loaded in %3 ms using %4 threads" )
+			 .arg( __samples.size() ).arg( __unique.size() ).arg( timer.elapsed() ).arg( threads ) );
+}
+
+void* SampleLoader::loader_thread( void* param )
+{
+	SampleLoader* loader = ( SampleLoader* )param;
+	int n = loader->__unique.size();
+	int i;
+	while ( ( i = loader->__next.fetch_add( 1 ) ) < n ) {
+		loader->__unique[i]->load();
+		loader->__done.fetch_add( 1 );
+	}
+	return 0;
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
@@ -0,0 +1,245 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+
+#include <sndfile.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#include <hydrogen/helpers/sample_packer.h>
+
+#include <hydrogen/Preferences.h>
+#include <hydrogen/basics/sample.h>
+
+namespace H2Core
+{
+
+const char* SamplePacker::__class_name = "SamplePacker";
+
+static inline int clamp_round( float value, float scale, int max )
+{
+	float scaled = value * scale;
+	if ( scaled > max ) return max;
+	if ( scaled < -max - 1 ) return -max - 1;
+	return ( int )lrintf( scaled );
+}
+
+static inline uint16_t float_to_half( float value )
+{
+	uint32_t x;
+	memcpy( &x, &value, sizeof( x ) );
+	uint32_t sign = ( x >> 16 ) & 0x8000;
+	int exponent = ( int )( ( x >> 23 ) & 0xff ) - 127 + 15;
+	uint32_t mantissa = x & 0x7fffff;
+	if ( exponent >= 31 ) {
+		// out of range, saturate to the largest half
+		return sign | 0x7bff;
+	}
+	if ( exponent <= 0 ) {
+		if ( exponent < -10 ) return sign;
+		mantissa |= 0x800000;
+		int shift = 14 - exponent;
+		uint32_t half = mantissa >> shift;
+		// round to nearest
+		if ( ( mantissa >> ( shift - 1 ) ) & 1 ) half++;
+		return sign | half;
+	}
+	// a rounding carry into the exponent is still the right value
+	uint32_t half = ( ( uint32_t )exponent << 10 ) | ( mantissa >> 13 );
+	half += ( mantissa >> 12 ) & 1;
+	if ( half >= 0x7c00 ) half = 0x7bff;
+	return sign | half;
+}
+
+int SamplePacker::bytes_per_frame( Format format )
+{
+	switch ( format ) {
+	case INT16:
+	case HALF:
+		return 2;
+	case INT24:
+		return 3;
+	default:
+		return sizeof( float );
+	}
+}
+
+char* SamplePacker::pack( Format format, const float* data, int frames )
+{
+	char* packed = new char[ ( size_t )frames * bytes_per_frame( format ) ];
+	switch ( format ) {
+	case INT16: {
+		int16_t* out = ( int16_t* )packed;
+		for ( int i = 0; i < frames; i++ ) out[i] = ( int16_t )clamp_round( data[i], 32768.0f, 32767 );
+		break;
+	}
+	case INT24: {
+		unsigned char* out = ( unsigned char* )packed;
+		for ( int i = 0; i < frames; i++ ) {
+			int value = clamp_round( data[i], 8388608.0f, 8388607 );
+			out[ 3 * i ] = value & 0xff;
+			out[ 3 * i + 1 ] = ( value >> 8 ) & 0xff;
+			out[ 3 * i + 2 ] = ( value >> 16 ) & 0xff;
+		}
+		break;
+	}
+	case HALF: {
+		uint16_t* out = ( uint16_t* )packed;
+		for ( int i = 0; i < frames; i++ ) out[i] = float_to_half( data[i] );
+		break;
+	}
+	default:
+		memcpy( packed, data, frames * sizeof( float ) );
+	}
+	return packed;
+}
+
+void SamplePacker::unpack( Format format, const char* packed, int first, int count, float* data )
+{
+	switch ( format ) {
+	case INT16: {
+		const int16_t* in = ( const int16_t* )packed + first;
+		const float scale = 1.0f / 32768.0f;
+		int i = 0;
+#ifdef __SSE2__
+		const __m128 vscale = _mm_set1_ps( scale );
+		for ( ; i + 8 <= count; i += 8 ) {
+			__m128i x = _mm_loadu_si128( ( const __m128i* )( in + i ) );
+			// each sample doubled in a 32 bits lane, the arithmetic shift extends its sign
+			__m128i lo = _mm_srai_epi32( _mm_unpacklo_epi16( x, x ), 16 );
+			__m128i hi = _mm_srai_epi32( _mm_unpackhi_epi16( x, x ), 16 );
+			_mm_storeu_ps( data + i, _mm_mul_ps( _mm_cvtepi32_ps( lo ), vscale ) );
+			_mm_storeu_ps( data + i + 4, _mm_mul_ps( _mm_cvtepi32_ps( hi ), vscale ) );
+		}
+#endif
+		for ( ; i < count; i++ ) data[i] = in[i] * scale;
+		break;
+	}
+	case INT24: {
+		const unsigned char* in = ( const unsigned char* )packed + 3 * first;
+		const float scale = 1.0f / 8388608.0f;
+		int i = 0;
+#ifdef __SSE2__
+		// four frames are read as 32 bits words, the last word reads a byte past them
+		const __m128 vscale = _mm_set1_ps( scale );
+		for ( ; i + 5 <= count; i += 4 ) {
+			int32_t words[4];
+			memcpy( words, in + 3 * i, 4 );
+			memcpy( words + 1, in + 3 * i + 3, 4 );
+			memcpy( words + 2, in + 3 * i + 6, 4 );
+			memcpy( words + 3, in + 3 * i + 9, 4 );
+			__m128i x = _mm_loadu_si128( ( const __m128i* )words );
+			x = _mm_srai_epi32( _mm_slli_epi32( x, 8 ), 8 );
+			_mm_storeu_ps( data + i, _mm_mul_ps( _mm_cvtepi32_ps( x ), vscale ) );
+		}
+#endif
+		for ( ; i < count; i++ ) {
+			// place the 24 bits at the top so the sign is extended
+			int32_t value = ( int32_t )( ( ( uint32_t )in[ 3 * i ] << 8 ) | ( ( uint32_t )in[ 3 * i + 1 ] << 16 ) | ( ( uint32_t )in[ 3 * i + 2 ] << 24 ) );
+			data[i] = ( value >> 8 ) * scale;
+		}
+		break;
+	}
+	case HALF: {
+		const uint16_t* in = ( const uint16_t* )packed + first;
+		// rebias the exponent with a multiply, which also turns half subnormals into floats
+		const float rebias = 5.192296858534828e+33f;  // 2^112
+		int i = 0;
+#if defined(__F16C__)
+		for ( ; i + 4 <= count; i += 4 ) {
+			_mm_storeu_ps( data + i, _mm_cvtph_ps( _mm_loadl_epi64( ( const __m128i* )( in + i ) ) ) );
+		}
+#elif defined(__SSE2__)
+		const __m128 vrebias = _mm_set1_ps( rebias );
+		const __m128i magnitude = _mm_set1_epi32( 0x7fff );
+		const __m128i sign = _mm_set1_epi32( 0x8000 );
+		const __m128i zero = _mm_setzero_si128();
+		for ( ; i + 4 <= count; i += 4 ) {
+			__m128i x = _mm_unpacklo_epi16( _mm_loadl_epi64( ( const __m128i* )( in + i ) ), zero );
+			__m128 value = _mm_mul_ps( _mm_castsi128_ps( _mm_slli_epi32( _mm_and_si128( x, magnitude ), 13 ) ), vrebias );
+			__m128 negative = _mm_castsi128_ps( _mm_slli_epi32( _mm_and_si128( x, sign ), 16 ) );
+			_mm_storeu_ps( data + i, _mm_or_ps( value, negative ) );
+		}
+#endif
+		for ( ; i < count; i++ ) {
+			uint32_t bits = ( uint32_t )( in[i] & 0x7fff ) << 13;
+			float value;
+			memcpy( &value, &bits, sizeof( value ) );
+			value *= rebias;
+			data[i] = ( in[i] & 0x8000 ) ? -value : value;
+		}
+		break;
+	}
+	default:
+		memcpy( data, ( const float* )packed + first, count * sizeof( float ) );
+	}
+}
+
+SamplePacker::Format SamplePacker::native_format( const QString& filepath )
+{
+	SF_INFO sound_info;
+	memset( &sound_info, 0, sizeof( sound_info ) );
+	SNDFILE* file = sf_open( filepath.toLocal8Bit(), SFM_READ, &sound_info );
+	if ( !file ) return FLOAT;
+	sf_close( file );
+	switch ( sound_info.format & SF_FORMAT_SUBMASK ) {
+	case SF_FORMAT_PCM_S8:
+	case SF_FORMAT_PCM_U8:
+	case SF_FORMAT_PCM_16:
+	case SF_FORMAT_ULAW:
+	case SF_FORMAT_ALAW:
+		return INT16;
+	case SF_FORMAT_PCM_24:
+		return INT24;
+	default:
+		return FLOAT;
+	}
+}
+
+SamplePacker::Format SamplePacker::parse( const QString& storage, const QString& filepath )
+{
+	if ( storage == "native" ) return native_format( filepath );
+	if ( storage == "half" ) return HALF;
+	return FLOAT;
+}
+
+bool SamplePacker::apply_policy( Sample* sample, const QString& kit_storage )
+{
+	if ( !sample ) return false;
+	QString storage = kit_storage.isEmpty() ? Preferences::get_instance()->m_sSampleStorage : kit_storage;
+	if ( storage.isEmpty() || storage == "float" ) return false;
+	Format format = parse( storage, sample->get_filepath() );
+	if ( format == FLOAT ) return false;
+	return sample->compact( format );
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
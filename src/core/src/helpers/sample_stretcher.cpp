@@ -0,0 +1,189 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <algorithm>
+#include <pthread.h>
+
+#include <QThread>
+#include <QTime>
+
+#include <hydrogen/helpers/sample_stretcher.h>
+
+#include <hydrogen/audio_engine.h>
+#include <hydrogen/basics/song.h>
+#include <hydrogen/basics/instrument.h>
+#include <hydrogen/basics/instrument_list.h>
+#include <hydrogen/basics/instrument_layer.h>
+#include <hydrogen/basics/instrument_component.h>
+
+namespace H2Core
+{
+
+const char* SampleStretcher::__class_name = "SampleStretcher";
+
+SampleStretcher::SampleStretcher( int kept_tempos )
+	: Object( __class_name )
+	, __kept_tempos( std::max( 1, kept_tempos ) )
+	, __song( 0 )
+	, __bpm( 0 )
+	, __next_job( 0 )
+{
+}
+
+SampleStretcher::~SampleStretcher()
+{
+	clear();
+}
+
+void SampleStretcher::clear()
+{
+	QMutexLocker lock( &__mutex );
+	__clear();
+}
+
+void SampleStretcher::__clear()
+{
+	for ( std::list<Tempo>::iterator it = __tempos.begin(); it != __tempos.end(); ++it ) {
+		for ( int i = 0; i < it->samples.size(); i++ ) delete it->samples[i];
+	}
+	__tempos.clear();
+}
+
+int SampleStretcher::stretch( Song* song, float bpm, int threads )
+{
+	if ( bpm <= 0 ) return 0;
+	QMutexLocker lock( &__mutex );
+	if ( song != __song ) {
+		// the kept samples belong to the previous song
+		__clear();
+		__song = song;
+	}
+	QTime timer;
+	timer.start();
+
+	__jobs.clear();
+	InstrumentList* instruments = song->get_instrument_list();
+	for ( int i = 0; i < instruments->size(); i++ ) {
+		std::vector<InstrumentComponent*>* components = instruments->get( i )->get_components();
+		for ( int j = 0; j < components->size(); j++ ) {
+			for ( int n = 0; n < MAX_LAYERS; n++ ) {
+				InstrumentLayer* layer = ( *components )[j]->get_layer( n );
+				Sample* sample = layer ? layer->get_sample() : 0;
+				if ( !sample || !sample->get_rubberband().use ) continue;
+				Job job;
+				job.layer = layer;
+				job.filepath = sample->get_filepath();
+				job.loops = sample->get_loops();
+				job.rubberband = sample->get_rubberband();
+				job.velocity = *sample->get_velocity_envelope();
+				job.pan = *sample->get_pan_envelope();
+				job.result = 0;
+				__jobs.push_back( job );
+			}
+		}
+	}
+	if ( __jobs.empty() ) return 0;
+
+	// the pooled tempos come back at once, the others are stretched side by side
+	__bpm = bpm;
+	__next_job = 0;
+	if ( threads <= 0 ) threads = QThread::idealThreadCount();
+	threads = std::min( std::max( 1, threads ), ( int )__jobs.size() );
+	std::vector<pthread_t> workers;
+	for ( int i = 1; i < threads; i++ ) {
+		pthread_t thread;
+		if ( pthread_create( &thread, 0, worker_thread, this ) != 0 ) {
+			ERRORLOG( "unable to start a stretcher thread" );
+			break;
+		}
+		workers.push_back( thread );
+	}
+	worker_thread( this );
+	for ( int i = 0; i < workers.size(); i++ ) pthread_join( workers[i], 0 );
+
+	// the layers may have lost their sample meanwhile, they are looked up again
+	std::vector<Sample*> kept;
+	std::vector<Sample*> replaced;
+	AudioEngine::get_instance()->lock( RIGHT_HERE );
+	for ( int i = 0; i < __jobs.size(); i++ ) {
+		Job& job = __jobs[i];
+		if ( !job.result ) continue;
+		bool found = false;
+		for ( int n = 0; n < instruments->size() && !found; n++ ) {
+			std::vector<InstrumentComponent*>* components = instruments->get( n )->get_components();
+			for ( int j = 0; j < components->size() && !found; j++ ) {
+				for ( int l = 0; l < MAX_LAYERS && !found; l++ ) {
+					found = ( ( *components )[j]->get_layer( l ) == job.layer );
+				}
+			}
+		}
+		if ( !found || !job.layer->get_sample() ) {
+			delete job.result;
+			continue;
+		}
+		replaced.push_back( job.layer->get_sample() );
+		job.layer->set_sample( job.result );
+		kept.push_back( new Sample( job.result ) );
+	}
+	AudioEngine::get_instance()->unlock();
+
+	for ( int i = 0; i < replaced.size(); i++ ) delete replaced[i];
+	__keep( bpm, kept );
+	__jobs.clear();
+	INFOLOG( QString( "%1 samples fit to %2 bpm in %3 ms" ).arg( replaced.size() ).arg( bpm ).arg( timer.elapsed() ) );
+	return replaced.size();
+}
+
+void SampleStretcher::__keep( float bpm, const std::vector<Sample*>& samples )
+{
+	for ( std::list<Tempo>::iterator it = __tempos.begin(); it != __tempos.end(); ++it ) {
+		if ( it->bpm != bpm ) continue;
+		for ( int i = 0; i < it->samples.size(); i++ ) delete it->samples[i];
+		__tempos.erase( it );
+		break;
+	}
+	Tempo tempo;
+	tempo.bpm = bpm;
+	tempo.samples = samples;
+	__tempos.push_front( tempo );
+	while ( __tempos.size() > __kept_tempos ) {
+		Tempo& oldest = __tempos.back();
+		// the pool frees the data at its next purge
+		for ( int i = 0; i < oldest.samples.size(); i++ ) delete oldest.samples[i];
+		__tempos.pop_back();
+	}
+}
+
+void* SampleStretcher::worker_thread( void* param )
+{
+	SampleStretcher* stretcher = ( SampleStretcher* )param;
+	int n;
+	while ( ( n = stretcher->__next_job.fetch_add( 1 ) ) < ( int )stretcher->__jobs.size() ) {
+		Job& job = stretcher->__jobs[n];
+		job.result = Sample::load( job.filepath, job.loops, job.rubberband, job.velocity, job.pan, stretcher->__bpm );
+	}
+	return 0;
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
@@ -0,0 +1,336 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <hydrogen/helpers/stress_song.h>
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+#include <hydrogen/hydrogen.h>
+#include <hydrogen/audio_engine.h>
+#include <hydrogen/timeline.h>
+#include <hydrogen/Preferences.h>
+#include <hydrogen/basics/song.h>
+#include <hydrogen/basics/note.h>
+#include <hydrogen/basics/sample.h>
+#include <hydrogen/basics/pattern.h>
+#include <hydrogen/basics/pattern_list.h>
+#include <hydrogen/basics/instrument.h>
+#include <hydrogen/basics/instrument_list.h>
+#include <hydrogen/basics/instrument_component.h>
+#include <hydrogen/basics/instrument_layer.h>
+#include <hydrogen/basics/drumkit_component.h>
+#include <hydrogen/sampler/Sampler.h>
+#include <hydrogen/IO/FakeDriver.h>
+
+namespace H2Core
+{
+
+const char* StressSong::__class_name = "StressSong";
+
+/* small LCG, the generated songs must not depend on the libc rand() sequence */
+static inline float next_random( unsigned* seed )
+{
+	*seed = *seed * 1103515245 + 12345;
+	return ( ( *seed >> 8 ) & 0xffff ) / 65536.0f;
+}
+
+StressSong::Options::Options()
+	: m_nInstruments( 16 )
+	, m_nLayers( 4 )
+	, m_nComponents( 1 )
+	, m_nSampleFrames( 22050 )
+	, m_nSampleRate( 44100 )
+	, m_nPatterns( 4 )
+	, m_nVirtualPatterns( 1 )
+	, m_nPatternLength( MAX_NOTES )
+	, m_nStep( 12 )
+	, m_nColumns( 16 )
+	, m_nPatternsPerColumn( 2 )
+	, m_fNoteDensity( 0.5 )
+	, m_fBpm( 120.0 )
+	, m_fHumanizeTime( 0.0 )
+	, m_fHumanizeVelocity( 0.0 )
+	, m_fSwing( 0.0 )
+	, m_fLeadLag( 0.0 )
+	, m_nTempoChanges( 0 )
+	, m_bMixedSelection( true )
+	, m_bFilters( false )
+	, m_nSeed( 1 )
+{
+}
+
+StressSong::Report::Report()
+	: m_nCycles( 0 )
+	, m_nFrames( 0 )
+	, m_fMaxProcessTime( 0.0 )
+	, m_fAvgProcessTime( 0.0 )
+	, m_fBudget( 0.0 )
+	, m_nOverruns( 0 )
+	, m_nMaxPlayingNotes( 0 )
+	, m_nMaxQueuedNotes( 0 )
+	, m_nMemoryStart( 0 )
+	, m_nMemoryEnd( 0 )
+{
+}
+
+Sample* StressSong::synth_sample( const QString& name, int frames, int sample_rate, float freq )
+{
+	float* data_l = new float[ frames ];
+	float* data_r = new float[ frames ];
+	const double two_pi = 6.283185307179586;
+	double decay = 5.0 / frames;
+	for ( int i = 0; i < frames; i++ ) {
+		double env = exp( -decay * i );
+		data_l[i] = env * sin( two_pi * freq * i / sample_rate );
+		data_r[i] = env * sin( two_pi * freq * 1.01 * i / sample_rate );
+	}
+	return new Sample( name, frames, sample_rate, data_l, data_r );
+}
+
+Song* StressSong::generate( const Options& options )
+{
+	unsigned seed = options.m_nSeed;
+	int nInstruments = std::max( 1, std::min( options.m_nInstruments, MAX_INSTRUMENTS ) );
+	int nLayers = std::max( 1, std::min( options.m_nLayers, MAX_LAYERS ) );
+	int nComponents = std::max( 1, std::min( options.m_nComponents, MAX_COMPONENTS ) );
+	int nFrames = std::max( 4, options.m_nSampleFrames );
+	int nLength = std::max( 1, options.m_nPatternLength );
+	int nStep = std::max( 1, options.m_nStep );
+
+	_INFOLOG( QString( "Generating stress song: %1 instruments, %2 layers, %3 components, density %4" )
+			  .arg( nInstruments ).arg( nLayers ).arg( nComponents ).arg( options.m_fNoteDensity ) );
+
+	Song* pSong = new Song( "Stress song", "hydrogen", options.m_fBpm, 0.5 );
+	pSong->set_metronome_volume( 0.5 );
+	pSong->set_notes( QString( "Generated with seed %1" ).arg( options.m_nSeed ) );
+	pSong->set_license( "" );
+	pSong->set_mode( Song::SONG_MODE );
+	pSong->set_loop_enabled( true );
+	pSong->set_humanize_time_value( options.m_fHumanizeTime );
+	pSong->set_humanize_velocity_value( options.m_fHumanizeVelocity );
+	pSong->set_swing_factor( options.m_fSwing );
+	pSong->set_filename( "" );
+
+	for ( int c = 0; c < nComponents; c++ ) {
+		pSong->get_components()->push_back( new DrumkitComponent( c, QString( "Component %1" ).arg( c + 1 ) ) );
+	}
+
+	InstrumentList* pInstrList = new InstrumentList();
+	for ( int i = 0; i < nInstruments; i++ ) {
+		Instrument* pInstr = new Instrument( i, QString( "Stress %1" ).arg( i + 1 ) );
+		pInstr->set_drumkit_name( "stress" );
+		if ( options.m_bMixedSelection ) {
+			pInstr->set_sample_selection_alg( ( Instrument::SampleSelectionAlgo )( i % 3 ) );
+		}
+		if ( options.m_bFilters && ( i % 2 ) ) {
+			pInstr->set_filter_active( true );
+			pInstr->set_filter_cutoff( 0.5 );
+			pInstr->set_filter_resonance( 0.5 );
+		}
+		// random and round robin need several candidates for the same velocity
+		bool bSplit = ( pInstr->sample_selection_alg() == Instrument::VELOCITY );
+
+		for ( int c = 0; c < nComponents; c++ ) {
+			InstrumentComponent* pCompo = new InstrumentComponent( c );
+			for ( int l = 0; l < nLayers; l++ ) {
+				float fFreq = 55.0 * pow( 2.0, ( ( i * 5 + c * 7 + l ) % 48 ) / 12.0 );
+				Sample* pSample = synth_sample( QString( "/stress/%1_%2_%3.wav" ).arg( i ).arg( c ).arg( l ),
+												nFrames, options.m_nSampleRate, fFreq );
+				InstrumentLayer* pLayer = new InstrumentLayer( pSample );
+				pLayer->set_start_velocity( bSplit ? ( float )l / nLayers : 0.0 );
+				pLayer->set_end_velocity( bSplit ? ( float )( l + 1 ) / nLayers : 1.0 );
+				pCompo->set_layer( pLayer, l );
+			}
+			pInstr->get_components()->push_back( pCompo );
+		}
+		pInstrList->add( pInstr );
+	}
+	pSong->set_instrument_list( pInstrList );
+
+	PatternList* pPatternList = new PatternList();
+	int nPatterns = std::max( 1, options.m_nPatterns );
+	for ( int p = 0; p < nPatterns; p++ ) {
+		Pattern* pPattern = new Pattern( QString( "Stress %1" ).arg( p + 1 ), "", "stress", nLength );
+		for ( int nPos = 0; nPos < nLength; nPos += nStep ) {
+			for ( int i = 0; i < nInstruments; i++ ) {
+				if ( next_random( &seed ) >= options.m_fNoteDensity ) {
+					continue;
+				}
+				float fVelocity = 0.1 + 0.9 * next_random( &seed );
+				Note* pNote = new Note( pInstrList->get( i ), nPos, fVelocity, 1.0, 1.0, -1, 0 );
+				if ( options.m_fLeadLag > 0.0 ) {
+					pNote->set_lead_lag( ( next_random( &seed ) * 2.0 - 1.0 ) * options.m_fLeadLag );
+				}
+				pPattern->insert_note( pNote );
+			}
+		}
+		pPatternList->add( pPattern );
+	}
+	// every virtual pattern plays two consecutive plain patterns
+	for ( int v = 0; v < options.m_nVirtualPatterns; v++ ) {
+		Pattern* pVirtual = new Pattern( QString( "Virtual %1" ).arg( v + 1 ), "", "stress", nLength );
+		pVirtual->virtual_patterns_add( pPatternList->get( v % nPatterns ) );
+		pVirtual->virtual_patterns_add( pPatternList->get( ( v + 1 ) % nPatterns ) );
+		pPatternList->add( pVirtual );
+	}
+	pPatternList->flattened_virtual_patterns_compute();
+	pSong->set_pattern_list( pPatternList );
+
+	std::vector<PatternList*>* pPatternGroupVector = new std::vector<PatternList*>;
+	int nTotalPatterns = pPatternList->size();
+	int nPerColumn = std::max( 1, std::min( options.m_nPatternsPerColumn, nTotalPatterns ) );
+	for ( int nColumn = 0; nColumn < std::max( 1, options.m_nColumns ); nColumn++ ) {
+		PatternList* pColumn = new PatternList();
+		for ( int k = 0; k < nPerColumn; k++ ) {
+			pColumn->add( pPatternList->get( ( nColumn + k ) % nTotalPatterns ) );
+		}
+		pPatternGroupVector->push_back( pColumn );
+	}
+	pSong->set_pattern_group_vector( pPatternGroupVector );
+	pSong->set_is_modified( false );
+
+	return pSong;
+}
+
+void StressSong::fill_timeline( Timeline* timeline, const Options& options )
+{
+	timeline->m_timelinevector.clear();
+	if ( options.m_nTempoChanges <= 0 ) {
+		return;
+	}
+
+	unsigned seed = options.m_nSeed + 1;
+	Timeline::HTimelineVector marker;
+	marker.m_htimelinebeat = 0;
+	marker.m_htimelinetick = 0;
+	marker.m_htimelinebpm = options.m_fBpm;
+	timeline->m_timelinevector.push_back( marker );
+
+	int nColumns = std::max( 1, options.m_nColumns );
+	for ( int i = 1; i <= options.m_nTempoChanges; i++ ) {
+		marker.m_htimelinebeat = i * nColumns / ( options.m_nTempoChanges + 1 );
+		marker.m_htimelinebpm = options.m_fBpm * ( 0.75 + 0.5 * next_random( &seed ) );
+		timeline->m_timelinevector.push_back( marker );
+	}
+	timeline->sortTimelineVector();
+}
+
+bool StressSong::soak( float seconds, Report* report )
+{
+	Hydrogen* pHydrogen = Hydrogen::get_instance();
+	Song* pSong = pHydrogen->getSong();
+	if ( !pSong ) {
+		_ERRORLOG( "No song to play" );
+		return false;
+	}
+	AudioOutput* pOutput = pHydrogen->getAudioOutput();
+	if ( !pOutput || pOutput->class_name() != FakeDriver::class_name() ) {
+		_ERRORLOG( "Soak runs need the Fake audio driver" );
+		return false;
+	}
+	FakeDriver* pDriver = static_cast<FakeDriver*>( pOutput );
+	Sampler* pSampler = AudioEngine::get_instance()->get_sampler();
+	bool bUseTimeline = Preferences::get_instance()->getUseTimelineBpm();
+
+	*report = Report();
+	report->m_nMemoryStart = resident_memory();
+
+	unsigned long nTotalFrames = ( unsigned long )( seconds * pDriver->getSampleRate() );
+	double fTotalTime = 0.0;
+
+	pSong->get_pattern_list()->set_to_old();
+	pDriver->m_transport.m_status = TransportInfo::ROLLING;
+
+	while ( report->m_nFrames < nTotalFrames ) {
+		if ( pDriver->processCycle() != 0 ) {
+			break;	// end of song
+		}
+		report->m_nCycles++;
+		report->m_nFrames += pDriver->getBufferSize();
+
+		float fTime = pHydrogen->getProcessTime();
+		fTotalTime += fTime;
+		report->m_fBudget = pHydrogen->getMaxProcessTime();
+		if ( fTime > report->m_fMaxProcessTime ) {
+			report->m_fMaxProcessTime = fTime;
+		}
+		if ( fTime > report->m_fBudget ) {
+			report->m_nOverruns++;
+		}
+		report->m_nMaxPlayingNotes = std::max( report->m_nMaxPlayingNotes, pSampler->get_playing_notes_number() );
+		report->m_nMaxQueuedNotes = std::max( report->m_nMaxQueuedNotes, pHydrogen->getSongNoteQueueSize() );
+
+		if ( bUseTimeline ) {
+			AudioEngine::get_instance()->lock( RIGHT_HERE );
+			pHydrogen->setTimelineBpm();
+			AudioEngine::get_instance()->unlock();
+		}
+	}
+
+	// let the engine see the transport stop and flush its queues
+	pDriver->m_transport.m_status = TransportInfo::STOPPED;
+	pDriver->processCycle();
+	pSampler->stop_playing_notes();
+
+	if ( report->m_nCycles > 0 ) {
+		report->m_fAvgProcessTime = fTotalTime / report->m_nCycles;
+	}
+	report->m_nMemoryEnd = resident_memory();
+
+	_INFOLOG( QString( "Soak: %1 cycles, max %2 ms, avg %3 ms, budget %4 ms, %5 overruns, polyphony %6, queue %7" )
+			  .arg( report->m_nCycles )
+			  .arg( report->m_fMaxProcessTime )
+			  .arg( report->m_fAvgProcessTime )
+			  .arg( report->m_fBudget )
+			  .arg( report->m_nOverruns )
+			  .arg( report->m_nMaxPlayingNotes )
+			  .arg( report->m_nMaxQueuedNotes ) );
+	return true;
+}
+
+long StressSong::resident_memory()
+{
+#ifdef __linux__
+	long nSize = 0;
+	long nResident = 0;
+	FILE* pFile = fopen( "/proc/self/statm", "r" );
+	if ( !pFile ) {
+		return 0;
+	}
+	if ( fscanf( pFile, "%ld %ld", &nSize, &nResident ) != 2 ) {
+		nResident = 0;
+	}
+	fclose( pFile );
+	return nResident * sysconf( _SC_PAGESIZE );
+#else
+	return 0;
+#endif
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
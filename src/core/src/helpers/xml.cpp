@@ -1,9 +1,11 @@
 
 #include <hydrogen/helpers/xml.h>
+#include <hydrogen/LocalFileMng.h>
 
 #include <QtCore/QFile>
 #include <QtCore/QLocale>
 #include <QtCore/QString>
+#include <QtCore/QTextCodec>
 #include <QtCore/QTextStream>
 #include <QtXmlPatterns/QXmlSchema>
 #include <QtXmlPatterns/QXmlSchemaValidator>
@@ -83,6 +85,14 @@ bool XMLNode::read_bool( const QString& node, bool default_value, bool inexisten
 	}
 }
 
+void XMLNode::read_record( XMLRecord* record )
+{
+	record->clear();
+	for ( QDomElement el = firstChildElement(); !el.isNull(); el = el.nextSiblingElement() ) {
+		record->add( el.tagName(), el.text() );
+	}
+}
+
 void XMLNode::write_child_node( const QString& node, const QString& text )
 {
 	QDomDocument doc = this->ownerDocument();
@@ -185,6 +195,138 @@ void XMLDoc::set_root( const QString& node_name, const QString& xmlns )
 	appendChild( root );
 }
 
+void XMLRecord::clear()
+{
+	__values.clear();
+}
+
+void XMLRecord::add( const QString& node, const QString& text )
+{
+	if ( has( node ) ) return;
+	__values.push_back( std::make_pair( node, text ) );
+}
+
+bool XMLRecord::has( const QString& node ) const
+{
+	for ( int i = 0; i < __values.size(); i++ ) {
+		if ( __values[i].first == node ) return true;
+	}
+	return false;
+}
+
+QString XMLRecord::read_child_node( const QString& node, bool inexistent_ok, bool empty_ok ) const
+{
+	for ( int i = 0; i < __values.size(); i++ ) {
+		if ( __values[i].first != node ) continue;
+		if( __values[i].second.isEmpty() ) {
+			if( !empty_ok ) ___DEBUGLOG( QString( "XML node %1 should not be empty." ).arg( node ) );
+			return 0;
+		}
+		return __values[i].second;
+	}
+	if( !inexistent_ok ) ___DEBUGLOG( QString( "XML node %1 should exists." ).arg( node ) );
+	return 0;
+}
+
+QString XMLRecord::read_string( const QString& node, const QString& default_value, bool inexistent_ok, bool empty_ok ) const
+{
+	QString ret = read_child_node( node, inexistent_ok, empty_ok );
+	if( ret.isNull() ) return default_value;
+	return ret;
+}
+
+float XMLRecord::read_float( const QString& node, float default_value, bool inexistent_ok, bool empty_ok ) const
+{
+	QString ret = read_child_node( node, inexistent_ok, empty_ok );
+	if( ret.isNull() ) return default_value;
+	return QLocale::c().toFloat( ret );
+}
+
+int XMLRecord::read_int( const QString& node, int default_value, bool inexistent_ok, bool empty_ok ) const
+{
+	QString ret = read_child_node( node, inexistent_ok, empty_ok );
+	if( ret.isNull() ) return default_value;
+	return QLocale::c().toInt( ret );
+}
+
+bool XMLRecord::read_bool( const QString& node, bool default_value, bool inexistent_ok, bool empty_ok ) const
+{
+	QString ret = read_child_node( node, inexistent_ok, empty_ok );
+	if( ret.isNull() ) return default_value;
+	return ( ret=="true" );
+}
+
+const char* XMLStreamReader::__class_name ="XMLStreamReader";
+
+XMLStreamReader::XMLStreamReader( ) : Object( __class_name ) { }
+
+XMLStreamReader::~XMLStreamReader()
+{
+	__file.close();
+}
+
+bool XMLStreamReader::open( const QString& filepath, const QString& root_name, const QString& xmlns )
+{
+	__file.setFileName( filepath );
+	if ( !__file.open( QIODevice::ReadOnly ) ) {
+		ERRORLOG( QString( "Unable to open %1 for reading" ).arg( filepath ) );
+		return false;
+	}
+	if ( !__file.peek( 5 ).startsWith( "<?xml" ) ) {
+		WARNINGLOG( QString( "File '%1' is being read in TinyXML compatibility mode" ).arg( filepath ) );
+		QString enc = QTextCodec::codecForLocale()->name();
+		if( enc == QString( "System" ) ) {
+			enc = "UTF-8";
+		}
+		__buffer = QString( "<?xml version='1.0' encoding='%1' ?>\n" ).arg( enc ).toLocal8Bit();
+		while( !__file.atEnd() ) {
+			QByteArray line = __file.readLine();
+			LocalFileMng::convertFromTinyXMLString( &line );
+			__buffer += line;
+		}
+		__file.close();
+		addData( __buffer );
+	} else {
+		setDevice( &__file );
+	}
+	if ( !readNextStartElement() || name() != root_name ) {
+		ERRORLOG( QString( "%1 node not found in %2" ).arg( root_name ).arg( filepath ) );
+		return false;
+	}
+	if ( !xmlns.isEmpty() && namespaceUri() != XMLNS_BASE + xmlns ) {
+		return false;
+	}
+	return true;
+}
+
+QString XMLStreamReader::read_text()
+{
+	QString text = readElementText( QXmlStreamReader::IncludeChildElements );
+	// QDomDocument drops the whitespace only text nodes
+	for ( int i = 0; i < text.size(); i++ ) {
+		if ( !text[i].isSpace() ) return text;
+	}
+	return QString( "" );
+}
+
+void XMLStreamReader::read_record( XMLRecord* record )
+{
+	record->clear();
+	while ( readNextStartElement() ) {
+		record->add( name().toString(), read_text() );
+	}
+}
+
+bool XMLStreamReader::check()
+{
+	if ( hasError() ) {
+		ERRORLOG( QString( "Unable to read XML document %1: %2 at line %3" )
+				  .arg( __file.fileName() ).arg( errorString() ).arg( lineNumber() ) );
+		return false;
+	}
+	return true;
+}
+
 };
 
 /* vim: set softtabstop=4 expandtab: */
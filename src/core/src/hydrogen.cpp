@@ -30,6 +30,7 @@
 #endif
 
 #include <pthread.h>
+#include <atomic>
 #include <cassert>
 #include <cstdio>
 #include <deque>
@@ -38,9 +39,11 @@
 #include <ctime>
 #include <cmath>
 #include <algorithm>
+#include <vector>
 
 #include <QtCore/QMutex>
 #include <QtCore/QMutexLocker>
+#include <QtCore/QTime>
 
 #include <hydrogen/LocalFileMng.h>
 #include <hydrogen/event_queue.h>
@@ -54,11 +57,15 @@
 #include <hydrogen/basics/instrument_list.h>
 #include <hydrogen/basics/instrument_layer.h>
 #include <hydrogen/basics/sample.h>
+#include <hydrogen/basics/sample_pool.h>
 #include <hydrogen/hydrogen.h>
 #include <hydrogen/basics/pattern.h>
 #include <hydrogen/basics/pattern_list.h>
 #include <hydrogen/basics/note.h>
 #include <hydrogen/helpers/filesystem.h>
+#include <hydrogen/helpers/layer_loader.h>
+#include <hydrogen/helpers/sample_stretcher.h>
+#include <hydrogen/helpers/sample_cache.h>
 #include <hydrogen/fx/LadspaFX.h>
 #include <hydrogen/fx/Effects.h>
 
@@ -126,8 +133,12 @@ struct compare_pNotes {
 	}
 };
 
-/// Song Note FIFO
-std::priority_queue<Note*, std::deque<Note*>, compare_pNotes > m_songNoteQueue;
+/// Song Note FIFO, its notes can be visited in place
+struct SongNoteQueue : public std::priority_queue<Note*, std::deque<Note*>, compare_pNotes > {
+	std::deque<Note*>::iterator begin() { return c.begin(); }
+	std::deque<Note*>::iterator end() { return c.end(); }
+};
+SongNoteQueue			m_songNoteQueue;
 std::deque<Note*>		m_midiNoteQueue;	///< Midi Note FIFO
 
 PatternList*			m_pNextPatterns;		///< Next pattern (used only in Pattern mode)
@@ -168,6 +179,37 @@ struct timeval			m_currentTickTime;
 unsigned long			m_nRealtimeFrames = 0;
 unsigned int			m_naddrealtimenotetickposition = 0;
 
+/// states of a background drumkit load
+enum DrumkitLoadState {
+	DRUMKIT_IDLE,			///< nothing to do
+	DRUMKIT_LOADING,		///< the loader thread prepares the new instruments
+	DRUMKIT_READY,			///< the new instruments wait for the switch boundary
+	DRUMKIT_SWITCHED,		///< the staged instruments hold the old drumkit, the loader thread frees the rest
+	DRUMKIT_LOADED			///< waiting for Hydrogen::finishDrumkitLoad() on the thread handling EVENT_DRUMKIT_LOADED
+};
+
+/// a drumkit loaded in the background, see Hydrogen::loadDrumkitAsync()
+struct DrumkitLoad {
+	std::atomic<int>		state;			///< one of DrumkitLoadState
+	std::atomic<bool>		abort;			///< set to stop the loader thread
+	Hydrogen::DrumkitSwitch	switchAt;		///< boundary to switch at
+	long long				nSwitchFrame;	///< transport frame of the boundary, -1 until the note queue reaches it
+	bool					bSwitched;		///< false if the switch was dropped because the song changed
+	bool					bConditional;	///< keep the instruments beyond the new kit which have notes
+	Song*					pSong;			///< the song the drumkit is loaded for
+	Drumkit*				pDrumkit;		///< copy of the drumkit, owned by the loader thread
+	QString					sDrumkitName;	///< name of the drumkit, for finishDrumkitLoad()
+	int						nKitInstruments;	///< number of instruments of the drumkit
+	std::vector<Instrument*>		instruments;	///< new instruments, the old ones once switched, NULL once added to the song
+	std::vector<DrumkitComponent*>	components;		///< new song components, the old ones once switched
+	pthread_t				thread;
+	bool					bThreadStarted;
+};
+DrumkitLoad				m_drumkitLoad;
+
+LayerLoader*			m_pLayerLoader = NULL;	///< loads the layers of the song in the background, see Preferences::m_bLazyLayerLoading
+SampleStretcher*		m_pSampleStretcher = NULL;	///< fits the rubberband samples to the tempo
+
 // PROTOTYPES
 void					audioEngine_init();
 void					audioEngine_destroy();
@@ -189,6 +231,10 @@ inline void				audioEngine_prepNoteQueue();
 
 inline int				findPatternInTick( int tick, bool loopMode, int *patternStartTick );
 
+void					audioEngine_switchDrumkit();
+inline void				audioEngine_process_checkDrumkitSwitch( unsigned nframes );
+void*					audioEngine_drumkitLoaderThread( void* param );
+
 void					audioEngine_seek( long long nFrames, bool bLoopMode = false );
 
 void					audioEngine_restartAudioDrivers();
@@ -433,10 +479,12 @@ inline void audioEngine_process_checkBPMChanged(Song* pSong)
 		return;
 
 	___WARNINGLOG( "Tempo change: Recomputing ticksize and frame position" );
-	float fTickNumber = m_pAudioDriver->m_transport.m_nFrames / fOldTickSize;
+	// in double precision and without rounding to a whole tick, the position keeps
+	// its place within the tick and does not move on with every tempo change
+	double fTickNumber = ( double )m_pAudioDriver->m_transport.m_nFrames / fOldTickSize;
 
 	// update frame position in transport class
-	m_pAudioDriver->m_transport.m_nFrames = ceil(fTickNumber) * fNewTickSize;
+	m_pAudioDriver->m_transport.m_nFrames = ( long long )round( fTickNumber * fNewTickSize );
 
 #ifdef H2CORE_HAVE_JACK
 	if ( JackAudioDriver::class_name() == m_pAudioDriver->class_name()
@@ -590,6 +638,8 @@ void audioEngine_seek( long long nFrames, bool bLoopMode )
 	//	hydrogenInstance->infoLog(tmp);
 
 	audioEngine_clearNoteQueue();
+	// the drumkit switch boundary is searched again from the new position
+	m_drumkitLoad.nSwitchFrame = -1;
 }
 
 inline void audioEngine_process_transport()
@@ -684,23 +734,9 @@ inline void audioEngine_process_clearAudioBuffers( uint32_t nFrames )
 		memset( m_pMainBuffer_R, 0, nFrames * sizeof( float ) );
 	}
 
-#ifdef H2CORE_HAVE_JACK
-	JackAudioDriver * jo = dynamic_cast<JackAudioDriver*>(m_pAudioDriver);
-	if( jo && jo->has_track_outs() ) {
-		float* buf;
-		int k;
-		for( k=0 ; k<jo->getNumTracks() ; ++k ) {
-			buf = jo->getTrackOut_L(k);
-			if( buf ) {
-				memset( buf, 0, nFrames * sizeof( float ) );
-			}
-			buf = jo->getTrackOut_R(k);
-			if( buf ) {
-				memset( buf, 0, nFrames * sizeof( float ) );
-			}
-		}
+	if ( m_pAudioDriver && m_pAudioDriver->has_track_outs() ) {
+		m_pAudioDriver->prepareTrackOuts( nFrames );
 	}
-#endif
 
 	mx.unlock();
 
@@ -720,6 +756,155 @@ inline void audioEngine_process_clearAudioBuffers( uint32_t nFrames )
 #endif
 }
 
+/// return true if the data of an instrument was exchanged by audioEngine_switchDrumkit()
+static bool audioEngine_isSwitched( InstrumentList* pInstrList, int nInstruments, Instrument* pInstr )
+{
+	int nIndex = pInstrList->index( pInstr );
+	return nIndex >= 0 && nIndex < nInstruments && m_drumkitLoad.instruments[ nIndex ];
+}
+
+/// exchange the song instruments data with the staged one, the audio engine must be locked
+void audioEngine_switchDrumkit()
+{
+	Song* pSong = Hydrogen::get_instance()->getSong();
+	if ( pSong == m_drumkitLoad.pSong ) {
+		Sampler* pSampler = AudioEngine::get_instance()->get_sampler();
+		InstrumentList* pInstrList = pSong->get_instrument_list();
+		int nInstruments = std::min( pInstrList->size(), ( int )m_drumkitLoad.instruments.size() );
+		for ( int i = 0; i < nInstruments; i++ ) {
+			Instrument* pInstr = pInstrList->get( i );
+			Instrument* pStaged = m_drumkitLoad.instruments[ i ];
+			if ( !pStaged ) continue;
+			// the song keeps its instruments, the patterns refer to them
+			pInstr->swap_drumkit_data( pStaged );
+			// the playing notes finish on the previous data, now held by the staged instrument
+			pSampler->retire_notes( pInstr, pStaged );
+		}
+		// the notes waiting in the queues were made for the previous data
+		for ( SongNoteQueue::iterator it = m_songNoteQueue.begin(); it != m_songNoteQueue.end(); ++it ) {
+			if ( audioEngine_isSwitched( pInstrList, nInstruments, ( *it )->get_instrument() ) ) {
+				( *it )->refresh_instrument_data();
+			}
+		}
+		for ( unsigned i = 0; i < m_midiNoteQueue.size(); i++ ) {
+			if ( audioEngine_isSwitched( pInstrList, nInstruments, m_midiNoteQueue[ i ]->get_instrument() ) ) {
+				m_midiNoteQueue[ i ]->refresh_instrument_data();
+			}
+		}
+		pSong->get_components()->swap( m_drumkitLoad.components );
+		m_drumkitLoad.bSwitched = true;
+	} else {
+		// the song changed meanwhile, only free the new drumkit
+		m_drumkitLoad.bSwitched = false;
+	}
+	m_drumkitLoad.state.store( DRUMKIT_SWITCHED, std::memory_order_release );
+}
+
+inline void audioEngine_process_checkDrumkitSwitch( unsigned nframes )
+{
+	if ( m_drumkitLoad.state.load( std::memory_order_acquire ) != DRUMKIT_READY ) return;
+	bool bSwitch = ( m_drumkitLoad.switchAt == Hydrogen::SWITCH_NOW ) || ( m_audioEngineState != STATE_PLAYING );
+	if ( !bSwitch && m_drumkitLoad.nSwitchFrame >= 0 ) {
+		// the boundary is played within this cycle
+		bSwitch = m_drumkitLoad.nSwitchFrame < ( long long )( m_pAudioDriver->m_transport.m_nFrames + nframes );
+	}
+	if ( bSwitch ) {
+		audioEngine_switchDrumkit();
+	}
+}
+
+void* audioEngine_drumkitLoaderThread( void* /*param*/ )
+{
+	Drumkit* pDrumkit = m_drumkitLoad.pDrumkit;
+	QTime loadTime;
+	loadTime.start();
+
+	// build complete instruments while the current ones keep playing
+	pDrumkit->load_samples( true );
+	InstrumentList* pKitInstrList = pDrumkit->get_instruments();
+	for ( int i = 0; i < pKitInstrList->size(); i++ ) {
+		Instrument* pInstr = new Instrument();
+		pInstr->load_from( pDrumkit, pKitInstrList->get( i ), false );
+		m_drumkitLoad.instruments.push_back( pInstr );
+	}
+	std::vector<DrumkitComponent*>* pKitCompoList = pDrumkit->get_components();
+	for ( int i = 0; i < pKitCompoList->size(); i++ ) {
+		DrumkitComponent* pSrcComponent = pKitCompoList->at( i );
+		DrumkitComponent* pNewComponent = new DrumkitComponent( pSrcComponent->get_id(), pSrcComponent->get_name() );
+		pNewComponent->load_from( pSrcComponent );
+		m_drumkitLoad.components.push_back( pNewComponent );
+	}
+	pDrumkit->unload_samples();
+	m_drumkitLoad.sDrumkitName = pDrumkit->get_name();
+	m_drumkitLoad.nKitInstruments = m_drumkitLoad.instruments.size();
+	delete pDrumkit;
+	m_drumkitLoad.pDrumkit = NULL;
+
+	// instruments the current drumkit doesn't have are added here, the audio thread only exchanges data
+	Song* pSong = m_drumkitLoad.pSong;
+	if ( pSong == Hydrogen::get_instance()->getSong()
+		 && pSong->get_instrument_list()->size() < m_drumkitLoad.nKitInstruments ) {
+		AudioEngine::get_instance()->lock( RIGHT_HERE );
+		if ( pSong == Hydrogen::get_instance()->getSong() ) {
+			InstrumentList* pInstrList = pSong->get_instrument_list();
+			for ( int i = pInstrList->size(); i < m_drumkitLoad.nKitInstruments; i++ ) {
+				pInstrList->add( m_drumkitLoad.instruments[ i ] );
+				m_drumkitLoad.instruments[ i ] = NULL;
+			}
+		}
+		AudioEngine::get_instance()->unlock();
+	}
+	___INFOLOG( QString( "drumkit %1 prepared in %2 ms" ).arg( m_drumkitLoad.sDrumkitName ).arg( loadTime.elapsed() ) );
+	m_drumkitLoad.state.store( DRUMKIT_READY, std::memory_order_release );
+
+	// the audio thread switches at the boundary, do it here if it is not processing
+	int nIdle = 0;
+	while ( m_drumkitLoad.state.load( std::memory_order_acquire ) != DRUMKIT_SWITCHED ) {
+		if ( m_drumkitLoad.abort ) {
+			AudioEngine::get_instance()->lock( RIGHT_HERE );
+			if ( m_drumkitLoad.state.load() == DRUMKIT_READY ) {
+				m_drumkitLoad.bSwitched = false;
+				m_drumkitLoad.state.store( DRUMKIT_SWITCHED, std::memory_order_release );
+			}
+			AudioEngine::get_instance()->unlock();
+			break;
+		}
+		nIdle = ( m_audioEngineState == STATE_PLAYING ) ? 0 : nIdle + 1;
+		if ( nIdle > 20 ) {
+			AudioEngine::get_instance()->lock( RIGHT_HERE );
+			if ( m_drumkitLoad.state.load() == DRUMKIT_READY ) {
+				audioEngine_switchDrumkit();
+			}
+			AudioEngine::get_instance()->unlock();
+		}
+		usleep( 10000 );
+	}
+
+	// the notes use component IDs only, the previous components can go
+	for ( int i = 0; i < m_drumkitLoad.components.size(); i++ ) {
+		delete m_drumkitLoad.components[ i ];
+	}
+	m_drumkitLoad.components.clear();
+
+	if ( !m_drumkitLoad.bSwitched ) {
+		for ( int i = 0; i < m_drumkitLoad.instruments.size(); i++ ) {
+			delete m_drumkitLoad.instruments[ i ];
+		}
+		m_drumkitLoad.instruments.clear();
+		SamplePool::purge();
+		m_drumkitLoad.state.store( DRUMKIT_IDLE, std::memory_order_release );
+		return NULL;
+	}
+
+	// the previous instruments data still plays its notes, finishDrumkitLoad() retires it with the song changes
+	___INFOLOG( QString( "drumkit switched after %1 ms" ).arg( loadTime.elapsed() ) );
+	m_drumkitLoad.state.store( DRUMKIT_LOADED, std::memory_order_release );
+	if ( !m_drumkitLoad.abort ) {
+		EventQueue::get_instance()->push_event( EVENT_DRUMKIT_LOADED, -1 );
+	}
+	return NULL;
+}
+
 /// Main audio processing function. Called by audio drivers.
 int audioEngine_process( uint32_t nframes, void* /*arg*/ )
 {
@@ -789,6 +974,9 @@ int audioEngine_process( uint32_t nframes, void* /*arg*/ )
 		sendPatternChange = true;
 	}
 
+	// a drumkit loaded in the background replaces the current one before the notes of the boundary are played
+	audioEngine_process_checkDrumkitSwitch( nframes );
+
 	// play all notes
 	audioEngine_process_playNotes( nframes );
 
@@ -830,6 +1018,17 @@ int audioEngine_process( uint32_t nframes, void* /*arg*/ )
 					buf_R = buf_L;
 				}
 
+				// a return routed to a channel pair goes there as well
+				int nTrack = m_pAudioDriver->getFXTrackIndex( nFX );
+				float* pTrack_L = m_pAudioDriver->getTrackBuffer_L( nTrack );
+				float* pTrack_R = m_pAudioDriver->getTrackBuffer_R( nTrack );
+				if ( pTrack_L && pTrack_R ) {
+					for ( unsigned i = 0; i < nframes; ++i ) {
+						pTrack_L[ i ] += buf_L[ i ];
+						pTrack_R[ i ] += buf_R[ i ];
+					}
+				}
+
 				for ( unsigned i = 0; i < nframes; ++i ) {
 					m_pMainBuffer_L[ i ] += buf_L[ i ];
 					m_pMainBuffer_R[ i ] += buf_R[ i ];
@@ -1195,6 +1394,17 @@ inline int audioEngine_updateNoteQueue( unsigned nFrames )
 			}
 		}
 
+		// remember where the drumkit loaded in the background takes over
+		if ( m_drumkitLoad.state.load( std::memory_order_acquire ) == DRUMKIT_READY
+			 && m_drumkitLoad.nSwitchFrame == -1 ) {
+			bool bBoundary = ( m_drumkitLoad.switchAt == Hydrogen::SWITCH_NEXT_BAR )
+							 ? ( m_nPatternTickPosition % MAX_NOTES == 0 )
+							 : ( m_nPatternTickPosition == 0 );
+			if ( bBoundary ) {
+				m_drumkitLoad.nSwitchFrame = ( long long )( tick * m_pAudioDriver->m_transport.m_nTickSize );
+			}
+		}
+
 		// metronome
 		// if (  ( m_nPatternStartTick == tick ) || ( ( tick - m_nPatternStartTick ) % 48 == 0 ) ) 
 		if ( m_nPatternTickPosition % 48 == 0 ) {
@@ -1713,9 +1923,14 @@ Hydrogen::Hydrogen()
 	__song = NULL;
 
 	m_pTimeline = new Timeline();
+	m_pLayerLoader = new LayerLoader();
+	m_pSampleStretcher = new SampleStretcher();
 
 	hydrogenInstance = this;
 
+	Preferences* pPref = Preferences::get_instance();
+	SampleCache::set_enabled( pPref->m_bSampleCache, pPref->m_nSampleCacheSize );
+
 	initBeatcounter();
 	// 	__instance = this;
 	audioEngine_init();
@@ -1743,6 +1958,20 @@ Hydrogen::~Hydrogen()
 #endif
 
 
+	// a drumkit still loading in the background refers to the song
+	if ( m_drumkitLoad.bThreadStarted ) {
+		m_drumkitLoad.abort = true;
+		pthread_join( m_drumkitLoad.thread, NULL );
+		m_drumkitLoad.bThreadStarted = false;
+	}
+	// a switch nobody finished leaves the previous instruments data to the death row
+	for ( int i = 0; i < m_drumkitLoad.instruments.size(); i++ ) {
+		if ( m_drumkitLoad.instruments[ i ] ) {
+			__instrument_death_row.push_back( m_drumkitLoad.instruments[ i ] );
+		}
+	}
+	m_drumkitLoad.instruments.clear();
+
 	if ( m_audioEngineState == STATE_PLAYING ) {
 		audioEngine_stop();
 	}
@@ -1751,6 +1980,10 @@ Hydrogen::~Hydrogen()
 	audioEngine_destroy();
 	__kill_instruments();
 
+	delete m_pLayerLoader;
+	m_pLayerLoader = NULL;
+	delete m_pSampleStretcher;
+	m_pSampleStretcher = NULL;
 	delete m_pTimeline;
 
 	__instance = NULL;
@@ -1818,6 +2051,10 @@ void Hydrogen::setSong( Song *pSong )
 	/* Set first pattern */
 	setSelectedPatternNumber( 0 );
 
+	// the layers of the previous song are no longer needed
+	m_pLayerLoader->stop();
+	m_pSampleStretcher->clear();
+
 	/* Delete previous Song
 	*  NOTE: current approach support only one Song
 	*        loaded at the same time
@@ -1839,11 +2076,21 @@ void Hydrogen::setSong( Song *pSong )
 	audioEngine_setSong ( pSong );
 
 	__song = pSong;
+	updateTempoMap();
+
+	// free the samples of the previous song nobody shares
+	SamplePool::purge();
+
+	if ( Preferences::get_instance()->m_bLazyLayerLoading ) {
+		m_pLayerLoader->start( pSong );
+	}
 }
 
 /* Mean: remove current song from memory */
 void Hydrogen::removeSong()
 {
+	m_pLayerLoader->stop();
+	m_pSampleStretcher->clear();
 	__song = NULL;
 	audioEngine_removeSong();
 }
@@ -2286,14 +2533,20 @@ int Hydrogen::getPatternPos()
 	return m_nSongPos;
 }
 
-/* Return pattern for selected song tick position */
-int Hydrogen::getPosForTick( unsigned long TickPos )
+/* Return pattern for selected song tick position, and the tick within the pattern in pPatternTick */
+int Hydrogen::getPosForTick( unsigned long TickPos, int* pPatternTick )
 {
 	Song* pSong = getSong();
 	if ( ! pSong ) return 0;
 
-	int patternStartTick;
-	return findPatternInTick( TickPos, pSong->is_loop_enabled(), &patternStartTick );
+	int patternStartTick = 0;
+	int nPos = findPatternInTick( TickPos, pSong->is_loop_enabled(), &patternStartTick );
+	if ( pPatternTick ) {
+		// past the end of a looped song the start tick is counted from the last loop
+		unsigned long nLoopTick = m_nSongSizeInTicks != 0 ? TickPos % m_nSongSizeInTicks : TickPos;
+		*pPatternTick = nPos >= 0 ? nLoopTick - patternStartTick : 0;
+	}
+	return nPos;
 }
 
 void Hydrogen::restartDrivers()
@@ -2302,7 +2555,7 @@ void Hydrogen::restartDrivers()
 }
 
 /// Export a song to a wav file, returns the elapsed time in mSec
-void Hydrogen::startExportSong( const QString& filename, int rate, int depth )
+void Hydrogen::startExportSong( const QStringList& filenames, int rate, int depth, int nChannelPairs )
 {
 	if ( getState() == STATE_PLAYING ) {
 		sequencer_stop();
@@ -2311,6 +2564,9 @@ void Hydrogen::startExportSong( const QString& filename, int rate, int depth )
 	AudioEngine::get_instance()->get_sampler()->stop_playing_notes();
 	Preferences *pPref = Preferences::get_instance();
 
+	// the export must not fall back on other layers, wait for the ones still loading
+	m_pLayerLoader->wait();
+
 	Song* pSong = getSong();
 	m_oldEngineMode = pSong->get_mode();
 	m_bOldLoopEnabled = pSong->is_loop_enabled();
@@ -2324,7 +2580,7 @@ void Hydrogen::startExportSong( const QString& filename, int rate, int depth )
 
 	/* FIXME: Questo codice fa davvero schifo.... */
 
-	m_pAudioDriver = new DiskWriterDriver( audioEngine_process, nSamplerate, filename, depth );
+	m_pAudioDriver = new DiskWriterDriver( audioEngine_process, nSamplerate, filenames, depth, nChannelPairs );
 
 	// reset
 	m_pAudioDriver->m_transport.m_nFrames = 0; // reset total frames
@@ -2436,6 +2692,11 @@ float Hydrogen::getMaxProcessTime()
 	return m_fMaxProcessTime;
 }
 
+int Hydrogen::getSongNoteQueueSize()
+{
+	return m_songNoteQueue.size();
+}
+
 
 // Setting conditional to true will keep instruments that have notes if new kit has less instruments than the old one
 int Hydrogen::loadDrumkit( Drumkit *pDrumkitInfo )
@@ -2454,6 +2715,19 @@ int Hydrogen::loadDrumkit( Drumkit *pDrumkitInfo, bool conditional )
 
 	INFOLOG( pDrumkitInfo->get_name() );
 	m_currentDrumkit = pDrumkitInfo->get_name();
+	QTime loadTime;
+	loadTime.start();
+
+	// the layers are rescheduled once the new instruments are in place
+	m_pLayerLoader->stop();
+
+	// decode all the samples in parallel, the instruments below get them from the SamplePool
+	// unless they are loaded later in the background
+	bool bLazy = Preferences::get_instance()->m_bLazyLayerLoading;
+	bool bLoadSamples = !bLazy && !pDrumkitInfo->samples_loaded();
+	if ( bLoadSamples ) {
+		pDrumkitInfo->load_samples( true );
+	}
 
 	std::vector<DrumkitComponent*>* pSongCompoList= getSong()->get_components();
 	std::vector<DrumkitComponent*>* pDrumkitCompoList = pDrumkitInfo->get_components();
@@ -2522,7 +2796,7 @@ int Hydrogen::loadDrumkit( Drumkit *pDrumkitInfo, bool conditional )
 
 		// creo i nuovi layer in base al nuovo strumento
 		// Moved code from here right into the Instrument class - Jakob Lund.
-		pInstr->load_from( pDrumkitInfo, pNewInstr );
+		pInstr->load_from( pDrumkitInfo, pNewInstr, true, bLazy );
 	}
 
 	//wolke: new delete funktion
@@ -2547,9 +2821,98 @@ int Hydrogen::loadDrumkit( Drumkit *pDrumkitInfo, bool conditional )
 
 	m_audioEngineState = old_ae_state;
 
+	if ( bLoadSamples ) {
+		pDrumkitInfo->unload_samples();
+	}
+	// the replaced layers released their samples under the audio engine lock, free them now
+	SamplePool::purge();
+	INFOLOG( QString( "drumkit %1 loaded in %2 ms" ).arg( pDrumkitInfo->get_name() ).arg( loadTime.elapsed() ) );
+
+	if ( bLazy ) {
+		m_pLayerLoader->start( getSong() );
+	}
+
 	return 0;	//ok
 }
 
+bool Hydrogen::loadDrumkitAsync( Drumkit *pDrumkitInfo, DrumkitSwitch switchAt, bool conditional )
+{
+	assert ( pDrumkitInfo );
+
+	if ( m_drumkitLoad.state.load( std::memory_order_acquire ) != DRUMKIT_IDLE ) {
+		WARNINGLOG( QString( "already loading a drumkit, %1 ignored" ).arg( pDrumkitInfo->get_name() ) );
+		return false;
+	}
+	if ( m_drumkitLoad.bThreadStarted ) {
+		pthread_join( m_drumkitLoad.thread, NULL );
+		m_drumkitLoad.bThreadStarted = false;
+	}
+	// the data retired by the previous load may have no notes left by now
+	__kill_instruments();
+
+	INFOLOG( pDrumkitInfo->get_name() );
+	m_drumkitLoad.pDrumkit = new Drumkit( pDrumkitInfo );
+	m_drumkitLoad.pSong = getSong();
+	m_drumkitLoad.switchAt = switchAt;
+	m_drumkitLoad.nSwitchFrame = -1;
+	m_drumkitLoad.bSwitched = false;
+	m_drumkitLoad.bConditional = conditional;
+	m_drumkitLoad.nKitInstruments = 0;
+	m_drumkitLoad.abort = false;
+	m_drumkitLoad.state.store( DRUMKIT_LOADING, std::memory_order_release );
+
+	if ( pthread_create( &m_drumkitLoad.thread, NULL, audioEngine_drumkitLoaderThread, NULL ) != 0 ) {
+		ERRORLOG( "unable to start the drumkit loader thread" );
+		delete m_drumkitLoad.pDrumkit;
+		m_drumkitLoad.pDrumkit = NULL;
+		m_drumkitLoad.state.store( DRUMKIT_IDLE, std::memory_order_release );
+		return false;
+	}
+	m_drumkitLoad.bThreadStarted = true;
+	return true;
+}
+
+bool Hydrogen::isDrumkitLoading()
+{
+	return m_drumkitLoad.state.load( std::memory_order_acquire ) != DRUMKIT_IDLE;
+}
+
+void Hydrogen::finishDrumkitLoad()
+{
+	if ( m_drumkitLoad.state.load( std::memory_order_acquire ) != DRUMKIT_LOADED ) return;
+	if ( m_drumkitLoad.bThreadStarted ) {
+		pthread_join( m_drumkitLoad.thread, NULL );
+		m_drumkitLoad.bThreadStarted = false;
+	}
+
+	Song* pSong = getSong();
+	if ( pSong == m_drumkitLoad.pSong ) {
+		setCurrentDrumkitname( m_drumkitLoad.sDrumkitName );
+		// instruments beyond the new drumkit are removed as loadDrumkit() does
+		int nInstrumentDiff = pSong->get_instrument_list()->size() - m_drumkitLoad.nKitInstruments;
+		for ( int i = 0; i < nInstrumentDiff; i++ ) {
+			removeInstrument( pSong->get_instrument_list()->size() - 1, m_drumkitLoad.bConditional );
+		}
+#ifdef H2CORE_HAVE_JACK
+		if ( Preferences::get_instance()->m_bJackTrackOuts ) {
+			AudioEngine::get_instance()->lock( RIGHT_HERE );
+			renameJackPorts( pSong );
+			AudioEngine::get_instance()->unlock();
+		}
+#endif
+	}
+
+	// the previous instruments data is deleted once its notes ended
+	for ( int i = 0; i < m_drumkitLoad.instruments.size(); i++ ) {
+		if ( m_drumkitLoad.instruments[ i ] ) {
+			__instrument_death_row.push_back( m_drumkitLoad.instruments[ i ] );
+		}
+	}
+	m_drumkitLoad.instruments.clear();
+	__kill_instruments();
+	m_drumkitLoad.state.store( DRUMKIT_IDLE, std::memory_order_release );
+}
+
 // This will check if an instrument has any notes
 bool Hydrogen::instrumentHasNotes( Instrument *pInst )
 {
@@ -2734,6 +3097,17 @@ void Hydrogen::setPatternPos( int pos )
 		m_nSongPos = pos;
 		m_nPatternTickPosition = 0;
 	}
+
+	// take the tempo of the new position before locating, the frame is then found
+	// with its own tick size instead of being rescaled from the old one afterwards
+	Song* pSong = getSong();
+	if ( pSong->get_mode() == Song::SONG_MODE && Preferences::get_instance()->getUseTimelineBpm() ) {
+		float fBpm = getTimelineBpm( pos );
+		if ( fBpm != pSong->__bpm ) {
+			setBPM( fBpm );
+			audioEngine_process_checkBPMChanged( pSong );
+		}
+	}
 	m_pAudioDriver->locate(
 				( int ) ( totalTick * m_pAudioDriver->m_transport.m_nTickSize )
 				);
@@ -3162,6 +3536,13 @@ void Hydrogen::setNewBpmJTM( float bpmJTM )
 	m_nNewBpmJTM = bpmJTM;
 }
 
+int Hydrogen::stretchRubberbandSamples( float fBpm )
+{
+	Song* pSong = getSong();
+	if ( !pSong ) return 0;
+	return m_pSampleStretcher->stretch( pSong, fBpm );
+}
+
 void Hydrogen::ComputeHumantimeFrames(uint32_t nFrames)
 {
 	if ( m_audioEngineState == STATE_PLAYING )
@@ -3216,6 +3597,7 @@ void Hydrogen::__kill_instruments()
 		delete pInstr;
 		c++;
 	}
+	if ( c ) SamplePool::purge();
 	if ( __instrument_death_row.size() ) {
 		pInstr = __instrument_death_row.front();
 		INFOLOG( QString( "Instrument %1 still has %2 active notes. "
@@ -3245,7 +3627,7 @@ unsigned int Hydrogen::__getMidiRealtimeNoteTickPosition()
 
 
 // Get TimelineBPM for Pos
-float Hydrogen::getTimelineBpm( int Beat )
+float Hydrogen::getTimelineBpm( int Beat, int Tick )
 {
 	Song* pSong = getSong();
 
@@ -3262,16 +3644,30 @@ float Hydrogen::getTimelineBpm( int Beat )
 	if ( ! Preferences::get_instance()->getUseTimelineBpm() )
 		return bpm;
 
-	for ( int i = 0; i < static_cast<int>(m_pTimeline->m_timelinevector.size()); i++) {
-		if ( m_pTimeline->m_timelinevector[i].m_htimelinebeat > Beat )
-			break;
-
-		bpm = m_pTimeline->m_timelinevector[i].m_htimelinebpm;
+	// the markers are sorted, the last one at or before the position applies
+	Timeline::HTimelineVector position;
+	position.m_htimelinebeat = Beat;
+	position.m_htimelinetick = Tick;
+	position.m_htimelinebpm = bpm;
+	std::vector<Timeline::HTimelineVector>::const_iterator it =
+		std::upper_bound( m_pTimeline->m_timelinevector.begin(), m_pTimeline->m_timelinevector.end(),
+						  position, Timeline::TimelineComparator() );
+	if ( it != m_pTimeline->m_timelinevector.begin() ) {
+		bpm = ( it - 1 )->m_htimelinebpm;
 	}
 
 	return bpm;
 }
 
+void Hydrogen::updateTempoMap()
+{
+#ifdef H2CORE_HAVE_JACK
+	if ( m_pAudioDriver && m_pAudioDriver->class_name() == JackAudioDriver::class_name() ) {
+		static_cast< JackAudioDriver* >( m_pAudioDriver )->updateTempoMap( getSong(), getTimeline() );
+	}
+#endif
+}
+
 void Hydrogen::setTimelineBpm()
 {
 	//time line test
@@ -3279,14 +3675,15 @@ void Hydrogen::setTimelineBpm()
 
 	// Update "engine" BPM
 	Song* pSong = getSong();
-	float BPM = getTimelineBpm ( getPatternPos() );
+	float BPM = getTimelineBpm ( getPatternPos(), getTickPosition() );
 	if ( BPM != pSong->__bpm )
 		setBPM( BPM );
 
 	// Update "realtime" BPM
 	unsigned long PlayTick = getRealtimeTickPosition();
-	int RealtimePatternPos = getPosForTick ( PlayTick );
-	float RealtimeBPM = getTimelineBpm ( RealtimePatternPos );
+	int RealtimePatternTick;
+	int RealtimePatternPos = getPosForTick ( PlayTick, &RealtimePatternTick );
+	float RealtimeBPM = getTimelineBpm ( RealtimePatternPos, RealtimePatternTick );
 
 	// FIXME: this was already done in setBPM but for "engine" time
 	//        so this is actually forcibly overwritten here
@@ -38,11 +38,13 @@
 #include <hydrogen/basics/song.h>
 #include <hydrogen/basics/drumkit.h>
 #include <hydrogen/basics/sample.h>
+#include <hydrogen/helpers/chunk_file.h>
 #include <hydrogen/helpers/filesystem.h>
 #include <hydrogen/fx/Effects.h>
 
 #include <algorithm>
 #include <cassert>
+#include <map>
 #include <cstdlib>
 #include <ctype.h>
 #include <sys/stat.h>
@@ -1280,6 +1282,7 @@ int SongWriter::writeSong( Song *song, const QString& filename )
 		LocalFileMng::writeXmlString( instrumentNode, "pan_R", QString("%1").arg( instr->get_pan_r() ) );
 		LocalFileMng::writeXmlString( instrumentNode, "gain", QString("%1").arg( instr->get_gain() ) );
 		LocalFileMng::writeXmlBool( instrumentNode, "applyVelocity", instr->get_apply_velocity() );
+		LocalFileMng::writeXmlBool( instrumentNode, "diskStreaming", instr->get_disk_streaming() );
 
 		LocalFileMng::writeXmlBool( instrumentNode, "filterActive", instr->is_filter_active() );
 		LocalFileMng::writeXmlString( instrumentNode, "filterCutoff", QString("%1").arg( instr->get_filter_cutoff() ) );
@@ -1519,6 +1522,9 @@ int SongWriter::writeSong( Song *song, const QString& filename )
 		for ( int t = 0; t < static_cast<int>(pTimeline->m_timelinevector.size()); t++){
 			QDomNode newBPMNode = doc.createElement( "newBPM" );
 			LocalFileMng::writeXmlString( newBPMNode, "BAR",QString("%1").arg( pTimeline->m_timelinevector[t].m_htimelinebeat ));
+			if ( pTimeline->m_timelinevector[t].m_htimelinetick != 0 ) {
+				LocalFileMng::writeXmlString( newBPMNode, "TICK",QString("%1").arg( pTimeline->m_timelinevector[t].m_htimelinetick ));
+			}
 			LocalFileMng::writeXmlString( newBPMNode, "BPM", QString("%1").arg( pTimeline->m_timelinevector[t].m_htimelinebpm  ) );
 			bpmTimeLine.appendChild( newBPMNode );
 		}
@@ -1561,5 +1567,258 @@ int SongWriter::writeSong( Song *song, const QString& filename )
 	return rv;
 }
 
+// Returns 0 on success, 1 if the file can't be written.
+int SongWriter::writeSongBinary( Song *song, const QString& filename )
+{
+	INFOLOG( "Saving binary song " + filename );
+
+	ChunkWriter writer( SONG_BINARY_MAGIC, SONG_BINARY_VERSION );
+
+	writer.begin_chunk( "SONG" );
+	writer.write_string( QString( get_version().c_str() ) );
+	writer.write_float( song->__bpm );
+	writer.write_float( song->get_volume() );
+	writer.write_float( song->get_metronome_volume() );
+	writer.write_string( song->__name );
+	writer.write_string( song->__author );
+	writer.write_string( song->get_notes() );
+	writer.write_string( song->get_license() );
+	writer.write_bool( song->is_loop_enabled() );
+	writer.write_bool( Preferences::get_instance()->patternModePlaysSelected() );
+	writer.write_bool( song->get_mode() == Song::SONG_MODE );
+	writer.write_float( song->get_humanize_time_value() );
+	writer.write_float( song->get_humanize_velocity_value() );
+	writer.write_float( song->get_swing_factor() );
+	writer.end_chunk();
+
+	// component list
+	std::vector<DrumkitComponent*>* pComponents = song->get_components();
+	writer.begin_chunk( "COMP" );
+	writer.write_u32( pComponents->size() );
+	for ( int i = 0; i < pComponents->size(); i++ ) {
+		DrumkitComponent* pCompo = ( *pComponents )[i];
+		writer.write_i32( pCompo->get_id() );
+		writer.write_string( pCompo->get_name() );
+		writer.write_float( pCompo->get_volume() );
+	}
+	writer.end_chunk();
+
+	// instrument list
+	InstrumentList* pInstruments = song->get_instrument_list();
+	writer.begin_chunk( "INST" );
+	writer.write_u32( pInstruments->size() );
+	for ( int i = 0; i < pInstruments->size(); i++ ) {
+		Instrument *instr = pInstruments->get( i );
+		assert( instr );
+		assert( instr->get_adsr() );
+
+		writer.write_i32( instr->get_id() );
+		writer.write_string( instr->get_name() );
+		writer.write_string( instr->get_drumkit_name() );
+		writer.write_float( instr->get_volume() );
+		writer.write_bool( instr->is_muted() );
+		writer.write_float( instr->get_pan_l() );
+		writer.write_float( instr->get_pan_r() );
+		writer.write_float( instr->get_gain() );
+		writer.write_bool( instr->get_apply_velocity() );
+		writer.write_bool( instr->get_disk_streaming() );
+		writer.write_bool( instr->is_filter_active() );
+		writer.write_float( instr->get_filter_cutoff() );
+		writer.write_float( instr->get_filter_resonance() );
+		for ( int nFX = 0; nFX < MAX_FX; nFX++ ) {
+			writer.write_float( instr->get_fx_level( nFX ) );
+		}
+		writer.write_float( instr->get_adsr()->get_attack() );
+		writer.write_float( instr->get_adsr()->get_decay() );
+		writer.write_float( instr->get_adsr()->get_sustain() );
+		writer.write_float( instr->get_adsr()->get_release() );
+		writer.write_float( instr->get_random_pitch_factor() );
+		writer.write_i32( instr->get_mute_group() );
+		writer.write_bool( instr->is_stop_notes() );
+		writer.write_u8( instr->sample_selection_alg() );
+		writer.write_i32( instr->get_midi_out_channel() );
+		writer.write_i32( instr->get_midi_out_note() );
+		writer.write_i32( instr->get_hihat_grp() );
+		writer.write_i32( instr->get_lower_cc() );
+		writer.write_i32( instr->get_higher_cc() );
+
+		std::vector<InstrumentComponent*>* pInstrCompos = instr->get_components();
+		writer.write_u32( pInstrCompos->size() );
+		for ( int nCompo = 0; nCompo < pInstrCompos->size(); nCompo++ ) {
+			InstrumentComponent* pComponent = ( *pInstrCompos )[ nCompo ];
+			writer.write_i32( pComponent->get_drumkit_componentID() );
+			writer.write_float( pComponent->get_gain() );
+
+			int nLayers = 0;
+			for ( int nLayer = 0; nLayer < MAX_LAYERS; nLayer++ ) {
+				InstrumentLayer *pLayer = pComponent->get_layer( nLayer );
+				if ( pLayer && pLayer->get_sample() ) nLayers++;
+			}
+			writer.write_u32( nLayers );
+			for ( int nLayer = 0; nLayer < MAX_LAYERS; nLayer++ ) {
+				InstrumentLayer *pLayer = pComponent->get_layer( nLayer );
+				if ( pLayer == NULL ) continue;
+				Sample *pSample = pLayer->get_sample();
+				if ( pSample == NULL ) continue;
+
+				Sample::Loops lo = pSample->get_loops();
+				Sample::Rubberband ro = pSample->get_rubberband();
+				writer.write_u8( nLayer );
+				writer.write_string( prepare_filename( pSample->get_filepath() ) );
+				writer.write_bool( pSample->get_is_modified() );
+				writer.write_u8( lo.mode );
+				writer.write_i32( lo.start_frame );
+				writer.write_i32( lo.loop_frame );
+				writer.write_i32( lo.count );
+				writer.write_i32( lo.end_frame );
+				writer.write_bool( ro.use );
+				writer.write_float( ro.divider );
+				writer.write_i32( ro.c_settings );
+				writer.write_float( ro.pitch );
+				writer.write_float( pLayer->get_start_velocity() );
+				writer.write_float( pLayer->get_end_velocity() );
+				writer.write_float( pLayer->get_gain() );
+				writer.write_float( pLayer->get_pitch() );
+
+				Sample::VelocityEnvelope* velocity = pSample->get_velocity_envelope();
+				writer.write_u32( velocity->size() );
+				for ( int y = 0; y < velocity->size(); y++ ) {
+					writer.write_i32( velocity->at( y ).frame );
+					writer.write_i32( velocity->at( y ).value );
+				}
+				Sample::PanEnvelope* pan = pSample->get_pan_envelope();
+				writer.write_u32( pan->size() );
+				for ( int y = 0; y < pan->size(); y++ ) {
+					writer.write_i32( pan->at( y ).frame );
+					writer.write_i32( pan->at( y ).value );
+				}
+			}
+		}
+	}
+	writer.end_chunk();
+
+	// pattern list, the notes of a pattern are stored column by column
+	PatternList* pPatterns = song->get_pattern_list();
+	std::map<Pattern*, int> patternIndex;
+	writer.begin_chunk( "PATT" );
+	writer.write_u32( pPatterns->size() );
+	for ( int i = 0; i < pPatterns->size(); i++ ) {
+		Pattern *pat = pPatterns->get( i );
+		patternIndex[ pat ] = i;
+		writer.write_string( pat->get_name() );
+		writer.write_string( pat->get_category() );
+		writer.write_i32( pat->get_length() );
+		writer.write_string( pat->get_info() );
+
+		const Pattern::notes_t* notes = pat->get_notes();
+		writer.write_u32( notes->size() );
+		FOREACH_NOTE_CST_IT_BEGIN_END(notes,it) writer.write_i32( it->second->get_position() );
+		FOREACH_NOTE_CST_IT_BEGIN_END(notes,it) writer.write_i32( it->second->get_instrument()->get_id() );
+		FOREACH_NOTE_CST_IT_BEGIN_END(notes,it) writer.write_float( it->second->get_velocity() );
+		FOREACH_NOTE_CST_IT_BEGIN_END(notes,it) writer.write_float( it->second->get_pan_l() );
+		FOREACH_NOTE_CST_IT_BEGIN_END(notes,it) writer.write_float( it->second->get_pan_r() );
+		FOREACH_NOTE_CST_IT_BEGIN_END(notes,it) writer.write_float( it->second->get_lead_lag() );
+		FOREACH_NOTE_CST_IT_BEGIN_END(notes,it) writer.write_float( it->second->get_pitch() );
+		FOREACH_NOTE_CST_IT_BEGIN_END(notes,it) writer.write_i32( it->second->get_length() );
+		FOREACH_NOTE_CST_IT_BEGIN_END(notes,it) writer.write_float( it->second->get_probability() );
+		FOREACH_NOTE_CST_IT_BEGIN_END(notes,it) writer.write_u8( it->second->get_key() );
+		FOREACH_NOTE_CST_IT_BEGIN_END(notes,it) writer.write_u8( ( qint8 )it->second->get_octave() );
+		FOREACH_NOTE_CST_IT_BEGIN_END(notes,it) writer.write_bool( it->second->get_note_off() );
+	}
+	writer.end_chunk();
+
+	// virtual patterns, by pattern index
+	writer.begin_chunk( "VPAT" );
+	for ( int i = 0; i < pPatterns->size(); i++ ) {
+		const Pattern::virtual_patterns_t* pVirtuals = pPatterns->get( i )->get_virtual_patterns();
+		if ( pVirtuals->empty() ) continue;
+		writer.write_u32( i );
+		writer.write_u32( pVirtuals->size() );
+		for ( Pattern::virtual_patterns_cst_it_t virtIter = pVirtuals->begin(); virtIter != pVirtuals->end(); ++virtIter ) {
+			writer.write_u32( patternIndex[ *virtIter ] );
+		}
+	}
+	writer.end_chunk();
+
+	// pattern sequence, by pattern index
+	std::vector<PatternList*>* pGroups = song->get_pattern_group_vector();
+	writer.begin_chunk( "SEQU" );
+	writer.write_u32( pGroups->size() );
+	for ( int i = 0; i < pGroups->size(); i++ ) {
+		PatternList *pList = ( *pGroups )[i];
+		writer.write_u32( pList->size() );
+		for ( int j = 0; j < pList->size(); j++ ) {
+			writer.write_u32( patternIndex[ pList->get( j ) ] );
+		}
+	}
+	writer.end_chunk();
+
+	// LADSPA FX
+	writer.begin_chunk( "LFX " );
+	writer.write_u32( MAX_FX );
+	for ( unsigned nFX = 0; nFX < MAX_FX; nFX++ ) {
+#ifdef H2CORE_HAVE_LADSPA
+		LadspaFX *pFX = Effects::get_instance()->getLadspaFX( nFX );
+		if ( pFX ) {
+			writer.write_bool( true );
+			writer.write_string( pFX->getPluginLabel() );
+			writer.write_string( pFX->getLibraryPath() );
+			writer.write_bool( pFX->isEnabled() );
+			writer.write_float( pFX->getVolume() );
+			writer.write_u32( pFX->inputControlPorts.size() );
+			for ( unsigned nControl = 0; nControl < pFX->inputControlPorts.size(); nControl++ ) {
+				LadspaControlPort *pControlPort = pFX->inputControlPorts[ nControl ];
+				writer.write_string( pControlPort->sName );
+				writer.write_float( pControlPort->fControlValue );
+			}
+			continue;
+		}
+#endif
+		writer.write_bool( false );
+	}
+	writer.end_chunk();
+
+	// bpm time line and tags
+	Timeline * pTimeline = Hydrogen::get_instance()->getTimeline();
+	writer.begin_chunk( "TIML" );
+	writer.write_u32( pTimeline->m_timelinevector.size() );
+	for ( int t = 0; t < static_cast<int>(pTimeline->m_timelinevector.size()); t++ ) {
+		writer.write_i32( pTimeline->m_timelinevector[t].m_htimelinebeat );
+		writer.write_float( pTimeline->m_timelinevector[t].m_htimelinebpm );
+	}
+	writer.end_chunk();
+
+	// the ticks of the tempo markers changing the tempo within a pattern, older versions skip the chunk
+	bool bBpmTicks = false;
+	for ( int t = 0; t < static_cast<int>(pTimeline->m_timelinevector.size()); t++ ) {
+		bBpmTicks = bBpmTicks || pTimeline->m_timelinevector[t].m_htimelinetick != 0;
+	}
+	if ( bBpmTicks ) {
+		writer.begin_chunk( "TIMT" );
+		writer.write_u32( pTimeline->m_timelinevector.size() );
+		for ( int t = 0; t < static_cast<int>(pTimeline->m_timelinevector.size()); t++ ) {
+			writer.write_i32( pTimeline->m_timelinevector[t].m_htimelinetick );
+		}
+		writer.end_chunk();
+	}
+
+	writer.begin_chunk( "TAGS" );
+	writer.write_u32( pTimeline->m_timelinetagvector.size() );
+	for ( int t = 0; t < static_cast<int>(pTimeline->m_timelinetagvector.size()); t++ ) {
+		writer.write_i32( pTimeline->m_timelinetagvector[t].m_htimelinetagbeat );
+		writer.write_string( pTimeline->m_timelinetagvector[t].m_htimelinetag );
+	}
+	writer.end_chunk();
+
+	if ( !writer.save( filename ) ) {
+		WARNINGLOG("File save reported an error.");
+		return 1;
+	}
+	song->set_is_modified( false );
+	song->set_filename( filename );
+	INFOLOG("Save was successful.");
+	return 0;
+}
+
 };
 
@@ -36,6 +36,7 @@
 #include <iostream>
 #include <cstdio>
 #include <list>
+#include <algorithm>
 
 #include <hydrogen/midi_map.h>
 #include "hydrogen/version.h"
@@ -181,6 +182,13 @@ Preferences::Preferences()
 	m_nMaxNotes = 256;
 	m_nBufferSize = 1024;
 	m_nSampleRate = 44100;
+	m_bSampleStreaming = false;
+	m_nSampleStreamingThreshold = 8192;
+	m_nSampleStreamingPreload = 500;
+	m_bSampleCache = false;
+	m_nSampleCacheSize = 512;
+	m_bLazyLayerLoading = false;
+	m_sSampleStorage = "float";
 
 	//___ oss driver properties ___
 	m_sOSSDevice = QString("/dev/dsp");
@@ -195,6 +203,13 @@ Preferences::Preferences()
 
 	//___  alsa audio driver properties ___
 	m_sAlsaAudioDevice = QString("hw:0");
+	m_bAlsaMmap = true;
+	m_nAlsaPeriodSize = 0;
+	m_nAlsaPeriods = 2;
+
+	//___  multichannel drivers properties ___
+	m_nOutputChannelPairs = 1;
+	// NONE: m_outputRoutes;
 
 	//___  jack driver properties ___
 	m_sJackPortName1 = QString("alsa_pcm:playback_1");
@@ -471,6 +486,13 @@ void Preferences::loadPreferences( bool bGlobal )
 				m_nMaxNotes = LocalFileMng::readXmlInt( audioEngineNode, "maxNotes", m_nMaxNotes );
 				m_nBufferSize = LocalFileMng::readXmlInt( audioEngineNode, "buffer_size", m_nBufferSize );
 				m_nSampleRate = LocalFileMng::readXmlInt( audioEngineNode, "samplerate", m_nSampleRate );
+				m_bSampleStreaming = LocalFileMng::readXmlBool( audioEngineNode, "sample_streaming", m_bSampleStreaming );
+				m_nSampleStreamingThreshold = LocalFileMng::readXmlInt( audioEngineNode, "sample_streaming_threshold", m_nSampleStreamingThreshold );
+				m_nSampleStreamingPreload = LocalFileMng::readXmlInt( audioEngineNode, "sample_streaming_preload", m_nSampleStreamingPreload );
+				m_bSampleCache = LocalFileMng::readXmlBool( audioEngineNode, "sample_cache", m_bSampleCache );
+				m_nSampleCacheSize = LocalFileMng::readXmlInt( audioEngineNode, "sample_cache_size", m_nSampleCacheSize );
+				m_bLazyLayerLoading = LocalFileMng::readXmlBool( audioEngineNode, "lazy_layer_loading", m_bLazyLayerLoading );
+				m_sSampleStorage = LocalFileMng::readXmlString( audioEngineNode, "sample_storage", m_sSampleStorage );
 
 				//// OSS DRIVER ////
 				QDomNode ossDriverNode = audioEngineNode.firstChildElement( "oss_driver" );
@@ -519,6 +541,32 @@ void Preferences::loadPreferences( bool bGlobal )
 					recreate = true;
 				} else {
 					m_sAlsaAudioDevice = LocalFileMng::readXmlString( alsaAudioDriverNode, "alsa_audio_device", m_sAlsaAudioDevice );
+					m_bAlsaMmap = LocalFileMng::readXmlBool( alsaAudioDriverNode, "alsa_mmap", m_bAlsaMmap, false );
+					m_nAlsaPeriodSize = std::min( LocalFileMng::readXmlInt( alsaAudioDriverNode, "alsa_period_size", m_nAlsaPeriodSize, false, false ), MAX_BUFFER_SIZE );
+					m_nAlsaPeriods = LocalFileMng::readXmlInt( alsaAudioDriverNode, "alsa_periods", m_nAlsaPeriods, false, false );
+				}
+
+				/// MULTICHANNEL OUTPUT ///
+				m_outputRoutes.clear();
+				QDomNode outputChannelsNode = audioEngineNode.firstChildElement( "output_channels" );
+				if ( !outputChannelsNode.isNull() ) {
+					m_nOutputChannelPairs = LocalFileMng::readXmlInt( outputChannelsNode, "pairs", m_nOutputChannelPairs );
+					QDomElement routeElement = outputChannelsNode.firstChildElement( "route" );
+					while ( !routeElement.isNull() ) {
+						OutputRoute route;
+						QString sSource = LocalFileMng::readXmlString( routeElement, "source", "instrument" );
+						if ( sSource == "component" ) {
+							route.m_source = OutputRoute::COMPONENT;
+						} else if ( sSource == "fx" ) {
+							route.m_source = OutputRoute::FX;
+						} else {
+							route.m_source = OutputRoute::INSTRUMENT;
+						}
+						route.m_sName = LocalFileMng::readXmlString( routeElement, "name", "" );
+						route.m_nPair = LocalFileMng::readXmlInt( routeElement, "pair", 0 );
+						m_outputRoutes.push_back( route );
+						routeElement = routeElement.nextSiblingElement( "route" );
+					}
 				}
 
 				/// MIDI DRIVER ///
@@ -845,6 +893,13 @@ void Preferences::savePreferences()
 		LocalFileMng::writeXmlString( audioEngineNode, "maxNotes", QString("%1").arg( m_nMaxNotes ) );
 		LocalFileMng::writeXmlString( audioEngineNode, "buffer_size", QString("%1").arg( m_nBufferSize ) );
 		LocalFileMng::writeXmlString( audioEngineNode, "samplerate", QString("%1").arg( m_nSampleRate ) );
+		LocalFileMng::writeXmlBool( audioEngineNode, "sample_streaming", m_bSampleStreaming );
+		LocalFileMng::writeXmlString( audioEngineNode, "sample_streaming_threshold", QString("%1").arg( m_nSampleStreamingThreshold ) );
+		LocalFileMng::writeXmlString( audioEngineNode, "sample_streaming_preload", QString("%1").arg( m_nSampleStreamingPreload ) );
+		LocalFileMng::writeXmlBool( audioEngineNode, "sample_cache", m_bSampleCache );
+		LocalFileMng::writeXmlString( audioEngineNode, "sample_cache_size", QString("%1").arg( m_nSampleCacheSize ) );
+		LocalFileMng::writeXmlBool( audioEngineNode, "lazy_layer_loading", m_bLazyLayerLoading );
+		LocalFileMng::writeXmlString( audioEngineNode, "sample_storage", m_sSampleStorage );
 
 		//// OSS DRIVER ////
 		QDomNode ossDriverNode = doc.createElement( "oss_driver" );
@@ -901,9 +956,33 @@ void Preferences::savePreferences()
 		QDomNode alsaAudioDriverNode = doc.createElement( "alsa_audio_driver" );
 		{
 			LocalFileMng::writeXmlString( alsaAudioDriverNode, "alsa_audio_device", m_sAlsaAudioDevice );
+			LocalFileMng::writeXmlBool( alsaAudioDriverNode, "alsa_mmap", m_bAlsaMmap );
+			LocalFileMng::writeXmlString( alsaAudioDriverNode, "alsa_period_size", QString("%1").arg( m_nAlsaPeriodSize ) );
+			LocalFileMng::writeXmlString( alsaAudioDriverNode, "alsa_periods", QString("%1").arg( m_nAlsaPeriods ) );
 		}
 		audioEngineNode.appendChild( alsaAudioDriverNode );
 
+		//// MULTICHANNEL OUTPUT ////
+		QDomNode outputChannelsNode = doc.createElement( "output_channels" );
+		{
+			LocalFileMng::writeXmlString( outputChannelsNode, "pairs", QString("%1").arg( m_nOutputChannelPairs ) );
+			for ( int i = 0; i < m_outputRoutes.size(); i++ ) {
+				const OutputRoute& route = m_outputRoutes[i];
+				QDomNode routeNode = doc.createElement( "route" );
+				QString sSource = "instrument";
+				if ( route.m_source == OutputRoute::COMPONENT ) {
+					sSource = "component";
+				} else if ( route.m_source == OutputRoute::FX ) {
+					sSource = "fx";
+				}
+				LocalFileMng::writeXmlString( routeNode, "source", sSource );
+				LocalFileMng::writeXmlString( routeNode, "name", route.m_sName );
+				LocalFileMng::writeXmlString( routeNode, "pair", QString("%1").arg( route.m_nPair ) );
+				outputChannelsNode.appendChild( routeNode );
+			}
+		}
+		audioEngineNode.appendChild( outputChannelsNode );
+
 		/// MIDI DRIVER ///
 		QDomNode midiDriverNode = doc.createElement( "midi_driver" );
 		{
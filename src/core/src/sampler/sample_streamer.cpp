@@ -0,0 +1,260 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <algorithm>
+
+#include <hydrogen/sampler/sample_streamer.h>
+
+#include <hydrogen/Preferences.h>
+#include <hydrogen/basics/sample.h>
+
+#ifdef WIN32
+#include <windows.h>
+#define STREAMER_SLEEP( ms ) Sleep( ms )
+#else
+#include <unistd.h>
+#define STREAMER_SLEEP( ms ) usleep( 1000 * ( ms ) )
+#endif
+
+#define STREAMER_BUSY_SLEEP     2       ///< ms between two passes while voices are streaming
+#define STREAMER_IDLE_SLEEP     20      ///< ms between two passes while no voice is streaming
+
+namespace H2Core
+{
+
+const char* SampleStreamer::__class_name = "SampleStreamer";
+std::atomic<SampleStreamer*> SampleStreamer::__shared( NULL );
+QMutex SampleStreamer::__shared_mutex;
+
+SampleStream::SampleStream()
+	: __state( FREE )
+	, __start( 0 )
+	, __end( 0 )
+	, __frames( 0 )
+	, __file( 0 )
+	, __channels( 0 )
+	, __file_pos( 0 )
+{
+	__ring_l = new float[ STREAM_RING_FRAMES ];
+	__ring_r = new float[ STREAM_RING_FRAMES ];
+}
+
+SampleStream::~SampleStream()
+{
+	delete[] __ring_l;
+	delete[] __ring_r;
+}
+
+int SampleStream::read( int frame, int nframes, float* dst_l, float* dst_r )
+{
+	int start = __start.load( std::memory_order_relaxed );
+	int end = __end.load( std::memory_order_acquire );
+	int missing = 0;
+	for ( int i = 0; i < nframes; i++ ) {
+		int f = frame + i;
+		if ( f >= start && f < end ) {
+			int idx = f & ( STREAM_RING_FRAMES - 1 );
+			dst_l[i] = __ring_l[idx];
+			dst_r[i] = __ring_r[idx];
+		} else {
+			dst_l[i] = 0.0f;
+			dst_r[i] = 0.0f;
+			if ( f < __frames ) missing++;
+		}
+	}
+	return missing;
+}
+
+void SampleStream::consume( int frame )
+{
+	if ( frame > __start.load( std::memory_order_relaxed ) ) {
+		__start.store( frame, std::memory_order_release );
+	}
+}
+
+void SampleStream::release()
+{
+	__state.store( RELEASED, std::memory_order_release );
+}
+
+SampleStreamer::SampleStreamer()
+	: Object( __class_name )
+	, __read_buffer( STREAM_CHUNK_FRAMES * 2 )
+	, __running( true )
+	, __underruns( 0 )
+{
+	pthread_attr_t attr;
+	pthread_attr_init( &attr );
+	pthread_create( &__thread, &attr, reader_thread, this );
+}
+
+SampleStreamer::~SampleStreamer()
+{
+	__running = false;
+	pthread_join( __thread, 0 );
+	for ( int i = 0; i < STREAM_SLOTS; i++ ) close( &__streams[i] );
+}
+
+SampleStream* SampleStreamer::acquire( Sample* sample, int frame )
+{
+	for ( int i = 0; i < STREAM_SLOTS; i++ ) {
+		SampleStream* stream = &__streams[i];
+		int state = SampleStream::FREE;
+		if ( !stream->__state.compare_exchange_strong( state, SampleStream::CLAIMED, std::memory_order_acquire ) ) continue;
+		stream->__filepath = sample->get_filepath();
+		stream->__frames = sample->get_frames();
+		stream->__start.store( frame, std::memory_order_relaxed );
+		stream->__end.store( frame, std::memory_order_relaxed );
+		stream->__state.store( SampleStream::STARTING, std::memory_order_release );
+		return stream;
+	}
+	return 0;
+}
+
+void* SampleStreamer::reader_thread( void* param )
+{
+	SampleStreamer* streamer = ( SampleStreamer* )param;
+	int reported_underruns = 0;
+	while ( streamer->__running ) {
+		bool active = false;
+		bool busy = false;
+		for ( int i = 0; i < STREAM_SLOTS; i++ ) {
+			SampleStream* stream = &streamer->__streams[i];
+			int state = stream->__state.load( std::memory_order_acquire );
+			if ( state == SampleStream::STARTING ) {
+				SF_INFO info;
+				info.format = 0;
+				stream->__file = sf_open( stream->__filepath.toLocal8Bit(), SFM_READ, &info );
+				if ( stream->__file ) {
+					stream->__channels = info.channels;
+					stream->__file_pos = 0;
+				} else {
+					_ERRORLOG( QString( "unable to stream %1, the voice will be silent" ).arg( stream->__filepath ) );
+				}
+				stream->__state.store( SampleStream::RUNNING, std::memory_order_release );
+				state = SampleStream::RUNNING;
+			}
+			if ( state == SampleStream::RUNNING ) {
+				active = true;
+				if ( streamer->fill( stream ) ) busy = true;
+			} else if ( state == SampleStream::RELEASED ) {
+				streamer->close( stream );
+				stream->__state.store( SampleStream::FREE, std::memory_order_release );
+			}
+		}
+		int underruns = streamer->get_underruns();
+		if ( underruns != reported_underruns ) {
+			_WARNINGLOG( QString( "%1 frames of streamed samples were not read from disk in time" ).arg( underruns - reported_underruns ) );
+			reported_underruns = underruns;
+		}
+		if ( !busy ) {
+			STREAMER_SLEEP( active ? STREAMER_BUSY_SLEEP : STREAMER_IDLE_SLEEP );
+		}
+	}
+	return 0;
+}
+
+bool SampleStreamer::fill( SampleStream* stream )
+{
+	if ( !stream->__file ) return false;
+
+	int start = stream->__start.load( std::memory_order_acquire );
+	int end = stream->__end.load( std::memory_order_relaxed );
+	if ( end < start ) {
+		// the voice ran past the frames read so far, skip ahead
+		end = start;
+	}
+	int space = start + STREAM_RING_FRAMES - end;
+	int left = stream->__frames - end;
+	int n = std::min( std::min( space, left ), STREAM_CHUNK_FRAMES );
+	// wait for room for a whole chunk unless the end of the sample is near
+	if ( n <= 0 || ( n < STREAM_CHUNK_FRAMES && n < left ) ) return false;
+
+	if ( stream->__file_pos != end ) {
+		if ( sf_seek( stream->__file, end, SEEK_SET ) < 0 ) {
+			ERRORLOG( QString( "unable to seek %1 to frame %2" ).arg( stream->__filepath ).arg( end ) );
+			close( stream );
+			return false;
+		}
+		stream->__file_pos = end;
+	}
+
+	int channels = stream->__channels;
+	if ( ( int )__read_buffer.size() < n * channels ) __read_buffer.resize( n * channels );
+	float* buffer = &__read_buffer[0];
+	sf_count_t count = sf_readf_float( stream->__file, buffer, n );
+	if ( count <= 0 ) {
+		ERRORLOG( QString( "unable to read %1 at frame %2" ).arg( stream->__filepath ).arg( end ) );
+		close( stream );
+		return false;
+	}
+	// same channel mapping as Sample::load()
+	for ( int i = 0; i < count; i++ ) {
+		int idx = ( end + i ) & ( STREAM_RING_FRAMES - 1 );
+		stream->__ring_l[idx] = buffer[i * channels];
+		stream->__ring_r[idx] = ( channels > 1 ) ? buffer[i * channels + 1] : buffer[i * channels];
+	}
+	stream->__file_pos += count;
+	stream->__end.store( end + count, std::memory_order_release );
+	return true;
+}
+
+void SampleStreamer::close( SampleStream* stream )
+{
+	if ( stream->__file ) {
+		sf_close( stream->__file );
+		stream->__file = 0;
+	}
+	stream->__filepath = QString();
+}
+
+bool SampleStreamer::apply_policy( Sample* sample, bool force )
+{
+	if ( !sample ) return false;
+	Preferences* pref = Preferences::get_instance();
+	if ( !force ) {
+		if ( !pref->m_bSampleStreaming ) return false;
+		if ( ( long long )sample->get_size() < ( long long )pref->m_nSampleStreamingThreshold * 1024 ) return false;
+	}
+	int preload_frames = ( int )( ( long long )pref->m_nSampleStreamingPreload * sample->get_sample_rate() / 1000 );
+	if ( preload_frames < STREAM_CHUNK_FRAMES ) preload_frames = STREAM_CHUNK_FRAMES;
+	if ( !sample->stream( preload_frames ) ) return false;
+
+	// the reader thread and its rings only exist once a sample needs them, never started by the audio thread
+	if ( !__shared.load( std::memory_order_acquire ) ) {
+		QMutexLocker lock( &__shared_mutex );
+		if ( !__shared.load( std::memory_order_relaxed ) ) {
+			__shared.store( new SampleStreamer(), std::memory_order_release );
+		}
+	}
+	return true;
+}
+
+void SampleStreamer::destroy_shared()
+{
+	QMutexLocker lock( &__shared_mutex );
+	delete __shared.exchange( NULL );
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
@@ -20,6 +20,7 @@
  *
  */
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstdlib>
@@ -47,25 +48,38 @@
 
 #include <hydrogen/fx/Effects.h>
 #include <hydrogen/sampler/Sampler.h>
+#include <hydrogen/sampler/sample_streamer.h>
 
 #include <iostream>
 #include <QDebug>
 
+/* room for the frames of a streamed sample a voice can read within a cycle, pitched up included */
+#define STREAM_WINDOW_FRAMES    ( 16 * MAX_BUFFER_SIZE )
+
 namespace H2Core
 {
 
 const char* Sampler::__class_name = "Sampler";
 
-Sampler::Sampler()
+Sampler::Sampler( AudioOutput* pOutput )
 		: Object( __class_name )
 		, __main_out_L( NULL )
 		, __main_out_R( NULL )
+		, __output( pOutput )
 		, __preview_instrument( NULL )
+		, __voice_buffer_L( NULL )
+		, __voice_buffer_R( NULL )
+		, __stream_window_L( NULL )
+		, __stream_window_R( NULL )
 {
 	INFOLOG( "INIT" );
 		__interpolateMode = LINEAR;
 	__main_out_L = new float[ MAX_BUFFER_SIZE ];
 	__main_out_R = new float[ MAX_BUFFER_SIZE ];
+	__voice_buffer_L = new float[ MAX_BUFFER_SIZE ];
+	__voice_buffer_R = new float[ MAX_BUFFER_SIZE ];
+	__stream_window_L = new float[ STREAM_WINDOW_FRAMES ];
+	__stream_window_R = new float[ STREAM_WINDOW_FRAMES ];
 
 	// instrument used in file preview
 	QString sEmptySampleFilename = Filesystem::empty_sample();
@@ -85,17 +99,31 @@ Sampler::~Sampler()
 
 	delete[] __main_out_L;
 	delete[] __main_out_R;
+	delete[] __voice_buffer_L;
+	delete[] __voice_buffer_R;
+	delete[] __stream_window_L;
+	delete[] __stream_window_R;
 
 	delete __preview_instrument;
 	__preview_instrument = NULL;
 }
 
+SampleStreamer* Sampler::get_streamer()
+{
+	// an offline render holds its samples whole, see OfflineRenderer
+	return __output ? NULL : SampleStreamer::get_shared();
+}
+
+AudioOutput* Sampler::__get_output() const
+{
+	return __output ? __output : Hydrogen::get_instance()->getAudioOutput();
+}
+
 // perche' viene passata anche la canzone? E' davvero necessaria?
 void Sampler::process( uint32_t nFrames, Song* pSong )
 {
 	//infoLog( "[process]" );
-	AudioOutput* audio_output = Hydrogen::get_instance()->getAudioOutput();
-	assert( audio_output );
+	assert( __get_output() );
 
 	memset( __main_out_L, 0, nFrames * sizeof( float ) );
 	memset( __main_out_R, 0, nFrames * sizeof( float ) );
@@ -138,7 +166,7 @@ void Sampler::process( uint32_t nFrames, Song* pSong )
 
 	while ( !__queuedNoteOffs.empty() ) {
 		pNote =  __queuedNoteOffs[0];
-		MidiOutput* midiOut = Hydrogen::get_instance()->getMidiOutput();
+		MidiOutput* midiOut = __output ? NULL : Hydrogen::get_instance()->getMidiOutput();
 		if( midiOut != NULL ){
 			midiOut->handleQueueNoteOff( pNote->get_instrument()->get_midi_out_channel(), pNote->get_midi_key(),  pNote->get_midi_velocity() );
 
@@ -232,8 +260,8 @@ bool Sampler::__render_note( Note* pNote, unsigned nBufferSize, Song* pSong )
 
 	unsigned int nFramepos;
 	Hydrogen* pEngine = Hydrogen::get_instance();
-	AudioOutput* audio_output = pEngine->getAudioOutput();
-	if (  pEngine->getState() == STATE_PLAYING ) {
+	AudioOutput* audio_output = __get_output();
+	if ( __output || pEngine->getState() == STATE_PLAYING ) {
 		nFramepos = audio_output->m_transport.m_nFrames;
 	} else {
 		// use this to support realtime events when not playing
@@ -250,19 +278,28 @@ bool Sampler::__render_note( Note* pNote, unsigned nBufferSize, Song* pSong )
 	int nReturnValueIndex = 0;
 	int nAlreadySelectedLayer = -1;
 
+	// the components share the filter ramp of the cycle
+	if ( pInstr->is_filter_active() ) {
+		pNote->ramp_filter();
+	}
+
 	for (std::vector<InstrumentComponent*>::iterator it = pInstr->get_components()->begin() ; it !=pInstr->get_components()->end(); ++it) {
 		nReturnValues[nReturnValueIndex] = false;
 		InstrumentComponent *pCompo = *it;
-		DrumkitComponent* pMainCompo = pEngine->getSong()->get_component( pCompo->get_drumkit_componentID() );
+		DrumkitComponent* pMainCompo = NULL;
 
 		if( pNote->get_specific_compo_id() != -1 && pNote->get_specific_compo_id() != pCompo->get_drumkit_componentID() )
 			continue;
 
 		if(		pInstr->is_preview_instrument()
 			||	pInstr->is_metronome_instrument()){
-			pMainCompo = pEngine->getSong()->get_components()->front();
+			pMainCompo = pSong->get_components()->front();
 		} else {
-			pMainCompo = pEngine->getSong()->get_component( pCompo->get_drumkit_componentID() );
+			pMainCompo = pSong->get_component( pCompo->get_drumkit_componentID() );
+			if ( !pMainCompo ) {
+				// the note outlived its component in a drumkit switch, see retire_notes()
+				pMainCompo = pSong->get_components()->front();
+			}
 		}
 
 		assert(pMainCompo);
@@ -290,23 +327,25 @@ bool Sampler::__render_note( Note* pNote, unsigned nBufferSize, Song* pSong )
 		}
 		else {
 			switch ( pInstr->sample_selection_alg() ) {
-				case Instrument::VELOCITY:
-					for ( unsigned nLayer = 0; nLayer < MAX_LAYERS; ++nLayer ) {
+				case Instrument::VELOCITY: {
+					int nGroup = pCompo->get_layer_group( pNote->get_velocity() );
+					if ( nGroup != -1 ) {
+						int nLayer = pCompo->get_group_layer( nGroup, 0 );
 						InstrumentLayer *pLayer = pCompo->get_layer( nLayer );
-						if ( pLayer == NULL ) continue;
-
-						if ( ( pNote->get_velocity() >= pLayer->get_start_velocity() ) && ( pNote->get_velocity() <= pLayer->get_end_velocity() ) ) {
+						if ( pLayer != NULL ) {
 							pSelectedLayer->SelectedLayer = nLayer;
 
 							pSample = pLayer->get_sample();
 							fLayerGain = pLayer->get_gain();
 							fLayerPitch = pLayer->get_pitch();
-							break;
 						}
 					}
 					break;
+				}
 
 				case Instrument::RANDOM:
+				case Instrument::ROUND_ROBIN:
+					// keep the components of an instrument on the same layer
 					if( nAlreadySelectedLayer != -1 ) {
 						InstrumentLayer *pLayer = pCompo->get_layer( nAlreadySelectedLayer );
 						if ( pLayer != NULL ) {
@@ -318,77 +357,42 @@ bool Sampler::__render_note( Note* pNote, unsigned nBufferSize, Song* pSong )
 						}
 					}
 					if( pSample == NULL ) {
-						int __possibleIndex[MAX_LAYERS];
-						int __poundSamples = 0;
-						for ( unsigned nLayer = 0; nLayer < MAX_LAYERS; ++nLayer ) {
-							InstrumentLayer *pLayer = pCompo->get_layer( nLayer );
-							if ( pLayer == NULL ) continue;
-
-							if ( ( pNote->get_velocity() >= pLayer->get_start_velocity() ) && ( pNote->get_velocity() <= pLayer->get_end_velocity() ) ) {
-								__possibleIndex[__poundSamples] = nLayer;
-								__poundSamples++;
+						int nGroup = pCompo->get_layer_group( pNote->get_velocity() );
+						// a group read while the table is rebuilt may not be filled yet
+						if ( nGroup != -1 && pCompo->get_group_size( nGroup ) > 0 ) {
+							int nLayer;
+							if ( pInstr->sample_selection_alg() == Instrument::RANDOM ) {
+								nLayer = pCompo->get_group_layer( nGroup, rand() % pCompo->get_group_size( nGroup ) );
+							} else {
+								nLayer = pCompo->next_round_robin( nGroup );
 							}
-						}
-
-						if( __poundSamples > 0 ) {
-							nAlreadySelectedLayer = __possibleIndex[rand() % __poundSamples];
-							pSelectedLayer->SelectedLayer = nAlreadySelectedLayer;
-
-							InstrumentLayer *pLayer = pCompo->get_layer( nAlreadySelectedLayer );
-
-							pSample = pLayer->get_sample();
-							fLayerGain = pLayer->get_gain();
-							fLayerPitch = pLayer->get_pitch();
-						}
-					}
-					break;
-
-				case Instrument::ROUND_ROBIN:
-					if( nAlreadySelectedLayer != -1 ) {
-						InstrumentLayer *pLayer = pCompo->get_layer( nAlreadySelectedLayer );
-						if ( pLayer != NULL ) {
-							pSelectedLayer->SelectedLayer = nAlreadySelectedLayer;
-
-							pSample = pLayer->get_sample();
-							fLayerGain = pLayer->get_gain();
-							fLayerPitch = pLayer->get_pitch();
-						}
-					}
-					if( !pSample ) {
-						int __possibleIndex[MAX_LAYERS];
-						int __foundSamples = 0;
-						float __roundRobinID;
-						for ( unsigned nLayer = 0; nLayer < MAX_LAYERS; ++nLayer ) {
 							InstrumentLayer *pLayer = pCompo->get_layer( nLayer );
-							if ( pLayer == NULL ) continue;
+							if ( pLayer != NULL ) {
+								nAlreadySelectedLayer = nLayer;
+								pSelectedLayer->SelectedLayer = nLayer;
 
-							if ( ( pNote->get_velocity() >= pLayer->get_start_velocity() ) && ( pNote->get_velocity() <= pLayer->get_end_velocity() ) ) {
-								__possibleIndex[__foundSamples] = nLayer;
-								__roundRobinID = pLayer->get_start_velocity();
-								__foundSamples++;
+								pSample = pLayer->get_sample();
+								fLayerGain = pLayer->get_gain();
+								fLayerPitch = pLayer->get_pitch();
 							}
 						}
-
-						if( __foundSamples > 0 ) {
-							__roundRobinID = pInstr->get_id() * 10 + __roundRobinID;
-							int p_indexToUse = pSong->get_latest_round_robin(__roundRobinID)+1;
-							if( p_indexToUse > __foundSamples - 1)
-								p_indexToUse = 0;
-
-							pSong->set_latest_round_robin(__roundRobinID, p_indexToUse);
-							nAlreadySelectedLayer = __possibleIndex[p_indexToUse];
-
-							pSelectedLayer->SelectedLayer = nAlreadySelectedLayer;
-
-							InstrumentLayer *pLayer = pCompo->get_layer( nAlreadySelectedLayer );
-							pSample = pLayer->get_sample();
-							fLayerGain = pLayer->get_gain();
-							fLayerPitch = pLayer->get_pitch();
-						}
 					}
 					break;
 			}
 		}
+		if ( pSample && pSample->is_empty() ) {
+			// the layer is still being loaded in the background, play the closest one loaded
+			int nLayer = pCompo->get_nearest_loaded_layer( pNote->get_velocity() );
+			pSample = NULL;
+			if ( nLayer != -1 ) {
+				InstrumentLayer *pLayer = pCompo->get_layer( nLayer );
+				pSelectedLayer->SelectedLayer = nLayer;
+
+				pSample = pLayer->get_sample();
+				fLayerGain = pLayer->get_gain();
+				fLayerPitch = pLayer->get_pitch();
+			}
+		}
 		if ( !pSample ) {
 			QString dummy = QString( "NULL sample for instrument %1. Note velocity: %2" ).arg( pInstr->get_name() ).arg( pNote->get_velocity() );
 			WARNINGLOG( dummy );
@@ -396,7 +400,7 @@ bool Sampler::__render_note( Note* pNote, unsigned nBufferSize, Song* pSong )
 			continue;
 		}
 
-		if ( pSelectedLayer->SamplePosition >= pSample->get_frames() ) {
+		if ( ( pSelectedLayer->SamplePosition >> SAMPLE_POSITION_SHIFT ) >= ( sample_position_t )pSample->get_frames() ) {
 			WARNINGLOG( "sample position out of bounds. The layer has been resized during note play?" );
 			nReturnValues[nReturnValueIndex] = true;
 			continue;
@@ -428,13 +432,15 @@ bool Sampler::__render_note( Note* pNote, unsigned nBufferSize, Song* pSong )
 		float cost_R = 1.0f;
 		float cost_track_L = 1.0f;
 		float cost_track_R = 1.0f;
+		// the tracks of an offline render are post-fader, they add up to the main mix
+		int nTrackOutputMode = __output ? 0 : Preferences::get_instance()->m_nJackTrackOutputMode;
 
 		assert(pMainCompo);
 
 		if ( pInstr->is_muted() || pSong->__is_muted || pMainCompo->is_muted() ) {	// is instrument muted?
 			cost_L = 0.0;
 			cost_R = 0.0;
-			if ( Preferences::get_instance()->m_nJackTrackOutputMode == 0 ) {
+			if ( nTrackOutputMode == 0 ) {
 				// Post-Fader
 				cost_track_L = 0.0;
 				cost_track_R = 0.0;
@@ -454,7 +460,7 @@ bool Sampler::__render_note( Note* pNote, unsigned nBufferSize, Song* pSong )
 			cost_L = cost_L * pMainCompo->get_volume(); // Component volument
 
 			cost_L = cost_L * pInstr->get_volume();		// instrument volume
-			if ( Preferences::get_instance()->m_nJackTrackOutputMode == 0 ) {
+			if ( nTrackOutputMode == 0 ) {
 			// Post-Fader
 			cost_track_L = cost_L * 2;
 			}
@@ -470,7 +476,7 @@ bool Sampler::__render_note( Note* pNote, unsigned nBufferSize, Song* pSong )
 			cost_R = cost_R * pMainCompo->get_volume(); // Component volument
 
 			cost_R = cost_R * pInstr->get_volume();		// instrument volume
-			if ( Preferences::get_instance()->m_nJackTrackOutputMode == 0 ) {
+			if ( nTrackOutputMode == 0 ) {
 			// Post-Fader
 			cost_track_R = cost_R * 2;
 			}
@@ -479,7 +485,7 @@ bool Sampler::__render_note( Note* pNote, unsigned nBufferSize, Song* pSong )
 		}
 
 		// direct track outputs only use velocity
-		if ( Preferences::get_instance()->m_nJackTrackOutputMode == 1 ) {
+		if ( nTrackOutputMode == 1 ) {
 			cost_track_L = cost_track_L * pNote->get_velocity();
 			cost_track_L = cost_track_L * fLayerGain;
 			cost_track_R = cost_track_L;
@@ -493,13 +499,22 @@ bool Sampler::__render_note( Note* pNote, unsigned nBufferSize, Song* pSong )
 		float fTotalPitch = pNote->get_total_pitch() + fLayerPitch;
 
 		//_INFOLOG( "total pitch: " + to_string( fTotalPitch ) );
-		if( ( int )pSelectedLayer->SamplePosition == 0 )
+		if( ( pSelectedLayer->SamplePosition >> SAMPLE_POSITION_SHIFT ) == 0 && !__output )
 		{
 			if( Hydrogen::get_instance()->getMidiOutput() != NULL ){
 			Hydrogen::get_instance()->getMidiOutput()->handleQueueNote( pNote );
 			}
 		}
 
+		// the track of a voice is looked up once, and again when the output rebuilds its routing
+		if ( audio_output->has_track_outs() ) {
+			int nRouting = audio_output->get_track_routing();
+			if ( pSelectedLayer->TrackRouting != nRouting ) {
+				pSelectedLayer->TrackOut = audio_output->getTrackIndex( pInstr, pCompo );
+				pSelectedLayer->TrackRouting = nRouting;
+			}
+		}
+
 		if ( fTotalPitch == 0.0 && pSample->get_sample_rate() == audio_output->getSampleRate() ) // NO RESAMPLE
 			nReturnValues[nReturnValueIndex] = __render_note_no_resample( pSample, pNote, pSelectedLayer, pCompo, pMainCompo, nBufferSize, nInitialSilence, cost_L, cost_R, cost_track_L, cost_track_R, pSong );
 		else // RESAMPLE
@@ -512,6 +527,82 @@ bool Sampler::__render_note( Note* pNote, unsigned nBufferSize, Song* pSong )
 	return true;
 }
 
+void Sampler::__get_sample_data(
+	Sample *pSample,
+	SelectedLayerInfo *pSelectedLayerInfo,
+	int nFirst,
+	int nLast,
+	float **ppData_L,
+	float **ppData_R
+)
+{
+	if ( pSample->is_compact() ) {
+		// only the frames played within this cycle are converted to float
+		if ( nFirst < 0 ) {
+			nFirst = 0;
+		}
+		assert( nLast - nFirst <= STREAM_WINDOW_FRAMES );
+		if ( pSample->is_mono() ) {
+			// converted once, the render kernels see both channels pointing to it
+			pSample->read( nFirst, nLast - nFirst, __stream_window_L, NULL );
+			*ppData_L = *ppData_R = __stream_window_L - nFirst;
+			return;
+		}
+		pSample->read( nFirst, nLast - nFirst, __stream_window_L, __stream_window_R );
+		*ppData_L = __stream_window_L - nFirst;
+		*ppData_R = __stream_window_R - nFirst;
+		return;
+	}
+
+	if ( !pSample->is_streamed() ) {
+		*ppData_L = pSample->get_data_l();
+		*ppData_R = pSample->get_data_r();
+		return;
+	}
+
+	int nResident = pSample->get_resident_frames();
+	if ( nFirst < 0 ) {
+		nFirst = 0;
+	}
+	// claim the stream at the start of the voice, the disk reads run while the preloaded frames play
+	SampleStreamer* pStreamer = get_streamer();
+	if ( pSelectedLayerInfo->Stream == NULL && pStreamer ) {
+		pSelectedLayerInfo->Stream = pStreamer->acquire( pSample, std::max( nResident, nFirst ) );
+	}
+	if ( nLast <= nResident ) {
+		*ppData_L = pSample->get_data_l();
+		*ppData_R = pSample->get_data_r();
+		return;
+	}
+
+	int nCount = nLast - nFirst;
+	assert( nCount <= STREAM_WINDOW_FRAMES );
+	int nCopied = 0;
+	if ( nFirst < nResident ) {
+		nCopied = nResident - nFirst;
+		memcpy( __stream_window_L, pSample->get_data_l() + nFirst, nCopied * sizeof( float ) );
+		memcpy( __stream_window_R, pSample->get_data_r() + nFirst, nCopied * sizeof( float ) );
+	}
+
+	int nMissing = 0;
+	if ( pSelectedLayerInfo->Stream ) {
+		nMissing = pSelectedLayerInfo->Stream->read( nFirst + nCopied, nCount - nCopied, __stream_window_L + nCopied, __stream_window_R + nCopied );
+		pSelectedLayerInfo->Stream->consume( nFirst );
+	} else {
+		// no stream left, the voice goes silent past the preloaded frames
+		memset( __stream_window_L + nCopied, 0, ( nCount - nCopied ) * sizeof( float ) );
+		memset( __stream_window_R + nCopied, 0, ( nCount - nCopied ) * sizeof( float ) );
+		nMissing = nCount - nCopied;
+	}
+	if ( nMissing > 0 && pStreamer ) {
+		pStreamer->add_underruns( nMissing );
+	}
+
+	// index the window by sample frame
+	*ppData_L = __stream_window_L - nFirst;
+	*ppData_R = __stream_window_R - nFirst;
+}
+
 bool Sampler::__render_note_no_resample(
 	Sample *pSample,
 	Note *pNote,
@@ -527,7 +618,7 @@ bool Sampler::__render_note_no_resample(
 	Song* pSong
 )
 {
-	AudioOutput* pAudioOutput = Hydrogen::get_instance()->getAudioOutput();
+	AudioOutput* pAudioOutput = __get_output();
 	bool retValue = true; // the note is ended
 
 	int nNoteLength = -1;
@@ -535,7 +626,8 @@ bool Sampler::__render_note_no_resample(
 		nNoteLength = ( int )( pNote->get_length() * pAudioOutput->m_transport.m_nTickSize );
 	}
 
-	int nAvail_bytes = pSample->get_frames() - ( int )pSelectedLayerInfo->SamplePosition;	// verifico il numero di frame disponibili ancora da eseguire
+	int nInitialSamplePos = ( int )( pSelectedLayerInfo->SamplePosition >> SAMPLE_POSITION_SHIFT );
+	int nAvail_bytes = pSample->get_frames() - nInitialSamplePos;	// verifico il numero di frame disponibili ancora da eseguire
 
 	if ( nAvail_bytes > nBufferSize - nInitialSilence ) {	// il sample e' piu' grande del buffersize
 		// imposto il numero dei bytes disponibili uguale al buffersize
@@ -547,12 +639,12 @@ bool Sampler::__render_note_no_resample(
 	//ADSR *pADSR = pNote->m_pADSR;
 
 	int nInitialBufferPos = nInitialSilence;
-	int nInitialSamplePos = ( int )pSelectedLayerInfo->SamplePosition;
 	int nSamplePos = nInitialSamplePos;
 	int nTimes = nInitialBufferPos + nAvail_bytes;
 
-	float *pSample_data_L = pSample->get_data_l();
-	float *pSample_data_R = pSample->get_data_r();
+	float *pSample_data_L;
+	float *pSample_data_R;
+	__get_sample_data( pSample, pSelectedLayerInfo, nInitialSamplePos, nInitialSamplePos + nAvail_bytes, &pSample_data_L, &pSample_data_R );
 
 	float fInstrPeak_L = pNote->get_instrument()->get_peak_l(); // this value will be reset to 0 by the mixer..
 	float fInstrPeak_R = pNote->get_instrument()->get_peak_r(); // this value will be reset to 0 by the mixer..
@@ -560,44 +652,46 @@ bool Sampler::__render_note_no_resample(
 	float fADSRValue;
 	float fVal_L;
 	float fVal_R;
+	bool bMono = ( pSample_data_R == pSample_data_L );
 
 
-#ifdef H2CORE_HAVE_JACK
-	JackAudioDriver* pJackAudioDriver = 0;
 	float *		pTrackOutL = 0;
 	float *		pTrackOutR = 0;
 
-	if( pAudioOutput->has_track_outs()
-	&& (pJackAudioDriver = dynamic_cast<JackAudioDriver*>(pAudioOutput)) ) {
-		 pTrackOutL = pJackAudioDriver->getTrackOut_L( pNote->get_instrument(), pCompo );
-		pTrackOutR = pJackAudioDriver->getTrackOut_R( pNote->get_instrument(), pCompo );
+	if( pAudioOutput->has_track_outs() ) {
+		pTrackOutL = pAudioOutput->getTrackBuffer_L( pSelectedLayerInfo->TrackOut );
+		pTrackOutR = pAudioOutput->getTrackBuffer_R( pSelectedLayerInfo->TrackOut );
 	}
-#endif
 
 	for ( int nBufferPos = nInitialBufferPos; nBufferPos < nTimes; ++nBufferPos ) {
-		if ( ( nNoteLength != -1 ) && ( nNoteLength <= pSelectedLayerInfo->SamplePosition ) ) {
+		if ( ( nNoteLength != -1 ) && ( nNoteLength <= nInitialSamplePos ) ) {
 						if ( pNote->get_adsr()->release() == 0 ) {
 				retValue = true;	// the note is ended
 			}
 		}
 
 		fADSRValue = pNote->get_adsr()->get_value( 1 );
-		fVal_L = pSample_data_L[ nSamplePos ] * fADSRValue;
-		fVal_R = pSample_data_R[ nSamplePos ] * fADSRValue;
+		__voice_buffer_L[ nBufferPos ] = pSample_data_L[ nSamplePos ] * fADSRValue;
+		__voice_buffer_R[ nBufferPos ] = bMono ? __voice_buffer_L[ nBufferPos ] : pSample_data_R[ nSamplePos ] * fADSRValue;
 
-		// Low pass resonant filter
-		if ( pNote->get_instrument()->is_filter_active() ) {
-			pNote->compute_lr_values( &fVal_L, &fVal_R );
-		}
+		++nSamplePos;
+	}
+
+	// Low pass resonant filter
+	if ( pNote->get_instrument()->is_filter_active() ) {
+		pNote->filter_block( __voice_buffer_L, __voice_buffer_R, nInitialBufferPos, nAvail_bytes, nBufferSize );
+	}
+
+	for ( int nBufferPos = nInitialBufferPos; nBufferPos < nTimes; ++nBufferPos ) {
+		fVal_L = __voice_buffer_L[ nBufferPos ];
+		fVal_R = __voice_buffer_R[ nBufferPos ];
 
-#ifdef H2CORE_HAVE_JACK
-		if(  pTrackOutL ) {
-			 pTrackOutL[nBufferPos] += fVal_L * cost_track_L;
+		if( pTrackOutL ) {
+			pTrackOutL[nBufferPos] += fVal_L * cost_track_L;
 		}
 		if( pTrackOutR ) {
 			pTrackOutR[nBufferPos] += fVal_R * cost_track_R;
 		}
-#endif
 
 		fVal_L = fVal_L * cost_L;
 		fVal_R = fVal_R * cost_R;
@@ -615,10 +709,8 @@ bool Sampler::__render_note_no_resample(
 		// to main mix
 		__main_out_L[nBufferPos] += fVal_L;
 		__main_out_R[nBufferPos] += fVal_R;
-
-		++nSamplePos;
 	}
-	pSelectedLayerInfo->SamplePosition += nAvail_bytes;
+	pSelectedLayerInfo->SamplePosition += ( sample_position_t )nAvail_bytes << SAMPLE_POSITION_SHIFT;
 	pNote->get_instrument()->set_peak_l( fInstrPeak_L );
 	pNote->get_instrument()->set_peak_r( fInstrPeak_R );
 
@@ -626,7 +718,7 @@ bool Sampler::__render_note_no_resample(
 #ifdef H2CORE_HAVE_LADSPA
 		float masterVol =  pSong->get_volume();
 	// LADSPA
-	for ( unsigned nFX = 0; nFX < MAX_FX; ++nFX ) {
+	for ( unsigned nFX = 0; nFX < MAX_FX && !__output; ++nFX ) {
 		LadspaFX *pFX = Effects::get_instance()->getLadspaFX( nFX );
 
 		float fLevel = pNote->get_instrument()->get_fx_level( nFX );
@@ -673,7 +765,7 @@ bool Sampler::__render_note_resample(
 	Song* pSong
 )
 {
-	AudioOutput* pAudioOutput = Hydrogen::get_instance()->getAudioOutput();
+	AudioOutput* pAudioOutput = __get_output();
 
 	int nNoteLength = -1;
 	if ( pNote->get_length() != -1 ) {
@@ -685,26 +777,51 @@ bool Sampler::__render_note_resample(
 //	_ERRORLOG( QString("pitch: %1, step: %2" ).arg(fNotePitch).arg( fStep) );
 	fStep *= ( float )pSample->get_sample_rate() / pAudioOutput->getSampleRate(); // Adjust for audio driver sample rate
 
-	// verifico il numero di frame disponibili ancora da eseguire
-	int nAvail_bytes = ( int )( ( float )( pSample->get_frames() - pSelectedLayerInfo->SamplePosition ) / fStep );
+	// the position advances by a fixed point step, so it never drifts between cycles
+	sample_position_t nStep = ( sample_position_t )( ( double )fStep * SAMPLE_POSITION_ONE + 0.5 );
+	if ( nStep == 0 ) {
+		nStep = 1;
+	}
+	sample_position_t nInitialPosition = pSelectedLayerInfo->SamplePosition;
+	sample_position_t nEndPosition = ( sample_position_t )pSample->get_frames() << SAMPLE_POSITION_SHIFT;
 
+	// verifico il numero di frame disponibili ancora da eseguire
+	sample_position_t nAvail = 0;
+	if ( nEndPosition > nInitialPosition ) {
+		nAvail = ( nEndPosition - nInitialPosition ) / nStep;
+	}
 
 	bool retValue = true; // the note is ended
-	if ( nAvail_bytes > nBufferSize - nInitialSilence ) {	// il sample e' piu' grande del buffersize
+	int nAvail_bytes;
+	if ( nAvail > ( sample_position_t )( nBufferSize - nInitialSilence ) ) {	// il sample e' piu' grande del buffersize
 		// imposto il numero dei bytes disponibili uguale al buffersize
 		nAvail_bytes = nBufferSize - nInitialSilence;
 		retValue = false; // the note is not ended yet
+	} else {
+		nAvail_bytes = ( int )nAvail;
+	}
+
+	if ( pSample->is_streamed() || pSample->is_compact() ) {
+		// the frames read within this cycle have to fit in the stream window
+		int nMaxAvail = ( int )( ( ( sample_position_t )( STREAM_WINDOW_FRAMES - 4 ) << SAMPLE_POSITION_SHIFT ) / nStep );
+		if ( nAvail_bytes > nMaxAvail ) {
+			nAvail_bytes = nMaxAvail;
+			retValue = false;
+		}
 	}
 
 	//	ADSR *pADSR = pNote->m_pADSR;
 
 	int nInitialBufferPos = nInitialSilence;
-	//float fInitialSamplePos = pNote->get_sample_position( pCompo->get_drumkit_componentID() );
-	double fSamplePos = pSelectedLayerInfo->SamplePosition;
+	int nInitialSamplePos = ( int )( nInitialPosition >> SAMPLE_POSITION_SHIFT );
+	sample_position_t nPosition = nInitialPosition;
 	int nTimes = nInitialBufferPos + nAvail_bytes;
 
-	float *pSample_data_L = pSample->get_data_l();
-	float *pSample_data_R = pSample->get_data_r();
+	// interpolation reads one frame before and two frames after the position
+	int nLastSamplePos = ( int )( ( nInitialPosition + ( sample_position_t )nAvail_bytes * nStep ) >> SAMPLE_POSITION_SHIFT );
+	float *pSample_data_L;
+	float *pSample_data_R;
+	__get_sample_data( pSample, pSelectedLayerInfo, nInitialSamplePos - 1, std::min( nLastSamplePos + 3, pSample->get_frames() ), &pSample_data_L, &pSample_data_R );
 
 	float fInstrPeak_L = pNote->get_instrument()->get_peak_l(); // this value will be reset to 0 by the mixer..
 	float fInstrPeak_R = pNote->get_instrument()->get_peak_r(); // this value will be reset to 0 by the mixer..
@@ -713,92 +830,63 @@ bool Sampler::__render_note_resample(
 	float fVal_L;
 	float fVal_R;
 	int nSampleFrames = pSample->get_frames();
+	bool bMono = ( pSample_data_R == pSample_data_L );
 
 
-#ifdef H2CORE_HAVE_JACK
-	JackAudioDriver* pJackAudioDriver = 0;
 	float *		pTrackOutL = 0;
 	float *		pTrackOutR = 0;
 
-	if( pAudioOutput->has_track_outs()
-	&& (pJackAudioDriver = dynamic_cast<JackAudioDriver*>(pAudioOutput)) ) {
-				pTrackOutL = pJackAudioDriver->getTrackOut_L( pNote->get_instrument(), pCompo );
-				pTrackOutR = pJackAudioDriver->getTrackOut_R( pNote->get_instrument(), pCompo );
+	if( pAudioOutput->has_track_outs() ) {
+		pTrackOutL = pAudioOutput->getTrackBuffer_L( pSelectedLayerInfo->TrackOut );
+		pTrackOutR = pAudioOutput->getTrackBuffer_R( pSelectedLayerInfo->TrackOut );
 	}
-#endif
 
 	for ( int nBufferPos = nInitialBufferPos; nBufferPos < nTimes; ++nBufferPos ) {
-		if ( ( nNoteLength != -1 ) && ( nNoteLength <= pSelectedLayerInfo->SamplePosition ) ) {
+		if ( ( nNoteLength != -1 ) && ( nNoteLength <= nInitialSamplePos ) ) {
 						if ( pNote->get_adsr()->release() == 0 ) {
 				retValue = 1;	// the note is ended
 			}
 		}
 
-		int nSamplePos = ( int )fSamplePos;
-		double fDiff = fSamplePos - nSamplePos;
+		int nSamplePos = ( int )( nPosition >> SAMPLE_POSITION_SHIFT );
+		double fDiff = ( nPosition & SAMPLE_POSITION_MASK ) * ( 1.0 / SAMPLE_POSITION_ONE );
 		if ( ( nSamplePos + 1 ) >= nSampleFrames ) {
 			//we reach the last audioframe.
 			//set this last frame to zero do nothin wrong.
-						fVal_L = 0.0;
-						fVal_R = 0.0;
+			fVal_L = 0.0;
+			fVal_R = 0.0;
+		} else if ( bMono ) {
+			// a mono sample is interpolated once, the mix below pans it
+			fVal_L = __interpolate( pSample_data_L, nSamplePos, fDiff, nSampleFrames );
+			fVal_R = fVal_L;
 		} else {
-			// some interpolation methods need 4 frames data.
-				float last_l;
-				float last_r;
-				if ( ( nSamplePos + 2 ) >= nSampleFrames ) {
-					last_l = 0.0;
-					last_r = 0.0;
-				} else {
-					last_l =  pSample_data_L[nSamplePos + 2];
-					last_r =  pSample_data_R[nSamplePos + 2];
-				}
-
-				switch( __interpolateMode ){
-
-						case LINEAR:
-								fVal_L = pSample_data_L[nSamplePos] * (1 - fDiff ) + pSample_data_L[nSamplePos + 1] * fDiff;
-								fVal_R = pSample_data_R[nSamplePos] * (1 - fDiff ) + pSample_data_R[nSamplePos + 1] * fDiff;
-								//fVal_L = linear_Interpolate( pSample_data_L[nSamplePos], pSample_data_L[nSamplePos + 1], fDiff);
-								//fVal_R = linear_Interpolate( pSample_data_R[nSamplePos], pSample_data_R[nSamplePos + 1], fDiff);
-								break;
-						case COSINE:
-								fVal_L = cosine_Interpolate( pSample_data_L[nSamplePos], pSample_data_L[nSamplePos + 1], fDiff);
-								fVal_R = cosine_Interpolate( pSample_data_R[nSamplePos], pSample_data_R[nSamplePos + 1], fDiff);
-								break;
-						case THIRD:
-								fVal_L = third_Interpolate( pSample_data_L[ nSamplePos -1], pSample_data_L[nSamplePos], pSample_data_L[nSamplePos + 1], last_l, fDiff);
-								fVal_R = third_Interpolate( pSample_data_R[ nSamplePos -1], pSample_data_R[nSamplePos], pSample_data_R[nSamplePos + 1], last_r, fDiff);
-								break;
-						case CUBIC:
-								fVal_L = cubic_Interpolate( pSample_data_L[ nSamplePos -1], pSample_data_L[nSamplePos], pSample_data_L[nSamplePos + 1], last_l, fDiff);
-								fVal_R = cubic_Interpolate( pSample_data_R[ nSamplePos -1], pSample_data_R[nSamplePos], pSample_data_R[nSamplePos + 1], last_r, fDiff);
-								break;
-						case HERMITE:
-								fVal_L = hermite_Interpolate( pSample_data_L[ nSamplePos -1], pSample_data_L[nSamplePos], pSample_data_L[nSamplePos + 1], last_l, fDiff);
-								fVal_R = hermite_Interpolate( pSample_data_R[ nSamplePos -1], pSample_data_R[nSamplePos], pSample_data_R[nSamplePos + 1], last_r, fDiff);
-								break;
-				}
+			fVal_L = __interpolate( pSample_data_L, nSamplePos, fDiff, nSampleFrames );
+			fVal_R = __interpolate( pSample_data_R, nSamplePos, fDiff, nSampleFrames );
 		}
 
 		// ADSR envelope
 		fADSRValue = pNote->get_adsr()->get_value( fStep );
-		fVal_L = fVal_L * fADSRValue;
-		fVal_R = fVal_R * fADSRValue;
-		// Low pass resonant filter
-		if ( pNote->get_instrument()->is_filter_active() ) {
-			pNote->compute_lr_values( &fVal_L, &fVal_R );
-		}
+		__voice_buffer_L[ nBufferPos ] = fVal_L * fADSRValue;
+		__voice_buffer_R[ nBufferPos ] = fVal_R * fADSRValue;
 
+		nPosition += nStep;
+	}
 
+	// Low pass resonant filter
+	if ( pNote->get_instrument()->is_filter_active() ) {
+		pNote->filter_block( __voice_buffer_L, __voice_buffer_R, nInitialBufferPos, nAvail_bytes, nBufferSize );
+	}
+
+	for ( int nBufferPos = nInitialBufferPos; nBufferPos < nTimes; ++nBufferPos ) {
+		fVal_L = __voice_buffer_L[ nBufferPos ];
+		fVal_R = __voice_buffer_R[ nBufferPos ];
 
-#ifdef H2CORE_HAVE_JACK
-		if( 		pTrackOutL ) {
-					pTrackOutL[nBufferPos] += fVal_L * cost_track_L;
+		if( pTrackOutL ) {
+			pTrackOutL[nBufferPos] += fVal_L * cost_track_L;
 		}
-		if( 		pTrackOutR ) {
-					pTrackOutR[nBufferPos] += fVal_R * cost_track_R;
+		if( pTrackOutR ) {
+			pTrackOutR[nBufferPos] += fVal_R * cost_track_R;
 		}
-#endif
 
 		fVal_L = fVal_L * cost_L;
 		fVal_R = fVal_R * cost_R;
@@ -816,10 +904,8 @@ bool Sampler::__render_note_resample(
 		// to main mix
 		__main_out_L[nBufferPos] += fVal_L;
 		__main_out_R[nBufferPos] += fVal_R;
-
-		fSamplePos += fStep;
 	}
-	pSelectedLayerInfo->SamplePosition += nAvail_bytes * fStep;
+	pSelectedLayerInfo->SamplePosition = nPosition;
 	pNote->get_instrument()->set_peak_l( fInstrPeak_L );
 	pNote->get_instrument()->set_peak_r( fInstrPeak_R );
 
@@ -828,7 +914,7 @@ bool Sampler::__render_note_resample(
 #ifdef H2CORE_HAVE_LADSPA
 	// LADSPA
 	float masterVol = pSong->get_volume();
-	for ( unsigned nFX = 0; nFX < MAX_FX; ++nFX ) {
+	for ( unsigned nFX = 0; nFX < MAX_FX && !__output; ++nFX ) {
 		LadspaFX *pFX = Effects::get_instance()->getLadspaFX( nFX );
 		float fLevel = pNote->get_instrument()->get_fx_level( nFX );
 		if ( ( pFX ) && ( fLevel != 0.0 ) ) {
@@ -843,10 +929,10 @@ bool Sampler::__render_note_resample(
 			float fFXCost_R = fLevel * masterVol;
 
 			int nBufferPos = nInitialBufferPos;
-			float fSamplePos = pSelectedLayerInfo->SamplePosition;
+			sample_position_t nPosition = nInitialPosition;
 			for ( int i = 0; i < nAvail_bytes; ++i ) {
-				int nSamplePos = ( int )fSamplePos;
-				double fDiff = fSamplePos - nSamplePos;
+				int nSamplePos = ( int )( nPosition >> SAMPLE_POSITION_SHIFT );
+				double fDiff = ( nPosition & SAMPLE_POSITION_MASK ) * ( 1.0 / SAMPLE_POSITION_ONE );
 
 				if ( ( nSamplePos + 1 ) >= nSampleFrames ) {
 					//we reach the last audioframe.
@@ -854,46 +940,13 @@ bool Sampler::__render_note_resample(
 					fVal_L = 0.0;
 					fVal_R = 0.0;
 				} else {
-					// some interpolation methods need 4 frames data.
-					float last_l;
-					float last_r;
-					if ( ( nSamplePos + 2 ) >= nSampleFrames ) {
-						last_l = 0.0;
-						last_r = 0.0;
-					}else
-					{
-						last_l =  pSample_data_L[nSamplePos + 2];
-						last_r =  pSample_data_R[nSamplePos + 2];
-					}
-
-					switch( __interpolateMode ){
-
-					case LINEAR:
-						fVal_L = pSample_data_L[nSamplePos] * (1 - fDiff ) + pSample_data_L[nSamplePos + 1] * fDiff;
-						fVal_R = pSample_data_R[nSamplePos] * (1 - fDiff ) + pSample_data_R[nSamplePos + 1] * fDiff;
-						break;
-					case COSINE:
-						fVal_L = cosine_Interpolate( pSample_data_L[nSamplePos], pSample_data_L[nSamplePos + 1], fDiff);
-						fVal_R = cosine_Interpolate( pSample_data_R[nSamplePos], pSample_data_R[nSamplePos + 1], fDiff);
-						break;
-					case THIRD:
-						fVal_L = third_Interpolate( pSample_data_L[ nSamplePos -1], pSample_data_L[nSamplePos], pSample_data_L[nSamplePos + 1], last_l, fDiff);
-						fVal_R = third_Interpolate( pSample_data_R[ nSamplePos -1], pSample_data_R[nSamplePos], pSample_data_R[nSamplePos + 1], last_r, fDiff);
-						break;
-					case CUBIC:
-						fVal_L = cubic_Interpolate( pSample_data_L[ nSamplePos -1], pSample_data_L[nSamplePos], pSample_data_L[nSamplePos + 1], last_l, fDiff);
-						fVal_R = cubic_Interpolate( pSample_data_R[ nSamplePos -1], pSample_data_R[nSamplePos], pSample_data_R[nSamplePos + 1], last_r, fDiff);
-						break;
-					case HERMITE:
-						fVal_L = hermite_Interpolate( pSample_data_L[ nSamplePos -1], pSample_data_L[nSamplePos], pSample_data_L[nSamplePos + 1], last_l, fDiff);
-						fVal_R = hermite_Interpolate( pSample_data_R[ nSamplePos -1], pSample_data_R[nSamplePos], pSample_data_R[nSamplePos + 1], last_r, fDiff);
-						break;
-					}
+					fVal_L = __interpolate( pSample_data_L, nSamplePos, fDiff, nSampleFrames );
+					fVal_R = bMono ? fVal_L : __interpolate( pSample_data_R, nSamplePos, fDiff, nSampleFrames );
 				}
 
 				pBuf_L[ nBufferPos ] += fVal_L * fFXCost_L;
-								pBuf_R[ nBufferPos ] += fVal_R * fFXCost_R;
-				fSamplePos += fStep;
+				pBuf_R[ nBufferPos ] += fVal_R * fFXCost_R;
+				nPosition += nStep;
 				++nBufferPos;
 			}
 		}
@@ -930,6 +983,20 @@ void Sampler::stop_playing_notes( Instrument* instrument )
 
 
 
+void Sampler::retire_notes( Instrument* instr, Instrument* retired )
+{
+	for ( unsigned i = 0; i < __playing_notes_queue.size(); ++i ) {
+		Note *pNote = __playing_notes_queue[ i ];
+		if ( pNote->get_instrument() == instr ) {
+			pNote->set_instrument( retired );
+			instr->dequeue();
+			retired->enqueue();
+		}
+	}
+}
+
+
+
 /// Preview, uses only the first layer
 void Sampler::preview_sample( Sample* sample, int length )
 {
@@ -35,7 +35,8 @@ namespace H2Core
 	void Timeline::sortTimelineVector()
 	{
 		//sort the timeline vector to beats a < b
-		sort(m_timelinevector.begin(), m_timelinevector.end(), TimelineComparator());
+		//markers on the same tick keep their order, the last one wins
+		stable_sort(m_timelinevector.begin(), m_timelinevector.end(), TimelineComparator());
 	}
 
 	void Timeline::sortTimelineTagVector()
@@ -42,6 +42,7 @@ class EventListener
 		virtual void jacksessionEvent( int nValue) { UNUSED( nValue ); }
 		virtual void playlistLoadSongEvent( int nIndex ){ UNUSED( nIndex ); }
 		virtual void undoRedoActionEvent( int nValue ){ UNUSED( nValue ); }
+		virtual void drumkitLoadedEvent() {}
 
 		virtual ~EventListener() {}
 };
@@ -42,10 +42,12 @@
 #include <hydrogen/Preferences.h>
 #include <hydrogen/timeline.h>
 #include <hydrogen/IO/AudioOutput.h>
+#include <hydrogen/IO/OfflineRenderer.h>
 #include <hydrogen/audio_engine.h>
 #include <hydrogen/sampler/Sampler.h>
 #include <hydrogen/event_queue.h>
 
+#include <algorithm>
 #include <memory>
 
 #ifdef WIN32
@@ -60,6 +62,7 @@ ExportSongDialog::ExportSongDialog(QWidget* parent)
 	: QDialog(parent)
 	, Object( __class_name )
 	, m_bExporting( false )
+	, m_pRenderer( NULL )
 {
 	setupUi( this );
 	setModal( true );
@@ -129,6 +132,7 @@ ExportSongDialog::ExportSongDialog(QWidget* parent)
 ExportSongDialog::~ExportSongDialog()
 {
 	HydrogenApp::get_instance()->removeEventListener( this );
+	delete m_pRenderer;
 }
 
 
@@ -226,20 +230,72 @@ void ExportSongDialog::on_okBtn_clicked()
 
 		}
 
-		if( exportTypeCombo->currentIndex() == 2 ) m_bExportTrackouts = true;
-		Hydrogen::get_instance()->startExportSong( filename, sampleRateCombo->currentText().toInt(), sampleDepthCombo->currentText().toInt() );
+		startExport( filename, true, exportTypeCombo->currentIndex() == 2 );
 
 		return;
 	}
 
 	if( exportTypeCombo->currentIndex() == 1 ){
-		m_bExportTrackouts = true;
-		exportTracks();
+		startExport( exportNameTxt->text(), false, true );
 		return;
 	}
 
 }
 
+void ExportSongDialog::startExport( const QString& sFilename, bool bMaster, bool bTracks )
+{
+	Hydrogen* pHydrogen = Hydrogen::get_instance();
+	Song* pSong = pHydrogen->getSong();
+	int nSampleRate = sampleRateCombo->currentText().toInt();
+	int nSampleDepth = sampleDepthCombo->currentText().toInt();
+
+	delete m_pRenderer;
+	m_pRenderer = NULL;
+	m_pProgressBar->setFormat( "%p%" );
+
+	// the LADSPA effects only run within the audio engine, which the disk writer takes over,
+	// the tracks are then rendered one after the other by soloing each instrument
+	if ( OfflineRenderer::uses_effects( pSong ) ) {
+		m_bExportTrackouts = bTracks;
+		if ( bMaster ) {
+			pHydrogen->startExportSong( sFilename, nSampleRate, nSampleDepth );
+		} else {
+			exportTracks();
+		}
+		return;
+	}
+	m_bExportTrackouts = false;
+
+	OfflineRenderer::Options options;
+	options.m_nSampleRate = nSampleRate;
+	options.m_nBufferSize = Preferences::get_instance()->m_nBufferSize;
+	options.m_bUseTimelineBpm = Preferences::get_instance()->getUseTimelineBpm();
+	options.m_interpolation = AudioEngine::get_instance()->get_sampler()->getInterpolateMode();
+	options.m_stems = bTracks ? OfflineRenderer::INSTRUMENT_STEMS : OfflineRenderer::NO_STEMS;
+	options.m_bMaster = bMaster;
+	m_pRenderer = new OfflineRenderer( pSong, options );
+
+	if ( bTracks && b_QfileDialog == false && !m_bOverwriteFiles ) {
+		QStringList filenames = m_pRenderer->get_stem_filenames( sFilename );
+		for ( int i = 0; i < filenames.size(); i++ ) {
+			if ( QFile( filenames[i] ).exists() == false ) continue;
+			int res = QMessageBox::information( this, "Hydrogen", tr( "The file %1 exists. \nOverwrite the existing file?").arg(filenames[i]), QMessageBox::Yes | QMessageBox::No | QMessageBox::YesToAll );
+			if (res == QMessageBox::No ) {
+				delete m_pRenderer;
+				m_pRenderer = NULL;
+				return;
+			}
+			if (res == QMessageBox::YesToAll ) {
+				m_bOverwriteFiles = true;
+				break;
+			}
+		}
+	}
+
+	m_bExporting = true;
+	m_pRenderer->start( sFilename, nSampleDepth );
+}
+
 void ExportSongDialog::exportTracks()
 {
 	Song *pSong = Hydrogen::get_instance()->getSong();
@@ -308,6 +364,8 @@ void ExportSongDialog::exportTracks()
 
 void ExportSongDialog::on_closeBtn_clicked()
 {
+	delete m_pRenderer;	// stops a running render
+	m_pRenderer = NULL;
 	Hydrogen::get_instance()->stopExportSong( true );
 	m_bExporting = false;
 	if(Preferences::get_instance()->getRubberBandBatchMode()){
@@ -487,6 +545,17 @@ void ExportSongDialog::progressEvent( int nValue )
 
 		m_bExporting = false;
 
+		if ( m_pRenderer ) {
+			m_pRenderer->wait();
+			if ( m_pRenderer->succeeded() ) {
+				m_pProgressBar->setFormat( trUtf8( "%p% (%1x realtime)" ).arg( m_pRenderer->get_report().m_fSpeed, 0, 'f', 1 ) );
+			} else {
+				ERRORLOG( "the export failed" );
+			}
+			delete m_pRenderer;
+			m_pRenderer = NULL;
+		}
+
 		if( m_nInstrument == Hydrogen::get_instance()->getSong()->get_instrument_list()->size() -1 ){
 			HydrogenApp::get_instance()->getMixer()->unmuteAll( false );
 			m_nInstrument = 0;
@@ -559,64 +628,22 @@ void ExportSongDialog::calculateRubberbandTime()
 	Hydrogen* pHydrogen = Hydrogen::get_instance();
 	Timeline* pTimeline = pHydrogen->getTimeline();
 
-	float oldBPM = pHydrogen->getSong()->__bpm;
-	float lowBPM = oldBPM;
-
-	if( pTimeline->m_timelinevector.size() >= 1 ){
-		for ( int t = 0; t < pTimeline->m_timelinevector.size(); t++){
-			if(pTimeline->m_timelinevector[t].m_htimelinebpm < lowBPM){
-				lowBPM =  pTimeline->m_timelinevector[t].m_htimelinebpm;
-			}
-
-		}
-	}
-
-	pHydrogen->setBPM(lowBPM);
+	// stretch the samples to every tempo of the timeline ahead of the export,
+	// which then swaps them in at each tempo change without waiting
 	time_t sTime = time(NULL);
-	Hydrogen *pEngine = Hydrogen::get_instance();
-	Song *song = pEngine->getSong();
-	assert(song);
-	if(song){
-		InstrumentList *songInstrList = song->get_instrument_list();
-		assert(songInstrList);
-		for ( unsigned nInstr = 0; nInstr < songInstrList->size(); ++nInstr ) {
-			Instrument *pInstr = songInstrList->get( nInstr );
-			assert( pInstr );
-			if ( pInstr ){
-                for (std::vector<InstrumentComponent*>::iterator it = pInstr->get_components()->begin() ; it != pInstr->get_components()->end(); ++it) {
-                    InstrumentComponent* pCompo = *it;
-                    for ( int nLayer = 0; nLayer < MAX_LAYERS; nLayer++ ) {
-                        InstrumentLayer *pLayer = pCompo->get_layer( nLayer );
-                        if ( pLayer ) {
-                            Sample *pSample = pLayer->get_sample();
-                            if ( pSample ) {
-                                if( pSample->get_rubberband().use ) {
-                                    Sample *newSample = Sample::load(
-                                                pSample->get_filepath(),
-                                                pSample->get_loops(),
-                                                pSample->get_rubberband(),
-                                                *pSample->get_velocity_envelope(),
-                                                *pSample->get_pan_envelope()
-                                                );
-                                    if( !newSample  ){
-                                        continue;
-                                    }
-                                    delete pSample;
-                                    // insert new sample from newInstrument
-                                    AudioEngine::get_instance()->lock( RIGHT_HERE );
-                                    pLayer->set_sample( newSample );
-                                    AudioEngine::get_instance()->unlock();
-
-                                }
-                            }
-						}
-					}
-				}
-			}
+	std::vector<float> tempos;
+	for ( int t = 0; t < pTimeline->m_timelinevector.size(); t++){
+		float fBpm = pTimeline->m_timelinevector[t].m_htimelinebpm;
+		if ( std::find( tempos.begin(), tempos.end(), fBpm ) == tempos.end() ) {
+			tempos.push_back( fBpm );
 		}
 	}
+	for ( int i = 0; i < tempos.size(); i++ ) {
+		pHydrogen->stretchRubberbandSamples( tempos[i] );
+	}
+	pHydrogen->stretchRubberbandSamples( pHydrogen->getNewBpmJTM() );
 	Preferences::get_instance()->setRubberBandCalcTime(time(NULL) - sTime);
-	pHydrogen->setBPM(oldBPM);
+
 	closeBtn->setEnabled(true);
 	resampleComboBox->setEnabled(true);
 	okBtn->setEnabled(true);
@@ -29,6 +29,11 @@
 #include "EventListener.h"
 #include <hydrogen/object.h>
 
+namespace H2Core
+{
+	class OfflineRenderer;
+}
+
 ///
 /// Dialog for exporting song
 ///
@@ -63,6 +68,8 @@ private:
 	bool checkUseOfRubberband();
 
 	bool m_bExporting;
+	/// Render the song into a file and/or a file per instrument, in the background.
+	void startExport( const QString& sFilename, bool bMaster, bool bTracks );
 	void exportTracks();
 	bool m_bExportTrackouts;
 	bool m_bOverwriteFiles;
@@ -71,6 +78,7 @@ private:
 	bool b_oldRubberbandBatchMode;
 	bool b_oldTimeLineBPMMode;
 	int m_oldInterpolation;
+	H2Core::OfflineRenderer* m_pRenderer;
 
 };
 
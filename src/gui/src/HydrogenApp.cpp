@@ -528,6 +528,10 @@ void HydrogenApp::onEventQueueTimer()
 				pListener->undoRedoActionEvent( event.value );
 				break;
 
+			case EVENT_DRUMKIT_LOADED:
+				pListener->drumkitLoadedEvent();
+				break;
+
 			default:
 				ERRORLOG( QString("[onEventQueueTimer] Unhandled event: %1").arg( event.type ) );
 			}
@@ -987,6 +987,7 @@ void InstrumentEditor::setAutoVelocity()
 			}
 		}
 	}
+	m_pInstrument->get_component(m_nSelectedComponent)->update_layer_table();
 }
 
 void InstrumentEditor::labelCompoClicked( ClickableLabel* pRef )
@@ -1341,46 +1342,7 @@ void InstrumentEditor::rubberbandbpmchangeEvent()
 	}
 	//	INFOLOG( "Tempo change: Recomputing rubberband samples." );
 	Hydrogen *pEngine = Hydrogen::get_instance();
-	Song *song = pEngine->getSong();
-	assert(song);
-	if(song){
-		InstrumentList *songInstrList = song->get_instrument_list();
-		assert(songInstrList);
-		for ( unsigned nInstr = 0; nInstr < songInstrList->size(); ++nInstr ) {
-			Instrument *pInstr = songInstrList->get( nInstr );
-			assert( pInstr );
-			if ( pInstr ){
-				for ( int nLayer = 0; nLayer < MAX_LAYERS; nLayer++ ) {
-					InstrumentLayer *pLayer = pInstr->get_component(m_nSelectedComponent)->get_layer( nLayer );
-					if ( pLayer ) {
-						Sample *pSample = pLayer->get_sample();
-						if ( pSample ) {
-							if( pSample->get_rubberband().use ) {
-								//INFOLOG( QString("Instrument %1 Layer %2" ).arg(nInstr).arg(nLayer));
-								Sample *newSample = Sample::load(
-														pSample->get_filepath(),
-														pSample->get_loops(),
-														pSample->get_rubberband(),
-														*pSample->get_velocity_envelope(),
-														*pSample->get_pan_envelope()
-														);
-								if( !newSample  ){
-									continue;
-								}
-								delete pSample;
-								// insert new sample from newInstrument
-								AudioEngine::get_instance()->lock( RIGHT_HERE );
-								pLayer->set_sample( newSample );
-								AudioEngine::get_instance()->unlock();
-
-							}
-						}
-					}
-				}
-			}
-		}
-	}
-
+	pEngine->stretchRubberbandSamples( pEngine->getNewBpmJTM() );
 }
 
 void InstrumentEditor::pSampleSelectionChanged( QString selected )
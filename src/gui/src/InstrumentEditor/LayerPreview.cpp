@@ -361,6 +361,7 @@ void LayerPreview::mouseMoveEvent( QMouseEvent *ev )
 		InstrumentLayer *pLayer = m_pInstrument->get_component(m_nSelectedComponent)->get_layer( m_nSelectedLayer );
 		if ( pLayer ) {
 			if ( m_bMouseGrab ) {
+				AudioEngine::get_instance()->lock( RIGHT_HERE );
 				if ( m_bGrabLeft ) {
 					if ( fVel < pLayer->get_end_velocity()) {
 						pLayer->set_start_velocity(fVel);
@@ -373,6 +374,8 @@ void LayerPreview::mouseMoveEvent( QMouseEvent *ev )
 						showLayerEndVelocity(pLayer, ev);
 					}
 				}
+				m_pInstrument->get_component(m_nSelectedComponent)->update_layer_table();
+				AudioEngine::get_instance()->unlock();
 				update();
 			}
 		}
@@ -20,6 +20,8 @@
  *
  */
 
+#include <vector>
+
 #include <hydrogen/basics/sample.h>
 #include <hydrogen/basics/song.h>
 #include <hydrogen/basics/instrument.h>
@@ -99,13 +101,23 @@ void WaveDisplay::updateDisplay( H2Core::InstrumentLayer *pLayer )
 		float fGain = height() / 2.0 * pLayer->get_gain();
 
 		float *pSampleData = pLayer->get_sample()->get_data_l();
+		// the end of a streamed sample is not in memory
+		int nResidentFrames = pLayer->get_sample()->get_resident_frames();
+		// a compact sample is converted for the drawing
+		std::vector<float> compactL, compactR;
+		if ( pLayer->get_sample()->is_compact() && nResidentFrames > 0 ) {
+			compactL.resize( nResidentFrames );
+			compactR.resize( nResidentFrames );
+			pLayer->get_sample()->read( 0, nResidentFrames, &compactL[0], &compactR[0] );
+			pSampleData = &compactL[0];
+		}
 
 		int nSamplePos =0;
 		int nVal;
 		for ( int i = 0; i < width(); ++i ){
 			nVal = 0;
 			for ( int j = 0; j < nScaleFactor; ++j ) {
-				if ( j < nSampleLength ) {
+				if ( j < nSampleLength && nSamplePos < nResidentFrames ) {
 					int newVal = (int)( pSampleData[ nSamplePos ] * fGain );
 					if ( newVal > nVal ) {
 						nVal = newVal;
@@ -34,6 +34,7 @@
 #include <hydrogen/basics/instrument_list.h>
 #include <hydrogen/basics/instrument_layer.h>
 #include <hydrogen/basics/drumkit_component.h>
+#include <hydrogen/helpers/drumkit_index.h>
 
 #include <hydrogen/lilypond/lilypond.h>
 
@@ -55,6 +56,7 @@
 #include "Mixer/Mixer.h"
 #include "InstrumentEditor/InstrumentEditorPanel.h"
 #include "PatternEditor/PatternEditorPanel.h"
+#include "PatternEditor/DrumPatternEditor.h"
 #include "SongEditor/SongEditor.h"
 #include "SongEditor/SongEditorPanel.h"
 #include "SoundLibrary/SoundLibraryPanel.h"
@@ -530,7 +532,8 @@ void MainForm::action_file_save_as()
 	//std::auto_ptr<QFileDialog> fd( new QFileDialog );
 	QFileDialog fd(this);
 	fd.setFileMode( QFileDialog::AnyFile );
-	fd.setNameFilter( trUtf8("Hydrogen Song (*.h2song)") );
+	QString sBinaryFilter = trUtf8("Hydrogen Binary Song (*%1)").arg( SONG_BINARY_EXT );
+	fd.setNameFilters( QStringList() << trUtf8("Hydrogen Song (*.h2song)") << sBinaryFilter );
 	fd.setAcceptMode( QFileDialog::AcceptSave );
 	fd.setWindowTitle( trUtf8( "Save song" ) );
 	fd.setSidebarUrls( fd.sidebarUrls() << QUrl::fromLocalFile( Filesystem::songs_dir() ) );
@@ -545,19 +548,24 @@ void MainForm::action_file_save_as()
 	}
 	else {
 		defaultFilename = lastFilename;
+		if ( lastFilename.endsWith( SONG_BINARY_EXT ) ) {
+			fd.selectNameFilter( sBinaryFilter );
+		}
 	}
 
 	fd.selectFile( defaultFilename );
 
 	QString filename;
+	bool bBinary = false;
 	if (fd.exec() == QDialog::Accepted) {
 		filename = fd.selectedFiles().first();
+		bBinary = fd.selectedNameFilter() == sBinaryFilter;
 	}
 
 	if ( !filename.isEmpty() ) {
 		QString sNewFilename = filename;
-		if ( sNewFilename.endsWith(".h2song") == false ) {
-			filename += ".h2song";
+		if ( sNewFilename.endsWith(".h2song") == false && sNewFilename.endsWith( SONG_BINARY_EXT ) == false ) {
+			filename += bBinary ? SONG_BINARY_EXT : ".h2song";
 		}
 
 		song->set_filename(filename);
@@ -722,7 +730,7 @@ void MainForm::action_file_open() {
 	//std::auto_ptr<QFileDialog> fd( new QFileDialog );
 	QFileDialog fd(this);
 	fd.setFileMode(QFileDialog::ExistingFile);
-	fd.setNameFilter( trUtf8("Hydrogen Song (*.h2song)") );
+	fd.setNameFilter( trUtf8("Hydrogen Song (*.h2song *%1)").arg( SONG_BINARY_EXT ) );
 	fd.setDirectory( lastUsedDir );
 
 	fd.setWindowTitle( trUtf8( "Open song" ) );
@@ -801,7 +809,7 @@ void MainForm::action_file_openDemo()
 	h2app->m_undoStack->clear();
 	QFileDialog fd(this);
 	fd.setFileMode(QFileDialog::ExistingFile);
-	fd.setNameFilter( trUtf8("Hydrogen Song (*.h2song)") );
+	fd.setNameFilter( trUtf8("Hydrogen Song (*.h2song *%1)").arg( SONG_BINARY_EXT ) );
 
 	fd.setWindowTitle( trUtf8( "Open song" ) );
 	fd.setWindowIcon( QPixmap( Skin::getImagePath() + "/icon16.png" ) );
@@ -1002,41 +1010,16 @@ void MainForm::action_instruments_onlineImportLibrary()
 void MainForm::action_instruments_saveLibrary()
 {
 	QString sDrumkitName = Hydrogen::get_instance()->getCurrentDrumkitname();
-	Drumkit *drumkitInfo = NULL;
-
-	//User drumkit list
-	QStringList usr_dks = Filesystem::usr_drumkits_list();
-	for (int i = 0; i < usr_dks.size(); ++i) {
-		QString absPath = Filesystem::usr_drumkits_dir() + "/" + usr_dks[i];
-		Drumkit *pInfo = Drumkit::load( absPath );
-		if (pInfo) {
-			if ( QString(pInfo->get_name() ) == sDrumkitName ){
-				drumkitInfo = pInfo;
-				break;
-			}
-		}
-	}
 
-	//System drumkit list
-	QStringList sys_dks = Filesystem::sys_drumkits_list();
-	for (int i = 0; i < sys_dks.size(); ++i) {
-		QString absPath = Filesystem::sys_drumkits_dir() + "/" + sys_dks[i];
-		Drumkit *pInfo = Drumkit::load( absPath );
-		if (pInfo) {
-			if ( QString( pInfo->get_name() ) == sDrumkitName ){
-				drumkitInfo = pInfo;
-				break;
-			}
-		}
-	}
-
-	if ( drumkitInfo != NULL ){
-		if( !H2Core::Drumkit::save( QString( drumkitInfo->get_name() ),
-									QString( drumkitInfo->get_author() ),
-									QString( drumkitInfo->get_info() ),
-									QString( drumkitInfo->get_license() ),
-									QString( drumkitInfo->get_image() ),
-									QString( drumkitInfo->get_image_license() ),
+	// the drumkit properties are kept by the index
+	DrumkitIndex::Entry entry;
+	if ( DrumkitIndex::find( sDrumkitName, &entry ) ){
+		if( !H2Core::Drumkit::save( entry.name,
+									entry.author,
+									entry.info,
+									entry.license,
+									entry.image,
+									entry.image_license,
 									H2Core::Hydrogen::get_instance()->getSong()->get_instrument_list(),
 									H2Core::Hydrogen::get_instance()->getSong()->get_components(),
 									true ) ) {
@@ -1682,6 +1665,20 @@ void MainForm::playlistLoadSongEvent (int nIndex)
 	HydrogenApp::get_instance()->setScrollStatusBarMessage( trUtf8( "Playlist: Set song No. %1" ).arg( nIndex +1 ), 5000 );
 }
 
+/// a drumkit loaded by Hydrogen::loadDrumkitAsync() replaced the previous one
+void MainForm::drumkitLoadedEvent()
+{
+	Hydrogen::get_instance()->finishDrumkitLoad();
+	Hydrogen::get_instance()->getSong()->set_is_modified( true );
+	h2app->onDrumkitLoad( Hydrogen::get_instance()->getCurrentDrumkitname() );
+	h2app->getPatternEditorPanel()->getDrumPatternEditor()->updateEditor();
+	h2app->getPatternEditorPanel()->updatePianorollEditor();
+
+	InstrumentEditorPanel::get_instance()->notifyOfDrumkitChange();
+
+	h2app->getInstrumentRack()->getSoundLibraryPanel()->update_background_color();
+}
+
 void MainForm::jacksessionEvent( int nEvent )
 {
 	switch (nEvent){
@@ -1908,39 +1905,18 @@ void MainForm::action_banks_properties()
 	QString sDrumkitName = Hydrogen::get_instance()->getCurrentDrumkitname();
 	Drumkit *drumkitInfo = NULL;
 
-	//User drumkit list
-	QStringList usr_dks = Filesystem::usr_drumkits_list();
-	for (int i = 0; i < usr_dks.size(); ++i) {
-		QString absPath = Filesystem::usr_drumkits_dir() + "/" + usr_dks[i];
-		Drumkit *pInfo = Drumkit::load( absPath );
-		if (pInfo) {
-			if ( QString(pInfo->get_name() ) == sDrumkitName ){
-				drumkitInfo = pInfo;
-				break;
-			}
-		}
-	}
-
-	//System drumkit list
-	QStringList sys_dks = Filesystem::sys_drumkits_list();
-	for (int i = 0; i < sys_dks.size(); ++i) {
-		QString absPath = Filesystem::sys_drumkits_dir() + "/" + sys_dks[i];
-		Drumkit *pInfo = Drumkit::load( absPath );
-		if (pInfo) {
-			if ( QString( pInfo->get_name() ) == sDrumkitName ){
-				drumkitInfo = pInfo;
-				break;
-			}
-		}
+	// only the matching drumkit is parsed
+	DrumkitIndex::Entry entry;
+	if ( DrumkitIndex::find( sDrumkitName, &entry ) ) {
+		drumkitInfo = Drumkit::load( entry.path );
 	}
 
-
-
 	assert( drumkitInfo );
 
 	//open the soundlibrary save dialog
 	SoundLibraryPropertiesDialog dialog( this , drumkitInfo, drumkitInfo );
 	dialog.exec();
+	delete drumkitInfo;
 }
 
 
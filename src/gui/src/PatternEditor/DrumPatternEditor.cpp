@@ -38,6 +38,8 @@
 #include <hydrogen/basics/adsr.h>
 #include <hydrogen/basics/note.h>
 #include <hydrogen/audio_engine.h>
+#include <hydrogen/helpers/filesystem.h>
+#include <hydrogen/helpers/drumkit_index.h>
 
 #include "UndoActions.h"
 #include "../HydrogenApp.h"
@@ -1283,8 +1285,10 @@ void  DrumPatternEditor::functionDropInstrumentRedoAction( QString sDrumkitName,
 			return;
 		}
 
-		Drumkit *pNewDrumkit = Drumkit::load_by_name( sDrumkitName, false );
-		if( pNewDrumkit == NULL ){
+		// the components are known by the index, the drumkit is not parsed again
+		DrumkitIndex::Entry drumkitEntry;
+		if( !DrumkitIndex::get( Filesystem::drumkit_path_search( sDrumkitName ), &drumkitEntry ) ){
+			delete pNewInstrument;
 			return;
 		}
 
@@ -1295,20 +1299,20 @@ void  DrumPatternEditor::functionDropInstrumentRedoAction( QString sDrumkitName,
 		std::vector<InstrumentComponent*>* pOldInstrumentComponents = new std::vector<InstrumentComponent*> ( pNewInstrument->get_components()->begin(), pNewInstrument->get_components()->end() );
 		pNewInstrument->get_components()->clear();
 
-		for (std::vector<DrumkitComponent*>::iterator it = pNewDrumkit->get_components()->begin() ; it != pNewDrumkit->get_components()->end(); ++it) {
-			DrumkitComponent* pComponent = *it;
-			int OldID = pComponent->get_id();
+		for (uint i = 0; i < drumkitEntry.components.size(); ++i) {
+			const DrumkitIndex::Component& component = drumkitEntry.components[i];
+			int OldID = component.id;
 			int NewID = -1;
 
-			NewID = findExistingCompo( pComponent->get_name() );
+			NewID = findExistingCompo( component.name );
 
 			if ( NewID == -1 ) {
 				NewID = findFreeCompoID();
 
 				AddedComponents->push_back( NewID );
 
-				pComponent->set_id( NewID );
-				pComponent->set_name( renameCompo( pComponent->get_name() ) );
+				DrumkitComponent* pComponent = new DrumkitComponent( NewID, renameCompo( component.name ) );
+				pComponent->set_volume( component.volume );
 				Hydrogen::get_instance()->getSong()->get_components()->push_back( pComponent );
 			}
 
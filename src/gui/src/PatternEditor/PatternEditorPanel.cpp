@@ -861,6 +861,7 @@ void PatternEditorPanel::patternSizeChanged( QString str )
 
 	if ( nSelected > 0 && nSelected <= 32 ) {
 		m_pPattern->set_length( nEighth * nSelected );
+		Hydrogen::get_instance()->updateTempoMap();
 	}
 	else {
 		ERRORLOG( QString("[patternSizeChanged] Unhandled case %1").arg( nSelected ) );
@@ -40,6 +40,7 @@
 #include <hydrogen/LashClient.h>
 #include <hydrogen/audio_engine.h>
 #include <hydrogen/sampler/Sampler.h>
+#include <hydrogen/helpers/sample_cache.h>
 #include "SongEditor/SongEditor.h"
 #include "SongEditor/SongEditorPanel.h"
 
@@ -161,6 +162,12 @@ PreferencesDialog::PreferencesDialog(QWidget* parent)
 
 	resampleComboBox->setCurrentIndex( (int) AudioEngine::get_instance()->get_sampler()->getInterpolateMode() );
 
+	// the sample cache writes decoded samples to disk, so it is left to the user to enable it
+	sampleCacheCheckBox->setChecked( pPref->m_bSampleCache );
+	sampleCacheSizeSpinBox->setValue( pPref->m_nSampleCacheSize );
+	sampleCacheSizeSpinBox->setEnabled( pPref->m_bSampleCache );
+	connect( sampleCacheCheckBox, SIGNAL( toggled( bool ) ), sampleCacheSizeSpinBox, SLOT( setEnabled( bool ) ) );
+
 	// Appearance tab
 	QString applicationFamily = pPref->getApplicationFontFamily();
 	int applicationPointSize = pPref->getApplicationFontPointSize();
@@ -394,6 +401,11 @@ void PreferencesDialog::on_okBtn_clicked()
 	// maxVoices
 	pPref->m_nMaxNotes = maxVoicesTxt->value();
 
+	// sample cache
+	pPref->m_bSampleCache = sampleCacheCheckBox->isChecked();
+	pPref->m_nSampleCacheSize = sampleCacheSizeSpinBox->value();
+	SampleCache::set_enabled( pPref->m_bSampleCache, pPref->m_nSampleCacheSize );
+
 	if ( m_pMidiDriverComboBox->currentText() == "ALSA" ) {
 		pPref->m_sMidiDriver = "ALSA";
 	}
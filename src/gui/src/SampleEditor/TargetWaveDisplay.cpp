@@ -200,6 +200,17 @@ void TargetWaveDisplay::updateDisplay( H2Core::InstrumentLayer *pLayer )
 
 		float *pSampleDatal = pLayer->get_sample()->get_data_l();
 		float *pSampleDatar = pLayer->get_sample()->get_data_r();
+		// the end of a streamed sample is not in memory
+		int nResidentFrames = pLayer->get_sample()->get_resident_frames();
+		// a compact sample is converted for the drawing
+		std::vector<float> compactL, compactR;
+		if ( pLayer->get_sample()->is_compact() && nResidentFrames > 0 ) {
+			compactL.resize( nResidentFrames );
+			compactR.resize( nResidentFrames );
+			pLayer->get_sample()->read( 0, nResidentFrames, &compactL[0], &compactR[0] );
+			pSampleDatal = &compactL[0];
+			pSampleDatar = &compactR[0];
+		}
 		int nSamplePos = 0;
 		int nVall;
 		int nValr;
@@ -207,7 +218,7 @@ void TargetWaveDisplay::updateDisplay( H2Core::InstrumentLayer *pLayer )
 			nVall = 0;
 			nValr = 0;
 			for ( int j = 0; j < nScaleFactor; ++j ) {
-				if ( j < nSampleLength ) {
+				if ( j < nSampleLength && nSamplePos < nResidentFrames ) {
 					if ( pSampleDatal[ nSamplePos ] < 0 ){
 						int newVal = static_cast<int>( pSampleDatal[ nSamplePos ] * -fGain );
 						nVall = newVal;
@@ -2154,12 +2154,14 @@ void SongEditorPositionRuler::editTimeLineAction( int newPosition, float newBpm
 	Timeline::HTimelineVector tlvector;
 
 	tlvector.m_htimelinebeat = newPosition -1 ;
+	tlvector.m_htimelinetick = 0;
 
 	if( newBpm < 30.0 ) newBpm = 30.0;
 	if( newBpm > 500.0 ) newBpm = 500.0;
 	tlvector.m_htimelinebpm = newBpm;
 	pTimeline->m_timelinevector.push_back( tlvector );
 	pTimeline->sortTimelineVector();
+	engine->updateTempoMap();
 	createBackground();
 }
 
@@ -2178,6 +2180,7 @@ void SongEditorPositionRuler::deleteTimeLinePosition( int position )
 			}
 		}
 	}
+	engine->updateTempoMap();
 	createBackground();
 }
 
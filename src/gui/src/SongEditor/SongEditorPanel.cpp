@@ -337,6 +337,9 @@ void SongEditorPanel::syncToExternalScrollBar()
 ///
 void SongEditorPanel::updateAll()
 {
+	// the pattern groups may have changed, and the tick of the tempo markers with them
+	Hydrogen::get_instance()->updateTempoMap();
+
 	m_pPatternList->createBackground();
 	m_pPatternList->update();
 
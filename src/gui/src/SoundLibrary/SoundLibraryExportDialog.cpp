@@ -70,12 +70,6 @@ SoundLibraryExportDialog::SoundLibraryExportDialog( QWidget* pParent,  const QSt
 SoundLibraryExportDialog::~SoundLibraryExportDialog()
 {
 	INFOLOG( "DESTROY" );
-
-	for (uint i = 0; i < drumkitInfoList.size(); i++ ) {
-		Drumkit* info = drumkitInfoList[i];
-		delete info;
-	}
-	drumkitInfoList.clear();
 }
 
 
@@ -94,23 +88,26 @@ void SoundLibraryExportDialog::on_exportBtn_clicked()
 
 
 	int componentID = -1;
-	Drumkit* info;
 	if( versionList->currentIndex() == 1 ) {
 		for (uint i = 0; i < drumkitInfoList.size(); i++ ) {
-			info = drumkitInfoList[i];
-			if( info->get_name().compare( drumkitName ) == 0 ) {
+			const DrumkitIndex::Entry& entry = drumkitInfoList[i];
+			if( entry.name.compare( drumkitName ) == 0 ) {
 				QString temporaryDrumkitXML = qdTempFolder.filePath( "drumkit.xml" );
 				INFOLOG( "[ExportSoundLibrary]" );
 				INFOLOG( "Saving temporary file into: " + temporaryDrumkitXML );
-				TmpFileCreated = true;
-				for (std::vector<DrumkitComponent*>::iterator it = info->get_components()->begin() ; it != info->get_components()->end(); ++it) {
-					DrumkitComponent* pComponent = *it;
-					if( pComponent->get_name().compare( componentList->currentText() ) == 0) {
-						componentID = pComponent->get_id();
+				for (uint j = 0; j < entry.components.size(); j++ ) {
+					if( entry.components[j].name.compare( componentList->currentText() ) == 0) {
+						componentID = entry.components[j].id;
 						break;
 					}
 				}
-				info->save_file( temporaryDrumkitXML, true, componentID );
+				// only the exported drumkit is parsed
+				Drumkit* info = Drumkit::load( entry.path );
+				if ( info ) {
+					TmpFileCreated = true;
+					info->save_file( temporaryDrumkitXML, true, componentID );
+					delete info;
+				}
 				break;
 			}
 		}
@@ -309,42 +306,19 @@ void SoundLibraryExportDialog::updateDrumkitList()
 
 	drumkitList->clear();
 
-	for (uint i = 0; i < drumkitInfoList.size(); i++ ) {
-		Drumkit* info = drumkitInfoList[i];
-		delete info;
-	}
-	drumkitInfoList.clear();
-
-	QStringList sysDrumkits = Filesystem::sys_drumkits_list();
-	for (int i = 0; i < sysDrumkits.size(); ++i) {
-		QString absPath = Filesystem::sys_drumkits_dir() + "/" + sysDrumkits.at(i);
-		Drumkit *info = Drumkit::load( absPath );
-		if (info) {
-			drumkitInfoList.push_back( info );
-			drumkitList->addItem( info->get_name() );
-			QStringList p_components;
-			for (std::vector<DrumkitComponent*>::iterator it = info->get_components()->begin() ; it != info->get_components()->end(); ++it) {
-				DrumkitComponent* p_compo = *it;
-				p_components.append(p_compo->get_name());
-			}
-			kit_components[info->get_name()] = p_components;
-		}
-	}
+	// the index only parses the drumkits which changed since the last listing
+	drumkitInfoList = DrumkitIndex::sys_drumkits();
+	DrumkitIndex::Entries userDrumkits = DrumkitIndex::usr_drumkits();
+	drumkitInfoList.insert( drumkitInfoList.end(), userDrumkits.begin(), userDrumkits.end() );
 
-	QStringList userDrumkits = Filesystem::usr_drumkits_list();
-	for (int i = 0; i < userDrumkits.size(); ++i) {
-		QString absPath = Filesystem::usr_drumkits_dir() + "/" + userDrumkits.at(i);
-		Drumkit *info = Drumkit::load( absPath );
-		if (info) {
-			drumkitInfoList.push_back( info );
-			drumkitList->addItem( info->get_name() );
-			QStringList p_components;
-			for (std::vector<DrumkitComponent*>::iterator it = info->get_components()->begin() ; it != info->get_components()->end(); ++it) {
-				DrumkitComponent* p_compo = *it;
-				p_components.append(p_compo->get_name());
-			}
-			kit_components[info->get_name()] = p_components;
+	for (uint i = 0; i < drumkitInfoList.size(); i++ ) {
+		const DrumkitIndex::Entry& entry = drumkitInfoList[i];
+		drumkitList->addItem( entry.name );
+		QStringList p_components;
+		for (uint j = 0; j < entry.components.size(); j++ ) {
+			p_components.append( entry.components[j].name );
 		}
+		kit_components[entry.name] = p_components;
 	}
 
 	/*
@@ -28,6 +28,7 @@
 #include <hydrogen/object.h>
 #include <hydrogen/basics/song.h>
 #include <hydrogen/basics/drumkit.h>
+#include <hydrogen/helpers/drumkit_index.h>
 
 #include <vector>
 
@@ -51,7 +52,7 @@ private slots:
 	void on_drumkitPathTxt_textChanged( QString str );
 	void updateDrumkitList();
 private:
-	std::vector<H2Core::Drumkit*> drumkitInfoList;
+	H2Core::DrumkitIndex::Entries drumkitInfoList;
 	QString preselectedKit;
 	QHash<QString, QStringList> kit_components;
 };
@@ -138,16 +138,6 @@ SoundLibraryPanel::SoundLibraryPanel( QWidget *pParent, bool bInItsOwnDialog )
 
 SoundLibraryPanel::~SoundLibraryPanel()
 {
-	for (uint i = 0; i < __system_drumkit_info_list.size(); ++i ) {
-		delete __system_drumkit_info_list[i];
-	}
-	__system_drumkit_info_list.clear();
-
-	for (uint i = 0; i < __user_drumkit_info_list.size(); ++i ) {
-		delete __user_drumkit_info_list[i];
-	}
-	__user_drumkit_info_list.clear();
-
 }
 
 
@@ -172,58 +162,18 @@ void SoundLibraryPanel::updateDrumkitList()
 
 	
 
-	for (uint i = 0; i < __system_drumkit_info_list.size(); ++i ) {
-		delete __system_drumkit_info_list[i];
-	}
-	__system_drumkit_info_list.clear();
-
-	for (uint i = 0; i < __user_drumkit_info_list.size(); ++i ) {
-		delete __user_drumkit_info_list[i];
-	}
-	__user_drumkit_info_list.clear();
+	// the index only parses the drumkits which changed since the last listing
+	__user_drumkit_info_list = DrumkitIndex::usr_drumkits();
+	__system_drumkit_info_list = DrumkitIndex::sys_drumkits();
 
 	//User drumkit list
-	QStringList usr_dks = Filesystem::usr_drumkits_list();
-	for (int i = 0; i < usr_dks.size(); ++i) {
-		QString absPath = Filesystem::usr_drumkits_dir() + "/" + usr_dks[i];
-		Drumkit *pInfo = Drumkit::load( absPath );
-		if (pInfo) {
-			__user_drumkit_info_list.push_back( pInfo );
-			QTreeWidgetItem* pDrumkitItem = new QTreeWidgetItem( __user_drumkits_item );
-			pDrumkitItem->setText( 0, pInfo->get_name() );
-			if ( QString(pInfo->get_name() ) == currentSL ){
-				pDrumkitItem->setBackgroundColor( 0, QColor( 50, 50, 50) );
-			}
-			InstrumentList *pInstrList = pInfo->get_instruments();
-			for ( uint nInstr = 0; nInstr < pInstrList->size(); ++nInstr ) {
-				Instrument *pInstr = pInstrList->get( nInstr );
-				QTreeWidgetItem* pInstrumentItem = new QTreeWidgetItem( pDrumkitItem );
-				pInstrumentItem->setText( 0, QString( "[%1] " ).arg( nInstr + 1 ) + pInstr->get_name() );
-				pInstrumentItem->setToolTip( 0, pInstr->get_name() );
-			}
-		}
+	for (uint i = 0; i < __user_drumkit_info_list.size(); ++i) {
+		addDrumkitItem( __user_drumkits_item, __user_drumkit_info_list[i], currentSL );
 	}
 
 	//System drumkit list
-	QStringList sys_dks = Filesystem::sys_drumkits_list();
-	for (int i = 0; i < sys_dks.size(); ++i) {
-		QString absPath = Filesystem::sys_drumkits_dir() + "/" + sys_dks[i];
-		Drumkit *pInfo = Drumkit::load( absPath );
-		if (pInfo) {
-			__system_drumkit_info_list.push_back( pInfo );
-			QTreeWidgetItem* pDrumkitItem = new QTreeWidgetItem( __system_drumkits_item );
-			pDrumkitItem->setText( 0, pInfo->get_name() );
-			if ( QString( pInfo->get_name() ) == currentSL ){
-				pDrumkitItem->setBackgroundColor( 0, QColor( 50, 50, 50) );
-			}
-			InstrumentList *pInstrList = pInfo->get_instruments();
-			for ( uint nInstr = 0; nInstr < pInstrList->size(); ++nInstr ) {
-				Instrument *pInstr = pInstrList->get( nInstr );
-				QTreeWidgetItem* pInstrumentItem = new QTreeWidgetItem( pDrumkitItem );
-				pInstrumentItem->setText( 0, QString( "[%1] " ).arg( nInstr + 1 ) + pInstr->get_name() );
-				pInstrumentItem->setToolTip( 0, pInstr->get_name() );
-			}
-		}
+	for (uint i = 0; i < __system_drumkit_info_list.size(); ++i) {
+		addDrumkitItem( __system_drumkits_item, __system_drumkit_info_list[i], currentSL );
 	}
 	
 	//Songlist
@@ -291,6 +241,22 @@ void SoundLibraryPanel::updateDrumkitList()
 
 
 
+void SoundLibraryPanel::addDrumkitItem( QTreeWidgetItem* pParent, const DrumkitIndex::Entry& entry, const QString& currentSL )
+{
+	QTreeWidgetItem* pDrumkitItem = new QTreeWidgetItem( pParent );
+	pDrumkitItem->setText( 0, entry.name );
+	if ( entry.name == currentSL ){
+		pDrumkitItem->setBackgroundColor( 0, QColor( 50, 50, 50) );
+	}
+	for ( int nInstr = 0; nInstr < entry.instruments.size(); ++nInstr ) {
+		QTreeWidgetItem* pInstrumentItem = new QTreeWidgetItem( pDrumkitItem );
+		pInstrumentItem->setText( 0, QString( "[%1] " ).arg( nInstr + 1 ) + entry.instruments[ nInstr ] );
+		pInstrumentItem->setToolTip( 0, entry.instruments[ nInstr ] );
+	}
+}
+
+
+
 void SoundLibraryPanel::on_DrumkitList_ItemChanged( QTreeWidgetItem * current, QTreeWidgetItem * previous )
 {
 	UNUSED( previous );
@@ -478,30 +444,13 @@ void SoundLibraryPanel::on_drumkitLoadAction()
 
 	QString sDrumkitName = __sound_library_tree->currentItem()->text(0);
 
-	Drumkit *drumkitInfo = NULL;
-
-	// find the drumkit in the list
-	for ( uint i = 0; i < __system_drumkit_info_list.size(); i++ ) {
-		Drumkit *pInfo = __system_drumkit_info_list[i];
-		if ( pInfo->get_name() == sDrumkitName ) {
-			drumkitInfo = pInfo;
-			break;
-		}
-	}
-	
-	for ( uint i = 0; i < __user_drumkit_info_list.size(); i++ ) {
-		Drumkit *pInfo = __user_drumkit_info_list[i];
-		if ( pInfo->get_name() == sDrumkitName ) {
-			drumkitInfo = pInfo;
-			break;
-		}
-	}
+	const DrumkitIndex::Entry* pEntry = findDrumkitEntry( sDrumkitName );
+	assert( pEntry );
 
 	InstrumentList *pSongInstrList = Hydrogen::get_instance()->getSong()->get_instrument_list();
-	InstrumentList *pDrumkitInstrList = drumkitInfo->get_instruments();
 
 	int oldCount = pSongInstrList->size();
-	int newCount = pDrumkitInstrList->size();
+	int newCount = pEntry->instruments.size();
 
 	bool conditionalLoad = false;
 	bool hasNotes = false;
@@ -561,21 +510,25 @@ void SoundLibraryPanel::on_drumkitLoadAction()
 	}
 
 
-	assert( drumkitInfo );
-
 	QApplication::setOverrideCursor(Qt::WaitCursor);
 
+	Drumkit *drumkitInfo = Drumkit::load( pEntry->path );
+	if ( drumkitInfo == NULL ) {
+		QApplication::restoreOverrideCursor();
+		QMessageBox::warning( this, "Hydrogen", tr( "Unable to load the drumkit %1" ).arg( sDrumkitName ) );
+		return;
+	}
 
-	Hydrogen::get_instance()->loadDrumkit( drumkitInfo, conditionalLoad );
-	Hydrogen::get_instance()->getSong()->set_is_modified( true );
-	HydrogenApp::get_instance()->onDrumkitLoad( drumkitInfo->get_name() );
-	HydrogenApp::get_instance()->getPatternEditorPanel()->getDrumPatternEditor()->updateEditor();
-	HydrogenApp::get_instance()->getPatternEditorPanel()->updatePianorollEditor();
-
-	InstrumentEditorPanel::get_instance()->notifyOfDrumkitChange();
-
-	__sound_library_tree->currentItem()->setBackgroundColor ( 0, QColor( 50, 50, 50) );
+	// the current drumkit keeps playing until the next bar, the editors are updated by MainForm::drumkitLoadedEvent()
+	bool bLoading = Hydrogen::get_instance()->loadDrumkitAsync( drumkitInfo, Hydrogen::SWITCH_NEXT_BAR, conditionalLoad );
+	delete drumkitInfo;
 	QApplication::restoreOverrideCursor();
+	if ( !bLoading ) {
+		update_background_color();
+		QMessageBox::information( this, "Hydrogen", tr( "Another drumkit is still being loaded, %1 was not loaded" ).arg( sDrumkitName ) );
+		return;
+	}
+	HydrogenApp::get_instance()->setStatusBarMessage( tr( "Loading drumkit: [%1]" ).arg( sDrumkitName ), 2000 );
 
 }
 
@@ -668,56 +621,51 @@ void SoundLibraryPanel::on_drumkitPropertiesAction()
 {
 	QString sDrumkitName = __sound_library_tree->currentItem()->text(0);
 
-	Drumkit *drumkitInfo = NULL;
-
-	// find the drumkit in the list
-	for ( uint i = 0; i < __system_drumkit_info_list.size(); i++ ) {
-		Drumkit *pInfo = __system_drumkit_info_list[i];
-		if ( pInfo->get_name() == sDrumkitName ) {
-			drumkitInfo = pInfo;
-			break;
-		}
-	}
-	for ( uint i = 0; i < __user_drumkit_info_list.size(); i++ ) {
-		Drumkit*pInfo = __user_drumkit_info_list[i];
-		if ( pInfo->get_name() == sDrumkitName ) {
-			drumkitInfo = pInfo;
-			break;
-		}
-	}
-
-	assert( drumkitInfo );
+	const DrumkitIndex::Entry* pEntry = findDrumkitEntry( sDrumkitName );
+	assert( pEntry );
 
 	QString sPreDrumkitName = Hydrogen::get_instance()->getCurrentDrumkitname();
 
-	Drumkit *preDrumkitInfo = NULL;
-	
+	const DrumkitIndex::Entry* pPreEntry = findDrumkitEntry( sPreDrumkitName );
 
-	// find the drumkit in the list
-	for ( uint i = 0; i < __system_drumkit_info_list.size(); i++ ) {
-		Drumkit *prInfo = __system_drumkit_info_list[i];
-		if ( prInfo->get_name() == sPreDrumkitName ) {
-			preDrumkitInfo = prInfo;
-			break;
-		}
-	}
-	for ( uint i = 0; i < __user_drumkit_info_list.size(); i++ ) {
-		Drumkit *prInfo = __user_drumkit_info_list[i];
-		if ( prInfo->get_name() == sPreDrumkitName ) {
-			preDrumkitInfo = prInfo;
-			break;
-		}
+	if ( pPreEntry == NULL ){
+		QMessageBox::warning( this, "Hydrogen", QString( "The current loaded song missing his soundlibrary.\nPlease load a existing soundlibrary first") );
+		return;
 	}
 
-	if ( preDrumkitInfo == NULL ){
-		QMessageBox::warning( this, "Hydrogen", QString( "The current loaded song missing his soundlibrary.\nPlease load a existing soundlibrary first") );
+	// the dialog may load either drumkit, both are parsed only now
+	Drumkit *drumkitInfo = Drumkit::load( pEntry->path );
+	Drumkit *preDrumkitInfo = Drumkit::load( pPreEntry->path );
+	if ( drumkitInfo == NULL || preDrumkitInfo == NULL ) {
+		delete drumkitInfo;
+		delete preDrumkitInfo;
+		QMessageBox::warning( this, "Hydrogen", tr( "Unable to load the drumkit %1" ).arg( sDrumkitName ) );
 		return;
 	}
-	assert( preDrumkitInfo );
-	
+
 	//open the soundlibrary save dialog 
 	SoundLibraryPropertiesDialog dialog( this , drumkitInfo, preDrumkitInfo );
 	dialog.exec();
+	delete drumkitInfo;
+	delete preDrumkitInfo;
+}
+
+
+
+const DrumkitIndex::Entry* SoundLibraryPanel::findDrumkitEntry( const QString& sDrumkitName )
+{
+	// user drumkits take precedence, as when the list was built with the drumkits themselves
+	for ( uint i = 0; i < __user_drumkit_info_list.size(); i++ ) {
+		if ( __user_drumkit_info_list[i].name == sDrumkitName ) {
+			return &__user_drumkit_info_list[i];
+		}
+	}
+	for ( uint i = 0; i < __system_drumkit_info_list.size(); i++ ) {
+		if ( __system_drumkit_info_list[i].name == sDrumkitName ) {
+			return &__system_drumkit_info_list[i];
+		}
+	}
+	return NULL;
 }
 
 
@@ -32,6 +32,7 @@
 #include <vector>
 
 #include <hydrogen/object.h>
+#include <hydrogen/helpers/drumkit_index.h>
 
 namespace H2Core
 {
@@ -93,12 +94,14 @@ private:
 	QTreeWidgetItem* __pattern_item;
 	QTreeWidgetItem* __pattern_item_list;
 
-	std::vector<H2Core::Drumkit*> __system_drumkit_info_list;
-	std::vector<H2Core::Drumkit*> __user_drumkit_info_list;
+	H2Core::DrumkitIndex::Entries __system_drumkit_info_list;
+	H2Core::DrumkitIndex::Entries __user_drumkit_info_list;
 	bool __expand_pattern_list;
 	bool __expand_songs_list;
 	void restore_background_color();
 	void change_background_color();
+	void addDrumkitItem( QTreeWidgetItem* pParent, const H2Core::DrumkitIndex::Entry& entry, const QString& currentSL );
+	const H2Core::DrumkitIndex::Entry* findDrumkitEntry( const QString& sDrumkitName );
 
 };
 
@@ -379,10 +379,11 @@ int main(int argc, char *argv[])
 		}
 
 		if( ! sDrumkitToLoad.isEmpty() ) {
-			H2Core::Drumkit* drumkitInfo = H2Core::Drumkit::load_by_name( sDrumkitToLoad, true );
+			H2Core::Drumkit* drumkitInfo = H2Core::Drumkit::load_by_name( sDrumkitToLoad, false );
 			if ( drumkitInfo ) {
-				H2Core::Hydrogen::get_instance()->loadDrumkit( drumkitInfo );
-				HydrogenApp::get_instance()->onDrumkitLoad( drumkitInfo->get_name() );
+				// MainForm::drumkitLoadedEvent() updates the GUI once it is switched
+				H2Core::Hydrogen::get_instance()->loadDrumkitAsync( drumkitInfo, H2Core::Hydrogen::SWITCH_NOW );
+				delete drumkitInfo;
 			} else {
 				___ERRORLOG ( "Error loading the drumkit" );
 			}
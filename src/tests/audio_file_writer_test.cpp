@@ -0,0 +1,127 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <hydrogen/IO/AudioFileWriter.h>
+#include <hydrogen/helpers/filesystem.h>
+#include <QFile>
+#include <sndfile.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace H2Core;
+
+class AudioFileWriterTest : public CppUnit::TestCase {
+	CPPUNIT_TEST_SUITE( AudioFileWriterTest );
+	CPPUNIT_TEST( testInterleave );
+	CPPUNIT_TEST( testWrite );
+	CPPUNIT_TEST( testChannels );
+	CPPUNIT_TEST_SUITE_END();
+
+	public:
+	void testInterleave()
+	{
+		// an odd count runs both the vector and the scalar loops
+		const unsigned nFrames = 7;
+		float left[ nFrames ] = { 0.0, 0.5, -0.5, 1.5, -1.5, 1.0, -2.0 };
+		float right[ nFrames ] = { 0.25, -3.0, 3.0, -0.75, 0.75, -1.0, 0.125 };
+		float out[ nFrames * 2 ];
+		AudioFileWriter::interleave( left, right, out, nFrames );
+		for ( unsigned i = 0; i < nFrames; i++ ) {
+			CPPUNIT_ASSERT_EQUAL( std::min( 1.0f, std::max( -1.0f, left[i] ) ), out[i * 2] );
+			CPPUNIT_ASSERT_EQUAL( std::min( 1.0f, std::max( -1.0f, right[i] ) ), out[i * 2 + 1] );
+		}
+	}
+
+	void testWrite()
+	{
+		const unsigned nFrames = 10000;
+		std::vector<float> left( nFrames ), right( nFrames );
+		for ( unsigned i = 0; i < nFrames; i++ ) {
+			left[i] = sinf( i * 0.01 ) * 0.8;
+			right[i] = cosf( i * 0.03 ) * 0.6;
+		}
+
+		// the same stream into two formats, through a ring much smaller than the stream
+		QString sWav = Filesystem::tmp_dir() + "/writer.wav";
+		QString sFlac = Filesystem::tmp_dir() + "/writer.flac";
+		AudioFileWriter wav( sWav, 44100, 32 );
+		AudioFileWriter flac( sFlac, 44100, 16 );
+		CPPUNIT_ASSERT( wav.open( 256, 2 ) );
+		CPPUNIT_ASSERT( flac.open( 1000, 3 ) );
+		unsigned nPos = 0;
+		unsigned nBlock = 1;
+		while ( nPos < nFrames ) {
+			unsigned nCount = std::min( nBlock, nFrames - nPos );
+			CPPUNIT_ASSERT( wav.write( &left[ nPos ], &right[ nPos ], nCount ) );
+			CPPUNIT_ASSERT( flac.write( &left[ nPos ], &right[ nPos ], nCount ) );
+			nPos += nCount;
+			nBlock = nBlock * 3 % 1021;
+		}
+		CPPUNIT_ASSERT( wav.close() );
+		CPPUNIT_ASSERT( flac.close() );
+
+		SF_INFO info;
+		info.format = 0;
+		SNDFILE* pFile = sf_open( sWav.toLocal8Bit(), SFM_READ, &info );
+		CPPUNIT_ASSERT( pFile );
+		CPPUNIT_ASSERT_EQUAL( ( sf_count_t )nFrames, info.frames );
+		std::vector<float> data( nFrames * 2 );
+		CPPUNIT_ASSERT_EQUAL( ( sf_count_t )nFrames, sf_readf_float( pFile, &data[0], nFrames ) );
+		sf_close( pFile );
+		for ( unsigned i = 0; i < nFrames; i++ ) {
+			CPPUNIT_ASSERT( fabsf( data[i * 2] - left[i] ) < 1e-6 );
+			CPPUNIT_ASSERT( fabsf( data[i * 2 + 1] - right[i] ) < 1e-6 );
+		}
+
+		info.format = 0;
+		pFile = sf_open( sFlac.toLocal8Bit(), SFM_READ, &info );
+		CPPUNIT_ASSERT( pFile );
+		CPPUNIT_ASSERT_EQUAL( ( sf_count_t )nFrames, info.frames );
+		sf_close( pFile );
+
+		QFile::remove( sWav );
+		QFile::remove( sFlac );
+	}
+
+	void testChannels()
+	{
+		// two channel pairs, the samples out of range are clamped
+		const unsigned nFrames = 3000;
+		const int nChannels = 4;
+		std::vector<float> buffers[ nChannels ];
+		const float* channels[ nChannels ];
+		for ( int c = 0; c < nChannels; c++ ) {
+			buffers[c].resize( nFrames );
+			for ( unsigned i = 0; i < nFrames; i++ ) {
+				buffers[c][i] = sinf( i * 0.01 * ( c + 1 ) ) * 1.5;
+			}
+			channels[c] = &buffers[c][0];
+		}
+
+		QString sWav = Filesystem::tmp_dir() + "/channels.wav";
+		AudioFileWriter wav( sWav, 48000, 32, nChannels );
+		CPPUNIT_ASSERT_EQUAL( nChannels, wav.get_channels() );
+		CPPUNIT_ASSERT( wav.open( 512, 2 ) );
+		CPPUNIT_ASSERT( wav.write( channels, nFrames ) );
+		CPPUNIT_ASSERT( wav.close() );
+
+		SF_INFO info;
+		info.format = 0;
+		SNDFILE* pFile = sf_open( sWav.toLocal8Bit(), SFM_READ, &info );
+		CPPUNIT_ASSERT( pFile );
+		CPPUNIT_ASSERT_EQUAL( nChannels, info.channels );
+		CPPUNIT_ASSERT_EQUAL( ( sf_count_t )nFrames, info.frames );
+		std::vector<float> data( nFrames * nChannels );
+		CPPUNIT_ASSERT_EQUAL( ( sf_count_t )nFrames, sf_readf_float( pFile, &data[0], nFrames ) );
+		sf_close( pFile );
+		for ( unsigned i = 0; i < nFrames; i++ ) {
+			for ( int c = 0; c < nChannels; c++ ) {
+				float fExpected = std::min( 1.0f, std::max( -1.0f, buffers[c][i] ) );
+				CPPUNIT_ASSERT( fabsf( data[i * nChannels + c] - fExpected ) < 1e-6 );
+			}
+		}
+
+		QFile::remove( sWav );
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( AudioFileWriterTest );
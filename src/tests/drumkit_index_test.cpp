@@ -0,0 +1,72 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <hydrogen/basics/drumkit.h>
+#include <hydrogen/helpers/drumkit_index.h>
+#include <hydrogen/helpers/filesystem.h>
+#include <QDateTime>
+#include <QFileInfo>
+#include <utime.h>
+
+#define BASE_DIR    "./src/tests/data"
+
+using namespace H2Core;
+
+class DrumkitIndexTest : public CppUnit::TestCase {
+	CPPUNIT_TEST_SUITE( DrumkitIndexTest );
+	CPPUNIT_TEST( testEntry );
+	CPPUNIT_TEST( testValidation );
+	CPPUNIT_TEST_SUITE_END();
+
+	QString m_sPath;
+
+	public:
+	void setUp()
+	{
+		m_sPath = Filesystem::tmp_dir() + "/indexed_dk";
+		CPPUNIT_ASSERT( Filesystem::mkdir( m_sPath ) );
+		CPPUNIT_ASSERT( Filesystem::file_copy( BASE_DIR"/drumkit/drumkit.xml", Filesystem::drumkit_file( m_sPath ), true ) );
+	}
+
+	void tearDown()
+	{
+		Filesystem::rm( m_sPath, true );
+	}
+
+	void testEntry()
+	{
+		DrumkitIndex::Entry entry;
+		CPPUNIT_ASSERT( DrumkitIndex::get( m_sPath, &entry ) );
+		CPPUNIT_ASSERT( entry.path == m_sPath );
+		CPPUNIT_ASSERT( entry.name == "H2 test DK" );
+		CPPUNIT_ASSERT_EQUAL( 4, entry.instruments.size() );
+		CPPUNIT_ASSERT( entry.instruments[0] == "Crash" );
+		CPPUNIT_ASSERT( Filesystem::file_readable( Filesystem::drumkit_index_file() ) );
+
+		CPPUNIT_ASSERT( !DrumkitIndex::get( Filesystem::tmp_dir() + "/no_such_dk", &entry ) );
+	}
+
+	void testValidation()
+	{
+		DrumkitIndex::Entry entry;
+		CPPUNIT_ASSERT( DrumkitIndex::get( m_sPath, &entry ) );
+
+		// a saved drumkit gets a new modification time and is read again
+		Drumkit* drumkit = Drumkit::load( m_sPath );
+		CPPUNIT_ASSERT( drumkit );
+		drumkit->set_name( "renamed" );
+		CPPUNIT_ASSERT( drumkit->save_file( Filesystem::drumkit_file( m_sPath ), true ) );
+		delete drumkit;
+		struct utimbuf times;
+		times.actime = times.modtime = QDateTime::currentDateTime().toTime_t() + 10;
+		CPPUNIT_ASSERT_EQUAL( 0, utime( Filesystem::drumkit_file( m_sPath ).toLocal8Bit().constData(), &times ) );
+
+		CPPUNIT_ASSERT( DrumkitIndex::get( m_sPath, &entry ) );
+		CPPUNIT_ASSERT( entry.name == "renamed" );
+		CPPUNIT_ASSERT_EQUAL( 4, entry.instruments.size() );
+
+		// a removed drumkit is no longer listed
+		Filesystem::rm( m_sPath, true );
+		CPPUNIT_ASSERT( !DrumkitIndex::get( m_sPath, &entry ) );
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( DrumkitIndexTest );
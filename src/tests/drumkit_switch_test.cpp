@@ -0,0 +1,147 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <hydrogen/hydrogen.h>
+#include <hydrogen/audio_engine.h>
+#include <hydrogen/event_queue.h>
+#include <hydrogen/Preferences.h>
+#include <hydrogen/basics/drumkit.h>
+#include <hydrogen/basics/song.h>
+#include <hydrogen/basics/pattern_list.h>
+#include <hydrogen/basics/instrument.h>
+#include <hydrogen/basics/instrument_list.h>
+#include <hydrogen/IO/FakeDriver.h>
+#include <hydrogen/helpers/stress_song.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+
+#define BASE_DIR    "./src/tests/data"
+
+using namespace H2Core;
+
+class DrumkitSwitchTest : public CppUnit::TestCase {
+	CPPUNIT_TEST_SUITE( DrumkitSwitchTest );
+	CPPUNIT_TEST( testSwitchWhilePlaying );
+	CPPUNIT_TEST( testDiscardExtraInstruments );
+	CPPUNIT_TEST_SUITE_END();
+
+	Song* newSong()
+	{
+		// every instrument plays on every step and rings until the next one
+		StressSong::Options options;
+		options.m_nInstruments = 8;
+		options.m_nLayers = 1;
+		options.m_nSampleFrames = 44100;
+		options.m_nColumns = 2;
+		options.m_fNoteDensity = 1.0;
+		options.m_bMixedSelection = false;
+		Song* pSong = StressSong::generate( options );
+		pSong->set_loop_enabled( true );
+		return pSong;
+	}
+
+	/// run one process cycle and return its peak
+	float processCycle( FakeDriver* pDriver )
+	{
+		CPPUNIT_ASSERT_EQUAL( 0, pDriver->processCycle() );
+		float fPeak = 0.0;
+		for ( unsigned i = 0; i < pDriver->getBufferSize(); i++ ) {
+			fPeak = std::max( fPeak, std::max( fabsf( pDriver->getOut_L()[ i ] ), fabsf( pDriver->getOut_R()[ i ] ) ) );
+		}
+		return fPeak;
+	}
+
+	/// complete the switch as the GUI does on EVENT_DRUMKIT_LOADED
+	void handleEvents()
+	{
+		Event event;
+		while ( ( event = EventQueue::get_instance()->pop_event() ).type != EVENT_NONE ) {
+			if ( event.type == EVENT_DRUMKIT_LOADED ) {
+				Hydrogen::get_instance()->finishDrumkitLoad();
+			}
+		}
+	}
+
+	public:
+	void setUp()
+	{
+		Preferences::create_instance();
+		Preferences::get_instance()->m_sAudioDriver = "Fake";
+		Hydrogen::create_instance();
+	}
+
+	void testSwitchWhilePlaying()
+	{
+		Hydrogen* pHydrogen = Hydrogen::get_instance();
+		FakeDriver* pDriver = dynamic_cast<FakeDriver*>( pHydrogen->getAudioOutput() );
+		CPPUNIT_ASSERT( pDriver );
+		Song* pSong = newSong();
+		pHydrogen->setSong( pSong );
+		Drumkit* pDrumkit = Drumkit::load( BASE_DIR"/drumkit" );
+		CPPUNIT_ASSERT( pDrumkit );
+
+		pSong->get_pattern_list()->set_to_old();
+		pDriver->m_transport.m_status = TransportInfo::ROLLING;
+
+		// wait for the first notes
+		int nCycles = 0;
+		while ( processCycle( pDriver ) == 0.0 ) {
+			CPPUNIT_ASSERT( ++nCycles < 100 );
+		}
+
+		CPPUNIT_ASSERT( pHydrogen->loadDrumkitAsync( pDrumkit, Hydrogen::SWITCH_NEXT_BAR ) );
+		delete pDrumkit;
+		CPPUNIT_ASSERT( pHydrogen->isDrumkitLoading() );
+
+		// the cycles keep playing the previous drumkit, then the new one from the bar on
+		int nSilentCycles = 0;
+		nCycles = 0;
+		while ( pHydrogen->isDrumkitLoading() ) {
+			if ( processCycle( pDriver ) == 0.0 ) {
+				nSilentCycles++;
+			}
+			CPPUNIT_ASSERT( ++nCycles < 10000 );
+			handleEvents();
+			usleep( 1000 );
+		}
+		for ( int i = 0; i < 100; i++ ) {
+			if ( processCycle( pDriver ) == 0.0 ) {
+				nSilentCycles++;
+			}
+		}
+		___INFOLOG( QString( "drumkit switched within %1 cycles, %2 silent" ).arg( nCycles ).arg( nSilentCycles ) );
+		CPPUNIT_ASSERT_EQUAL( 0, nSilentCycles );
+
+		CPPUNIT_ASSERT( pHydrogen->getCurrentDrumkitname() == "H2 test DK" );
+		// the instruments beyond the new drumkit have notes and are kept
+		CPPUNIT_ASSERT_EQUAL( 8, pSong->get_instrument_list()->size() );
+		CPPUNIT_ASSERT( pSong->get_instrument_list()->get( 0 )->get_name() == "Crash" );
+
+		pDriver->m_transport.m_status = TransportInfo::STOPPED;
+		pDriver->processCycle();
+		AudioEngine::get_instance()->get_sampler()->stop_playing_notes();
+	}
+
+	void testDiscardExtraInstruments()
+	{
+		Hydrogen* pHydrogen = Hydrogen::get_instance();
+		Song* pSong = newSong();
+		pHydrogen->setSong( pSong );
+		Drumkit* pDrumkit = Drumkit::load( BASE_DIR"/drumkit" );
+		CPPUNIT_ASSERT( pDrumkit );
+
+		// the transport is stopped, the loader thread switches on its own
+		CPPUNIT_ASSERT( pHydrogen->loadDrumkitAsync( pDrumkit, Hydrogen::SWITCH_NOW, false ) );
+		CPPUNIT_ASSERT( !pHydrogen->loadDrumkitAsync( pDrumkit, Hydrogen::SWITCH_NOW, false ) );
+		delete pDrumkit;
+		for ( int i = 0; pHydrogen->isDrumkitLoading(); i++ ) {
+			CPPUNIT_ASSERT( i < 1000 );
+			handleEvents();
+			usleep( 10000 );
+		}
+
+		CPPUNIT_ASSERT( pHydrogen->getCurrentDrumkitname() == "H2 test DK" );
+		CPPUNIT_ASSERT_EQUAL( 4, pSong->get_instrument_list()->size() );
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( DrumkitSwitchTest );
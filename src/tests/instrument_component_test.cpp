@@ -0,0 +1,153 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <hydrogen/basics/instrument_component.h>
+#include <hydrogen/basics/instrument_layer.h>
+#include <hydrogen/basics/sample.h>
+
+using namespace H2Core;
+
+class InstrumentComponentTest : public CppUnit::TestCase {
+	CPPUNIT_TEST_SUITE( InstrumentComponentTest );
+	CPPUNIT_TEST( testVelocityGroups );
+	CPPUNIT_TEST( testVelocityEdges );
+	CPPUNIT_TEST( testRoundRobin );
+	CPPUNIT_TEST( testNearestLoadedLayer );
+	CPPUNIT_TEST_SUITE_END();
+
+	InstrumentLayer* newLayer( float start, float end )
+	{
+		InstrumentLayer* layer = new InstrumentLayer( nullptr );
+		layer->set_start_velocity( start );
+		layer->set_end_velocity( end );
+		return layer;
+	}
+
+	InstrumentLayer* newSampleLayer( float start, float end, bool loaded )
+	{
+		Sample* sample;
+		if ( loaded ) {
+			sample = new Sample( "loaded.wav", 10, 44100, new float[10], new float[10] );
+		} else {
+			sample = new Sample( "lazy.wav" );
+		}
+		InstrumentLayer* layer = new InstrumentLayer( sample );
+		layer->set_start_velocity( start );
+		layer->set_end_velocity( end );
+		return layer;
+	}
+
+	void testVelocityGroups()
+	{
+		InstrumentComponent compo( 0 );
+		CPPUNIT_ASSERT_EQUAL( -1, compo.get_layer_group( 0.5f ) );
+
+		compo.set_layer( newLayer( 0.0f, 0.5f ), 0 );
+		compo.set_layer( newLayer( 0.6f, 1.0f ), 2 );
+
+		int low = compo.get_layer_group( 0.2f );
+		int high = compo.get_layer_group( 0.9f );
+		CPPUNIT_ASSERT( low != -1 && high != -1 && low != high );
+		CPPUNIT_ASSERT_EQUAL( 1, compo.get_group_size( low ) );
+		CPPUNIT_ASSERT_EQUAL( 0, compo.get_group_layer( low, 0 ) );
+		CPPUNIT_ASSERT_EQUAL( 2, compo.get_group_layer( high, 0 ) );
+		CPPUNIT_ASSERT_EQUAL( -1, compo.get_layer_group( 0.55f ) );
+		CPPUNIT_ASSERT_EQUAL( low, compo.get_layer_group( 0.0f ) );
+		CPPUNIT_ASSERT_EQUAL( high, compo.get_layer_group( 1.0f ) );
+
+		// editing a velocity range needs a table update
+		compo.get_layer( 2 )->set_start_velocity( 0.5f );
+		compo.update_layer_table();
+		CPPUNIT_ASSERT_EQUAL( 2, compo.get_group_size( compo.get_layer_group( 0.5f ) ) );
+		CPPUNIT_ASSERT_EQUAL( high, compo.get_layer_group( 0.55f ) );
+	}
+
+	void testVelocityEdges()
+	{
+		// ranges not falling on any grid, one of them narrower than 1/127
+		InstrumentComponent compo( 0 );
+		compo.set_layer( newLayer( 0.0f, 0.5f ), 0 );
+		compo.set_layer( newLayer( 0.5f, 0.7f ), 1 );
+		compo.set_layer( newLayer( 0.7f, 0.8f ), 2 );
+		compo.set_layer( newLayer( 0.81f, 1.0f ), 3 );
+		compo.set_layer( newLayer( 0.903f, 0.905f ), 4 );
+
+		// every velocity gets the layers whose range holds it, the first one is played
+		for ( int i = 0; i <= 10000; i++ ) {
+			float velocity = i / 10000.0f;
+			int group = compo.get_layer_group( velocity );
+			int first = -1;
+			int count = 0;
+			for ( int n = 0; n < 5; n++ ) {
+				InstrumentLayer* layer = compo.get_layer( n );
+				if ( velocity >= layer->get_start_velocity() && velocity <= layer->get_end_velocity() ) {
+					if ( first == -1 ) first = n;
+					count++;
+				}
+			}
+			if ( count == 0 ) {
+				CPPUNIT_ASSERT_EQUAL( -1, group );
+				continue;
+			}
+			CPPUNIT_ASSERT( group != -1 );
+			CPPUNIT_ASSERT_EQUAL( count, compo.get_group_size( group ) );
+			CPPUNIT_ASSERT_EQUAL( first, compo.get_group_layer( group, 0 ) );
+		}
+
+		// a shared edge plays the lower layer, the gap between two layers stays silent
+		CPPUNIT_ASSERT_EQUAL( 0, compo.get_group_layer( compo.get_layer_group( 0.5f ), 0 ) );
+		CPPUNIT_ASSERT_EQUAL( 2, compo.get_group_size( compo.get_layer_group( 0.5f ) ) );
+		CPPUNIT_ASSERT_EQUAL( 2, compo.get_group_layer( compo.get_layer_group( 0.8f ), 0 ) );
+		CPPUNIT_ASSERT_EQUAL( -1, compo.get_layer_group( 0.805f ) );
+		CPPUNIT_ASSERT_EQUAL( 3, compo.get_group_layer( compo.get_layer_group( 0.81f ), 0 ) );
+		CPPUNIT_ASSERT_EQUAL( 2, compo.get_group_size( compo.get_layer_group( 0.904f ) ) );
+		CPPUNIT_ASSERT_EQUAL( 1, compo.get_group_size( compo.get_layer_group( 0.9f ) ) );
+		CPPUNIT_ASSERT_EQUAL( -1, compo.get_layer_group( 1.5f ) );
+		CPPUNIT_ASSERT_EQUAL( -1, compo.get_layer_group( -0.1f ) );
+	}
+
+	void testRoundRobin()
+	{
+		InstrumentComponent compo( 0 );
+		compo.set_layer( newLayer( 0.0f, 1.0f ), 0 );
+		compo.set_layer( newLayer( 0.0f, 1.0f ), 1 );
+		compo.set_layer( newLayer( 0.0f, 1.0f ), 2 );
+
+		int group = compo.get_layer_group( 0.8f );
+		CPPUNIT_ASSERT_EQUAL( 3, compo.get_group_size( group ) );
+		CPPUNIT_ASSERT_EQUAL( group, compo.get_layer_group( 0.1f ) );
+		CPPUNIT_ASSERT_EQUAL( 0, compo.next_round_robin( group ) );
+		CPPUNIT_ASSERT_EQUAL( 1, compo.next_round_robin( group ) );
+		CPPUNIT_ASSERT_EQUAL( 2, compo.next_round_robin( group ) );
+		CPPUNIT_ASSERT_EQUAL( 0, compo.next_round_robin( group ) );
+
+		// counters are per component
+		InstrumentComponent other( &compo );
+		CPPUNIT_ASSERT_EQUAL( 0, other.next_round_robin( other.get_layer_group( 0.8f ) ) );
+		CPPUNIT_ASSERT_EQUAL( 1, compo.next_round_robin( group ) );
+	}
+
+	void testNearestLoadedLayer()
+	{
+		InstrumentComponent compo( 0 );
+		CPPUNIT_ASSERT_EQUAL( -1, compo.get_nearest_loaded_layer( 0.5f ) );
+
+		compo.set_layer( newSampleLayer( 0.0f, 0.25f, true ), 0 );
+		compo.set_layer( newSampleLayer( 0.25f, 0.5f, false ), 1 );
+		compo.set_layer( newSampleLayer( 0.5f, 0.75f, false ), 2 );
+		compo.set_layer( newSampleLayer( 0.75f, 1.0f, true ), 3 );
+
+		CPPUNIT_ASSERT_EQUAL( 0, compo.get_nearest_loaded_layer( 0.1f ) );
+		CPPUNIT_ASSERT_EQUAL( 0, compo.get_nearest_loaded_layer( 0.4f ) );
+		CPPUNIT_ASSERT_EQUAL( 3, compo.get_nearest_loaded_layer( 0.6f ) );
+
+		// only pooled data can be shared
+		Sample unpooled( "loaded.wav", 10, 44100, new float[10], new float[10] );
+		CPPUNIT_ASSERT( !compo.get_layer( 2 )->get_sample()->share( &unpooled ) );
+
+		// once loaded a layer is played for its own velocities
+		delete compo.get_layer( 2 )->get_sample();
+		compo.get_layer( 2 )->set_sample( new Sample( "loaded.wav", 10, 44100, new float[10], new float[10] ) );
+		CPPUNIT_ASSERT_EQUAL( 2, compo.get_nearest_loaded_layer( 0.6f ) );
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( InstrumentComponentTest );
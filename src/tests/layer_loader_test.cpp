@@ -0,0 +1,97 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <hydrogen/basics/song.h>
+#include <hydrogen/basics/note.h>
+#include <hydrogen/basics/sample.h>
+#include <hydrogen/basics/sample_pool.h>
+#include <hydrogen/basics/pattern.h>
+#include <hydrogen/basics/pattern_list.h>
+#include <hydrogen/basics/instrument.h>
+#include <hydrogen/basics/instrument_list.h>
+#include <hydrogen/basics/instrument_layer.h>
+#include <hydrogen/basics/instrument_component.h>
+#include <hydrogen/helpers/layer_loader.h>
+#include <QDir>
+
+using namespace H2Core;
+
+class LayerLoaderTest : public CppUnit::TestCase {
+	CPPUNIT_TEST_SUITE( LayerLoaderTest );
+	CPPUNIT_TEST( testScheduleAndFill );
+	CPPUNIT_TEST_SUITE_END();
+
+	QStringList m_paths;
+
+	Instrument* newInstrument( int id, const QStringList& files, const QList<float>& ranges )
+	{
+		Instrument* instrument = new Instrument( id, QString( "instrument %1" ).arg( id ) );
+		InstrumentComponent* compo = new InstrumentComponent( 0 );
+		for ( int i = 0; i < files.size(); i++ ) {
+			// samples without data, as created in lazy mode
+			InstrumentLayer* layer = new InstrumentLayer( new Sample( files[i] ) );
+			layer->set_start_velocity( ranges[ 2 * i ] );
+			layer->set_end_velocity( ranges[ 2 * i + 1 ] );
+			compo->set_layer( layer, i );
+		}
+		instrument->get_components()->push_back( compo );
+		return instrument;
+	}
+
+	public:
+	void setUp()
+	{
+		const int frames = 500;
+		for ( int f = 0; f < 3; f++ ) {
+			float* data_l = new float[ frames ];
+			float* data_r = new float[ frames ];
+			for ( int i = 0; i < frames; i++ ) {
+				data_l[i] = data_r[i] = f / 4.0f;
+			}
+			QString path = QDir::tempPath() + QString( "/h2_layer_%1.wav" ).arg( f );
+			Sample written( path, frames, 44100, data_l, data_r );
+			CPPUNIT_ASSERT( written.write( path, SF_FORMAT_WAV | SF_FORMAT_FLOAT ) );
+			m_paths << path;
+		}
+	}
+
+	void tearDown()
+	{
+		SamplePool::purge();
+		for ( int f = 0; f < m_paths.size(); f++ ) QFile::remove( m_paths[f] );
+		m_paths.clear();
+	}
+
+	void testScheduleAndFill()
+	{
+		Song song( "lazy", "test", 120, 0.5 );
+		InstrumentList* instruments = new InstrumentList();
+		Instrument* snare = newInstrument( 0, QStringList() << m_paths[0] << m_paths[1], QList<float>() << 0.0f << 0.5f << 0.5f << 1.0f );
+		Instrument* kick = newInstrument( 1, QStringList() << m_paths[2], QList<float>() << 0.0f << 1.0f );
+		instruments->add( snare );
+		instruments->add( kick );
+		song.set_instrument_list( instruments );
+		Pattern* pattern = new Pattern();
+		pattern->insert_note( new Note( snare, 0, 0.8f, 0.5f, 0.5f, -1, 0 ) );
+		PatternList* patterns = new PatternList();
+		patterns->add( pattern );
+		song.set_pattern_list( patterns );
+
+		// the layer reached by the song comes first
+		std::vector<QString> files = LayerLoader::schedule( &song );
+		CPPUNIT_ASSERT_EQUAL( 3, ( int )files.size() );
+		CPPUNIT_ASSERT( files[0] == m_paths[1] );
+
+		Sample loaded( m_paths[1] );
+		loaded.load();
+		CPPUNIT_ASSERT_EQUAL( 1, LayerLoader::fill( &song, &loaded ) );
+		InstrumentComponent* compo = snare->get_components()->front();
+		CPPUNIT_ASSERT( compo->get_layer( 1 )->get_sample()->get_data_l() == loaded.get_data_l() );
+		CPPUNIT_ASSERT( !compo->get_layer( 0 )->get_sample()->get_data_l() );
+		CPPUNIT_ASSERT_EQUAL( 1, compo->get_nearest_loaded_layer( 0.1f ) );
+
+		// loaded layers are not scheduled again
+		files = LayerLoader::schedule( &song );
+		CPPUNIT_ASSERT_EQUAL( 2, ( int )files.size() );
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( LayerLoaderTest );
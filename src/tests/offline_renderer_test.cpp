@@ -0,0 +1,304 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <hydrogen/hydrogen.h>
+#include <hydrogen/timeline.h>
+#include <hydrogen/Preferences.h>
+#include <hydrogen/basics/song.h>
+#include <hydrogen/basics/instrument.h>
+#include <hydrogen/basics/instrument_list.h>
+#include <hydrogen/basics/instrument_component.h>
+#include <hydrogen/basics/instrument_layer.h>
+#include <hydrogen/basics/sample.h>
+#include <hydrogen/IO/AudioOutput.h>
+#include <hydrogen/IO/OfflineRenderer.h>
+#include <hydrogen/helpers/filesystem.h>
+#include <hydrogen/helpers/stress_song.h>
+#include <QFile>
+#include <sndfile.h>
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <vector>
+
+using namespace H2Core;
+
+class OfflineRendererTest : public CppUnit::TestCase {
+	CPPUNIT_TEST_SUITE( OfflineRendererTest );
+	CPPUNIT_TEST( testMemory );
+	CPPUNIT_TEST( testRange );
+	CPPUNIT_TEST( testFile );
+	CPPUNIT_TEST( testStems );
+	CPPUNIT_TEST( testSegments );
+	CPPUNIT_TEST( testResidency );
+	CPPUNIT_TEST_SUITE_END();
+
+	StressSong::Options m_options;
+
+	public:
+	void setUp()
+	{
+		Preferences::create_instance();
+		Preferences::get_instance()->m_sAudioDriver = "Fake";
+		Hydrogen::create_instance();
+		m_options = StressSong::Options();
+		m_options.m_nInstruments = 8;
+		m_options.m_nSampleFrames = 4096;
+		m_options.m_nColumns = 4;
+		m_options.m_bMixedSelection = false;    // no random layer selection
+	}
+
+	void tearDown()
+	{
+		Hydrogen::get_instance()->getTimeline()->m_timelinevector.clear();
+	}
+
+	void testMemory()
+	{
+		Song* pSong = StressSong::generate( m_options );
+		long long nLiveFrames = Hydrogen::get_instance()->getAudioOutput()->m_transport.m_nFrames;
+
+		// 120 bpm at 48 ticks per beat is 459.375 frames per tick
+		OfflineRenderer::Options options;
+		OfflineRenderer renderer( pSong, options );
+		CPPUNIT_ASSERT_EQUAL( 4 * 88200ul, renderer.get_length() );
+
+		std::vector<float> left, right;
+		CPPUNIT_ASSERT( renderer.render( &left, &right ) );
+		CPPUNIT_ASSERT_EQUAL( ( size_t )renderer.get_length(), left.size() );
+		CPPUNIT_ASSERT_EQUAL( left.size(), right.size() );
+		const OfflineRenderer::Report& report = renderer.get_report();
+		CPPUNIT_ASSERT_EQUAL( renderer.get_length(), report.m_nFrames );
+		CPPUNIT_ASSERT( report.m_fPeak_L > 0.0 );
+		CPPUNIT_ASSERT( report.m_fSpeed > 0.0 );
+		___INFOLOG( QString( "%1 s of audio rendered in %2 s, %3x realtime" )
+					.arg( report.m_fDuration ).arg( report.m_fRenderTime ).arg( report.m_fSpeed ) );
+
+		// the live driver has not moved
+		CPPUNIT_ASSERT_EQUAL( nLiveFrames, Hydrogen::get_instance()->getAudioOutput()->m_transport.m_nFrames );
+
+		// without humanization the render is reproducible
+		OfflineRenderer again( pSong, options );
+		std::vector<float> left2, right2;
+		CPPUNIT_ASSERT( again.render( &left2, &right2 ) );
+		CPPUNIT_ASSERT( left == left2 );
+		CPPUNIT_ASSERT( right == right2 );
+
+		delete pSong;
+	}
+
+	void testRange()
+	{
+		m_options.m_nSampleFrames = 22050;
+		Song* pSong = StressSong::generate( m_options );
+		OfflineRenderer::Options options;
+		options.m_nFirstColumn = 1;
+		options.m_nLastColumn = 2;
+		options.m_nTailFrames = 44100;
+		OfflineRenderer renderer( pSong, options );
+		CPPUNIT_ASSERT_EQUAL( 2 * 88200ul, renderer.get_length() );
+
+		std::vector<float> left, right;
+		CPPUNIT_ASSERT( renderer.render( &left, &right ) );
+		// the voices of the last column ring into the tail
+		CPPUNIT_ASSERT( left.size() > renderer.get_length() );
+		CPPUNIT_ASSERT( left.size() <= renderer.get_length() + 44100 );
+
+		delete pSong;
+	}
+
+	void testFile()
+	{
+		Song* pSong = StressSong::generate( m_options );
+		QString sPath = Filesystem::tmp_dir() + "/offline.wav";
+		OfflineRenderer::Options options;
+		OfflineRenderer renderer( pSong, options );
+		renderer.start( sPath, 16 );
+		renderer.wait();
+		CPPUNIT_ASSERT( !renderer.is_running() );
+		CPPUNIT_ASSERT( renderer.succeeded() );
+
+		SF_INFO info;
+		info.format = 0;
+		SNDFILE* pFile = sf_open( sPath.toLocal8Bit(), SFM_READ, &info );
+		CPPUNIT_ASSERT( pFile );
+		CPPUNIT_ASSERT_EQUAL( 2, info.channels );
+		CPPUNIT_ASSERT_EQUAL( 44100, info.samplerate );
+		CPPUNIT_ASSERT_EQUAL( ( sf_count_t )renderer.get_length(), info.frames );
+		sf_close( pFile );
+
+		QFile::remove( sPath );
+		delete pSong;
+	}
+
+	void testStems()
+	{
+		m_options.m_nComponents = 2;
+		Song* pSong = StressSong::generate( m_options );
+		OfflineRenderer::Options options;
+		options.m_stems = OfflineRenderer::INSTRUMENT_STEMS;
+		OfflineRenderer renderer( pSong, options );
+		int nStems = renderer.get_stem_count();
+		CPPUNIT_ASSERT( nStems > 0 && nStems <= 8 );
+		QStringList filenames = renderer.get_stem_filenames( "/tmp/song.x/export.flac" );
+		CPPUNIT_ASSERT_EQUAL( nStems, filenames.size() );
+		CPPUNIT_ASSERT( filenames[0] == "/tmp/song.x/export-" + renderer.get_stem_name( 0 ) + ".flac" );
+
+		// the tracks add up to the master bus
+		unsigned nFrames;
+		float fPeak = 0.0;
+		while ( ( nFrames = renderer.render_block() ) > 0 ) {
+			for ( unsigned i = 0; i < nFrames; i++ ) {
+				float fSum_L = 0.0, fSum_R = 0.0;
+				for ( int nStem = 0; nStem < nStems; nStem++ ) {
+					fSum_L += renderer.get_stem_L( nStem )[i];
+					fSum_R += renderer.get_stem_R( nStem )[i];
+				}
+				CPPUNIT_ASSERT( fabsf( fSum_L - renderer.getOut_L()[i] ) < 1e-4 );
+				CPPUNIT_ASSERT( fabsf( fSum_R - renderer.getOut_R()[i] ) < 1e-4 );
+				fPeak = std::max( fPeak, fabsf( fSum_L ) );
+			}
+		}
+		CPPUNIT_ASSERT( fPeak > 0.0 );
+
+		options.m_stems = OfflineRenderer::COMPONENT_STEMS;
+		OfflineRenderer components( pSong, options );
+		CPPUNIT_ASSERT_EQUAL( 2 * nStems, components.get_stem_count() );
+
+		// every component of a playing instrument is routed to a track of its own
+		std::set<int> tracks;
+		InstrumentList* pInstruments = components.get_song()->get_instrument_list();
+		for ( int i = 0; i < pInstruments->size(); i++ ) {
+			std::vector<InstrumentComponent*>* pComponents = pInstruments->get( i )->get_components();
+			for ( int j = 0; j < pComponents->size(); j++ ) {
+				int nTrack = components.getTrackIndex( pInstruments->get( i ), ( *pComponents )[j] );
+				if ( nTrack == -1 ) continue;
+				CPPUNIT_ASSERT( components.getTrackBuffer_L( nTrack ) == components.get_stem_L( nTrack ) );
+				CPPUNIT_ASSERT( components.getTrackBuffer_R( nTrack ) == components.get_stem_R( nTrack ) );
+				tracks.insert( nTrack );
+			}
+		}
+		CPPUNIT_ASSERT_EQUAL( ( size_t )components.get_stem_count(), tracks.size() );
+		CPPUNIT_ASSERT( components.getTrackBuffer_L( components.get_stem_count() ) == NULL );
+
+		delete pSong;
+	}
+
+	/** give every layer of the song a new sample of its file, set up by a function */
+	void replaceSamples( Song* pSong, const std::vector<QString>& files, Sample* ( *make )( const QString& ) )
+	{
+		int nFile = 0;
+		InstrumentList* pInstruments = pSong->get_instrument_list();
+		for ( int i = 0; i < pInstruments->size(); i++ ) {
+			std::vector<InstrumentComponent*>* pComponents = pInstruments->get( i )->get_components();
+			for ( int j = 0; j < pComponents->size(); j++ ) {
+				for ( int n = 0; n < MAX_LAYERS; n++ ) {
+					InstrumentLayer* pLayer = ( *pComponents )[j]->get_layer( n );
+					if ( !pLayer ) continue;
+					delete pLayer->get_sample();
+					pLayer->set_sample( make( files[ nFile++ ] ) );
+				}
+			}
+		}
+	}
+
+	static Sample* loadedSample( const QString& sPath )
+	{
+		return Sample::load( sPath );
+	}
+
+	static Sample* streamedSample( const QString& sPath )
+	{
+		Sample* pSample = Sample::load( sPath );
+		CPPUNIT_ASSERT( pSample->stream( 1024 ) );
+		return pSample;
+	}
+
+	static Sample* lazySample( const QString& sPath )
+	{
+		return new Sample( sPath );
+	}
+
+	void testResidency()
+	{
+		// the samples are written to files so they can be streamed or loaded later
+		m_options.m_nInstruments = 4;
+		m_options.m_nSampleFrames = 30000;
+		Song* pSong = StressSong::generate( m_options );
+		std::vector<QString> files;
+		InstrumentList* pInstruments = pSong->get_instrument_list();
+		for ( int i = 0; i < pInstruments->size(); i++ ) {
+			std::vector<InstrumentComponent*>* pComponents = pInstruments->get( i )->get_components();
+			for ( int j = 0; j < pComponents->size(); j++ ) {
+				for ( int n = 0; n < MAX_LAYERS; n++ ) {
+					InstrumentLayer* pLayer = ( *pComponents )[j]->get_layer( n );
+					if ( !pLayer ) continue;
+					QString sPath = Filesystem::tmp_dir() + QString( "/residency_%1.wav" ).arg( files.size() );
+					CPPUNIT_ASSERT( pLayer->get_sample()->write( sPath, SF_FORMAT_WAV | SF_FORMAT_FLOAT ) );
+					files.push_back( sPath );
+				}
+			}
+		}
+
+		OfflineRenderer::Options options;
+		replaceSamples( pSong, files, loadedSample );
+		std::vector<float> left, right;
+		{
+			OfflineRenderer renderer( pSong, options );
+			CPPUNIT_ASSERT( renderer.render( &left, &right ) );
+		}
+		CPPUNIT_ASSERT( *std::max_element( left.begin(), left.end() ) > 0.0 );
+
+		// a streamed kit renders whole at any speed, a kit still loading renders its own layers
+		Sample* ( *kits[] )( const QString& ) = { streamedSample, lazySample };
+		for ( int k = 0; k < 2; k++ ) {
+			replaceSamples( pSong, files, kits[k] );
+			OfflineRenderer renderer( pSong, options );
+			std::vector<float> left2, right2;
+			CPPUNIT_ASSERT( renderer.render( &left2, &right2 ) );
+			CPPUNIT_ASSERT( left == left2 );
+			CPPUNIT_ASSERT( right == right2 );
+		}
+
+		// the segments get the same data
+		std::vector<float> left3, right3;
+		CPPUNIT_ASSERT( OfflineRenderer::render_parallel( pSong, options, 2, &left3, &right3, NULL ) );
+		CPPUNIT_ASSERT( left == left3 );
+
+		for ( int i = 0; i < files.size(); i++ ) {
+			QFile::remove( files[i] );
+		}
+		delete pSong;
+	}
+
+	void testSegments()
+	{
+		// voices ringing across the segment boundaries, notes moved around them and tempo changes
+		m_options.m_nSampleFrames = 60000;
+		m_options.m_nColumns = 8;
+		m_options.m_fLeadLag = 0.5;
+		m_options.m_fSwing = 0.5;
+		m_options.m_nTempoChanges = 2;
+		Song* pSong = StressSong::generate( m_options );
+		StressSong::fill_timeline( Hydrogen::get_instance()->getTimeline(), m_options );
+		OfflineRenderer::Options options;
+		options.m_bUseTimelineBpm = true;
+		options.m_nTailFrames = 88200;
+
+		OfflineRenderer renderer( pSong, options );
+		std::vector<float> left, right;
+		CPPUNIT_ASSERT( renderer.render( &left, &right ) );
+
+		// joined end to end, the segments give the very same samples
+		std::vector<float> left2, right2;
+		OfflineRenderer::Report report;
+		CPPUNIT_ASSERT( OfflineRenderer::render_parallel( pSong, options, 3, &left2, &right2, &report ) );
+		CPPUNIT_ASSERT_EQUAL( left.size(), left2.size() );
+		CPPUNIT_ASSERT( left == left2 );
+		CPPUNIT_ASSERT( right == right2 );
+		CPPUNIT_ASSERT_EQUAL( ( unsigned long )left.size(), report.m_nFrames );
+		CPPUNIT_ASSERT_EQUAL( renderer.get_report().m_fPeak_L, report.m_fPeak_L );
+
+		delete pSong;
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( OfflineRendererTest );
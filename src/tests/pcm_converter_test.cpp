@@ -0,0 +1,91 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <hydrogen/IO/PcmConverter.h>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <vector>
+
+using namespace H2Core;
+
+class PcmConverterTest : public CppUnit::TestCase {
+	CPPUNIT_TEST_SUITE( PcmConverterTest );
+	CPPUNIT_TEST( testSaturation );
+	CPPUNIT_TEST( testFormats );
+	CPPUNIT_TEST_SUITE_END();
+
+	std::vector<float> m_buffers[3];
+	const float* m_channels[3];
+
+	public:
+	void setUp()
+	{
+		// overs on both sides, an odd count runs both the vector and the scalar loops
+		const unsigned nFrames = 1031;
+		for ( int c = 0; c < 3; c++ ) {
+			m_buffers[c].resize( nFrames );
+			for ( unsigned i = 0; i < nFrames; i++ ) {
+				m_buffers[c][i] = sinf( i * 0.05 * ( c + 1 ) ) * 1.25;
+			}
+			m_channels[c] = &m_buffers[c][0];
+		}
+	}
+
+	static float clamp( float fValue )
+	{
+		return std::min( 1.0f, std::max( -1.0f, fValue ) );
+	}
+
+	void testSaturation()
+	{
+		float left[5] = { 1.0, 1.5, -1.0, -4.0, 0.5 };
+		float right[5] = { -2.0, 0.0, 3.0, 1.0, -0.5 };
+		const float* channels[2] = { left, right };
+		int16_t out[10];
+		PcmConverter::interleave( channels, 2, 5, PcmConverter::S16, out );
+		int16_t expected[10] = { 32767, -32767, 32767, 0, -32767, 32767, -32767, 32767, 16384, -16384 };
+		for ( int i = 0; i < 10; i++ ) {
+			CPPUNIT_ASSERT_EQUAL( expected[i], out[i] );
+		}
+
+		int32_t out32[10];
+		PcmConverter::interleave( channels, 2, 5, PcmConverter::S32, out32 );
+		CPPUNIT_ASSERT_EQUAL( 8388607 * 256, out32[0] );
+		CPPUNIT_ASSERT_EQUAL( -8388607 * 256, out32[1] );
+		CPPUNIT_ASSERT_EQUAL( 8388607 * 256, out32[2] );
+		CPPUNIT_ASSERT_EQUAL( -8388607 * 256, out32[6] );
+	}
+
+	void testFormats()
+	{
+		const unsigned nFrames = m_buffers[0].size();
+		for ( int nChannels = 1; nChannels <= 3; nChannels++ ) {
+			std::vector<int16_t> s16( nFrames * nChannels );
+			std::vector<int32_t> s24( nFrames * nChannels );
+			std::vector<int32_t> s32( nFrames * nChannels );
+			std::vector<unsigned char> s24_3( nFrames * nChannels * 3 );
+			std::vector<float> f32( nFrames * nChannels );
+			PcmConverter::interleave( m_channels, nChannels, nFrames, PcmConverter::S16, &s16[0] );
+			PcmConverter::interleave( m_channels, nChannels, nFrames, PcmConverter::S24, &s24[0] );
+			PcmConverter::interleave( m_channels, nChannels, nFrames, PcmConverter::S32, &s32[0] );
+			PcmConverter::interleave( m_channels, nChannels, nFrames, PcmConverter::S24_3, &s24_3[0] );
+			PcmConverter::interleave( m_channels, nChannels, nFrames, PcmConverter::FLOAT, &f32[0] );
+
+			for ( unsigned i = 0; i < nFrames; i++ ) {
+				for ( int c = 0; c < nChannels; c++ ) {
+					int n = i * nChannels + c;
+					float fValue = clamp( m_buffers[c][i] );
+					CPPUNIT_ASSERT_EQUAL( ( int16_t )lrintf( fValue * 32767 ), s16[n] );
+					CPPUNIT_ASSERT_EQUAL( ( int32_t )lrintf( fValue * 8388607 ), s24[n] );
+					CPPUNIT_ASSERT_EQUAL( s24[n] * 256, s32[n] );
+					int32_t nPacked = s24_3[n * 3] | ( s24_3[n * 3 + 1] << 8 ) | ( ( signed char )s24_3[n * 3 + 2] << 16 );
+					CPPUNIT_ASSERT_EQUAL( s24[n], nPacked );
+					CPPUNIT_ASSERT_EQUAL( fValue, f32[n] );
+				}
+			}
+		}
+		CPPUNIT_ASSERT_EQUAL( 3, PcmConverter::sample_bytes( PcmConverter::S24_3 ) );
+		CPPUNIT_ASSERT_EQUAL( 2, PcmConverter::sample_bytes( PcmConverter::S16 ) );
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( PcmConverterTest );
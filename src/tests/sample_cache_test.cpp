@@ -0,0 +1,103 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <hydrogen/basics/sample.h>
+#include <hydrogen/helpers/filesystem.h>
+#include <hydrogen/helpers/sample_cache.h>
+#include <QDir>
+
+using namespace H2Core;
+
+class SampleCacheTest : public CppUnit::TestCase {
+	CPPUNIT_TEST_SUITE( SampleCacheTest );
+	CPPUNIT_TEST( testCache );
+	CPPUNIT_TEST( testProcessing );
+	CPPUNIT_TEST_SUITE_END();
+
+	int cachedFiles()
+	{
+		return QDir( Filesystem::samples_cache_dir() ).entryList( QStringList( "*.h2cache" ), QDir::Files ).size();
+	}
+
+	void testCache()
+	{
+		const int frames = 5000;
+		float* data_l = new float[ frames ];
+		float* data_r = new float[ frames ];
+		for ( int i = 0; i < frames; i++ ) {
+			data_l[i] = ( i % 100 ) / 100.0f;
+			data_r[i] = -data_l[i];
+		}
+		QString path = QDir::tempPath() + "/h2_cached.wav";
+		Sample written( path, frames, 44100, data_l, data_r );
+		CPPUNIT_ASSERT( written.write( path, SF_FORMAT_WAV | SF_FORMAT_FLOAT ) );
+
+		SampleCache::set_enabled( true, 0 );
+		SampleCache::clear();
+		CPPUNIT_ASSERT_EQUAL( 0, cachedFiles() );
+
+		// the first load decodes and stores, the second one maps the stored data
+		Sample* decoded = Sample::load( path );
+		CPPUNIT_ASSERT( decoded != 0 );
+		CPPUNIT_ASSERT_EQUAL( 1, cachedFiles() );
+		Sample* mapped = Sample::load( path );
+		CPPUNIT_ASSERT( mapped != 0 );
+		CPPUNIT_ASSERT_EQUAL( frames, mapped->get_frames() );
+		CPPUNIT_ASSERT_EQUAL( 44100, mapped->get_sample_rate() );
+		for ( int i = 0; i < frames; i++ ) {
+			CPPUNIT_ASSERT_EQUAL( data_l[i], mapped->get_data_l()[i] );
+			CPPUNIT_ASSERT_EQUAL( data_r[i], mapped->get_data_r()[i] );
+		}
+
+		// in place transformations work on a private copy
+		Sample::VelocityEnvelope velocity;
+		velocity.push_back( Sample::EnvelopePoint( 0, 91 ) );
+		velocity.push_back( Sample::EnvelopePoint( 841, 91 ) );
+		mapped->apply_velocity( velocity );
+		CPPUNIT_ASSERT_EQUAL( 0.0f, mapped->get_data_l()[1] );
+		CPPUNIT_ASSERT_EQUAL( data_l[1], decoded->get_data_l()[1] );
+
+		delete mapped;
+		delete decoded;
+		SampleCache::clear();
+		CPPUNIT_ASSERT_EQUAL( 0, cachedFiles() );
+		SampleCache::set_enabled( false, 0 );
+		QFile::remove( path );
+	}
+
+	void testProcessing()
+	{
+		const int frames = 1000;
+		float* data_l = new float[ frames ];
+		float* data_r = new float[ frames ];
+		float stretched[ frames ];
+		for ( int i = 0; i < frames; i++ ) {
+			data_l[i] = ( i % 50 ) / 50.0f;
+			data_r[i] = data_l[i];
+			stretched[i] = 0.5f;
+		}
+		QString path = QDir::tempPath() + "/h2_processed.wav";
+		Sample written( path, frames, 44100, data_l, data_r );
+		CPPUNIT_ASSERT( written.write( path, SF_FORMAT_WAV | SF_FORMAT_FLOAT ) );
+
+		SampleCache::set_enabled( true, 0 );
+		SampleCache::clear();
+
+		// processed data is only found under its own processing
+		CPPUNIT_ASSERT( SampleCache::store( path, frames, 44100, stretched, stretched, "a" ) );
+		int cached_frames = 0, sample_rate = 0;
+		float* cached_l = 0;
+		float* cached_r = 0;
+		QFile* file = SampleCache::map( path, &cached_frames, &sample_rate, &cached_l, &cached_r, "a" );
+		CPPUNIT_ASSERT( file != 0 );
+		CPPUNIT_ASSERT_EQUAL( frames, cached_frames );
+		CPPUNIT_ASSERT_EQUAL( 0.5f, cached_l[ frames - 1 ] );
+		delete file;
+		CPPUNIT_ASSERT( SampleCache::map( path, &cached_frames, &sample_rate, &cached_l, &cached_r, "b" ) == 0 );
+		CPPUNIT_ASSERT( SampleCache::map( path, &cached_frames, &sample_rate, &cached_l, &cached_r ) == 0 );
+
+		SampleCache::clear();
+		SampleCache::set_enabled( false, 0 );
+		QFile::remove( path );
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( SampleCacheTest );
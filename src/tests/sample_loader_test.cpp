@@ -0,0 +1,52 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <hydrogen/basics/sample.h>
+#include <hydrogen/helpers/sample_loader.h>
+#include <QDir>
+
+using namespace H2Core;
+
+class SampleLoaderTest : public CppUnit::TestCase {
+	CPPUNIT_TEST_SUITE( SampleLoaderTest );
+	CPPUNIT_TEST( testLoad );
+	CPPUNIT_TEST_SUITE_END();
+
+	void testLoad()
+	{
+		const int files = 5;
+		QStringList paths;
+		for ( int f = 0; f < files; f++ ) {
+			int frames = 1000 * ( f + 1 );
+			float* data_l = new float[ frames ];
+			float* data_r = new float[ frames ];
+			for ( int i = 0; i < frames; i++ ) {
+				data_l[i] = f / 10.0f;
+				data_r[i] = -data_l[i];
+			}
+			QString path = QDir::tempPath() + QString( "/h2_loader_%1.wav" ).arg( f );
+			Sample written( path, frames, 44100, data_l, data_r );
+			CPPUNIT_ASSERT( written.write( path, SF_FORMAT_WAV | SF_FORMAT_FLOAT ) );
+			paths << path;
+		}
+
+		// every file twice, the loader decodes each once
+		SampleLoader loader( 3 );
+		std::vector<Sample*> samples;
+		for ( int i = 0; i < 2 * files; i++ ) {
+			samples.push_back( new Sample( paths[ i % files ] ) );
+			loader.add( samples.back() );
+		}
+		CPPUNIT_ASSERT_EQUAL( 2 * files, loader.size() );
+		loader.run( false );
+
+		for ( int i = 0; i < 2 * files; i++ ) {
+			int f = i % files;
+			CPPUNIT_ASSERT_EQUAL( 1000 * ( f + 1 ), samples[i]->get_frames() );
+			CPPUNIT_ASSERT_EQUAL( f / 10.0f, samples[i]->get_data_l()[0] );
+			CPPUNIT_ASSERT_EQUAL( -f / 10.0f, samples[i]->get_data_r()[ samples[i]->get_frames() - 1 ] );
+			delete samples[i];
+		}
+		for ( int f = 0; f < files; f++ ) QFile::remove( paths[f] );
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( SampleLoaderTest );
@@ -0,0 +1,160 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <hydrogen/basics/sample.h>
+#include <hydrogen/basics/sample_pool.h>
+#include <hydrogen/helpers/sample_packer.h>
+#include <QDir>
+#include <QTime>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace H2Core;
+
+class SamplePackerTest : public CppUnit::TestCase {
+	CPPUNIT_TEST_SUITE( SamplePackerTest );
+	CPPUNIT_TEST( testIntegerRoundTrip );
+	CPPUNIT_TEST( testHalfRoundTrip );
+	CPPUNIT_TEST( testCompactSample );
+	CPPUNIT_TEST( testUnpackCost );
+	CPPUNIT_TEST_SUITE_END();
+
+	QString m_sPath;
+
+	public:
+	void setUp()
+	{
+		const int frames = 1000;
+		float* data_l = new float[ frames ];
+		float* data_r = new float[ frames ];
+		for ( int i = 0; i < frames; i++ ) {
+			data_l[i] = ( ( i % 200 ) - 100 ) / 128.0f;
+			data_r[i] = -data_l[i] / 2;
+		}
+		m_sPath = QDir::tempPath() + "/h2_packed.wav";
+		Sample written( m_sPath, frames, 44100, data_l, data_r );
+		CPPUNIT_ASSERT( written.write( m_sPath, SF_FORMAT_WAV | SF_FORMAT_PCM_16 ) );
+		SamplePool::purge();
+	}
+
+	void tearDown()
+	{
+		SamplePool::purge();
+		QFile::remove( m_sPath );
+	}
+
+	void testIntegerRoundTrip()
+	{
+		const int frames = 5;
+		// values on the 16 bits grid, including both ends of the range
+		float data[ frames ] = { -1.0f, -0.5f, 0.0f, 1.0f / 32768.0f, 32767.0f / 32768.0f };
+		float out[ frames ];
+
+		char* packed = SamplePacker::pack( SamplePacker::INT16, data, frames );
+		SamplePacker::unpack( SamplePacker::INT16, packed, 0, frames, out );
+		for ( int i = 0; i < frames; i++ ) CPPUNIT_ASSERT_EQUAL( data[i], out[i] );
+		delete[] packed;
+
+		// 24 bits keeps the 16 bits grid and its own
+		data[3] = -3.0f / 8388608.0f;
+		packed = SamplePacker::pack( SamplePacker::INT24, data, frames );
+		SamplePacker::unpack( SamplePacker::INT24, packed, 1, frames - 1, out );
+		for ( int i = 1; i < frames; i++ ) CPPUNIT_ASSERT_EQUAL( data[i], out[ i - 1 ] );
+		delete[] packed;
+
+		// out of range values are clipped
+		float loud = 1.5f;
+		packed = SamplePacker::pack( SamplePacker::INT16, &loud, 1 );
+		SamplePacker::unpack( SamplePacker::INT16, packed, 0, 1, out );
+		CPPUNIT_ASSERT_EQUAL( 32767.0f / 32768.0f, out[0] );
+		delete[] packed;
+	}
+
+	void testHalfRoundTrip()
+	{
+		const int frames = 2001;
+		std::vector<float> data( frames ), out( frames );
+		for ( int i = 0; i < frames; i++ ) data[i] = ( i - 1000 ) / 1000.0f;
+		data[1] = 1e-6f;
+
+		char* packed = SamplePacker::pack( SamplePacker::HALF, &data[0], frames );
+		SamplePacker::unpack( SamplePacker::HALF, packed, 0, frames, &out[0] );
+		for ( int i = 0; i < frames; i++ ) {
+			CPPUNIT_ASSERT_DOUBLES_EQUAL( data[i], out[i], 1e-3 );
+		}
+		CPPUNIT_ASSERT_EQUAL( 0.0f, out[1000] );
+		CPPUNIT_ASSERT_EQUAL( -1.0f, out[0] );
+		delete[] packed;
+	}
+
+	void testCompactSample()
+	{
+		CPPUNIT_ASSERT( SamplePacker::native_format( m_sPath ) == SamplePacker::INT16 );
+
+		Sample* plain = Sample::load( m_sPath );
+		Sample* compact = Sample::load( m_sPath );
+		CPPUNIT_ASSERT( compact->compact( SamplePacker::INT16 ) );
+		CPPUNIT_ASSERT( compact->is_compact() );
+		CPPUNIT_ASSERT( !compact->is_empty() );
+		CPPUNIT_ASSERT( !compact->get_data_l() );
+		CPPUNIT_ASSERT_EQUAL( plain->get_frames(), compact->get_frames() );
+
+		// a 16 bits file is held without loss
+		std::vector<float> l( 300 ), r( 300 );
+		CPPUNIT_ASSERT_EQUAL( 300, compact->read( 700, 400, &l[0], &r[0] ) );
+		for ( int i = 0; i < 300; i++ ) {
+			CPPUNIT_ASSERT_EQUAL( plain->get_data_l()[ 700 + i ], l[i] );
+			CPPUNIT_ASSERT_EQUAL( plain->get_data_r()[ 700 + i ], r[i] );
+		}
+
+		// samples compacted the same way share their data
+		Sample* again = Sample::load( m_sPath );
+		CPPUNIT_ASSERT( again->compact( SamplePacker::INT16 ) );
+		CPPUNIT_ASSERT_EQUAL( 2, SamplePool::size() );
+
+		delete plain;
+		delete compact;
+		delete again;
+	}
+
+	void testUnpackCost()
+	{
+		// a second of 44.1 kHz stereo unpacked in render sized blocks, as the sampler reads it
+		const int frames = 2 * 44100;
+		const int block = 1024;
+		const int rounds = 20;
+		std::vector<float> data( frames ), out( block );
+		for ( int i = 0; i < frames; i++ ) data[i] = sinf( i * 0.01f ) * 0.9f;
+
+		SamplePacker::Format formats[] = { SamplePacker::FLOAT, SamplePacker::INT16, SamplePacker::INT24, SamplePacker::HALF };
+		const char* names[] = { "float", "int16", "int24", "half" };
+		for ( int f = 0; f < 4; f++ ) {
+			char* packed = SamplePacker::pack( formats[f], &data[0], frames );
+			QTime timer;
+			timer.start();
+			float fSum = 0;
+			for ( int r = 0; r < rounds; r++ ) {
+				for ( int first = 0; first < frames; first += block ) {
+					int count = std::min( block, frames - first );
+					SamplePacker::unpack( formats[f], packed, first, count, &out[0] );
+					fSum += out[ count - 1 ];
+				}
+			}
+			int nTime = timer.elapsed();
+			// the sum keeps the unpacking from being optimized away
+			CPPUNIT_ASSERT( fSum == fSum );
+			long long nBytes = ( long long )frames * SamplePacker::bytes_per_frame( formats[f] );
+			long long nSaved = ( long long )frames * sizeof( float ) - nBytes;
+			___INFOLOG( QString( "%1: %2 ms for %3 frames unpacked, %4 bytes held, %5 bytes saved" )
+						.arg( names[f] ).arg( nTime ).arg( ( long long )frames * rounds ).arg( nBytes ).arg( nSaved ) );
+
+			// the unpacked blocks match a single unpack of the whole data
+			std::vector<float> whole( frames );
+			SamplePacker::unpack( formats[f], packed, 0, frames, &whole[0] );
+			SamplePacker::unpack( formats[f], packed, frames - 37, 37, &out[0] );
+			for ( int i = 0; i < 37; i++ ) CPPUNIT_ASSERT_EQUAL( whole[ frames - 37 + i ], out[i] );
+			delete[] packed;
+		}
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( SamplePackerTest );
@@ -0,0 +1,130 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <hydrogen/basics/sample.h>
+#include <hydrogen/basics/sample_pool.h>
+#include <QDir>
+
+#define MONO_SAMPLE_PATH    "./src/tests/data/drumkit/kick.wav"
+
+using namespace H2Core;
+
+class SamplePoolTest : public CppUnit::TestCase {
+	CPPUNIT_TEST_SUITE( SamplePoolTest );
+	CPPUNIT_TEST( testSharing );
+	CPPUNIT_TEST( testProcessing );
+	CPPUNIT_TEST( testMono );
+	CPPUNIT_TEST_SUITE_END();
+
+	QString m_sPath;
+
+	public:
+	void setUp()
+	{
+		const int frames = 2000;
+		float* data_l = new float[ frames ];
+		float* data_r = new float[ frames ];
+		for ( int i = 0; i < frames; i++ ) {
+			data_l[i] = ( i % 100 ) / 100.0f;
+			data_r[i] = -data_l[i];
+		}
+		m_sPath = QDir::tempPath() + "/h2_pooled.wav";
+		Sample written( m_sPath, frames, 44100, data_l, data_r );
+		CPPUNIT_ASSERT( written.write( m_sPath, SF_FORMAT_WAV | SF_FORMAT_FLOAT ) );
+		SamplePool::purge();
+	}
+
+	void tearDown()
+	{
+		SamplePool::purge();
+		QFile::remove( m_sPath );
+	}
+
+	void testSharing()
+	{
+		int pooled = SamplePool::size();
+		Sample* first = Sample::load( m_sPath );
+		Sample* second = Sample::load( m_sPath );
+		Sample* copy = new Sample( first );
+		CPPUNIT_ASSERT_EQUAL( pooled + 1, SamplePool::size() );
+		CPPUNIT_ASSERT( first->get_data_l() == second->get_data_l() );
+		CPPUNIT_ASSERT( first->get_data_r() == copy->get_data_r() );
+
+		// modifying one sample leaves the shared data untouched
+		Sample::VelocityEnvelope velocity;
+		velocity.push_back( Sample::EnvelopePoint( 0, 91 ) );
+		velocity.push_back( Sample::EnvelopePoint( 841, 91 ) );
+		float value = first->get_data_l()[1];
+		copy->apply_velocity( velocity );
+		CPPUNIT_ASSERT( copy->get_data_l() != first->get_data_l() );
+		CPPUNIT_ASSERT_EQUAL( 0.0f, copy->get_data_l()[1] );
+		CPPUNIT_ASSERT_EQUAL( value, second->get_data_l()[1] );
+
+		// buffers outlive their last sample until purged
+		delete first;
+		delete second;
+		delete copy;
+		CPPUNIT_ASSERT_EQUAL( pooled + 1, SamplePool::size() );
+		SamplePool::purge();
+		CPPUNIT_ASSERT_EQUAL( pooled, SamplePool::size() );
+	}
+
+	void testProcessing()
+	{
+		Sample::Loops loops;
+		loops.end_frame = 1000;
+		loops.loop_frame = 500;
+		loops.count = 2;
+		Sample::Rubberband rubber;
+		Sample::VelocityEnvelope velocity;
+		Sample::PanEnvelope pan;
+
+		Sample* plain = Sample::load( m_sPath );
+		Sample* looped = Sample::load( m_sPath, loops, rubber, velocity, pan );
+		Sample* again = Sample::load( m_sPath, loops, rubber, velocity, pan );
+		CPPUNIT_ASSERT_EQUAL( 2000, plain->get_frames() );
+		CPPUNIT_ASSERT_EQUAL( 2000, looped->get_frames() );
+		CPPUNIT_ASSERT( looped->get_data_l() != plain->get_data_l() );
+		CPPUNIT_ASSERT( looped->get_data_l() == again->get_data_l() );
+		CPPUNIT_ASSERT( again->get_is_modified() );
+		CPPUNIT_ASSERT( again->get_loops() == loops );
+		CPPUNIT_ASSERT_EQUAL( plain->get_data_l()[600], again->get_data_l()[1100] );
+
+		delete plain;
+		delete looped;
+		delete again;
+	}
+
+	void testMono()
+	{
+		Sample* mono = Sample::load( MONO_SAMPLE_PATH );
+		CPPUNIT_ASSERT( mono );
+		CPPUNIT_ASSERT( mono->is_mono() );
+		CPPUNIT_ASSERT( mono->get_data_l() == mono->get_data_r() );
+		Sample* stereo = Sample::load( m_sPath );
+		CPPUNIT_ASSERT( !stereo->is_mono() );
+
+		// panning splits the channels of a copy, the pooled data stays mono
+		Sample* panned = new Sample( mono );
+		Sample::PanEnvelope pan;
+		pan.push_back( Sample::EnvelopePoint( 0, 90 ) );
+		pan.push_back( Sample::EnvelopePoint( 841, 90 ) );
+		panned->apply_pan( pan );
+		CPPUNIT_ASSERT( !panned->is_mono() );
+		CPPUNIT_ASSERT( mono->is_mono() );
+		CPPUNIT_ASSERT_EQUAL( 0.0f, panned->get_data_l()[100] );
+		CPPUNIT_ASSERT_EQUAL( mono->get_data_l()[100], panned->get_data_r()[100] );
+
+		// compact data stays mono and reads into both channels
+		CPPUNIT_ASSERT( mono->compact( SamplePacker::INT16 ) );
+		CPPUNIT_ASSERT( mono->is_mono() );
+		float l[4], r[4];
+		CPPUNIT_ASSERT_EQUAL( 4, mono->read( 100, 4, l, r ) );
+		for ( int i = 0; i < 4; i++ ) CPPUNIT_ASSERT_EQUAL( l[i], r[i] );
+		CPPUNIT_ASSERT_EQUAL( panned->get_data_r()[100], l[0] );
+
+		delete mono;
+		delete stereo;
+		delete panned;
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( SamplePoolTest );
@@ -0,0 +1,72 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <hydrogen/basics/sample.h>
+#include <hydrogen/sampler/sample_streamer.h>
+#include <QDir>
+#include <algorithm>
+#include <unistd.h>
+
+using namespace H2Core;
+
+class SampleStreamerTest : public CppUnit::TestCase {
+	CPPUNIT_TEST_SUITE( SampleStreamerTest );
+	CPPUNIT_TEST( testStream );
+	CPPUNIT_TEST_SUITE_END();
+
+	void testStream()
+	{
+		const int frames = 100000;
+		const int preload = 10000;
+		float* data_l = new float[ frames ];
+		float* data_r = new float[ frames ];
+		for ( int i = 0; i < frames; i++ ) {
+			data_l[i] = ( i % 1000 ) / 1000.0f;
+			data_r[i] = -data_l[i];
+		}
+		QString path = QDir::tempPath() + "/h2_streamed.wav";
+		Sample written( path, frames, 44100, data_l, data_r );
+		CPPUNIT_ASSERT( written.write( path, SF_FORMAT_WAV | SF_FORMAT_FLOAT ) );
+
+		Sample* sample = Sample::load( path );
+		CPPUNIT_ASSERT( sample != 0 );
+		CPPUNIT_ASSERT( sample->stream( preload ) );
+		CPPUNIT_ASSERT( sample->is_streamed() );
+		CPPUNIT_ASSERT_EQUAL( frames, sample->get_frames() );
+		CPPUNIT_ASSERT_EQUAL( preload, sample->get_resident_frames() );
+
+		SampleStreamer streamer;
+		SampleStream* stream = streamer.acquire( sample, preload );
+		CPPUNIT_ASSERT( stream != 0 );
+
+		// drain the stream as a voice would, waiting for the reader thread when it lags behind
+		float buffer_l[ 512 ];
+		float buffer_r[ 512 ];
+		int frame = preload;
+		int waits = 0;
+		while ( frame < frames && waits < 2000 ) {
+			int n = std::min( 512, frames - frame );
+			if ( stream->read( frame, n, buffer_l, buffer_r ) > 0 ) {
+				usleep( 1000 );
+				waits++;
+				continue;
+			}
+			for ( int i = 0; i < n; i++ ) {
+				CPPUNIT_ASSERT_EQUAL( data_l[ frame + i ], buffer_l[i] );
+				CPPUNIT_ASSERT_EQUAL( data_r[ frame + i ], buffer_r[i] );
+			}
+			frame += n;
+			stream->consume( frame );
+		}
+		CPPUNIT_ASSERT_EQUAL( frames, frame );
+		stream->release();
+
+		// transformations bring the whole sample back in memory
+		sample->apply_velocity( Sample::VelocityEnvelope( 2, Sample::EnvelopePoint( 0, 0 ) ) );
+		CPPUNIT_ASSERT( !sample->is_streamed() );
+		CPPUNIT_ASSERT_EQUAL( frames, sample->get_resident_frames() );
+
+		delete sample;
+		QFile::remove( path );
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( SampleStreamerTest );
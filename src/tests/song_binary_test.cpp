@@ -0,0 +1,158 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <hydrogen/hydrogen.h>
+#include <hydrogen/timeline.h>
+#include <hydrogen/Preferences.h>
+#include <hydrogen/basics/song.h>
+#include <hydrogen/basics/note.h>
+#include <hydrogen/basics/pattern.h>
+#include <hydrogen/basics/pattern_list.h>
+#include <hydrogen/basics/sample.h>
+#include <hydrogen/basics/instrument.h>
+#include <hydrogen/basics/instrument_list.h>
+#include <hydrogen/basics/instrument_component.h>
+#include <hydrogen/basics/instrument_layer.h>
+#include <hydrogen/helpers/filesystem.h>
+#include <hydrogen/helpers/stress_song.h>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <QTime>
+
+#define SAMPLE_PATH     "./src/tests/data/drumkit/kick.wav"
+
+using namespace H2Core;
+
+class SongBinaryTest : public CppUnit::TestCase {
+	CPPUNIT_TEST_SUITE( SongBinaryTest );
+	CPPUNIT_TEST( testRoundTrip );
+	CPPUNIT_TEST( testTruncated );
+	CPPUNIT_TEST_SUITE_END();
+
+	QString m_sXml;
+	QString m_sBinary;
+
+	public:
+	void setUp()
+	{
+		Preferences::create_instance();
+		Preferences::get_instance()->m_sAudioDriver = "Fake";
+		Hydrogen::create_instance();
+		m_sXml = Filesystem::tmp_dir() + "/binary.h2song";
+		m_sBinary = Filesystem::tmp_dir() + "/binary" + SONG_BINARY_EXT;
+	}
+
+	void tearDown()
+	{
+		Hydrogen::get_instance()->getTimeline()->m_timelinevector.clear();
+		QFile::remove( m_sXml );
+		QFile::remove( m_sBinary );
+		QFile::remove( m_sXml + ".again" );
+	}
+
+	QByteArray readAll( const QString& sPath )
+	{
+		QFile file( sPath );
+		CPPUNIT_ASSERT( file.open( QIODevice::ReadOnly ) );
+		return file.readAll();
+	}
+
+	void testRoundTrip()
+	{
+		StressSong::Options options;
+		options.m_nInstruments = 16;
+		options.m_nComponents = 2;
+		options.m_nSampleFrames = 256;
+		options.m_nPatterns = 16;
+		options.m_nVirtualPatterns = 4;
+		options.m_nColumns = 32;
+		options.m_fNoteDensity = 0.75;
+		options.m_fLeadLag = 0.5;
+		options.m_nTempoChanges = 3;
+
+		Song* pSong = StressSong::generate( options );
+		StressSong::fill_timeline( Hydrogen::get_instance()->getTimeline(), options );
+
+		// one layer refers to an existing file, with an envelope
+		Sample::Loops loops;
+		Sample::Rubberband rubber;
+		Sample::VelocityEnvelope velocity;
+		velocity.push_back( Sample::EnvelopePoint( 0, 91 ) );
+		velocity.push_back( Sample::EnvelopePoint( 841, 40 ) );
+		Sample::PanEnvelope pan;
+		InstrumentLayer* pLayer = pSong->get_instrument_list()->get( 0 )->get_components()->front()->get_layer( 0 );
+		delete pLayer->get_sample();
+		pLayer->set_sample( Sample::load( QFileInfo( SAMPLE_PATH ).absoluteFilePath(), loops, rubber, velocity, pan ) );
+		CPPUNIT_ASSERT( pLayer->get_sample() );
+
+		CPPUNIT_ASSERT( pSong->save( m_sXml ) );
+		delete pSong;
+
+		// XML to binary
+		Song* pXml = Song::load( m_sXml );
+		CPPUNIT_ASSERT( pXml );
+		CPPUNIT_ASSERT( !Song::is_binary( m_sXml ) );
+		CPPUNIT_ASSERT( pXml->save( m_sBinary ) );
+		CPPUNIT_ASSERT( Song::is_binary( m_sBinary ) );
+		CPPUNIT_ASSERT( pXml->save( m_sXml ) );
+		___INFOLOG( QString( "song takes %1 bytes as XML, %2 bytes as binary" )
+					.arg( QFileInfo( m_sXml ).size() ).arg( QFileInfo( m_sBinary ).size() ) );
+
+		QTime timer;
+		timer.start();
+		Song* pBinary = Song::load( m_sBinary );
+		___INFOLOG( QString( "binary song read in %1 ms" ).arg( timer.elapsed() ) );
+		CPPUNIT_ASSERT( pBinary );
+		CPPUNIT_ASSERT( pBinary->get_filename() == QFileInfo( m_sBinary ).absoluteFilePath() );
+		CPPUNIT_ASSERT_EQUAL( 16, pBinary->get_instrument_list()->size() );
+		CPPUNIT_ASSERT_EQUAL( 20, pBinary->get_pattern_list()->size() );
+		CPPUNIT_ASSERT_EQUAL( 32, ( int )pBinary->get_pattern_group_vector()->size() );
+		CPPUNIT_ASSERT_EQUAL( 4, ( int )Hydrogen::get_instance()->getTimeline()->m_timelinevector.size() );
+
+		Sample* pSample = pBinary->get_instrument_list()->get( 0 )->get_components()->front()->get_layer( 0 )->get_sample();
+		CPPUNIT_ASSERT( pSample );
+		CPPUNIT_ASSERT( pSample->get_is_modified() );
+		CPPUNIT_ASSERT_EQUAL( 2, ( int )pSample->get_velocity_envelope()->size() );
+		CPPUNIT_ASSERT_EQUAL( 40, pSample->get_velocity_envelope()->at( 1 ).value );
+
+		int nNotes = 0;
+		for ( int i = 0; i < pXml->get_pattern_list()->size(); i++ ) {
+			nNotes += pXml->get_pattern_list()->get( i )->get_notes()->size();
+			CPPUNIT_ASSERT_EQUAL( pXml->get_pattern_list()->get( i )->get_notes()->size(),
+								  pBinary->get_pattern_list()->get( i )->get_notes()->size() );
+		}
+		CPPUNIT_ASSERT( nNotes > 0 );
+
+		// binary back to XML is lossless, the lines are sorted as virtual patterns are written in pointer order
+		CPPUNIT_ASSERT( pBinary->save( m_sXml + ".again" ) );
+		QStringList xml = QString::fromUtf8( readAll( m_sXml ) ).split( "\n" );
+		QStringList again = QString::fromUtf8( readAll( m_sXml + ".again" ) ).split( "\n" );
+		CPPUNIT_ASSERT_EQUAL( xml.size(), again.size() );
+		xml.sort();
+		again.sort();
+		CPPUNIT_ASSERT( xml == again );
+
+		delete pXml;
+		delete pBinary;
+	}
+
+	void testTruncated()
+	{
+		StressSong::Options options;
+		options.m_nInstruments = 4;
+		options.m_nPatterns = 4;
+		options.m_nColumns = 4;
+		Song* pSong = StressSong::generate( options );
+		CPPUNIT_ASSERT( pSong->save( m_sBinary ) );
+		delete pSong;
+
+		QByteArray data = readAll( m_sBinary );
+		QFile file( m_sBinary );
+		CPPUNIT_ASSERT( file.open( QIODevice::WriteOnly | QIODevice::Truncate ) );
+		file.write( data.left( data.size() / 2 ) );
+		file.close();
+		CPPUNIT_ASSERT( Song::is_binary( m_sBinary ) );
+		CPPUNIT_ASSERT( Song::load( m_sBinary ) == NULL );
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( SongBinaryTest );
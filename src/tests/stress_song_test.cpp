@@ -0,0 +1,112 @@
+#include "stress_song_test.h"
+
+#include <hydrogen/hydrogen.h>
+#include <hydrogen/timeline.h>
+#include <hydrogen/Preferences.h>
+#include <hydrogen/basics/song.h>
+#include <hydrogen/basics/pattern.h>
+#include <hydrogen/basics/pattern_list.h>
+#include <hydrogen/basics/instrument.h>
+#include <hydrogen/basics/instrument_list.h>
+#include <hydrogen/basics/instrument_component.h>
+#include <hydrogen/basics/instrument_layer.h>
+#include <hydrogen/helpers/stress_song.h>
+
+CPPUNIT_TEST_SUITE_REGISTRATION( StressSongTest );
+
+using namespace H2Core;
+
+static int count_notes( Song* pSong )
+{
+	int nNotes = 0;
+	PatternList* pPatterns = pSong->get_pattern_list();
+	for ( int i = 0; i < pPatterns->size(); i++ ) {
+		nNotes += pPatterns->get( i )->get_notes()->size();
+	}
+	return nNotes;
+}
+
+void StressSongTest::setUp()
+{
+	Preferences::create_instance();
+	Preferences::get_instance()->m_sAudioDriver = "Fake";
+	Hydrogen::create_instance();
+}
+
+void StressSongTest::testGenerate()
+{
+	StressSong::Options options;
+	options.m_nInstruments = 8;
+	options.m_nLayers = 3;
+	options.m_nComponents = 2;
+	options.m_nSampleFrames = 1024;
+	options.m_nPatterns = 3;
+	options.m_nVirtualPatterns = 2;
+	options.m_nColumns = 5;
+	options.m_fNoteDensity = 0.5;
+
+	Song* pSong = StressSong::generate( options );
+	CPPUNIT_ASSERT( pSong != NULL );
+	CPPUNIT_ASSERT_EQUAL( 8, pSong->get_instrument_list()->size() );
+	CPPUNIT_ASSERT_EQUAL( 2, ( int )pSong->get_components()->size() );
+	CPPUNIT_ASSERT_EQUAL( 5, pSong->get_pattern_list()->size() );
+	CPPUNIT_ASSERT_EQUAL( 5, ( int )pSong->get_pattern_group_vector()->size() );
+
+	Instrument* pInstr = pSong->get_instrument_list()->get( 0 );
+	CPPUNIT_ASSERT_EQUAL( 2, ( int )pInstr->get_components()->size() );
+	InstrumentComponent* pCompo = pInstr->get_components()->front();
+	CPPUNIT_ASSERT( pCompo->get_layer( 2 ) != NULL );
+	CPPUNIT_ASSERT( pCompo->get_layer( 3 ) == NULL );
+
+	Pattern* pVirtual = pSong->get_pattern_list()->get( 3 );
+	CPPUNIT_ASSERT( !pVirtual->virtual_patterns_empty() );
+
+	// same seed, same song
+	int nNotes = count_notes( pSong );
+	CPPUNIT_ASSERT( nNotes > 0 );
+	Song* pOther = StressSong::generate( options );
+	CPPUNIT_ASSERT_EQUAL( nNotes, count_notes( pOther ) );
+
+	delete pOther;
+	delete pSong;
+}
+
+void StressSongTest::testSoak()
+{
+	StressSong::Options options;
+	options.m_nInstruments = 16;
+	options.m_nLayers = 4;
+	options.m_nComponents = 2;
+	options.m_nSampleFrames = 4410;
+	options.m_fNoteDensity = 0.75;
+	options.m_fHumanizeTime = 0.5;
+	options.m_fHumanizeVelocity = 0.5;
+	options.m_fSwing = 0.3;
+	options.m_fLeadLag = 0.5;
+	options.m_nTempoChanges = 3;
+	options.m_bFilters = true;
+
+	Hydrogen* pHydrogen = Hydrogen::get_instance();
+	Preferences* pPref = Preferences::get_instance();
+	bool bUseTimeline = pPref->getUseTimelineBpm();
+	pPref->setUseTimelineBpm( true );
+
+	Song* pSong = StressSong::generate( options );
+	pHydrogen->setSong( pSong );
+	StressSong::fill_timeline( pHydrogen->getTimeline(), options );
+	CPPUNIT_ASSERT_EQUAL( 4, ( int )pHydrogen->getTimeline()->m_timelinevector.size() );
+
+	StressSong::Report report;
+	CPPUNIT_ASSERT( StressSong::soak( 4.0, &report ) );
+	CPPUNIT_ASSERT( report.m_nCycles > 0 );
+	CPPUNIT_ASSERT( report.m_nFrames >= 4 * 44100 );
+	CPPUNIT_ASSERT( report.m_nMaxPlayingNotes > 0 );
+	CPPUNIT_ASSERT( report.m_fBudget > 0 );
+	CPPUNIT_ASSERT( report.m_fMaxProcessTime >= report.m_fAvgProcessTime );
+
+	// the engine must not keep notes once the transport stopped
+	CPPUNIT_ASSERT_EQUAL( 0, pHydrogen->getSongNoteQueueSize() );
+
+	pHydrogen->getTimeline()->m_timelinevector.clear();
+	pPref->setUseTimelineBpm( bUseTimeline );
+}
@@ -0,0 +1,19 @@
+#ifndef STRESS_SONG_TEST_H
+#define STRESS_SONG_TEST_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class StressSongTest : public CppUnit::TestCase {
+	CPPUNIT_TEST_SUITE(StressSongTest);
+	CPPUNIT_TEST(testGenerate);
+	CPPUNIT_TEST(testSoak);
+	CPPUNIT_TEST_SUITE_END();
+
+	public:
+	virtual void setUp();
+	void testGenerate();
+	void testSoak();
+};
+
+
+#endif
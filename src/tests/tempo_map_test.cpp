@@ -0,0 +1,139 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <hydrogen/hydrogen.h>
+#include <hydrogen/timeline.h>
+#include <hydrogen/Preferences.h>
+#include <hydrogen/basics/song.h>
+#include <hydrogen/basics/tempo_map.h>
+#include <hydrogen/IO/OfflineRenderer.h>
+#include <hydrogen/helpers/stress_song.h>
+#include <cmath>
+#include <vector>
+
+using namespace H2Core;
+
+class TempoMapTest : public CppUnit::TestCase {
+	CPPUNIT_TEST_SUITE( TempoMapTest );
+	CPPUNIT_TEST( testConstant );
+	CPPUNIT_TEST( testDrift );
+	CPPUNIT_TEST( testTimeline );
+	CPPUNIT_TEST_SUITE_END();
+
+	public:
+	void setUp()
+	{
+		Preferences::create_instance();
+		Preferences::get_instance()->m_sAudioDriver = "Fake";
+		Hydrogen::create_instance();
+	}
+
+	void tearDown()
+	{
+		Hydrogen::get_instance()->getTimeline()->m_timelinevector.clear();
+	}
+
+	void testConstant()
+	{
+		// 120 bpm at 48 ticks per beat is 459.375 frames per tick
+		TempoMap map( 120, 48, 44100 );
+		CPPUNIT_ASSERT_EQUAL( 1, map.size() );
+		CPPUNIT_ASSERT_EQUAL( 88200.0, map.tick_to_frame( 192 ) );
+		CPPUNIT_ASSERT_EQUAL( 192.0, map.frame_to_tick( 88200 ) );
+		CPPUNIT_ASSERT_EQUAL( 459.375, map.get_tick_size( 1000 ) );
+		CPPUNIT_ASSERT_EQUAL( -1.0, map.next_tempo_change( 0 ) );
+
+		// a tempo set on a tick already changing it replaces it
+		map.add_tempo( 96, 60 );
+		map.add_tempo( 96, 240 );
+		CPPUNIT_ASSERT_EQUAL( 2, map.size() );
+		CPPUNIT_ASSERT_EQUAL( 96.0, map.next_tempo_change( 0 ) );
+		CPPUNIT_ASSERT_EQUAL( 120.0f, map.get_bpm( 95.5 ) );
+		CPPUNIT_ASSERT_EQUAL( 240.0f, map.get_bpm( 96 ) );
+		CPPUNIT_ASSERT_EQUAL( 44100.0 + 96 * 229.6875, map.tick_to_frame( 192 ) );
+	}
+
+	void testDrift()
+	{
+		// thousands of tempo changes, some of them between two ticks
+		const int nChanges = 20000;
+		TempoMap map( 120, 48, 48000 );
+		std::vector<double> ticks, frames;
+		long double fFrame = 0;
+		double fTick = 0;
+		float fBpm = 120;
+		unsigned nSeed = 1;
+		for ( int i = 0; i < nChanges; i++ ) {
+			double fNext = fTick + 1 + ( i % 37 ) + ( i % 5 == 0 ? 0.25 : 0 );
+			fFrame += ( long double )( fNext - fTick ) * 48000 * 60.0 / fBpm / 48;
+			nSeed = nSeed * 1103515245 + 12345;
+			fBpm = 60 + ( nSeed >> 16 ) % 180 + 0.5;
+			map.add_tempo( fNext, fBpm );
+			fTick = fNext;
+			ticks.push_back( fTick );
+			frames.push_back( ( double )fFrame );
+		}
+		CPPUNIT_ASSERT_EQUAL( nChanges + 1, map.size() );
+
+		// every change falls on the frame summed in extended precision, and back on its tick
+		for ( int i = 0; i < nChanges; i++ ) {
+			CPPUNIT_ASSERT( fabs( map.tick_to_frame( ticks[i] ) - frames[i] ) < 1e-3 );
+			CPPUNIT_ASSERT( fabs( map.frame_to_tick( frames[i] ) - ticks[i] ) < 1e-6 );
+			double fMiddle = ticks[i] + 0.5;
+			CPPUNIT_ASSERT( fabs( map.frame_to_tick( map.tick_to_frame( fMiddle ) ) - fMiddle ) < 1e-9 );
+		}
+
+		// the order the tempos come in does not matter
+		TempoMap reversed( 120, 48, 48000 );
+		for ( int i = 2000; i >= 0; i-- ) {
+			reversed.add_tempo( ticks[i], map.get_bpm( ticks[i] ) );
+		}
+		for ( int i = 0; i <= 2000; i++ ) {
+			CPPUNIT_ASSERT( fabs( reversed.tick_to_frame( ticks[i] ) - map.tick_to_frame( ticks[i] ) ) < 1e-6 );
+		}
+	}
+
+	void testTimeline()
+	{
+		StressSong::Options options;
+		options.m_nInstruments = 4;
+		options.m_nSampleFrames = 1024;
+		options.m_nColumns = 4;
+		options.m_bMixedSelection = false;
+		Song* pSong = StressSong::generate( options );
+		CPPUNIT_ASSERT_EQUAL( 120.0f, pSong->__bpm );
+
+		// the second marker changes the tempo in the middle of the second pattern group
+		Timeline* pTimeline = Hydrogen::get_instance()->getTimeline();
+		Timeline::HTimelineVector marker;
+		marker.m_htimelinebeat = 1;
+		marker.m_htimelinetick = 96;
+		marker.m_htimelinebpm = 150;
+		pTimeline->m_timelinevector.push_back( marker );
+		marker.m_htimelinebeat = 0;
+		marker.m_htimelinetick = 0;
+		marker.m_htimelinebpm = 100;
+		pTimeline->m_timelinevector.push_back( marker );
+		pTimeline->sortTimelineVector();
+
+		TempoMap map;
+		map.load( pSong, pTimeline, 44100, false );
+		CPPUNIT_ASSERT_EQUAL( 1, map.size() );
+		map.load( pSong, pTimeline, 44100, true );
+		CPPUNIT_ASSERT_EQUAL( 2, map.size() );
+		CPPUNIT_ASSERT_EQUAL( 100.0f, map.get_bpm( 287 ) );
+		CPPUNIT_ASSERT_EQUAL( 150.0f, map.get_bpm( 288 ) );
+		CPPUNIT_ASSERT_EQUAL( 288 * 551.25, map.tick_to_frame( 288 ) );
+
+		// the export plays the song along the same map
+		OfflineRenderer::Options renderOptions;
+		renderOptions.m_bUseTimelineBpm = true;
+		OfflineRenderer renderer( pSong, renderOptions );
+		CPPUNIT_ASSERT_EQUAL( ( unsigned long )llround( map.tick_to_frame( 4 * 192 ) ), renderer.get_length() );
+		std::vector<float> left, right;
+		CPPUNIT_ASSERT( renderer.render( &left, &right ) );
+		CPPUNIT_ASSERT_EQUAL( ( size_t )renderer.get_length(), left.size() );
+
+		delete pSong;
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( TempoMapTest );
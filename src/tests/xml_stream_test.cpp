@@ -0,0 +1,185 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <hydrogen/hydrogen.h>
+#include <hydrogen/timeline.h>
+#include <hydrogen/Preferences.h>
+#include <hydrogen/basics/drumkit.h>
+#include <hydrogen/basics/song.h>
+#include <hydrogen/basics/note.h>
+#include <hydrogen/basics/pattern.h>
+#include <hydrogen/basics/pattern_list.h>
+#include <hydrogen/basics/instrument.h>
+#include <hydrogen/basics/instrument_list.h>
+#include <hydrogen/basics/instrument_component.h>
+#include <hydrogen/helpers/filesystem.h>
+#include <hydrogen/helpers/stress_song.h>
+#include <QFile>
+#include <QTime>
+
+#define BASE_DIR    "./src/tests/data"
+
+using namespace H2Core;
+
+class XmlStreamTest : public CppUnit::TestCase {
+	CPPUNIT_TEST_SUITE( XmlStreamTest );
+	CPPUNIT_TEST( testSong );
+	CPPUNIT_TEST( testPattern );
+	CPPUNIT_TEST_SUITE_END();
+
+	public:
+	void setUp()
+	{
+		Preferences::create_instance();
+		Preferences::get_instance()->m_sAudioDriver = "Fake";
+		Hydrogen::create_instance();
+	}
+
+	void compareNotes( Pattern* pSaved, Pattern* pRead )
+	{
+		CPPUNIT_ASSERT( pSaved->get_name() == pRead->get_name() );
+		CPPUNIT_ASSERT_EQUAL( pSaved->get_length(), pRead->get_length() );
+		CPPUNIT_ASSERT_EQUAL( pSaved->get_notes()->size(), pRead->get_notes()->size() );
+		Pattern::notes_cst_it_t it = pRead->get_notes()->begin();
+		FOREACH_NOTE_CST_IT_BEGIN_END( pSaved->get_notes(), saved_it ) {
+			Note* pNote = saved_it->second;
+			Note* pOther = it->second;
+			CPPUNIT_ASSERT_EQUAL( pNote->get_position(), pOther->get_position() );
+			CPPUNIT_ASSERT_EQUAL( pNote->get_instrument()->get_id(), pOther->get_instrument()->get_id() );
+			CPPUNIT_ASSERT_DOUBLES_EQUAL( pNote->get_velocity(), pOther->get_velocity(), 1e-4 );
+			CPPUNIT_ASSERT_DOUBLES_EQUAL( pNote->get_pan_l(), pOther->get_pan_l(), 1e-4 );
+			CPPUNIT_ASSERT_DOUBLES_EQUAL( pNote->get_pan_r(), pOther->get_pan_r(), 1e-4 );
+			CPPUNIT_ASSERT_EQUAL( pNote->get_length(), pOther->get_length() );
+			CPPUNIT_ASSERT_DOUBLES_EQUAL( pNote->get_pitch(), pOther->get_pitch(), 1e-4 );
+			CPPUNIT_ASSERT_DOUBLES_EQUAL( pNote->get_lead_lag(), pOther->get_lead_lag(), 1e-4 );
+			CPPUNIT_ASSERT_DOUBLES_EQUAL( pNote->get_probability(), pOther->get_probability(), 1e-4 );
+			CPPUNIT_ASSERT_EQUAL( pNote->get_note_off(), pOther->get_note_off() );
+			CPPUNIT_ASSERT( pNote->key_to_string() == pOther->key_to_string() );
+			++it;
+		}
+	}
+
+	void comparePatterns( Song* pSaved, Song* pRead )
+	{
+		PatternList* pPatterns = pSaved->get_pattern_list();
+		CPPUNIT_ASSERT_EQUAL( 20, pRead->get_pattern_list()->size() );
+		for ( int i = 0; i < pPatterns->size(); i++ ) {
+			compareNotes( pPatterns->get( i ), pRead->get_pattern_list()->get( i ) );
+			CPPUNIT_ASSERT_EQUAL( pPatterns->get( i )->get_virtual_patterns()->size(),
+								  pRead->get_pattern_list()->get( i )->get_virtual_patterns()->size() );
+		}
+	}
+
+	void testSong()
+	{
+		StressSong::Options options;
+		options.m_nInstruments = 16;
+		options.m_nComponents = 2;
+		options.m_nSampleFrames = 256;
+		options.m_nPatterns = 16;
+		options.m_nVirtualPatterns = 4;
+		options.m_nColumns = 32;
+		options.m_fNoteDensity = 0.75;
+		options.m_fLeadLag = 0.5;
+		options.m_nTempoChanges = 3;
+		QString sPath = Filesystem::tmp_dir() + "/stream.h2song";
+
+		Timeline* pTimeline = Hydrogen::get_instance()->getTimeline();
+		Song* pSong = StressSong::generate( options );
+		StressSong::fill_timeline( pTimeline, options );
+		CPPUNIT_ASSERT( pSong->save( sPath ) );
+		Timeline::HTimelineVector bpm = pTimeline->m_timelinevector[1];
+
+		// the song read back matches the one saved
+		SongReader reader;
+		QTime timer;
+		timer.start();
+		Song* pRead = reader.readSong( sPath );
+		___INFOLOG( QString( "song read in %1 ms" ).arg( timer.elapsed() ) );
+		CPPUNIT_ASSERT( pRead );
+
+		CPPUNIT_ASSERT( pSong->__name == pRead->__name );
+		CPPUNIT_ASSERT_DOUBLES_EQUAL( pSong->__bpm, pRead->__bpm, 1e-4 );
+		CPPUNIT_ASSERT_DOUBLES_EQUAL( pSong->get_swing_factor(), pRead->get_swing_factor(), 1e-4 );
+		CPPUNIT_ASSERT_EQUAL( pSong->get_components()->size(), pRead->get_components()->size() );
+		CPPUNIT_ASSERT_EQUAL( 4, ( int )pTimeline->m_timelinevector.size() );
+		CPPUNIT_ASSERT_DOUBLES_EQUAL( bpm.m_htimelinebpm, pTimeline->m_timelinevector[1].m_htimelinebpm, 1e-4 );
+
+		InstrumentList* pInstruments = pSong->get_instrument_list();
+		CPPUNIT_ASSERT_EQUAL( 16, pRead->get_instrument_list()->size() );
+		for ( int i = 0; i < pInstruments->size(); i++ ) {
+			Instrument* pInstr = pInstruments->get( i );
+			Instrument* pOther = pRead->get_instrument_list()->get( i );
+			CPPUNIT_ASSERT_EQUAL( pInstr->get_id(), pOther->get_id() );
+			CPPUNIT_ASSERT( pInstr->get_name() == pOther->get_name() );
+			CPPUNIT_ASSERT_EQUAL( pInstr->is_filter_active(), pOther->is_filter_active() );
+			CPPUNIT_ASSERT_EQUAL( pInstr->get_components()->size(), pOther->get_components()->size() );
+			InstrumentComponent* pCompo = pInstr->get_components()->back();
+			InstrumentComponent* pOtherCompo = pOther->get_components()->back();
+			CPPUNIT_ASSERT_EQUAL( pCompo->get_drumkit_componentID(), pOtherCompo->get_drumkit_componentID() );
+			for ( int nLayer = 0; nLayer < MAX_LAYERS; nLayer++ ) {
+				CPPUNIT_ASSERT_EQUAL( pCompo->get_layer( nLayer ) == 0, pOtherCompo->get_layer( nLayer ) == 0 );
+			}
+		}
+
+		comparePatterns( pSong, pRead );
+		CPPUNIT_ASSERT_EQUAL( 32, ( int )pRead->get_pattern_group_vector()->size() );
+		for ( int i = 0; i < pSong->get_pattern_group_vector()->size(); i++ ) {
+			PatternList* pColumn = ( *pSong->get_pattern_group_vector() )[i];
+			PatternList* pOtherColumn = ( *pRead->get_pattern_group_vector() )[i];
+			CPPUNIT_ASSERT_EQUAL( pColumn->size(), pOtherColumn->size() );
+			for ( int j = 0; j < pColumn->size(); j++ ) {
+				CPPUNIT_ASSERT( pColumn->get( j )->get_name() == pOtherColumn->get( j )->get_name() );
+			}
+		}
+		delete pRead;
+
+		// a patternList before the instrumentList is read in a second pass
+		QFile file( sPath );
+		CPPUNIT_ASSERT( file.open( QIODevice::ReadOnly ) );
+		QString sXml = QString::fromUtf8( file.readAll() );
+		file.close();
+		int nStart = sXml.indexOf( "<patternList>" );
+		int nEnd = sXml.indexOf( "</patternList>" ) + QString( "</patternList>" ).length();
+		CPPUNIT_ASSERT( nStart > 0 && nEnd > nStart );
+		QString sPatternList = sXml.mid( nStart, nEnd - nStart );
+		sXml.remove( nStart, nEnd - nStart );
+		sXml.insert( sXml.indexOf( "<instrumentList>" ), sPatternList );
+		CPPUNIT_ASSERT( file.open( QIODevice::WriteOnly | QIODevice::Truncate ) );
+		file.write( sXml.toUtf8() );
+		file.close();
+
+		pRead = reader.readSong( sPath );
+		CPPUNIT_ASSERT( pRead );
+		comparePatterns( pSong, pRead );
+
+		pTimeline->m_timelinevector.clear();
+		delete pRead;
+		delete pSong;
+		QFile::remove( sPath );
+	}
+
+	void testPattern()
+	{
+		Drumkit* pDrumkit = Drumkit::load( BASE_DIR"/drumkit" );
+		CPPUNIT_ASSERT( pDrumkit );
+		CPPUNIT_ASSERT( pDrumkit->get_name() == "H2 test DK" );
+		CPPUNIT_ASSERT_EQUAL( 4, pDrumkit->get_instruments()->size() );
+		CPPUNIT_ASSERT( pDrumkit->get_instruments()->get( 0 )->get_drumkit_name() == "H2 test DK" );
+
+		Pattern* pPattern = Pattern::load_file( BASE_DIR"/pattern/pat.h2pattern", pDrumkit->get_instruments() );
+		CPPUNIT_ASSERT( pPattern );
+		CPPUNIT_ASSERT( pPattern->get_name() == "1" );
+		CPPUNIT_ASSERT( pPattern->get_info() == "" );
+		CPPUNIT_ASSERT_EQUAL( 192, pPattern->get_length() );
+
+		QFile file( BASE_DIR"/pattern/pat.h2pattern" );
+		CPPUNIT_ASSERT( file.open( QIODevice::ReadOnly ) );
+		int nNotes = QString( file.readAll() ).count( "<note>" );
+		CPPUNIT_ASSERT( nNotes > 0 );
+		CPPUNIT_ASSERT_EQUAL( nNotes, ( int )pPattern->get_notes()->size() );
+
+		delete pPattern;
+		delete pDrumkit;
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( XmlStreamTest );